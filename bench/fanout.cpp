@@ -0,0 +1,185 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Measure the CPU cost per receiver of a broker that sends one message to many subscribers.
+// The server side endpoint publishes the same message `receivers` times, and the time of
+// the async_publish() calls is measured. The calls only build the message, store it for
+// QoS1 and QoS2, and queue it, so the cost is the same as sending to the different
+// connections. The queued messages are written to the client after the measurement.
+//
+// buffer: async_publish(topic buffer, contents buffer, life_keeper, qos, retain) for each receiver
+// fanout: async_publish(fanout, qos) with one publish_fanout that is made for all receivers
+//
+// The rounds of both ways are repeated alternately, and the medians are printed.
+//
+// Usage:
+//   bench_fanout [receivers] [payload size]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+
+#include <mqtt_server_cpp.hpp>
+#include <mqtt/client.hpp>
+
+namespace as = boost::asio;
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr std::uint16_t const port = 1883;
+
+int main(int argc, char** argv) {
+    std::size_t receivers = argc > 1 ? std::stoul(argv[1]) : 10000;
+    std::size_t payload = argc > 2 ? std::stoul(argv[2]) : 64;
+
+    as::io_service ios;
+    mqtt::server<> s(as::ip::tcp::endpoint(as::ip::tcp::v4(), port), ios);
+    std::shared_ptr<mqtt::server<>::endpoint_t> sep;
+    auto c = mqtt::make_client(ios, "localhost", port);
+
+    auto topic = std::make_shared<std::string>("site/1/device/1/temperature");
+    auto contents = std::make_shared<std::string>(payload, 'x');
+
+    std::size_t const repeat = 7;
+    // (qos, fanout)
+    std::vector<std::pair<std::uint8_t, bool>> rounds;
+    for (std::uint8_t qos = 0; qos != 3; ++qos) {
+        for (std::size_t i = 0; i != repeat; ++i) {
+            rounds.emplace_back(qos, i % 2 == 0);
+            rounds.emplace_back(qos, i % 2 != 0);
+        }
+    }
+    // [qos][fanout]
+    std::vector<double> results[3][2];
+    std::size_t round = 0;
+    std::size_t received = 0;
+    std::size_t acked = 0;
+
+    auto run_round =
+        [&] {
+            auto qos = rounds[round].first;
+            auto start = clock_type::now();
+            if (rounds[round].second) {
+                auto fanout = std::make_shared<mqtt::publish_fanout const>(
+                    as::buffer(*topic),
+                    as::buffer(*contents),
+                    [topic, contents] {});
+                for (std::size_t i = 0; i != receivers; ++i) {
+                    sep->async_publish(fanout, qos);
+                }
+            }
+            else {
+                for (std::size_t i = 0; i != receivers; ++i) {
+                    sep->async_publish(
+                        as::buffer(*topic),
+                        as::buffer(*contents),
+                        [topic, contents] {},
+                        qos,
+                        false);
+                }
+            }
+            auto end = clock_type::now();
+            results[qos][rounds[round].second].push_back(
+                std::chrono::duration<double, std::nano>(end - start).count() / double(receivers));
+        };
+
+    // Start the next round after all packet identifiers are released.
+    auto next_round =
+        [&] {
+            if (received != receivers) return;
+            if (rounds[round].first != mqtt::qos::at_most_once && acked != receivers) return;
+            received = 0;
+            acked = 0;
+            if (++round == rounds.size()) {
+                c->async_disconnect();
+            }
+            else {
+                run_round();
+            }
+        };
+
+    s.set_error_handler([](boost::system::error_code const&) {});
+    s.set_accept_handler(
+        [&](mqtt::server<>::endpoint_t& ep) {
+            sep = ep.shared_from_this();
+            ep.set_auto_pub_response(true, true);
+            ep.start_session([](boost::system::error_code const&) {});
+            ep.set_connect_handler(
+                [&]
+                (std::string const&,
+                 mqtt::optional<std::string> const&,
+                 mqtt::optional<std::string> const&,
+                 mqtt::optional<mqtt::will>,
+                 bool,
+                 std::uint16_t) {
+                    sep->async_connack(false, mqtt::connect_return_code::accepted);
+                    return true;
+                });
+            ep.set_puback_handler(
+                [&](std::uint16_t) {
+                    ++acked;
+                    next_round();
+                    return true;
+                });
+            ep.set_pubcomp_handler(
+                [&](std::uint16_t) {
+                    ++acked;
+                    next_round();
+                    return true;
+                });
+            ep.set_disconnect_handler(
+                [&] {
+                    sep.reset();
+                    s.close();
+                });
+        });
+    s.listen();
+
+    c->set_clean_session(true);
+    c->set_auto_pub_response(true, true);
+    c->set_connack_handler(
+        [&](bool, std::uint8_t) {
+            run_round();
+            return true;
+        });
+    c->set_publish_handler(
+        [&](std::uint8_t,
+            mqtt::optional<std::uint16_t>,
+            std::string,
+            std::string) {
+            ++received;
+            next_round();
+            return true;
+        });
+    c->connect();
+    ios.run();
+
+    std::cout
+        << "receivers: " << receivers << std::endl
+        << "payload: " << payload << std::endl
+        << std::setw(6) << "qos"
+        << std::setw(14) << "buffer ns"
+        << std::setw(14) << "fanout ns"
+        << std::endl
+        << std::fixed << std::setprecision(1);
+    auto median =
+        [](std::vector<double> v) {
+            std::sort(v.begin(), v.end());
+            return v.empty() ? 0.0 : v[v.size() / 2];
+        };
+    for (std::size_t qos = 0; qos != 3; ++qos) {
+        std::cout
+            << std::setw(6) << qos
+            << std::setw(14) << median(results[qos][0])
+            << std::setw(14) << median(results[qos][1])
+            << std::endl;
+    }
+}
@@ -0,0 +1,115 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Compare packet id acquire/release between mqtt::packet_id_pool and
+// the std::set based implementation that was used by mqtt::endpoint before.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <deque>
+#include <set>
+#include <limits>
+#include <string>
+#include <cstdint>
+
+#include <mqtt/packet_id_pool.hpp>
+
+template <typename PacketId>
+class set_pool {
+public:
+    PacketId acquire() {
+        if (ids_.size() == std::numeric_limits<PacketId>::max()) return 0;
+        if (master_ == std::numeric_limits<PacketId>::max()) {
+            master_ = 1U;
+        }
+        else {
+            ++master_;
+        }
+        auto ret = ids_.insert(master_);
+        if (ret.second) return master_;
+
+        auto last = ids_.end();
+        auto e = last;
+        --last;
+
+        if (*last != std::numeric_limits<PacketId>::max()) {
+            master_ = static_cast<PacketId>(*last + 1U);
+            ids_.insert(e, master_);
+            return master_;
+        }
+
+        auto b = ids_.begin();
+        auto prev = *b;
+        if (prev != 1U) {
+            master_ = 1U;
+            ids_.insert(b, master_);
+            return master_;
+        }
+        ++b;
+        while (*b - 1U == prev && b != e) {
+            prev = *b;
+            ++b;
+        }
+        master_ = static_cast<PacketId>(prev + 1U);
+        ids_.insert(b, master_);
+        return master_;
+    }
+
+    bool erase(PacketId id) {
+        return ids_.erase(id);
+    }
+
+private:
+    std::set<PacketId> ids_;
+    PacketId master_ = 0;
+};
+
+// Keep in_flight ids acquired, and release the oldest one and acquire a new one per iteration.
+template <typename Pool, typename PacketId>
+double run(std::size_t in_flight, std::size_t iterations) {
+    Pool pool;
+    std::deque<PacketId> window;
+    for (std::size_t i = 0; i != in_flight; ++i) {
+        window.push_back(pool.acquire());
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i != iterations; ++i) {
+        pool.erase(window.front());
+        window.pop_front();
+        window.push_back(pool.acquire());
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / double(iterations);
+}
+
+template <typename PacketId>
+void compare(char const* name, std::size_t in_flight, std::size_t iterations) {
+    auto set_ns = run<set_pool<PacketId>, PacketId>(in_flight, iterations);
+    auto pool_ns = run<mqtt::packet_id_pool<PacketId>, PacketId>(in_flight, iterations);
+    std::cout
+        << std::left << std::setw(10) << name
+        << std::right << std::setw(10) << in_flight
+        << std::fixed << std::setprecision(1)
+        << std::setw(14) << set_ns
+        << std::setw(14) << pool_ns
+        << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::size_t iterations = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    std::cout
+        << std::left << std::setw(10) << "id"
+        << std::right << std::setw(10) << "in-flight"
+        << std::setw(14) << "set ns/op"
+        << std::setw(14) << "pool ns/op"
+        << std::endl;
+    compare<std::uint16_t>("16bit", 1000, iterations);
+    compare<std::uint16_t>("16bit", 60000, iterations);
+    compare<std::uint32_t>("32bit", 1000, iterations);
+    compare<std::uint32_t>("32bit", 60000, iterations);
+    compare<std::uint32_t>("32bit", 1000000, iterations);
+}
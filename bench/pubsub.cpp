@@ -0,0 +1,481 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// End-to-end publish benchmark using the in-process test broker.
+//
+// The broker runs on its own thread, because test_broker publishes synchronously.
+// If --shards is greater than 1, test_sharded_broker runs with the number of threads instead.
+// Each client subscribes to its own topic and publishes to it. The send time is
+// written in the first bytes of the payload, and the latency is measured when
+// the client receives the message from the broker. Each client keeps `window`
+// messages in flight.
+//
+// Usage:
+//   bench_pubsub [--qos 0,1,2] [--payload 16,1024,65536,1048576]
+//                [--connections 1,100,10000] [--strand both|strand|no_strand]
+//                [--messages N] [--window N] [--shards N] [--json FILE]
+//                [--baseline FILE] [--min-ratio R]
+//
+// The results are printed as a table, and written as JSON if --json is specified.
+// If --baseline is specified, the throughput of each scenario is compared with the one in the
+// JSON file that an earlier run wrote. If it is less than R (default 0.5) times the baseline,
+// or a message is lost, the scenario is reported as a regression and the exit status is 1.
+// Each connection uses two file descriptors (client and broker side). The soft limit is raised
+// to the hard limit at startup.
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <thread>
+#include <functional>
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif // !defined(_WIN32)
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include "../test/test_settings.hpp"
+#include "../test/test_broker.hpp"
+#include "../test/test_server_no_tls.hpp"
+#include "../test/test_sharded_broker.hpp"
+
+#include <mqtt/client.hpp>
+
+namespace as = boost::asio;
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr std::size_t const max_connecting = 64;
+
+struct scenario {
+    std::uint8_t qos;
+    std::size_t payload;
+    std::size_t connections;
+    bool strand;
+};
+
+struct result {
+    scenario sc;
+    std::size_t messages = 0;
+    double seconds = 0;
+    double p50_us = 0;
+    double p99_us = 0;
+    double p999_us = 0;
+    double max_us = 0;
+    std::size_t errors = 0;
+};
+
+struct options {
+    std::vector<std::uint8_t> qos { 0, 1, 2 };
+    std::vector<std::size_t> payload { 16, 1024, 65536, 1024 * 1024 };
+    std::vector<std::size_t> connections { 1, 100, 10000 };
+    std::vector<bool> strand { true, false };
+    std::size_t messages = 20000;
+    std::size_t window = 8;
+    std::size_t shards = 1;
+    std::string json;
+    std::string baseline;
+    double min_ratio = 0.5;
+};
+
+inline std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        clock_type::now().time_since_epoch()).count();
+}
+
+inline double percentile(std::vector<double> const& sorted, double p) {
+    if (sorted.empty()) return 0;
+    auto idx = static_cast<std::size_t>(p * double(sorted.size()));
+    if (idx >= sorted.size()) idx = sorted.size() - 1;
+    return sorted[idx];
+}
+
+template <typename Client>
+result run(
+    scenario const& sc,
+    options const& opts,
+    std::vector<std::shared_ptr<Client>> const& clients,
+    as::io_service& ios,
+    std::function<void()> const& close_server) {
+    result r;
+    r.sc = sc;
+
+    // The total bytes are limited to 256MB, but each client publishes at least one message.
+    std::size_t total = std::min(opts.messages, std::max<std::size_t>(1, 256 * 1024 * 1024 / sc.payload));
+    std::size_t per_client = std::max<std::size_t>(1, total / sc.connections);
+    std::size_t window = std::min(opts.window, per_client);
+    r.messages = per_client * sc.connections;
+
+    std::vector<double> latencies;
+    latencies.reserve(r.messages);
+
+    struct state {
+        std::string topic;
+        std::size_t sent = 0;
+        std::size_t received = 0;
+        std::size_t acked = 0;
+    };
+    std::vector<state> states(clients.size());
+    std::size_t connecting = 0;
+    std::size_t subscribed = 0;
+    std::size_t done = 0;
+    std::size_t closed = 0;
+    clock_type::time_point start;
+    clock_type::time_point end;
+
+    std::string payload(sc.payload, 'x');
+
+    auto publish = [&](std::size_t i) {
+        auto& st = states[i];
+        ++st.sent;
+        auto t = now_ns();
+        std::memcpy(&payload[0], &t, std::min(sizeof(t), payload.size()));
+        clients[i]->async_publish(st.topic, payload, sc.qos);
+    };
+
+    auto check_done = [&](std::size_t i) {
+        auto& st = states[i];
+        if (st.received == per_client && (sc.qos == mqtt::qos::at_most_once || st.acked == per_client)) {
+            if (++done == clients.size()) {
+                end = clock_type::now();
+                for (auto& c : clients) {
+                    auto wp = std::weak_ptr<Client>(c);
+                    ios.post([wp] { if (auto c = wp.lock()) c->async_disconnect(); });
+                }
+            }
+        }
+    };
+
+    // Connect the clients gradually not to overflow the listen backlog.
+    auto connect_next = [&] {
+        if (connecting != clients.size()) clients[connecting++]->connect();
+    };
+
+    auto check_closed = [&] {
+        if (++closed == clients.size()) close_server();
+    };
+
+    for (std::size_t i = 0; i != clients.size(); ++i) {
+        auto& c = clients[i];
+        states[i].topic = "bench/" + std::to_string(i);
+        c->set_clean_session(true);
+        c->set_client_id("bench" + std::to_string(i));
+        // The clients only use async APIs, so the responses are sent asynchronously too.
+        c->set_auto_pub_response(true, true);
+        c->set_connack_handler(
+            [&, i]
+            (bool, std::uint8_t) {
+                connect_next();
+                clients[i]->async_subscribe(states[i].topic, sc.qos);
+                return true;
+            });
+        c->set_suback_handler(
+            [&]
+            (typename Client::packet_id_t, std::vector<mqtt::optional<std::uint8_t>>) {
+                if (++subscribed == clients.size()) {
+                    start = clock_type::now();
+                    for (std::size_t j = 0; j != clients.size(); ++j) {
+                        for (std::size_t k = 0; k != window; ++k) publish(j);
+                    }
+                }
+                return true;
+            });
+        c->set_publish_handler(
+            [&, i]
+            (std::uint8_t,
+             mqtt::optional<typename Client::packet_id_t>,
+             std::string,
+             std::string contents) {
+                std::int64_t t = 0;
+                std::memcpy(&t, contents.data(), std::min(sizeof(t), contents.size()));
+                latencies.push_back(double(now_ns() - t) / 1000.0);
+                auto& st = states[i];
+                ++st.received;
+                if (st.sent < per_client) publish(i);
+                check_done(i);
+                return true;
+            });
+        auto on_ack =
+            [&, i]
+            (typename Client::packet_id_t) {
+                ++states[i].acked;
+                check_done(i);
+                return true;
+            };
+        c->set_puback_handler(on_ack);
+        c->set_pubcomp_handler(on_ack);
+        c->set_close_handler(check_closed);
+        c->set_error_handler(
+            [&]
+            (boost::system::error_code const& ec) {
+                // e.g. too many open files. Stop the scenario.
+                if (r.errors++ == 0) {
+                    std::cerr << "error: " << ec.message() << std::endl;
+                    for (auto& c : clients) {
+                        auto wp = std::weak_ptr<Client>(c);
+                        ios.post([wp] { if (auto c = wp.lock()) c->force_disconnect(); });
+                    }
+                    close_server();
+                }
+            });
+    }
+    for (std::size_t i = 0; i != max_connecting; ++i) connect_next();
+    ios.run();
+
+    if (done == clients.size()) {
+        r.seconds = std::chrono::duration<double>(end - start).count();
+    }
+    std::sort(latencies.begin(), latencies.end());
+    r.p50_us = percentile(latencies, 0.5);
+    r.p99_us = percentile(latencies, 0.99);
+    r.p999_us = percentile(latencies, 0.999);
+    r.max_us = latencies.empty() ? 0 : latencies.back();
+    return r;
+}
+
+template <typename MakeClient>
+result run(
+    scenario const& sc,
+    options const& opts,
+    as::io_service& ios,
+    MakeClient make_client,
+    std::function<void()> const& close_server) {
+    // Resolve once and share the endpoints with all clients.
+    as::ip::tcp::resolver res(ios);
+    auto eps = std::make_shared<std::vector<as::ip::tcp::endpoint>>();
+    for (auto const& e : res.resolve(broker_url, std::to_string(broker_notls_port))) {
+        eps->push_back(e.endpoint());
+    }
+
+    using client_t = typename decltype(make_client(ios))::element_type;
+    std::vector<std::shared_ptr<client_t>> clients;
+    for (std::size_t i = 0; i != sc.connections; ++i) {
+        clients.push_back(make_client(ios));
+        clients.back()->set_resolved_endpoints(eps);
+    }
+    return run(sc, opts, clients, ios, close_server);
+}
+
+template <typename MakeClient>
+result run(scenario const& sc, options const& opts, MakeClient make_client) {
+    as::io_service ios;
+    if (opts.shards > 1) {
+        test_sharded_broker b(broker_notls_port, opts.shards);
+        b.run();
+        auto r = run(sc, opts, ios, make_client, [&] { b.close(); });
+        b.join();
+        return r;
+    }
+
+    as::io_service broker_ios;
+    test_broker b(broker_ios);
+    test_server_no_tls s(broker_ios, b);
+    std::thread th([&] { broker_ios.run(); });
+    auto r = run(
+        sc, opts, ios, make_client,
+        [&] {
+            broker_ios.post([&] { s.close(); });
+        });
+    th.join();
+    return r;
+}
+
+result run(scenario const& sc, options const& opts) {
+    if (sc.strand) {
+        return run(
+            sc, opts,
+            [](as::io_service& ios) {
+                return mqtt::make_client(ios, broker_url, broker_notls_port);
+            });
+    }
+    return run(
+        sc, opts,
+        [](as::io_service& ios) {
+            return mqtt::make_client_no_strand(ios, broker_url, broker_notls_port);
+        });
+}
+
+template <typename T>
+std::vector<T> parse_list(std::string const& str) {
+    std::vector<T> ret;
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        ret.push_back(static_cast<T>(std::stoul(item)));
+    }
+    return ret;
+}
+
+bool parse_options(int argc, char** argv, options& opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string key = argv[i];
+        if (i + 1 == argc) return false;
+        std::string value = argv[++i];
+        if (key == "--qos") opts.qos = parse_list<std::uint8_t>(value);
+        else if (key == "--payload") opts.payload = parse_list<std::size_t>(value);
+        else if (key == "--connections") opts.connections = parse_list<std::size_t>(value);
+        else if (key == "--messages") opts.messages = std::stoul(value);
+        else if (key == "--window") opts.window = std::max<std::size_t>(1, std::stoul(value));
+        else if (key == "--shards") opts.shards = std::stoul(value);
+        else if (key == "--json") opts.json = value;
+        else if (key == "--baseline") opts.baseline = value;
+        else if (key == "--min-ratio") opts.min_ratio = std::stod(value);
+        else if (key == "--strand") {
+            if (value == "both") opts.strand = { true, false };
+            else if (value == "strand") opts.strand = { true };
+            else if (value == "no_strand") opts.strand = { false };
+            else return false;
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline double msgs_per_sec(result const& r) {
+    return r.seconds > 0 ? double(r.messages) / r.seconds : 0;
+}
+
+void write_json(std::ostream& o, std::vector<result> const& results, std::size_t shards) {
+    o << "{\n  \"benchmark\": \"pubsub\",\n  \"shards\": " << shards << ",\n  \"results\": [";
+    for (std::size_t i = 0; i != results.size(); ++i) {
+        auto const& r = results[i];
+        o << (i == 0 ? "\n" : ",\n")
+          << "    {"
+          << "\"qos\": " << int(r.sc.qos)
+          << ", \"payload\": " << r.sc.payload
+          << ", \"connections\": " << r.sc.connections
+          << ", \"strand\": " << (r.sc.strand ? "true" : "false")
+          << ", \"messages\": " << r.messages
+          << ", \"seconds\": " << r.seconds
+          << ", \"msgs_per_sec\": " << msgs_per_sec(r)
+          << ", \"latency_us\": {"
+          << "\"p50\": " << r.p50_us
+          << ", \"p99\": " << r.p99_us
+          << ", \"p999\": " << r.p999_us
+          << ", \"max\": " << r.max_us
+          << "}"
+          << ", \"errors\": " << r.errors
+          << "}";
+    }
+    o << "\n  ]\n}\n";
+}
+
+// Returns the number of the regressions. The scenarios that are not in the baseline are skipped.
+std::size_t compare_baseline(std::string const& path, std::vector<result> const& results, double min_ratio) {
+    namespace pt = boost::property_tree;
+    pt::ptree baseline;
+    pt::read_json(path, baseline);
+    std::size_t regressions = 0;
+    for (auto const& r : results) {
+        if (r.errors != 0) {
+            std::cout << "REGRESSION: " << r.errors << " errors" << std::endl;
+            ++regressions;
+            continue;
+        }
+        for (auto const& e : baseline.get_child("results")) {
+            auto const& b = e.second;
+            if (b.get<int>("qos") != int(r.sc.qos) ||
+                b.get<std::size_t>("payload") != r.sc.payload ||
+                b.get<std::size_t>("connections") != r.sc.connections ||
+                b.get<bool>("strand") != r.sc.strand) continue;
+            auto expected = b.get<double>("msgs_per_sec");
+            auto actual = msgs_per_sec(r);
+            bool ok = actual >= expected * min_ratio;
+            std::cout
+                << (ok ? "ok        " : "REGRESSION")
+                << ": qos " << int(r.sc.qos)
+                << " payload " << r.sc.payload
+                << " conns " << r.sc.connections
+                << (r.sc.strand ? " strand" : " no_strand")
+                << " " << actual << " msgs/s, baseline " << expected << " msgs/s"
+                << std::endl;
+            if (!ok) ++regressions;
+            break;
+        }
+    }
+    return regressions;
+}
+
+void raise_fd_limit() {
+#if !defined(_WIN32)
+    rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+#endif // !defined(_WIN32)
+}
+
+int main(int argc, char** argv) {
+    options opts;
+    if (!parse_options(argc, argv, opts)) {
+        std::cerr
+            << "Usage: " << argv[0]
+            << " [--qos 0,1,2] [--payload 16,1024] [--connections 1,100]"
+            << " [--strand both|strand|no_strand] [--messages N] [--window N] [--shards N] [--json FILE]"
+            << " [--baseline FILE] [--min-ratio R]"
+            << std::endl;
+        return 1;
+    }
+    raise_fd_limit();
+
+    std::cout
+        << std::setw(4) << "qos"
+        << std::setw(10) << "payload"
+        << std::setw(8) << "conns"
+        << std::setw(11) << "strand"
+        << std::setw(10) << "msgs"
+        << std::setw(12) << "msgs/s"
+        << std::setw(10) << "p50 us"
+        << std::setw(10) << "p99 us"
+        << std::setw(10) << "p999 us"
+        << std::setw(8) << "errors"
+        << std::endl;
+
+    std::vector<result> results;
+    for (auto strand : opts.strand) {
+        for (auto connections : opts.connections) {
+            for (auto payload : opts.payload) {
+                for (auto qos : opts.qos) {
+                    auto r = run(scenario { qos, payload, connections, strand }, opts);
+                    std::cout
+                        << std::fixed << std::setprecision(1)
+                        << std::setw(4) << int(qos)
+                        << std::setw(10) << payload
+                        << std::setw(8) << connections
+                        << std::setw(11) << (strand ? "strand" : "no_strand")
+                        << std::setw(10) << r.messages
+                        << std::setw(12) << (r.seconds > 0 ? double(r.messages) / r.seconds : 0)
+                        << std::setw(10) << r.p50_us
+                        << std::setw(10) << r.p99_us
+                        << std::setw(10) << r.p999_us
+                        << std::setw(8) << r.errors
+                        << std::endl;
+                    results.push_back(r);
+                }
+            }
+        }
+    }
+
+    if (!opts.json.empty()) {
+        std::ofstream ofs(opts.json);
+        write_json(ofs, results, opts.shards);
+    }
+    if (!opts.baseline.empty() && compare_baseline(opts.baseline, results, opts.min_ratio) != 0) {
+        return 1;
+    }
+}
@@ -0,0 +1,107 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Compare the QoS2 duplicate detection of inbound publishes between
+// the storages of mqtt::packet_id_set and std::set that was used by mqtt::endpoint before.
+// Each inbound publish is looked up and inserted, and released by the pubrel
+// that arrives in_flight publishes later.
+// The peer chooses the ids. "sparse" ids are 65536 apart, so each id is in its own bitmap page.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <set>
+#include <limits>
+#include <string>
+#include <cstdint>
+
+#include <mqtt/packet_id_pool.hpp>
+
+template <typename PacketId>
+struct std_set {
+    bool handled(PacketId id) const { return s.find(id) != s.end(); }
+    void insert(PacketId id) { s.emplace(id); }
+    void erase(PacketId id) { s.erase(id); }
+    std::set<PacketId> s;
+};
+
+template <typename PacketId, typename Storage>
+struct id_set {
+    bool handled(PacketId id) const { return s.contains(id); }
+    void insert(PacketId id) { s.insert(id); }
+    void erase(PacketId id) { s.erase(id); }
+    mqtt::packet_id_set<PacketId, std::allocator<char>, Storage> s;
+};
+
+template <typename PacketId>
+using bitmap_set = id_set<PacketId, mqtt::packet_id_bitmap_storage>;
+
+template <typename PacketId>
+using hash_set = id_set<PacketId, mqtt::packet_id_hash_storage>;
+
+template <typename PacketId>
+PacketId next(PacketId id, PacketId stride) {
+    auto ret = static_cast<PacketId>(id + stride);
+    return ret == 0 || ret < id ? PacketId(1) : ret;
+}
+
+template <typename Set, typename PacketId>
+double run(std::size_t in_flight, PacketId stride, std::size_t iterations) {
+    Set set;
+    PacketId publish_id = 0;
+    PacketId pubrel_id = 0;
+    for (std::size_t i = 0; i != in_flight; ++i) {
+        publish_id = next(publish_id, stride);
+        set.insert(publish_id);
+    }
+    std::size_t duplicated = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i != iterations; ++i) {
+        pubrel_id = next(pubrel_id, stride);
+        set.erase(pubrel_id);
+        publish_id = next(publish_id, stride);
+        if (set.handled(publish_id)) ++duplicated;
+        else set.insert(publish_id);
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (duplicated != 0) std::cerr << "unexpected duplicate" << std::endl;
+    return std::chrono::duration<double, std::nano>(end - start).count() / double(iterations);
+}
+
+template <typename PacketId>
+void compare(char const* name, std::size_t in_flight, PacketId stride, std::size_t iterations) {
+    auto set = run<std_set<PacketId>, PacketId>(in_flight, stride, iterations);
+    auto bitmap = run<bitmap_set<PacketId>, PacketId>(in_flight, stride, iterations);
+    auto hash = run<hash_set<PacketId>, PacketId>(in_flight, stride, iterations);
+    std::cout
+        << std::left << std::setw(14) << name
+        << std::right << std::setw(10) << in_flight
+        << std::fixed << std::setprecision(1)
+        << std::setw(14) << set
+        << std::setw(14) << bitmap
+        << std::setw(14) << hash
+        << std::setw(14) << 1000.0 / hash
+        << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::size_t iterations = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    std::cout
+        << std::left << std::setw(14) << "id"
+        << std::right << std::setw(10) << "in-flight"
+        << std::setw(14) << "set ns/msg"
+        << std::setw(14) << "bitmap ns/msg"
+        << std::setw(14) << "hash ns/msg"
+        << std::setw(14) << "hash Mmsg/s"
+        << std::endl;
+    compare<std::uint16_t>("16bit", 10, 1, iterations);
+    compare<std::uint16_t>("16bit", 1000, 1, iterations);
+    compare<std::uint16_t>("16bit", 60000, 1, iterations);
+    compare<std::uint32_t>("32bit", 1000, 1, iterations);
+    compare<std::uint32_t>("32bit", 1000000, 1, iterations);
+    compare<std::uint32_t>("32bit sparse", 1000, 0x10000, iterations);
+    compare<std::uint32_t>("32bit sparse", 60000, 0x10000, iterations);
+}
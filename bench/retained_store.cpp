@@ -0,0 +1,133 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Look up the retained messages for the subscriptions with 1M retained topics.
+// mqtt::retained_store walks the topic tree. It is compared with the scan of all
+// retained messages that a wildcard aware broker needs with the index that is keyed
+// by the exact topic names.
+//
+// Usage:
+//   bench_retained_store [sites] [devices per site] [lookups]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <random>
+#include <cstdint>
+#include <algorithm>
+
+#include <mqtt/retained_store.hpp>
+#include <mqtt/topic_trie.hpp>
+
+using clock_type = std::chrono::steady_clock;
+
+struct retain {
+    std::shared_ptr<std::string> topic;
+    std::shared_ptr<std::string> contents;
+};
+
+template <typename F>
+double measure(std::size_t n, F&& f) {
+    auto start = clock_type::now();
+    f();
+    auto end = clock_type::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / double(n);
+}
+
+std::string topic(std::size_t site, std::size_t device) {
+    return "site/" + std::to_string(site) + "/device/" + std::to_string(device) + "/temperature";
+}
+
+int main(int argc, char** argv) {
+    std::size_t sites = argc > 1 ? std::stoul(argv[1]) : 1000;
+    std::size_t devices = argc > 2 ? std::stoul(argv[2]) : 1000;
+    std::size_t lookups = argc > 3 ? std::stoul(argv[3]) : 1000;
+
+    mqtt::retained_store<retain> store;
+    std::map<std::string, retain> exact;
+    auto contents = std::make_shared<std::string>("20.5");
+    auto insert = measure(
+        sites * devices,
+        [&] {
+            for (std::size_t s = 0; s != sites; ++s) {
+                for (std::size_t d = 0; d != devices; ++d) {
+                    auto t = std::make_shared<std::string>(topic(s, d));
+                    store.insert_or_assign(*t, retain { t, contents }, contents->size());
+                    exact.emplace(*t, retain { t, contents });
+                }
+            }
+        });
+
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<std::size_t> site_dist(0, sites - 1);
+    std::uniform_int_distribution<std::size_t> device_dist(0, devices - 1);
+
+    struct query {
+        char const* name;
+        std::vector<std::string> filters;
+    };
+    std::vector<query> queries {
+        { "exact", {} },
+        { "site/N/device/+/..", {} },
+        { "site/N/#", {} },
+        { "site/+/device/N/..", {} },
+    };
+    for (std::size_t i = 0; i != lookups; ++i) {
+        auto s = std::to_string(site_dist(gen));
+        auto d = std::to_string(device_dist(gen));
+        queries[0].filters.push_back("site/" + s + "/device/" + d + "/temperature");
+        queries[1].filters.push_back("site/" + s + "/device/+/temperature");
+        queries[2].filters.push_back("site/" + s + "/#");
+        queries[3].filters.push_back("site/+/device/" + d + "/temperature");
+    }
+
+    auto u = store.memory_usage();
+    std::cout
+        << "retained messages: " << u.messages << std::endl
+        << "accounted bytes: " << u.bytes << std::endl
+        << "tree nodes: " << u.nodes << std::endl
+        << "index bytes (estimated): " << u.index_bytes << std::endl
+        << "insert ns: " << std::fixed << std::setprecision(1) << insert << std::endl
+        << std::left << std::setw(24) << "filter"
+        << std::right << std::setw(16) << "tree ns"
+        << std::setw(16) << "scan ns"
+        << std::setw(16) << "matches/lookup"
+        << std::endl;
+
+    for (auto const& q : queries) {
+        std::size_t matched = 0;
+        auto tree = measure(
+            q.filters.size(),
+            [&] {
+                for (auto const& f : q.filters) store.find(f, [&](retain const&) { ++matched; });
+            });
+
+        // The scan is too slow to run all lookups.
+        std::size_t scan_lookups = std::min<std::size_t>(q.filters.size(), 5);
+        std::size_t scan_matched = 0;
+        auto scan = measure(
+            scan_lookups,
+            [&] {
+                for (std::size_t i = 0; i != scan_lookups; ++i) {
+                    mqtt::topic_trie<int> t;
+                    t.insert(q.filters[i], 0);
+                    for (auto const& e : exact) {
+                        t.match(e.first, [&](int) { ++scan_matched; });
+                    }
+                }
+            });
+        std::cout
+            << std::left << std::setw(24) << q.name
+            << std::right << std::setw(16) << tree
+            << std::setw(16) << scan
+            << std::setw(16) << double(matched) / double(q.filters.size())
+            << std::endl;
+    }
+}
@@ -0,0 +1,226 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Subscription churn benchmark of test_sharded_broker.
+//
+// The broker runs with --shards threads. A persistent session subscribes --subscriptions
+// filters in advance, so the subscription index is large. Then --clients clients on --threads
+// client threads subscribe and unsubscribe their own filter --rounds times each. Each client
+// waits for the SUBACK and the UNSUBACK before the next request, and the latencies are measured.
+//
+// Usage:
+//   bench_subscription_churn [--shards N] [--threads N] [--clients N]
+//                            [--subscriptions N] [--rounds N]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <tuple>
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+
+#include "../test/test_settings.hpp"
+#include "../test/test_sharded_broker.hpp"
+
+#include <mqtt/client.hpp>
+
+namespace as = boost::asio;
+
+using clock_type = std::chrono::steady_clock;
+
+struct options {
+    std::size_t shards = 4;
+    std::size_t threads = 4;
+    std::size_t clients = 16;
+    std::size_t subscriptions = 10000;
+    std::size_t rounds = 200;
+};
+
+bool parse_options(int argc, char** argv, options& opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string key = argv[i];
+        if (i + 1 == argc) return false;
+        auto value = static_cast<std::size_t>(std::stoul(argv[++i]));
+        if (key == "--shards") opts.shards = std::max<std::size_t>(1, value);
+        else if (key == "--threads") opts.threads = std::max<std::size_t>(1, value);
+        else if (key == "--clients") opts.clients = std::max<std::size_t>(1, value);
+        else if (key == "--subscriptions") opts.subscriptions = value;
+        else if (key == "--rounds") opts.rounds = std::max<std::size_t>(1, value);
+        else return false;
+    }
+    return true;
+}
+
+// Subscribe the filters in the persistent session, and disconnect.
+void preload(std::size_t subscriptions) {
+    constexpr std::size_t const batch = 1000;
+    as::io_service ios;
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_client_id("preload");
+    c->set_clean_session(false);
+    std::size_t requested = 0;
+    std::size_t acked = 0;
+    auto subscribe_next = [&] {
+        std::vector<std::tuple<std::string, std::uint8_t>> entries;
+        for (; requested != subscriptions && entries.size() != batch; ++requested) {
+            entries.emplace_back("preload/" + std::to_string(requested) + "/+", mqtt::qos::at_most_once);
+        }
+        c->async_subscribe(entries);
+        return entries.size();
+    };
+    c->set_connack_handler(
+        [&]
+        (bool, std::uint8_t) {
+            if (subscriptions == 0) c->async_disconnect();
+            else subscribe_next();
+            return true;
+        });
+    c->set_suback_handler(
+        [&]
+        (std::uint16_t, std::vector<mqtt::optional<std::uint8_t>> results) {
+            acked += results.size();
+            if (acked == subscriptions) c->async_disconnect();
+            else subscribe_next();
+            return true;
+        });
+    c->connect();
+    ios.run();
+}
+
+struct thread_result {
+    std::vector<double> latencies;
+    std::size_t errors = 0;
+};
+
+// Run the clients of a client thread.
+void churn(std::size_t first, std::size_t step, options const& opts, thread_result& r) {
+    as::io_service ios;
+    using client_t = decltype(mqtt::make_client(ios, broker_url, broker_notls_port));
+    struct state {
+        client_t c;
+        std::string topic;
+        std::size_t rounds = 0;
+        clock_type::time_point sent;
+    };
+    std::vector<state> states;
+    for (std::size_t i = first; i < opts.clients; i += step) {
+        states.emplace_back();
+        states.back().c = mqtt::make_client(ios, broker_url, broker_notls_port);
+        states.back().topic = "churn/" + std::to_string(i);
+    }
+    r.latencies.reserve(states.size() * opts.rounds * 2);
+
+    auto measure = [&](state& st) {
+        r.latencies.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - st.sent).count());
+        st.sent = clock_type::now();
+    };
+    for (auto& st : states) {
+        auto p = &st;
+        st.c->set_client_id(st.topic);
+        st.c->set_clean_session(true);
+        st.c->set_connack_handler(
+            [p]
+            (bool, std::uint8_t) {
+                p->sent = clock_type::now();
+                p->c->async_subscribe(p->topic, mqtt::qos::at_most_once);
+                return true;
+            });
+        st.c->set_suback_handler(
+            [&, p]
+            (std::uint16_t, std::vector<mqtt::optional<std::uint8_t>>) {
+                measure(*p);
+                p->c->async_unsubscribe(p->topic);
+                return true;
+            });
+        st.c->set_unsuback_handler(
+            [&, p]
+            (std::uint16_t) {
+                measure(*p);
+                if (++p->rounds == opts.rounds) p->c->async_disconnect();
+                else p->c->async_subscribe(p->topic, mqtt::qos::at_most_once);
+                return true;
+            });
+        st.c->set_error_handler(
+            [&]
+            (boost::system::error_code const&) {
+                ++r.errors;
+            });
+        st.c->connect();
+    }
+    ios.run();
+}
+
+double percentile(std::vector<double> const& sorted, double p) {
+    if (sorted.empty()) return 0;
+    auto idx = static_cast<std::size_t>(p * double(sorted.size()));
+    if (idx >= sorted.size()) idx = sorted.size() - 1;
+    return sorted[idx];
+}
+
+int main(int argc, char** argv) {
+    options opts;
+    if (!parse_options(argc, argv, opts)) {
+        std::cerr
+            << "Usage: " << argv[0]
+            << " [--shards N] [--threads N] [--clients N] [--subscriptions N] [--rounds N]"
+            << std::endl;
+        return 1;
+    }
+
+    test_sharded_broker b(broker_notls_port, opts.shards);
+    b.run();
+    preload(opts.subscriptions);
+
+    std::vector<thread_result> results(opts.threads);
+    std::vector<std::thread> threads;
+    auto start = clock_type::now();
+    for (std::size_t i = 0; i != opts.threads; ++i) {
+        threads.emplace_back(
+            [&, i] {
+                churn(i, opts.threads, opts, results[i]);
+            }
+        );
+    }
+    for (auto& th : threads) th.join();
+    auto seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    b.close();
+    b.join();
+
+    std::vector<double> latencies;
+    std::size_t errors = 0;
+    for (auto const& r : results) {
+        latencies.insert(latencies.end(), r.latencies.begin(), r.latencies.end());
+        errors += r.errors;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout
+        << std::setw(8) << "shards"
+        << std::setw(9) << "threads"
+        << std::setw(9) << "clients"
+        << std::setw(8) << "subs"
+        << std::setw(10) << "requests"
+        << std::setw(12) << "requests/s"
+        << std::setw(10) << "p50 us"
+        << std::setw(10) << "p99 us"
+        << std::setw(8) << "errors"
+        << std::endl;
+    std::cout
+        << std::setw(8) << opts.shards
+        << std::setw(9) << opts.threads
+        << std::setw(9) << opts.clients
+        << std::setw(8) << opts.subscriptions
+        << std::setw(10) << latencies.size()
+        << std::fixed << std::setprecision(1)
+        << std::setw(12) << double(latencies.size()) / seconds
+        << std::setw(10) << percentile(latencies, 0.5)
+        << std::setw(10) << percentile(latencies, 0.99)
+        << std::setw(8) << errors
+        << std::endl;
+}
@@ -0,0 +1,190 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Match topic names against 1M subscriptions.
+// mqtt::topic_trie is compared with the ordered multi_index of topic strings that
+// test_broker used before, which supports only exact matching, and with a linear scan
+// that a wildcard aware broker would need without the trie.
+//
+// Usage:
+//   bench_topic_trie [sites] [devices per site] [lookups]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <algorithm>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/member.hpp>
+
+#include <mqtt/topic_trie.hpp>
+
+namespace mi = boost::multi_index;
+
+using clock_type = std::chrono::steady_clock;
+
+struct sub {
+    std::string topic;
+    std::size_t id;
+};
+
+using mi_sub = mi::multi_index_container<
+    sub,
+    mi::indexed_by<
+        mi::ordered_non_unique<
+            BOOST_MULTI_INDEX_MEMBER(sub, std::string, topic)
+        >
+    >
+>;
+
+// The matching rule without the trie.
+bool matches(mqtt::string_view filter, mqtt::string_view topic) {
+    if (!topic.empty() && topic[0] == '$' && !filter.empty() && (filter[0] == '+' || filter[0] == '#')) return false;
+    while (true) {
+        auto fpos = filter.find('/');
+        auto flevel = filter.substr(0, fpos);
+        if (flevel == "#") return true;
+        auto tpos = topic.find('/');
+        auto tlevel = topic.substr(0, tpos);
+        if (flevel != "+" && flevel != tlevel) return false;
+        if (fpos == mqtt::string_view::npos || tpos == mqtt::string_view::npos) {
+            if (tpos == mqtt::string_view::npos && fpos != mqtt::string_view::npos) {
+                return filter.substr(fpos + 1) == "#";
+            }
+            return fpos == tpos;
+        }
+        filter = filter.substr(fpos + 1);
+        topic = topic.substr(tpos + 1);
+    }
+}
+
+template <typename F>
+double measure(std::size_t n, F&& f) {
+    auto start = clock_type::now();
+    f();
+    auto end = clock_type::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / double(n);
+}
+
+std::string topic(std::size_t site, std::size_t device) {
+    return "site/" + std::to_string(site) + "/device/" + std::to_string(device) + "/temperature";
+}
+
+int main(int argc, char** argv) {
+    std::size_t sites = argc > 1 ? std::stoul(argv[1]) : 1000;
+    std::size_t devices = argc > 2 ? std::stoul(argv[2]) : 1000;
+    std::size_t lookups = argc > 3 ? std::stoul(argv[3]) : 1000000;
+
+    // Exact subscriptions for each device, and wildcard subscriptions for each site.
+    std::vector<std::string> filters;
+    filters.reserve(sites * devices + sites * 2);
+    for (std::size_t s = 0; s != sites; ++s) {
+        for (std::size_t d = 0; d != devices; ++d) {
+            filters.push_back(topic(s, d));
+        }
+        filters.push_back("site/" + std::to_string(s) + "/device/+/temperature");
+        filters.push_back("site/" + std::to_string(s) + "/#");
+    }
+
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<std::size_t> site_dist(0, sites - 1);
+    std::uniform_int_distribution<std::size_t> device_dist(0, devices - 1);
+    std::vector<std::string> topics;
+    topics.reserve(lookups);
+    for (std::size_t i = 0; i != lookups; ++i) {
+        topics.push_back(topic(site_dist(gen), device_dist(gen)));
+    }
+
+    mqtt::topic_trie<std::size_t> trie;
+    auto trie_insert = measure(
+        filters.size(),
+        [&] {
+            for (std::size_t i = 0; i != filters.size(); ++i) trie.insert(filters[i], i);
+        });
+
+    auto nodes = trie.node_count();
+
+    mi_sub subs;
+    auto mi_insert = measure(
+        filters.size(),
+        [&] {
+            for (std::size_t i = 0; i != filters.size(); ++i) subs.insert(sub { filters[i], i });
+        });
+
+    std::size_t trie_matched = 0;
+    auto trie_match = measure(
+        topics.size(),
+        [&] {
+            for (auto const& t : topics) trie.match(t, [&](std::size_t) { ++trie_matched; });
+        });
+
+    std::size_t mi_matched = 0;
+    auto mi_match = measure(
+        topics.size(),
+        [&] {
+            for (auto const& t : topics) {
+                auto r = subs.equal_range(t);
+                for (; r.first != r.second; ++r.first) ++mi_matched;
+            }
+        });
+
+    // The linear scan is too slow to run all lookups.
+    std::size_t scan_lookups = std::min<std::size_t>(topics.size(), 20);
+    std::size_t scan_matched = 0;
+    auto scan_match = measure(
+        scan_lookups,
+        [&] {
+            for (std::size_t i = 0; i != scan_lookups; ++i) {
+                for (auto const& f : filters) {
+                    if (matches(f, topics[i])) ++scan_matched;
+                }
+            }
+        });
+
+    std::size_t erased = 0;
+    auto trie_erase = measure(
+        filters.size(),
+        [&] {
+            for (std::size_t i = 0; i != filters.size(); ++i) {
+                erased += trie.erase_if(filters[i], [&](std::size_t v) { return v == i; });
+            }
+        });
+
+    std::cout
+        << "subscriptions: " << filters.size() << std::endl
+        << "trie nodes: " << nodes << std::endl
+        << "all erased: " << (erased == filters.size() && trie.node_count() == 0 ? "yes" : "no") << std::endl
+        << std::left << std::setw(20) << ""
+        << std::right << std::setw(14) << "insert ns"
+        << std::setw(14) << "match ns"
+        << std::setw(14) << "erase ns"
+        << std::setw(18) << "matches/lookup"
+        << std::endl
+        << std::fixed << std::setprecision(1)
+        << std::left << std::setw(20) << "topic_trie"
+        << std::right << std::setw(14) << trie_insert
+        << std::setw(14) << trie_match
+        << std::setw(14) << trie_erase
+        << std::setw(18) << double(trie_matched) / double(topics.size())
+        << std::endl
+        << std::left << std::setw(20) << "multi_index (exact)"
+        << std::right << std::setw(14) << mi_insert
+        << std::setw(14) << mi_match
+        << std::setw(14) << "-"
+        << std::setw(18) << double(mi_matched) / double(topics.size())
+        << std::endl
+        << std::left << std::setw(20) << "linear scan"
+        << std::right << std::setw(14) << "-"
+        << std::setw(14) << scan_match
+        << std::setw(14) << "-"
+        << std::setw(18) << double(scan_matched) / double(scan_lookups)
+        << std::endl;
+}
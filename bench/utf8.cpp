@@ -0,0 +1,63 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Compare utf8string::validate_contents implementations.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <mqtt/utf8encoded_strings.hpp>
+
+template <typename F>
+double run(F const& f, std::vector<std::string> const& strs, std::size_t iterations) {
+    std::size_t bytes = 0;
+    std::size_t well_formed = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i != iterations; ++i) {
+        for (auto const& s : strs) {
+            if (f(s) == mqtt::utf8string::validation::well_formed) ++well_formed;
+            bytes += s.size();
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (well_formed == 0) std::cerr << "unexpected result" << std::endl;
+    // MB/s
+    return double(bytes) / std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+void compare(char const* name, std::vector<std::string> const& strs, std::size_t iterations) {
+    using namespace mqtt::utf8string;
+    std::cout << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(1);
+#if defined(MQTT_USE_STR_CHECK)
+    std::cout << std::setw(12) << run([](mqtt::string_view s) { return detail::validate_contents_scalar(s); }, strs, iterations);
+#if defined(MQTT_UTF8_SIMD)
+    std::cout << std::setw(12) << run([](mqtt::string_view s) { return detail::validate_contents_sse2(s); }, strs, iterations);
+    if (detail::has_avx2()) {
+        std::cout << std::setw(12) << run([](mqtt::string_view s) { return detail::validate_contents_avx2(s); }, strs, iterations);
+    }
+#endif // defined(MQTT_UTF8_SIMD)
+#endif // defined(MQTT_USE_STR_CHECK)
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::size_t iterations = argc > 1 ? std::stoul(argv[1]) : 100000;
+    std::cout
+        << std::left << std::setw(16) << "MB/s"
+        << std::right
+        << std::setw(12) << "scalar"
+        << std::setw(12) << "sse2"
+        << std::setw(12) << "avx2"
+        << std::endl;
+    compare("topic", { "sensors/building1/floor2/room3/temperature" }, iterations);
+    compare("long ascii", { std::string(1024, 'a') }, iterations / 10);
+    std::string mixed;
+    while (mixed.size() < 1024) mixed += "topic/\xe3\x81\x82/level";
+    compare("mixed", { mixed }, iterations / 10);
+}
@@ -1,7 +1,18 @@
+#include <string>
+
 #include "../test/test_broker.hpp"
 #include "../test/test_server_no_tls.hpp"
+#include "../test/test_sharded_broker.hpp"
 
-int main() {
+// Usage: broker [threads]
+int main(int argc, char** argv) {
+    std::size_t threads = argc > 1 ? std::stoul(argv[1]) : 1;
+    if (threads > 1) {
+        test_sharded_broker b(broker_notls_port, threads);
+        b.run();
+        b.join();
+        return 0;
+    }
     boost::asio::io_service ios;
     test_broker b(ios);
     test_server_no_tls s(ios, b);
@@ -48,6 +48,7 @@ class client : public endpoint<Socket, std::mutex, std::lock_guard, PacketIdByte
 public:
     using packet_id_t = typename base::packet_id_t;
     using async_handler_t = typename base::async_handler_t;
+    using session_handler_t = typename base::session_handler_t;
     using close_handler = typename base::close_handler;
     using error_handler = typename base::error_handler;
     using connack_handler = typename base::connack_handler;
@@ -356,46 +357,55 @@ public:
         set_keep_alive_sec_ping_ms(keep_alive_sec, keep_alive_sec * 1000 / 2);
     }
 
+    /**
+     * @brief Endpoints that are already resolved.
+     */
+    using resolved_endpoints_t = std::vector<as::ip::tcp::endpoint>;
+
+    /**
+     * @brief Set a connect timeout.
+     * @param timeout If resolving the host and connecting to the broker are not finished within timeout,
+     *                the connection is aborted and the error handler is called with
+     *                boost::asio::error::timed_out.
+     *                If timeout is not positive, no timeout is set. That is the default.
+     */
+    void set_connect_timeout(boost::posix_time::time_duration const& timeout) {
+        connect_timeout_ = timeout;
+    }
+
+    /**
+     * @brief Set resolved endpoints of the broker.
+     * When endpoints are set, connect() doesn't resolve the host and tries to connect to the endpoints.
+     * The endpoints can be shared by many clients that connect to the same broker.
+     * It is useful to start many clients at once.
+     * @param endpoints resolved endpoints. If nullptr is set, connect() resolves the host.
+     */
+    void set_resolved_endpoints(std::shared_ptr<resolved_endpoints_t const> endpoints) {
+        resolved_endpoints_ = std::move(endpoints);
+    }
+
     /**
      * @brief Connect to a broker
      * Before calling connect(), call set_xxx member functions to configure the connection.
+     * The host is resolved asynchronously. If it is failed, the error handler is called.
      * @param func finish handler that is called when the session is finished
      */
-    void connect(async_handler_t const& func = async_handler_t()) {
-        as::ip::tcp::resolver r(ios_);
-#if BOOST_VERSION < 106600
-        as::ip::tcp::resolver::query q(host_, port_);
-        auto it = r.resolve(q);
-        as::ip::tcp::resolver::iterator end;
-#else  // BOOST_VERSION < 106600
-        auto eps = r.resolve(host_, port_);
-        auto it = eps.begin();
-        auto end = eps.end();
-#endif // BOOST_VERSION < 106600
+    void connect(session_handler_t const& func = session_handler_t()) {
         setup_socket(base::socket());
-        connect_impl(*base::socket(), it, end, func);
+        start_connect(func);
     }
 
     /**
      * @brief Connect to a broker
      * Before calling connect(), call set_xxx member functions to configure the connection.
+     * The host is resolved asynchronously. If it is failed, the error handler is called.
      * @param socket The library uses the socket instead of internal generation.
      *               You can configure the socket prior to connect.
      * @param func finish handler that is called when the session is finished
      */
-    void connect(std::unique_ptr<Socket>&& socket, async_handler_t const& func = async_handler_t()) {
-        as::ip::tcp::resolver r(ios_);
-#if BOOST_VERSION < 106600
-        as::ip::tcp::resolver::query q(host_, port_);
-        auto it = r.resolve(q);
-        as::ip::tcp::resolver::iterator end;
-#else  // BOOST_VERSION < 106600
-        auto eps = r.resolve(host_, port_);
-        auto it = eps.begin();
-        auto end = eps.end();
-#endif // BOOST_VERSION < 106600
+    void connect(std::unique_ptr<Socket>&& socket, session_handler_t const& func = session_handler_t()) {
         base::socket() = std::move(socket);
-        connect_impl(*base::socket(), it, end, func);
+        start_connect(func);
     }
 
     /**
@@ -449,7 +459,7 @@ public:
      */
     void async_disconnect(
         boost::posix_time::time_duration const& timeout,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         if (ping_duration_ms_ != 0) tim_ping_.cancel();
         if (base::connected()) {
             std::weak_ptr<this_type> wp(std::static_pointer_cast<this_type>(this->shared_from_this()));
@@ -463,7 +473,7 @@ public:
                     }
                 }
             );
-            base::async_disconnect(func);
+            base::async_disconnect(std::move(func));
         }
     }
 
@@ -475,10 +485,10 @@ public:
      * See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718090<BR>
      * @param func A callback function that is called when async operation will finish.
      */
-    void async_disconnect(async_handler_t const& func = async_handler_t()) {
+    void async_disconnect(async_handler_t func = async_handler_t()) {
         if (ping_duration_ms_ != 0) tim_ping_.cancel();
         if (base::connected()) {
-            base::async_disconnect(func);
+            base::async_disconnect(std::move(func));
         }
     }
 
@@ -538,11 +548,15 @@ protected:
         :ios_(ios),
          tim_ping_(ios_),
          tim_close_(ios_),
+         tim_connect_(ios_),
+         resolver_(ios_),
          host_(std::move(host)),
          port_(std::move(port)),
          tls_(tls),
          keep_alive_sec_(0),
-         ping_duration_ms_(0)
+         ping_duration_ms_(0),
+         connecting_(false),
+         connect_timed_out_(false)
 #if !defined(MQTT_NO_TLS)
          ,
          ctx_(as::ssl::context::tlsv12)
@@ -588,7 +602,7 @@ private:
     template <typename Strand>
     void handshake_socket(
         tcp_endpoint<as::ip::tcp::socket, Strand>&,
-        async_handler_t const& func) {
+        session_handler_t const& func) {
         base::async_read_control_packet_type(func);
         base::connect(keep_alive_sec_);
     }
@@ -597,7 +611,7 @@ private:
     template <typename Strand>
     void handshake_socket(
         ws_endpoint<as::ip::tcp::socket, Strand>& socket,
-        async_handler_t const& func) {
+        session_handler_t const& func) {
         auto self = this->shared_from_this();
         socket.async_handshake(
             host_,
@@ -616,7 +630,7 @@ private:
     template <typename Strand>
     void handshake_socket(
         tcp_endpoint<as::ssl::stream<as::ip::tcp::socket>, Strand>& socket,
-        async_handler_t const& func) {
+        session_handler_t const& func) {
         auto self = this->shared_from_this();
         socket.async_handshake(
             as::ssl::stream_base::client,
@@ -632,7 +646,7 @@ private:
     template <typename Strand>
     void handshake_socket(
         ws_endpoint<as::ssl::stream<as::ip::tcp::socket>, Strand>& socket,
-        async_handler_t const& func) {
+        session_handler_t const& func) {
         auto self = this->shared_from_this();
         socket.next_layer().async_handshake(
             as::ssl::stream_base::client,
@@ -654,13 +668,57 @@ private:
 
 #endif // defined(MQTT_NO_TLS)
 
+    void start_connect(session_handler_t const& func) {
+        set_connect_timer();
+        if (resolved_endpoints_) {
+            // Keep the endpoints until async_connect is finished.
+            auto eps = resolved_endpoints_;
+            connect_impl(*base::socket(), eps->begin(), eps->end(), eps, func);
+            return;
+        }
+        auto self = this->shared_from_this();
+#if BOOST_VERSION < 106600
+        as::ip::tcp::resolver::query q(host_, port_);
+        resolver_.async_resolve(
+            q,
+            [this, self, func]
+            (boost::system::error_code const& ec, as::ip::tcp::resolver::iterator it) mutable {
+                if (ec) {
+                    handle_connect_error(ec);
+                    return;
+                }
+                connect_impl(*base::socket(), it, as::ip::tcp::resolver::iterator(), nullptr, func);
+            }
+        );
+#else  // BOOST_VERSION < 106600
+        resolver_.async_resolve(
+            host_,
+            port_,
+            [this, self, func]
+            (boost::system::error_code const& ec, as::ip::tcp::resolver::results_type eps) mutable {
+                if (ec) {
+                    handle_connect_error(ec);
+                    return;
+                }
+                connect_impl(*base::socket(), eps.begin(), eps.end(), nullptr, func);
+            }
+        );
+#endif // BOOST_VERSION < 106600
+    }
+
     template <typename Iterator>
-    void connect_impl(Socket& socket, Iterator it, Iterator end, async_handler_t const& func = async_handler_t()) {
+    void connect_impl(
+        Socket& socket,
+        Iterator it,
+        Iterator end,
+        std::shared_ptr<resolved_endpoints_t const> eps,
+        session_handler_t const& func = session_handler_t()) {
         auto self = this->shared_from_this();
         as::async_connect(
             socket.lowest_layer(), it, end,
-            [this, self, &socket, func]
-            (boost::system::error_code const& ec, as::ip::tcp::resolver::iterator) mutable {
+            [this, self, &socket, eps, func]
+            (boost::system::error_code ec, Iterator) mutable {
+                cancel_connect_timer(ec);
                 base::set_close_handler([this](){ handle_close(); });
                 base::set_error_handler([this](boost::system::error_code const& ec){ handle_error(ec); });
                 if (!ec) {
@@ -682,6 +740,44 @@ private:
             });
     }
 
+    void handle_connect_error(boost::system::error_code ec) {
+        cancel_connect_timer(ec);
+        base::set_close_handler([this](){ handle_close(); });
+        base::set_error_handler([this](boost::system::error_code const& ec){ handle_error(ec); });
+        base::handle_close_or_error(ec);
+    }
+
+    void set_connect_timer() {
+        connecting_ = true;
+        connect_timed_out_ = false;
+        if (connect_timeout_ <= boost::posix_time::time_duration()) return;
+        tim_connect_.expires_from_now(connect_timeout_);
+        std::weak_ptr<this_type> wp(std::static_pointer_cast<this_type>(this->shared_from_this()));
+        tim_connect_.async_wait(
+            [wp](boost::system::error_code const& ec) {
+                if (auto sp = wp.lock()) {
+                    sp->handle_connect_timer(ec);
+                }
+            }
+        );
+    }
+
+    void handle_connect_timer(boost::system::error_code const& ec) {
+        if (ec || !connecting_) return;
+        // The pending resolve or connect is finished with operation_aborted.
+        connect_timed_out_ = true;
+        resolver_.cancel();
+        boost::system::error_code close_ec;
+        base::socket()->lowest_layer().close(close_ec);
+    }
+
+    // If the connect timer is expired, ec is replaced with timed_out.
+    void cancel_connect_timer(boost::system::error_code& ec) {
+        connecting_ = false;
+        if (connect_timeout_ > boost::posix_time::time_duration()) tim_connect_.cancel();
+        if (ec && connect_timed_out_) ec = as::error::timed_out;
+    }
+
     void handle_timer(boost::system::error_code const& ec) {
         if (!ec) {
             base::pingreq();
@@ -720,11 +816,17 @@ private:
     as::io_service& ios_;
     as::deadline_timer tim_ping_;
     as::deadline_timer tim_close_;
+    as::deadline_timer tim_connect_;
+    as::ip::tcp::resolver resolver_;
     std::string host_;
     std::string port_;
     bool tls_;
     std::uint16_t keep_alive_sec_;
     std::size_t ping_duration_ms_;
+    boost::posix_time::time_duration connect_timeout_;
+    std::shared_ptr<resolved_endpoints_t const> resolved_endpoints_;
+    bool connecting_;
+    bool connect_timed_out_;
 #if !defined(MQTT_NO_TLS)
     as::ssl::context ctx_;
 #endif // !defined(MQTT_NO_TLS)
@@ -10,23 +10,20 @@
 #include <string>
 #include <vector>
 #include <deque>
+#include <array>
 #include <functional>
-#include <set>
 #include <memory>
 #include <mutex>
 #include <atomic>
+#include <algorithm>
+#include <iterator>
+#include <tuple>
 
 #include <boost/any.hpp>
 #include <boost/optional.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/asio.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/sequenced_index.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/member.hpp>
-#include <boost/multi_index/mem_fun.hpp>
-#include <boost/multi_index/composite_key.hpp>
 #include <boost/system/error_code.hpp>
 #include <boost/assert.hpp>
 
@@ -44,11 +41,16 @@
 #include <mqtt/tcp_endpoint.hpp>
 #include <mqtt/unique_scope_guard.hpp>
 #include <mqtt/shared_scope_guard.hpp>
+#include <mqtt/move_only_function.hpp>
 #include <mqtt/message_variant.hpp>
 #include <mqtt/two_byte_util.hpp>
 #include <mqtt/four_byte_util.hpp>
 #include <mqtt/packet_id_type.hpp>
+#include <mqtt/packet_id_pool.hpp>
+#include <mqtt/multi_index_store.hpp>
+#include <mqtt/flat_store.hpp>
 #include <mqtt/optional.hpp>
+#include <mqtt/string_view.hpp>
 
 #if defined(MQTT_USE_WS)
 #include <mqtt/ws_endpoint.hpp>
@@ -57,15 +59,30 @@
 namespace mqtt {
 
 namespace as = boost::asio;
-namespace mi = boost::multi_index;
 
-template <typename Socket, typename Mutex = std::mutex, template<typename...> class LockGuard = std::lock_guard, std::size_t PacketIdBytes = 2>
-class endpoint : public std::enable_shared_from_this<endpoint<Socket, Mutex, LockGuard, PacketIdBytes>> {
-    using this_type = endpoint<Socket, Mutex, LockGuard, PacketIdBytes>;
+template <
+    typename Socket,
+    typename Mutex = std::mutex,
+    template<typename...> class LockGuard = std::lock_guard,
+    std::size_t PacketIdBytes = 2,
+    typename Alloc = std::allocator<char>,
+    template<typename...> class Store = multi_index_store
+>
+class endpoint : public std::enable_shared_from_this<endpoint<Socket, Mutex, LockGuard, PacketIdBytes, Alloc, Store>> {
+    using this_type = endpoint<Socket, Mutex, LockGuard, PacketIdBytes, Alloc, Store>;
+    // Alloc is used for the buffers and the send queue, not for the stored messages.
+    // It is default constructed where it is used, so it must be stateless.
+    template <typename T>
+    using rebind_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+    using buffer_t = std::vector<char, Alloc>;
 public:
-    using async_handler_t = std::function<void(boost::system::error_code const& ec)>;
+    // The completion handler of the async write is moved into the send queue, and called once.
+    using async_handler_t = move_only_function<void(boost::system::error_code const& ec)>;
+    // The finish handler of the session is passed to each read of the session.
+    using session_handler_t = std::function<void(boost::system::error_code const& ec)>;
     using life_keeper_t = std::function<void()>;
     using packet_id_t = typename packet_id_type<PacketIdBytes>::type;
+    using publish_fanout_t = basic_publish_fanout<PacketIdBytes>;
 
     /**
      * @brief Constructor for client
@@ -74,14 +91,21 @@ public:
         :connected_(false),
          mqtt_connected_(false),
          clean_session_(false),
-         packet_id_master_(0),
          auto_pub_response_(true),
          auto_pub_response_async_(false),
+         async_resend_(false),
          disconnect_requested_(false),
          connect_requested_(false),
+         read_buffer_size_(0),
+         read_buf_begin_(0),
+         read_buf_end_(0),
+         read_buf_parsing_(false),
+         read_buf_next_requested_(false),
+         max_queue_send_count_(1),
+         max_queue_send_size_(0),
          h_mqtt_message_processed_(
              [this]
-             (async_handler_t const& func) {
+             (session_handler_t const& func) {
                  async_read_control_packet_type(func);
              }
          )
@@ -96,14 +120,21 @@ public:
          connected_(true),
          mqtt_connected_(false),
          clean_session_(false),
-         packet_id_master_(0),
          auto_pub_response_(true),
          auto_pub_response_async_(false),
+         async_resend_(false),
          disconnect_requested_(false),
          connect_requested_(false),
+         read_buffer_size_(0),
+         read_buf_begin_(0),
+         read_buf_end_(0),
+         read_buf_parsing_(false),
+         read_buf_next_requested_(false),
+         max_queue_send_count_(1),
+         max_queue_send_size_(0),
          h_mqtt_message_processed_(
              [this]
-             (async_handler_t const& func) {
+             (session_handler_t const& func) {
                  async_read_control_packet_type(func);
              }
          )
@@ -207,6 +238,38 @@ public:
                                                std::string topic_name,
                                                std::string contents)>;
 
+    /**
+     * @brief Shared buffer that holds a received publish message
+     */
+    using shared_buffer = std::shared_ptr<buffer_t const>;
+
+    /**
+     * @brief Publish handler that receives the topic name and the contents without copy
+     * @param fixed_header
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1 Fixed header<BR>
+     *        You can check the fixed header using mqtt::publish functions.
+     * @param packet_id
+     *        packet identifier<BR>
+     *        If received publish's QoS is 0, packet_id is mqtt::nullopt.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718039<BR>
+     *        3.3.2  Variable header
+     * @param topic_name
+     *        Topic name. It refers to the inside of buffer.
+     * @param contents
+     *        Published contents. It refers to the inside of buffer.
+     * @param buffer
+     *        The buffer that holds the received message.<BR>
+     *        topic_name and contents are valid while the buffer is kept.
+     *        If the buffer is not kept after the handler returns, it is reused for the next message.
+     * @return if the handler returns true, then continue receiving, otherwise quit.
+     */
+    using publish_view_handler = std::function<bool(std::uint8_t fixed_header,
+                                                    mqtt::optional<packet_id_t> packet_id,
+                                                    mqtt::string_view topic_name,
+                                                    mqtt::string_view contents,
+                                                    shared_buffer buffer)>;
+
     /**
      * @brief Puback handler
      * @param packet_id
@@ -397,7 +460,7 @@ public:
      * @param func A callback function that is called when async operation will finish.
      */
     using mqtt_message_processed_handler =
-        std::function<void(async_handler_t const& func)>;
+        std::function<void(session_handler_t const& func)>;
 
     endpoint(this_type const&) = delete;
     endpoint(this_type&&) = delete;
@@ -499,6 +562,62 @@ public:
         auto_pub_response_async_ = async;
     }
 
+    /**
+     * @brief Set asynchronous resend mode.
+     * @param async resend the stored messages asynchronously
+     *
+     * When the client receives connack with clean_session false, the stored publish and pubrel
+     * messages are resent. By default they are written synchronously while the store is locked.<BR>
+     * When async is true, they are copied out of the store and queued with the async write
+     * functions, so they are coalesced with the other async writes. Set it if the endpoint is used
+     * with the async APIs. The messages are queued before the connack handler is called.
+     */
+    void set_async_resend(bool async = true) {
+        async_resend_ = async;
+    }
+
+    /**
+     * @brief Set receive buffer size.
+     * @param size receive buffer size in bytes. 0 means the receive buffer is not used.
+     *
+     * When size is not 0, the endpoint reads as many bytes as the socket has into the receive buffer,
+     * and then processes all complete mqtt messages in the buffer before the next read.<BR>
+     * If a message is larger than the data in the buffer, the rest of the message is read directly
+     * into the message payload. So the buffer size doesn't limit the message size.<BR>
+     * When size is 0 (default), the fixed header and the remaining length are read byte by byte.<BR>
+     * This function should be called before the session is started.
+     */
+    void set_read_buffer_size(std::size_t size) {
+        read_buffer_size_ = size == 0 || size >= min_read_buffer_size ? size : min_read_buffer_size;
+    }
+
+    /**
+     * @brief Set maximum number of queued messages sent at once.
+     * @param count maximum number of messages. 0 means no limit.
+     *
+     * The messages that are queued by async_* functions while the previous write is in progress
+     * are gathered and sent by one write.<BR>
+     * A large batch could be written by several system calls. Don't mix the synchronous functions,
+     * including the synchronous auto publish response, with the async functions, because their
+     * write could be placed between them.<BR>
+     * Each message's handler is called when the write is completed.<BR>
+     * The default value is 1. It means that each message is written one by one.
+     */
+    void set_max_queue_send_count(std::size_t count) {
+        max_queue_send_count_ = count;
+    }
+
+    /**
+     * @brief Set maximum total size of queued messages sent at once.
+     * @param size maximum size in bytes. 0 means no limit.
+     *
+     * The first message is always sent even if it is larger than size.<BR>
+     * The default value is 0.
+     */
+    void set_max_queue_send_size(std::size_t size) {
+        max_queue_send_size_ = size;
+    }
+
     /**
      * @brief Set close handler
      * @param h handler
@@ -537,6 +656,18 @@ public:
      */
     void set_publish_handler(publish_handler h = publish_handler()) {
         h_publish_ = std::move(h);
+        h_publish_view_ = publish_view_handler();
+    }
+
+    /**
+     * @brief Set publish handler that receives the topic name and the contents without copy
+     * @param h handler
+     *
+     * The handler replaces the handler that is set by set_publish_handler().
+     */
+    void set_publish_view_handler(publish_view_handler h = publish_view_handler()) {
+        h_publish_view_ = std::move(h);
+        h_publish_ = publish_handler();
     }
 
     /**
@@ -745,6 +876,14 @@ public:
         return h_publish_;
     }
 
+    /**
+     * @brief Get publish handler that receives the topic name and the contents without copy
+     * @return handler
+     */
+    publish_view_handler const& get_publish_view_handler() const {
+        return h_publish_view_;
+    }
+
     /**
      * @brief Get puback handler
      * @return handler
@@ -887,7 +1026,7 @@ public:
      * @param func finish handler that is called when the session is finished
      *
      */
-    void start_session(async_handler_t const& func = async_handler_t()) {
+    void start_session(session_handler_t const& func = session_handler_t()) {
         async_read_control_packet_type(func);
     }
 
@@ -929,6 +1068,42 @@ public:
         acquired_publish(0, topic_name, contents, [] {}, qos::at_most_once, retain);
     }
 
+    /**
+     * @brief Publish QoS0 to the prepared topic
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     */
+    void publish_at_most_once(
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        bool retain = false) {
+        acquired_publish(0, topic_name, contents, qos::at_most_once, retain);
+    }
+
+    /**
+     * @brief Publish QoS0 to the prepared topic
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     */
+    void publish_at_most_once(
+        prepared_topic const& topic_name,
+        as::const_buffer const& contents,
+        bool retain = false) {
+        acquired_publish(0, topic_name, contents, [] {}, qos::at_most_once, retain);
+    }
+
     /**
      * @brief Publish QoS1
      * @param topic_name
@@ -975,6 +1150,52 @@ public:
         return packet_id;
     }
 
+    /**
+     * @brief Publish QoS1 to the prepared topic
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @return packet_id
+     * packet_id is automatically generated.
+     */
+    packet_id_t publish_at_least_once(
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        bool retain = false) {
+        packet_id_t packet_id = acquire_unique_packet_id();
+        acquired_publish_at_least_once(packet_id, topic_name, contents, retain);
+        return packet_id;
+    }
+
+    /**
+     * @brief Publish QoS1 to the prepared topic
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping contents lifetime.
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @return packet_id
+     * packet_id is automatically generated.
+     */
+    packet_id_t publish_at_least_once(
+        prepared_topic const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false) {
+        packet_id_t packet_id = acquire_unique_packet_id();
+        acquired_publish_at_least_once(packet_id, topic_name, contents, life_keeper, retain);
+        return packet_id;
+    }
+
     /**
      * @brief Publish QoS2
      * @param topic_name
@@ -1021,6 +1242,52 @@ public:
         return packet_id;
     }
 
+    /**
+     * @brief Publish QoS2 to the prepared topic
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @return packet_id
+     * packet_id is automatically generated.
+     */
+    packet_id_t publish_exactly_once(
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        bool retain = false) {
+        packet_id_t packet_id = acquire_unique_packet_id();
+        acquired_publish_exactly_once(packet_id, topic_name, contents, retain);
+        return packet_id;
+    }
+
+    /**
+     * @brief Publish QoS2 to the prepared topic
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping contents lifetime.
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @return packet_id
+     * packet_id is automatically generated.
+     */
+    packet_id_t publish_exactly_once(
+        prepared_topic const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false) {
+        packet_id_t packet_id = acquire_unique_packet_id();
+        acquired_publish_exactly_once(packet_id, topic_name, contents, life_keeper, retain);
+        return packet_id;
+    }
+
     /**
      * @brief Publish
      * @param topic_name
@@ -1075,6 +1342,115 @@ public:
         return packet_id;
     }
 
+    /**
+     * @brief Publish the message that is shared with other endpoints
+     *        The topic name, contents, and retain flag are taken from fanout.
+     *        fanout is kept until the message is no longer needed.
+     * @param fanout
+     *        The shared parts of the message. See basic_publish_fanout.
+     * @param qos
+     *        mqtt::qos
+     * @return packet_id. If qos is set to at_most_once, return 0.
+     * packet_id is automatically generated.
+     */
+    packet_id_t publish(
+        std::shared_ptr<publish_fanout_t const> const& fanout,
+        std::uint8_t qos = qos::at_most_once) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        packet_id_t packet_id = qos == qos::at_most_once ? 0 : acquire_unique_packet_id();
+        acquired_publish(packet_id, fanout, qos);
+        return packet_id;
+    }
+
+    /**
+     * @brief Prepare the topic name for repeated publishing
+     *        The topic name is checked and its length is encoded only once here.
+     * @param topic_name
+     *        A topic name to publish
+     * @return prepared_topic that can be passed to the publish functions instead of topic_name
+     */
+    prepared_topic prepare_topic(std::string topic_name) const {
+        return prepared_topic(std::move(topic_name));
+    }
+
+    /**
+     * @brief Publish to the prepared topic
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param qos
+     *        mqtt::qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @return packet_id. If qos is set to at_most_once, return 0.
+     * packet_id is automatically generated.
+     */
+    packet_id_t publish(
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        std::uint8_t qos = qos::at_most_once,
+        bool retain = false) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        packet_id_t packet_id = qos == qos::at_most_once ? 0 : acquire_unique_packet_id();
+        acquired_publish(packet_id, topic_name, contents, qos, retain);
+        return packet_id;
+    }
+
+    /**
+     * @brief Publish to the prepared topic
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping contents lifetime.
+     * @param qos
+     *        mqtt::qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @return packet_id. If qos is set to at_most_once, return 0.
+     * packet_id is automatically generated.
+     */
+    packet_id_t publish(
+        prepared_topic const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        std::uint8_t qos = qos::at_most_once,
+        bool retain = false) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        packet_id_t packet_id = qos == qos::at_most_once ? 0 : acquire_unique_packet_id();
+        acquired_publish(packet_id, topic_name, contents, life_keeper, qos, retain);
+        return packet_id;
+    }
+
+    /**
+     * @brief Publish many messages at once
+     *        The packet ids are acquired and the messages are stored under one lock,
+     *        and all messages are written by one write.
+     * @param entries
+     *        The range of std::tuple<std::string, std::string, std::uint8_t>.<BR>
+     *        Each entry is the topic name, the contents, and the qos of a message.
+     * @return packet_ids of the messages. If the qos of the message is at_most_once, it is 0.
+     * packet_ids are automatically generated.
+     */
+    template <typename Range>
+    std::vector<packet_id_t> publish_batch(Range const& entries) {
+        std::vector<basic_publish_message<PacketIdBytes>> msgs;
+        std::vector<packet_id_t> packet_ids;
+        auto sp = store_publish_batch(entries, msgs, packet_ids);
+        std::vector<as::const_buffer> buf;
+        for (auto const& msg : msgs) {
+            auto cbs = msg.const_buffer_sequence();
+            buf.insert(buf.end(), cbs.begin(), cbs.end());
+        }
+        do_sync_write_buffers(buf);
+        return packet_ids;
+    }
+
     /**
      * @brief Subscribe
      * @param topic_name
@@ -1310,11 +1686,11 @@ public:
     }
 
     /**
-     * @brief Publish QoS2 with a manual set packet identifier
+     * @brief Publish QoS1 to the prepared topic with a manual set packet identifier
      * @param packet_id
      *        packet identifier
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name that is prepared by prepare_topic()
      * @param contents
      *        The contents to publish
      * @param retain
@@ -1324,27 +1700,27 @@ public:
      * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
      *         contents doesn't publish, otherwise return true and contents publish.
      */
-    bool publish_exactly_once(
+    bool publish_at_least_once(
         packet_id_t packet_id,
-        std::string const& topic_name,
+        prepared_topic const& topic_name,
         std::string const& contents,
         bool retain = false) {
         if (register_packet_id(packet_id)) {
-            acquired_publish_exactly_once(packet_id, topic_name, contents, retain);
+            acquired_publish_at_least_once(packet_id, topic_name, contents, retain);
             return true;
         }
         return false;
     }
 
     /**
-     * @brief Publish QoS2 with a manual set packet identifier
+     * @brief Publish QoS1 to the prepared topic with a manual set packet identifier
      * @param packet_id
      *        packet identifier
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name that is prepared by prepare_topic()
      * @param contents
      *        The contents to publish
-     * @param life_keeper the function that is keeping topic_name and contents lifetime.
+     * @param life_keeper the function that is keeping contents lifetime.
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
@@ -1352,52 +1728,164 @@ public:
      * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
      *         contents doesn't publish, otherwise return true and contents publish.
      */
-    bool publish_exactly_once(
+    bool publish_at_least_once(
         packet_id_t packet_id,
-        as::const_buffer const& topic_name,
+        prepared_topic const& topic_name,
         as::const_buffer const& contents,
         life_keeper_t const& life_keeper,
         bool retain = false) {
         if (register_packet_id(packet_id)) {
-            acquired_publish_exactly_once(packet_id, topic_name, contents, life_keeper, retain);
+            acquired_publish_at_least_once(packet_id, topic_name, contents, life_keeper, retain);
             return true;
         }
         return false;
     }
 
     /**
-     * @brief Publish with a manual set packet identifier
+     * @brief Publish QoS2 with a manual set packet identifier
      * @param packet_id
      *        packet identifier
      * @param topic_name
      *        A topic name to publish
      * @param contents
      *        The contents to publish
-     * @param qos
-     *        mqtt::qos
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
      *        3.3.1.3 RETAIN
      * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
-     *         contents don't publish, otherwise return true and contents publish.
+     *         contents doesn't publish, otherwise return true and contents publish.
      */
-    bool publish(
+    bool publish_exactly_once(
         packet_id_t packet_id,
         std::string const& topic_name,
         std::string const& contents,
-        std::uint8_t qos = qos::at_most_once,
         bool retain = false) {
-        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         if (register_packet_id(packet_id)) {
-            acquired_publish(packet_id, topic_name, contents, qos, retain);
+            acquired_publish_exactly_once(packet_id, topic_name, contents, retain);
             return true;
         }
         return false;
     }
 
     /**
-     * @brief Publish with a manual set packet identifier
+     * @brief Publish QoS2 with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier
+     * @param topic_name
+     *        A topic name to publish
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping topic_name and contents lifetime.
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
+     *         contents doesn't publish, otherwise return true and contents publish.
+     */
+    bool publish_exactly_once(
+        packet_id_t packet_id,
+        as::const_buffer const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false) {
+        if (register_packet_id(packet_id)) {
+            acquired_publish_exactly_once(packet_id, topic_name, contents, life_keeper, retain);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Publish QoS2 to the prepared topic with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
+     *         contents doesn't publish, otherwise return true and contents publish.
+     */
+    bool publish_exactly_once(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        bool retain = false) {
+        if (register_packet_id(packet_id)) {
+            acquired_publish_exactly_once(packet_id, topic_name, contents, retain);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Publish QoS2 to the prepared topic with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping contents lifetime.
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
+     *         contents doesn't publish, otherwise return true and contents publish.
+     */
+    bool publish_exactly_once(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false) {
+        if (register_packet_id(packet_id)) {
+            acquired_publish_exactly_once(packet_id, topic_name, contents, life_keeper, retain);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Publish with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier
+     * @param topic_name
+     *        A topic name to publish
+     * @param contents
+     *        The contents to publish
+     * @param qos
+     *        mqtt::qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
+     *         contents don't publish, otherwise return true and contents publish.
+     */
+    bool publish(
+        packet_id_t packet_id,
+        std::string const& topic_name,
+        std::string const& contents,
+        std::uint8_t qos = qos::at_most_once,
+        bool retain = false) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        if (register_packet_id(packet_id)) {
+            acquired_publish(packet_id, topic_name, contents, qos, retain);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Publish with a manual set packet identifier
      * @param packet_id
      *        packet identifier
      * @param topic_name
@@ -1429,6 +1917,70 @@ public:
         return false;
     }
 
+    /**
+     * @brief Publish to the prepared topic with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param qos
+     *        mqtt::qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
+     *         contents don't publish, otherwise return true and contents publish.
+     */
+    bool publish(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        std::uint8_t qos = qos::at_most_once,
+        bool retain = false) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        if (register_packet_id(packet_id)) {
+            acquired_publish(packet_id, topic_name, contents, qos, retain);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Publish to the prepared topic with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping contents lifetime.
+     * @param qos
+     *        mqtt::qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
+     *         contents don't publish, otherwise return true and contents publish.
+     */
+    bool publish(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        std::uint8_t qos = qos::at_most_once,
+        bool retain = false) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        if (register_packet_id(packet_id)) {
+            acquired_publish(packet_id, topic_name, contents, life_keeper, qos, retain);
+            return true;
+        }
+        return false;
+    }
+
     /**
      * @brief Publish as dup with a manual set packet identifier
      * @param packet_id
@@ -1493,6 +2045,70 @@ public:
         return false;
     }
 
+    /**
+     * @brief Publish as dup to the prepared topic with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param qos
+     *        mqtt::qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
+     *         contents don't publish, otherwise return true and contents publish.
+     */
+    bool publish_dup(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        std::uint8_t qos = qos::at_most_once,
+        bool retain = false) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        if (register_packet_id(packet_id)) {
+            acquired_publish_dup(packet_id, topic_name, contents, qos, retain);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Publish as dup to the prepared topic with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping contents lifetime.
+     * @param qos
+     *        mqtt::qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
+     *         contents don't publish, otherwise return true and contents publish.
+     */
+    bool publish_dup(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        std::uint8_t qos = qos::at_most_once,
+        bool retain = false) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        if (register_packet_id(packet_id)) {
+            acquired_publish_dup(packet_id, topic_name, contents, life_keeper, qos, retain);
+            return true;
+        }
+        return false;
+    }
+
     /**
      * @brief Subscribe with a manual set packet identifier
      * @param packet_id
@@ -1686,64 +2302,298 @@ public:
     // packet_id has already been acquired version
 
     /**
-     * @brief Publish QoS1 with already acquired packet identifier
+     * @brief Publish QoS1 with already acquired packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     * @param topic_name
+     *        A topic name to publish
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     */
+    void acquired_publish_at_least_once(
+        packet_id_t packet_id,
+        std::string const& topic_name,
+        std::string const& contents,
+        bool retain = false) {
+
+        auto sp = make_publish_buffer(topic_name, contents);
+
+        send_publish(
+            as::buffer(sp->data(), topic_name.size()),
+            qos::at_least_once,
+            retain,
+            false,
+            packet_id,
+            as::buffer(sp->data() + topic_name.size(), contents.size()),
+            [sp] {}
+        );
+    }
+
+    /**
+     * @brief Publish QoS1 with already acquired packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     * @param topic_name
+     *        A topic name to publish
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping topic_name and contents lifetime.
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     */
+    void acquired_publish_at_least_once(
+        packet_id_t packet_id,
+        as::const_buffer const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false) {
+
+        send_publish(
+            topic_name,
+            qos::at_least_once,
+            retain,
+            false,
+            packet_id,
+            contents,
+            life_keeper
+        );
+    }
+
+    /**
+     * @brief Publish QoS1 to the prepared topic with already acquired packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     */
+    void acquired_publish_at_least_once(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        bool retain = false) {
+        acquired_publish(packet_id, topic_name, contents, qos::at_least_once, retain);
+    }
+
+    /**
+     * @brief Publish QoS1 to the prepared topic with already acquired packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping contents lifetime.
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     */
+    void acquired_publish_at_least_once(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false) {
+        acquired_publish(packet_id, topic_name, contents, life_keeper, qos::at_least_once, retain);
+    }
+
+    /**
+     * @brief Publish QoS2 with already acquired packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     * @param topic_name
+     *        A topic name to publish
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     */
+    void acquired_publish_exactly_once(
+        packet_id_t packet_id,
+        std::string const& topic_name,
+        std::string const& contents,
+        bool retain = false) {
+
+        auto sp = make_publish_buffer(topic_name, contents);
+
+        send_publish(
+            as::buffer(sp->data(), topic_name.size()),
+            qos::exactly_once,
+            retain,
+            false,
+            packet_id,
+            as::buffer(sp->data() + topic_name.size(), contents.size()),
+            [sp] {}
+        );
+    }
+
+    /**
+     * @brief Publish QoS2 with already acquired packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     * @param topic_name
+     *        A topic name to publish
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping topic_name and contents lifetime.
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     */
+    void acquired_publish_exactly_once(
+        packet_id_t packet_id,
+        as::const_buffer const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false) {
+
+        send_publish(
+            topic_name,
+            qos::exactly_once,
+            retain,
+            false,
+            packet_id,
+            contents,
+            life_keeper
+        );
+    }
+
+    /**
+     * @brief Publish QoS2 to the prepared topic with already acquired packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     */
+    void acquired_publish_exactly_once(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        bool retain = false) {
+        acquired_publish(packet_id, topic_name, contents, qos::exactly_once, retain);
+    }
+
+    /**
+     * @brief Publish QoS2 to the prepared topic with already acquired packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping contents lifetime.
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     */
+    void acquired_publish_exactly_once(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false) {
+        acquired_publish(packet_id, topic_name, contents, life_keeper, qos::exactly_once, retain);
+    }
+
+    /**
+     * @brief Publish with already acquired packet identifier
      * @param packet_id
      *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
      *        The ownership of  the packet_id moves to the library.
+     *        If qos == qos::at_most_once, packet_id must be 0. But not checked in release mode due to performance.
      * @param topic_name
      *        A topic name to publish
      * @param contents
      *        The contents to publish
+     * @param qos
+     *        mqtt::qos
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
      *        3.3.1.3 RETAIN
      */
-    void acquired_publish_at_least_once(
+    void acquired_publish(
         packet_id_t packet_id,
         std::string const& topic_name,
         std::string const& contents,
+        std::uint8_t qos = qos::at_most_once,
         bool retain = false) {
-
-        auto sp_topic_name = std::make_shared<std::string>(topic_name);
-        auto sp_contents = std::make_shared<std::string>(contents);
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        BOOST_ASSERT((qos == qos::at_most_once && packet_id == 0) || (qos != qos::at_most_once && packet_id != 0));
+        auto sp = make_publish_buffer(topic_name, contents);
 
         send_publish(
-            as::buffer(*sp_topic_name),
-            qos::at_least_once,
+            as::buffer(sp->data(), topic_name.size()),
+            qos,
             retain,
             false,
             packet_id,
-            as::buffer(*sp_contents),
-            [sp_topic_name, sp_contents] {}
+            as::buffer(sp->data() + topic_name.size(), contents.size()),
+            [sp] {}
         );
     }
 
     /**
-     * @brief Publish QoS1 with already acquired packet identifier
+     * @brief Publish with already acquired packet identifier
      * @param packet_id
      *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
      *        The ownership of  the packet_id moves to the library.
+     *        If qos == qos::at_most_once, packet_id must be 0. But not checked in release mode due to performance.
      * @param topic_name
      *        A topic name to publish
      * @param contents
      *        The contents to publish
      * @param life_keeper the function that is keeping topic_name and contents lifetime.
+     * @param qos
+     *        mqtt::qos
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
      *        3.3.1.3 RETAIN
      */
-    void acquired_publish_at_least_once(
+    void acquired_publish(
         packet_id_t packet_id,
         as::const_buffer const& topic_name,
         as::const_buffer const& contents,
         life_keeper_t const& life_keeper,
+        std::uint8_t qos = qos::at_most_once,
         bool retain = false) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        BOOST_ASSERT((qos == qos::at_most_once && packet_id == 0) || (qos != qos::at_most_once && packet_id != 0));
 
         send_publish(
             topic_name,
-            qos::at_least_once,
+            qos,
             retain,
             false,
             packet_id,
@@ -1753,74 +2603,107 @@ public:
     }
 
     /**
-     * @brief Publish QoS2 with already acquired packet identifier
+     * @brief Publish the message that is shared with other endpoints with already acquired packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     *        If qos == qos::at_most_once, packet_id must be 0. But not checked in release mode due to performance.
+     * @param fanout
+     *        The shared parts of the message. See basic_publish_fanout.
+     * @param qos
+     *        mqtt::qos
+     */
+    void acquired_publish(
+        packet_id_t packet_id,
+        std::shared_ptr<publish_fanout_t const> const& fanout,
+        std::uint8_t qos = qos::at_most_once) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        BOOST_ASSERT((qos == qos::at_most_once && packet_id == 0) || (qos != qos::at_most_once && packet_id != 0));
+
+        send_publish(fanout, qos, packet_id);
+    }
+
+    /**
+     * @brief Publish to the prepared topic with already acquired packet identifier
      * @param packet_id
      *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
      *        The ownership of  the packet_id moves to the library.
+     *        If qos == qos::at_most_once, packet_id must be 0. But not checked in release mode due to performance.
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name that is prepared by prepare_topic()
      * @param contents
      *        The contents to publish
+     * @param qos
+     *        mqtt::qos
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
      *        3.3.1.3 RETAIN
      */
-    void acquired_publish_exactly_once(
+    void acquired_publish(
         packet_id_t packet_id,
-        std::string const& topic_name,
+        prepared_topic const& topic_name,
         std::string const& contents,
+        std::uint8_t qos = qos::at_most_once,
         bool retain = false) {
-
-        auto sp_topic_name = std::make_shared<std::string>(topic_name);
-        auto sp_contents = std::make_shared<std::string>(contents);
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        BOOST_ASSERT((qos == qos::at_most_once && packet_id == 0) || (qos != qos::at_most_once && packet_id != 0));
+        auto sp = make_publish_buffer(contents);
 
         send_publish(
-            as::buffer(*sp_topic_name),
-            qos::exactly_once,
+            topic_name,
+            qos,
             retain,
             false,
             packet_id,
-            as::buffer(*sp_contents),
-            [sp_topic_name, sp_contents] {}
+            as::buffer(sp->data(), sp->size()),
+            [sp, topic_name] {}
         );
     }
 
     /**
-     * @brief Publish QoS2 with already acquired packet identifier
+     * @brief Publish to the prepared topic with already acquired packet identifier
      * @param packet_id
      *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
      *        The ownership of  the packet_id moves to the library.
+     *        If qos == qos::at_most_once, packet_id must be 0. But not checked in release mode due to performance.
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name that is prepared by prepare_topic()
      * @param contents
      *        The contents to publish
-     * @param life_keeper the function that is keeping topic_name and contents lifetime.
+     * @param life_keeper the function that is keeping contents lifetime.
+     * @param qos
+     *        mqtt::qos
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
      *        3.3.1.3 RETAIN
      */
-    void acquired_publish_exactly_once(
+    void acquired_publish(
         packet_id_t packet_id,
-        as::const_buffer const& topic_name,
+        prepared_topic const& topic_name,
         as::const_buffer const& contents,
         life_keeper_t const& life_keeper,
+        std::uint8_t qos = qos::at_most_once,
         bool retain = false) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        BOOST_ASSERT((qos == qos::at_most_once && packet_id == 0) || (qos != qos::at_most_once && packet_id != 0));
 
         send_publish(
             topic_name,
-            qos::exactly_once,
+            qos,
             retain,
             false,
             packet_id,
             contents,
-            life_keeper
+            [topic_name, life_keeper] {
+                if (life_keeper) life_keeper();
+            }
         );
     }
 
     /**
-     * @brief Publish with already acquired packet identifier
+     * @brief Publish as dup with already acquired packet identifier
      * @param packet_id
      *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
      *        The ownership of  the packet_id moves to the library.
@@ -1836,7 +2719,7 @@ public:
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
      *        3.3.1.3 RETAIN
      */
-    void acquired_publish(
+    void acquired_publish_dup(
         packet_id_t packet_id,
         std::string const& topic_name,
         std::string const& contents,
@@ -1844,22 +2727,22 @@ public:
         bool retain = false) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         BOOST_ASSERT((qos == qos::at_most_once && packet_id == 0) || (qos != qos::at_most_once && packet_id != 0));
-        auto sp_topic_name = std::make_shared<std::string>(topic_name);
-        auto sp_contents = std::make_shared<std::string>(contents);
+
+        auto sp = make_publish_buffer(topic_name, contents);
 
         send_publish(
-            as::buffer(*sp_topic_name),
+            as::buffer(sp->data(), topic_name.size()),
             qos,
             retain,
-            false,
+            true,
             packet_id,
-            as::buffer(*sp_contents),
-            [sp_topic_name, sp_contents] {}
+            as::buffer(sp->data() + topic_name.size(), contents.size()),
+            [sp] {}
         );
     }
 
     /**
-     * @brief Publish with already acquired packet identifier
+     * @brief Publish as dup with already acquired packet identifier
      * @param packet_id
      *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
      *        The ownership of  the packet_id moves to the library.
@@ -1876,7 +2759,7 @@ public:
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
      *        3.3.1.3 RETAIN
      */
-    void acquired_publish(
+    void acquired_publish_dup(
         packet_id_t packet_id,
         as::const_buffer const& topic_name,
         as::const_buffer const& contents,
@@ -1890,7 +2773,7 @@ public:
             topic_name,
             qos,
             retain,
-            false,
+            true,
             packet_id,
             contents,
             life_keeper
@@ -1898,13 +2781,13 @@ public:
     }
 
     /**
-     * @brief Publish as dup with already acquired packet identifier
+     * @brief Publish as dup to the prepared topic with already acquired packet identifier
      * @param packet_id
      *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
      *        The ownership of  the packet_id moves to the library.
      *        If qos == qos::at_most_once, packet_id must be 0. But not checked in release mode due to performance.
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name that is prepared by prepare_topic()
      * @param contents
      *        The contents to publish
      * @param qos
@@ -1916,38 +2799,36 @@ public:
      */
     void acquired_publish_dup(
         packet_id_t packet_id,
-        std::string const& topic_name,
+        prepared_topic const& topic_name,
         std::string const& contents,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         BOOST_ASSERT((qos == qos::at_most_once && packet_id == 0) || (qos != qos::at_most_once && packet_id != 0));
-
-        auto sp_topic_name = std::make_shared<std::string>(topic_name);
-        auto sp_contents = std::make_shared<std::string>(contents);
+        auto sp = make_publish_buffer(contents);
 
         send_publish(
-            as::buffer(*sp_topic_name),
+            topic_name,
             qos,
             retain,
             true,
             packet_id,
-            as::buffer(*sp_contents),
-            [sp_topic_name, sp_contents] {}
+            as::buffer(sp->data(), sp->size()),
+            [sp, topic_name] {}
         );
     }
 
     /**
-     * @brief Publish as dup with already acquired packet identifier
+     * @brief Publish as dup to the prepared topic with already acquired packet identifier
      * @param packet_id
      *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
      *        The ownership of  the packet_id moves to the library.
      *        If qos == qos::at_most_once, packet_id must be 0. But not checked in release mode due to performance.
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name that is prepared by prepare_topic()
      * @param contents
      *        The contents to publish
-     * @param life_keeper the function that is keeping topic_name and contents lifetime.
+     * @param life_keeper the function that is keeping contents lifetime.
      * @param qos
      *        mqtt::qos
      * @param retain
@@ -1957,7 +2838,7 @@ public:
      */
     void acquired_publish_dup(
         packet_id_t packet_id,
-        as::const_buffer const& topic_name,
+        prepared_topic const& topic_name,
         as::const_buffer const& contents,
         life_keeper_t const& life_keeper,
         std::uint8_t qos = qos::at_most_once,
@@ -1972,7 +2853,9 @@ public:
             true,
             packet_id,
             contents,
-            life_keeper
+            [topic_name, life_keeper] {
+                if (life_keeper) life_keeper();
+            }
         );
     }
 
@@ -2272,8 +3155,8 @@ public:
         std::string const& topic_name,
         std::string const& contents,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
-        acquired_async_publish(0, topic_name, contents, qos::at_most_once, retain, func);
+        async_handler_t func = async_handler_t()) {
+        acquired_async_publish(0, topic_name, contents, qos::at_most_once, retain, std::move(func));
     }
 
     /**
@@ -2294,8 +3177,50 @@ public:
         as::const_buffer const& topic_name,
         as::const_buffer const& contents,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
-        acquired_async_publish(0, topic_name, contents, [] {}, qos::at_most_once, retain, func);
+        async_handler_t func = async_handler_t()) {
+        acquired_async_publish(0, topic_name, contents, [] {}, qos::at_most_once, retain, std::move(func));
+    }
+
+    /**
+     * @brief Publish QoS0 to the prepared topic
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     */
+    void async_publish_at_most_once(
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        acquired_async_publish(0, topic_name, contents, qos::at_most_once, retain, std::move(func));
+    }
+
+    /**
+     * @brief Publish QoS0 to the prepared topic
+     *        topic_name and contents are reference type. So caller need to keep the lifetime of them
+     *        until func is called.
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     */
+    void async_publish_at_most_once(
+        prepared_topic const& topic_name,
+        as::const_buffer const& contents,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        acquired_async_publish(0, topic_name, contents, [] {}, qos::at_most_once, retain, std::move(func));
     }
 
     /**
@@ -2316,9 +3241,9 @@ public:
         std::string const& topic_name,
         std::string const& contents,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         packet_id_t packet_id = acquire_unique_packet_id();
-        acquired_async_publish_at_least_once(packet_id, topic_name, contents, retain, func);
+        acquired_async_publish_at_least_once(packet_id, topic_name, contents, retain, std::move(func));
         return packet_id;
     }
 
@@ -2342,9 +3267,59 @@ public:
         as::const_buffer const& contents,
         life_keeper_t const& life_keeper,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
+        packet_id_t packet_id = acquire_unique_packet_id();
+        acquired_async_publish_at_least_once(packet_id, topic_name, contents, life_keeper, retain, std::move(func));
+        return packet_id;
+    }
+
+    /**
+     * @brief Publish QoS1 to the prepared topic
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     * @return packet_id
+     * packet_id is automatically generated.
+     */
+    packet_id_t async_publish_at_least_once(
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        packet_id_t packet_id = acquire_unique_packet_id();
+        acquired_async_publish_at_least_once(packet_id, topic_name, contents, retain, std::move(func));
+        return packet_id;
+    }
+
+    /**
+     * @brief Publish QoS1 to the prepared topic
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping contents lifetime.
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     * @return packet_id
+     * packet_id is automatically generated.
+     */
+    packet_id_t async_publish_at_least_once(
+        prepared_topic const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
         packet_id_t packet_id = acquire_unique_packet_id();
-        acquired_async_publish_at_least_once(packet_id, topic_name, contents, life_keeper, retain, func);
+        acquired_async_publish_at_least_once(packet_id, topic_name, contents, life_keeper, retain, std::move(func));
         return packet_id;
     }
 
@@ -2366,42 +3341,172 @@ public:
         std::string const& topic_name,
         std::string const& contents,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
+        packet_id_t packet_id = acquire_unique_packet_id();
+        acquired_async_publish_exactly_once(packet_id, topic_name, contents, retain, std::move(func));
+        return packet_id;
+    }
+
+    /**
+     * @brief Publish QoS2
+     * @param topic_name
+     *        A topic name to publish
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping topic_name and contents lifetime.
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     * @return packet_id
+     * packet_id is automatically generated.
+     */
+    packet_id_t async_publish_exactly_once(
+        as::const_buffer const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        packet_id_t packet_id = acquire_unique_packet_id();
+        acquired_async_publish_exactly_once(packet_id, topic_name, contents, life_keeper, retain, std::move(func));
+        return packet_id;
+    }
+
+    /**
+     * @brief Publish QoS2 to the prepared topic
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     * @return packet_id
+     * packet_id is automatically generated.
+     */
+    packet_id_t async_publish_exactly_once(
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        packet_id_t packet_id = acquire_unique_packet_id();
+        acquired_async_publish_exactly_once(packet_id, topic_name, contents, retain, std::move(func));
+        return packet_id;
+    }
+
+    /**
+     * @brief Publish QoS2 to the prepared topic
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping contents lifetime.
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     * @return packet_id
+     * packet_id is automatically generated.
+     */
+    packet_id_t async_publish_exactly_once(
+        prepared_topic const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
         packet_id_t packet_id = acquire_unique_packet_id();
-        acquired_async_publish_exactly_once(packet_id, topic_name, contents, retain, func);
+        acquired_async_publish_exactly_once(packet_id, topic_name, contents, life_keeper, retain, std::move(func));
+        return packet_id;
+    }
+
+    /**
+     * @brief Publish
+     * @param topic_name
+     *        A topic name to publish
+     * @param contents
+     *        The contents to publish
+     * @param qos
+     *        mqtt::qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     * @return packet_id. If qos is set to at_most_once, return 0.
+     * packet_id is automatically generated.
+     */
+    packet_id_t async_publish(
+        std::string const& topic_name,
+        std::string const& contents,
+        std::uint8_t qos = qos::at_most_once,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        packet_id_t packet_id = qos == qos::at_most_once ? 0 : acquire_unique_packet_id();
+        acquired_async_publish(packet_id, topic_name, contents, qos, retain, std::move(func));
         return packet_id;
     }
 
     /**
-     * @brief Publish QoS2
+     * @brief Publish
      * @param topic_name
      *        A topic name to publish
      * @param contents
      *        The contents to publish
      * @param life_keeper the function that is keeping topic_name and contents lifetime.
+     * @param qos
+     *        mqtt::qos
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
      *        3.3.1.3 RETAIN
      * @param func A callback function that is called when async operation will finish.
-     * @return packet_id
+     * @return packet_id. If qos is set to at_most_once, return 0.
      * packet_id is automatically generated.
      */
-    packet_id_t async_publish_exactly_once(
+    packet_id_t async_publish(
         as::const_buffer const& topic_name,
         as::const_buffer const& contents,
         life_keeper_t const& life_keeper,
+        std::uint8_t qos = qos::at_most_once,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
-        packet_id_t packet_id = acquire_unique_packet_id();
-        acquired_async_publish_exactly_once(packet_id, topic_name, contents, life_keeper, retain, func);
+        async_handler_t func = async_handler_t()) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        packet_id_t packet_id = qos == qos::at_most_once ? 0 : acquire_unique_packet_id();
+        acquired_async_publish(packet_id, topic_name, contents, life_keeper, qos, retain, std::move(func));
         return packet_id;
     }
 
     /**
-     * @brief Publish
+     * @brief Publish the message that is shared with other endpoints
+     *        The topic name, contents, and retain flag are taken from fanout.
+     *        fanout is kept until the message is no longer needed.
+     * @param fanout
+     *        The shared parts of the message. See basic_publish_fanout.
+     * @param qos
+     *        mqtt::qos
+     * @param func A callback function that is called when async operation will finish.
+     * @return packet_id. If qos is set to at_most_once, return 0.
+     * packet_id is automatically generated.
+     */
+    packet_id_t async_publish(
+        std::shared_ptr<publish_fanout_t const> const& fanout,
+        std::uint8_t qos = qos::at_most_once,
+        async_handler_t func = async_handler_t()) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        packet_id_t packet_id = qos == qos::at_most_once ? 0 : acquire_unique_packet_id();
+        acquired_async_publish(packet_id, fanout, qos, std::move(func));
+        return packet_id;
+    }
+
+    /**
+     * @brief Publish to the prepared topic
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name that is prepared by prepare_topic()
      * @param contents
      *        The contents to publish
      * @param qos
@@ -2415,24 +3520,24 @@ public:
      * packet_id is automatically generated.
      */
     packet_id_t async_publish(
-        std::string const& topic_name,
+        prepared_topic const& topic_name,
         std::string const& contents,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         packet_id_t packet_id = qos == qos::at_most_once ? 0 : acquire_unique_packet_id();
-        acquired_async_publish(packet_id, topic_name, contents, qos, retain, func);
+        acquired_async_publish(packet_id, topic_name, contents, qos, retain, std::move(func));
         return packet_id;
     }
 
     /**
-     * @brief Publish
+     * @brief Publish to the prepared topic
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name that is prepared by prepare_topic()
      * @param contents
      *        The contents to publish
-     * @param life_keeper the function that is keeping topic_name and contents lifetime.
+     * @param life_keeper the function that is keeping contents lifetime.
      * @param qos
      *        mqtt::qos
      * @param retain
@@ -2444,18 +3549,44 @@ public:
      * packet_id is automatically generated.
      */
     packet_id_t async_publish(
-        as::const_buffer const& topic_name,
+        prepared_topic const& topic_name,
         as::const_buffer const& contents,
         life_keeper_t const& life_keeper,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         packet_id_t packet_id = qos == qos::at_most_once ? 0 : acquire_unique_packet_id();
-        acquired_async_publish(packet_id, topic_name, contents, life_keeper, qos, retain, func);
+        acquired_async_publish(packet_id, topic_name, contents, life_keeper, qos, retain, std::move(func));
         return packet_id;
     }
 
+    /**
+     * @brief Publish many messages at once
+     *        The packet ids are acquired and the messages are stored under one lock,
+     *        and all messages are queued at once to be written together.
+     * @param entries
+     *        The range of std::tuple<std::string, std::string, std::uint8_t>.<BR>
+     *        Each entry is the topic name, the contents, and the qos of a message.
+     * @param func A callback function that is called when all messages are written.
+     * @return packet_ids of the messages. If the qos of the message is at_most_once, it is 0.
+     * packet_ids are automatically generated.
+     */
+    template <typename Range>
+    std::vector<packet_id_t> async_publish_batch(
+        Range const& entries,
+        async_handler_t func = async_handler_t()) {
+        std::vector<basic_publish_message<PacketIdBytes>> msgs;
+        std::vector<packet_id_t> packet_ids;
+        auto sp = store_publish_batch(entries, msgs, packet_ids);
+        do_async_write_batch(
+            std::move(msgs),
+            std::move(func),
+            [sp] {}
+        );
+        return packet_ids;
+    }
+
     /**
      * @brief Subscribe
      * @param topic_name
@@ -2523,10 +3654,10 @@ public:
     packet_id_t async_subscribe(
         std::string const& topic_name,
         std::uint8_t qos,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         packet_id_t packet_id = acquire_unique_packet_id();
-        acquired_async_subscribe(packet_id, topic_name, qos, func);
+        acquired_async_subscribe(packet_id, topic_name, qos, std::move(func));
         return packet_id;
     }
 
@@ -2545,10 +3676,10 @@ public:
     packet_id_t async_subscribe(
         as::const_buffer const& topic_name,
         std::uint8_t qos,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         packet_id_t packet_id = acquire_unique_packet_id();
-        acquired_async_subscribe(packet_id, topic_name, qos, func);
+        acquired_async_subscribe(packet_id, topic_name, qos, std::move(func));
         return packet_id;
     }
 
@@ -2563,9 +3694,9 @@ public:
      */
     packet_id_t async_subscribe(
         std::vector<std::tuple<std::string, std::uint8_t>> const& params,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         packet_id_t packet_id = acquire_unique_packet_id();
-        acquired_async_subscribe(packet_id, params, func);
+        acquired_async_subscribe(packet_id, params, std::move(func));
         return packet_id;
     }
 
@@ -2580,9 +3711,9 @@ public:
      */
     packet_id_t async_subscribe(
         std::vector<std::tuple<as::const_buffer, std::uint8_t>> const& params,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         packet_id_t packet_id = acquire_unique_packet_id();
-        acquired_async_subscribe(packet_id, params, func);
+        acquired_async_subscribe(packet_id, params, std::move(func));
         return packet_id;
     }
 
@@ -2642,9 +3773,9 @@ public:
      */
     packet_id_t async_unsubscribe(
         std::string const& topic_name,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         packet_id_t packet_id = acquire_unique_packet_id();
-        acquired_async_unsubscribe(packet_id, topic_name, func);
+        acquired_async_unsubscribe(packet_id, topic_name, std::move(func));
         return packet_id;
     }
 
@@ -2660,9 +3791,9 @@ public:
      */
     packet_id_t async_unsubscribe(
         as::const_buffer const& topic_name,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         packet_id_t packet_id = acquire_unique_packet_id();
-        acquired_async_unsubscribe(packet_id, topic_name, func);
+        acquired_async_unsubscribe(packet_id, topic_name, std::move(func));
         return packet_id;
     }
 
@@ -2678,9 +3809,9 @@ public:
      */
     packet_id_t async_unsubscribe(
         std::vector<std::string> const& params,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         packet_id_t packet_id = acquire_unique_packet_id();
-        acquired_async_unsubscribe(packet_id, params, func);
+        acquired_async_unsubscribe(packet_id, params, std::move(func));
         return packet_id;
     }
 
@@ -2696,9 +3827,9 @@ public:
      */
     packet_id_t async_unsubscribe(
         std::vector<as::const_buffer> const& params,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         packet_id_t packet_id = acquire_unique_packet_id();
-        acquired_async_unsubscribe(packet_id, params, func);
+        acquired_async_unsubscribe(packet_id, params, std::move(func));
         return packet_id;
     }
 
@@ -2710,10 +3841,10 @@ public:
      * When the endpoint disconnects using disconnect(), a will won't send.<BR>
      * See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718090<BR>
      */
-    void async_disconnect(async_handler_t const& func = async_handler_t()) {
+    void async_disconnect(async_handler_t func = async_handler_t()) {
         if (connected_ && mqtt_connected_) {
             disconnect_requested_ = true;
-            async_send_disconnect(func);
+            async_send_disconnect(std::move(func));
         }
     }
 
@@ -2740,9 +3871,9 @@ public:
         std::string const& topic_name,
         std::string const& contents,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         if (register_packet_id(packet_id)) {
-            acquired_async_publish_at_least_once(packet_id, topic_name, contents, retain, func);
+            acquired_async_publish_at_least_once(packet_id, topic_name, contents, retain, std::move(func));
             return true;
         }
         return false;
@@ -2771,9 +3902,69 @@ public:
         as::const_buffer const& contents,
         life_keeper_t const& life_keeper,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
+        if (register_packet_id(packet_id)) {
+            acquired_async_publish_at_least_once(packet_id, topic_name, contents, life_keeper, retain, std::move(func));
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Publish QoS1 to the prepared topic with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
+     *         contents doesn't publish, otherwise return true and contents publish.
+     */
+    bool async_publish_at_least_once(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        if (register_packet_id(packet_id)) {
+            acquired_async_publish_at_least_once(packet_id, topic_name, contents, retain, std::move(func));
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Publish QoS1 to the prepared topic with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping contents lifetime.
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
+     *         contents doesn't publish, otherwise return true and contents publish.
+     */
+    bool async_publish_at_least_once(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
         if (register_packet_id(packet_id)) {
-            acquired_async_publish_at_least_once(packet_id, topic_name, contents, life_keeper, retain, func);
+            acquired_async_publish_at_least_once(packet_id, topic_name, contents, life_keeper, retain, std::move(func));
             return true;
         }
         return false;
@@ -2800,9 +3991,9 @@ public:
         std::string const& topic_name,
         std::string const& contents,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         if (register_packet_id(packet_id)) {
-            acquired_async_publish_exactly_once(packet_id, topic_name, contents, retain, func);
+            acquired_async_publish_exactly_once(packet_id, topic_name, contents, retain, std::move(func));
             return true;
         }
         return false;
@@ -2827,20 +4018,216 @@ public:
      */
     bool async_publish_exactly_once(
         packet_id_t packet_id,
-        as::const_buffer const& topic_name,
+        as::const_buffer const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        if (register_packet_id(packet_id)) {
+            acquired_async_publish_exactly_once(packet_id, topic_name, contents, life_keeper, retain, std::move(func));
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Publish QoS2 to the prepared topic with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
+     *         contents doesn't publish, otherwise return true and contents publish.
+     */
+    bool async_publish_exactly_once(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        if (register_packet_id(packet_id)) {
+            acquired_async_publish_exactly_once(packet_id, topic_name, contents, retain, std::move(func));
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Publish QoS2 to the prepared topic with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping contents lifetime.
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
+     *         contents doesn't publish, otherwise return true and contents publish.
+     */
+    bool async_publish_exactly_once(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        if (register_packet_id(packet_id)) {
+            acquired_async_publish_exactly_once(packet_id, topic_name, contents, life_keeper, retain, std::move(func));
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Publish with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier
+     * @param topic_name
+     *        A topic name to publish
+     * @param contents
+     *        The contents to publish
+     * @param qos
+     *        mqtt::qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
+     *         contents don't publish, otherwise return true and contents publish.
+     */
+    bool async_publish(
+        packet_id_t packet_id,
+        std::string const& topic_name,
+        std::string const& contents,
+        std::uint8_t qos = qos::at_most_once,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        if (register_packet_id(packet_id)) {
+            acquired_async_publish(packet_id, topic_name, contents, qos, retain, std::move(func));
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Publish with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier
+     * @param topic_name
+     *        A topic name to publish
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping topic_name and contents lifetime.
+     * @param qos
+     *        mqtt::qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
+     *         contents don't publish, otherwise return true and contents publish.
+     */
+    bool async_publish(
+        packet_id_t packet_id,
+        as::const_buffer const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        std::uint8_t qos = qos::at_most_once,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        if (register_packet_id(packet_id)) {
+            acquired_async_publish(packet_id, topic_name, contents, life_keeper, qos, retain, std::move(func));
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Publish to the prepared topic with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param qos
+     *        mqtt::qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
+     *         contents don't publish, otherwise return true and contents publish.
+     */
+    bool async_publish(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        std::uint8_t qos = qos::at_most_once,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        if (register_packet_id(packet_id)) {
+            acquired_async_publish(packet_id, topic_name, contents, qos, retain, std::move(func));
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Publish to the prepared topic with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping contents lifetime.
+     * @param qos
+     *        mqtt::qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
+     *         contents don't publish, otherwise return true and contents publish.
+     */
+    bool async_publish(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
         as::const_buffer const& contents,
         life_keeper_t const& life_keeper,
+        std::uint8_t qos = qos::at_most_once,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         if (register_packet_id(packet_id)) {
-            acquired_async_publish_exactly_once(packet_id, topic_name, contents, life_keeper, retain, func);
+            acquired_async_publish(packet_id, topic_name, contents, life_keeper, qos, retain, std::move(func));
             return true;
         }
         return false;
     }
 
     /**
-     * @brief Publish with a manual set packet identifier
+     * @brief Publish as dup with a manual set packet identifier
      * @param packet_id
      *        packet identifier
      * @param topic_name
@@ -2857,23 +4244,23 @@ public:
      * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
      *         contents don't publish, otherwise return true and contents publish.
      */
-    bool async_publish(
+    bool async_publish_dup(
         packet_id_t packet_id,
         std::string const& topic_name,
         std::string const& contents,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         if (register_packet_id(packet_id)) {
-            acquired_async_publish(packet_id, topic_name, contents, qos, retain, func);
+            acquired_async_publish_dup(packet_id, topic_name, contents, qos, retain, std::move(func));
             return true;
         }
         return false;
     }
 
     /**
-     * @brief Publish with a manual set packet identifier
+     * @brief Publish as dup with a manual set packet identifier
      * @param packet_id
      *        packet identifier
      * @param topic_name
@@ -2891,28 +4278,28 @@ public:
      * @return If packet_id is used in the publishing/subscribing sequence, then returns false and
      *         contents don't publish, otherwise return true and contents publish.
      */
-    bool async_publish(
+    bool async_publish_dup(
         packet_id_t packet_id,
         as::const_buffer const& topic_name,
         as::const_buffer const& contents,
         life_keeper_t const& life_keeper,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         if (register_packet_id(packet_id)) {
-            acquired_async_publish(packet_id, topic_name, contents, life_keeper, qos, retain, func);
+            acquired_async_publish_dup(packet_id, topic_name, contents, life_keeper, qos, retain, std::move(func));
             return true;
         }
         return false;
     }
 
     /**
-     * @brief Publish as dup with a manual set packet identifier
+     * @brief Publish as dup to the prepared topic with a manual set packet identifier
      * @param packet_id
      *        packet identifier
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name that is prepared by prepare_topic()
      * @param contents
      *        The contents to publish
      * @param qos
@@ -2927,28 +4314,28 @@ public:
      */
     bool async_publish_dup(
         packet_id_t packet_id,
-        std::string const& topic_name,
+        prepared_topic const& topic_name,
         std::string const& contents,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         if (register_packet_id(packet_id)) {
-            acquired_async_publish_dup(packet_id, topic_name, contents, qos, retain, func);
+            acquired_async_publish_dup(packet_id, topic_name, contents, qos, retain, std::move(func));
             return true;
         }
         return false;
     }
 
     /**
-     * @brief Publish as dup with a manual set packet identifier
+     * @brief Publish as dup to the prepared topic with a manual set packet identifier
      * @param packet_id
      *        packet identifier
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name that is prepared by prepare_topic()
      * @param contents
      *        The contents to publish
-     * @param life_keeper the function that is keeping topic_name and contents lifetime.
+     * @param life_keeper the function that is keeping contents lifetime.
      * @param qos
      *        mqtt::qos
      * @param retain
@@ -2961,15 +4348,15 @@ public:
      */
     bool async_publish_dup(
         packet_id_t packet_id,
-        as::const_buffer const& topic_name,
+        prepared_topic const& topic_name,
         as::const_buffer const& contents,
         life_keeper_t const& life_keeper,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         if (register_packet_id(packet_id)) {
-            acquired_async_publish_dup(packet_id, topic_name, contents, life_keeper, qos, retain, func);
+            acquired_async_publish_dup(packet_id, topic_name, contents, life_keeper, qos, retain, std::move(func));
             return true;
         }
         return false;
@@ -3053,10 +4440,10 @@ public:
         packet_id_t packet_id,
         std::string const& topic_name,
         std::uint8_t qos,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         if (register_packet_id(packet_id)) {
-            acquired_async_subscribe(packet_id, topic_name, qos, func);
+            acquired_async_subscribe(packet_id, topic_name, qos, std::move(func));
             return true;
         }
         return false;
@@ -3080,10 +4467,10 @@ public:
         packet_id_t packet_id,
         as::const_buffer const& topic_name,
         std::uint8_t qos,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         if (register_packet_id(packet_id)) {
-            acquired_async_subscribe(packet_id, topic_name, qos, func);
+            acquired_async_subscribe(packet_id, topic_name, qos, std::move(func));
             return true;
         }
         return false;
@@ -3103,9 +4490,9 @@ public:
     bool async_subscribe(
         packet_id_t packet_id,
         std::vector<std::tuple<std::string, std::uint8_t>> const& params,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         if (register_packet_id(packet_id)) {
-            acquired_async_subscribe(packet_id, params, func);
+            acquired_async_subscribe(packet_id, params, std::move(func));
             return true;
         }
         return false;
@@ -3125,9 +4512,9 @@ public:
     bool async_subscribe(
         packet_id_t packet_id,
         std::vector<std::tuple<as::const_buffer, std::uint8_t>> const& params,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         if (register_packet_id(packet_id)) {
-            acquired_async_subscribe(packet_id, params, func);
+            acquired_async_subscribe(packet_id, params, std::move(func));
             return true;
         }
         return false;
@@ -3202,9 +4589,9 @@ public:
     bool async_unsubscribe(
         packet_id_t packet_id,
         std::vector<std::string> const& params,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         if (register_packet_id(packet_id)) {
-            acquired_async_unsubscribe(packet_id, params, func);
+            acquired_async_unsubscribe(packet_id, params, std::move(func));
             return true;
         }
         return false;
@@ -3225,9 +4612,9 @@ public:
     bool async_unsubscribe(
         packet_id_t packet_id,
         std::vector<as::const_buffer> const& params,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         if (register_packet_id(packet_id)) {
-            acquired_async_unsubscribe(packet_id, params, func);
+            acquired_async_unsubscribe(packet_id, params, std::move(func));
             return true;
         }
         return false;
@@ -3255,20 +4642,19 @@ public:
         std::string const& topic_name,
         std::string const& contents,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
 
-        auto sp_topic_name = std::make_shared<std::string>(topic_name);
-        auto sp_contents = std::make_shared<std::string>(contents);
+        auto sp = make_publish_buffer(topic_name, contents);
 
         async_send_publish(
-            as::buffer(*sp_topic_name),
+            as::buffer(sp->data(), topic_name.size()),
             qos::at_least_once,
             retain,
             false,
             packet_id,
-            as::buffer(*sp_contents),
-            func,
-            [sp_topic_name, sp_contents] {}
+            as::buffer(sp->data() + topic_name.size(), contents.size()),
+            std::move(func),
+            [sp] {}
         );
     }
 
@@ -3296,7 +4682,7 @@ public:
         as::const_buffer const& contents,
         life_keeper_t const& life_keeper,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
 
         async_send_publish(
             topic_name,
@@ -3305,11 +4691,63 @@ public:
             false,
             packet_id,
             contents,
-            func,
+            std::move(func),
             life_keeper
         );
     }
 
+    /**
+     * @brief Publish QoS1 to the prepared topic with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     */
+    void acquired_async_publish_at_least_once(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        acquired_async_publish(packet_id, topic_name, contents, qos::at_least_once, retain, std::move(func));
+    }
+
+    /**
+     * @brief Publish QoS1 to the prepared topic with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper
+     *        The function for keeping contents life.
+     *        It is usually a lambda expression that captures shared_ptr of contents.
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     */
+    void acquired_async_publish_at_least_once(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        acquired_async_publish(packet_id, topic_name, contents, life_keeper, qos::at_least_once, retain, std::move(func));
+    }
+
     /**
      * @brief Publish QoS2 with a manual set packet identifier
      * @param packet_id
@@ -3330,20 +4768,19 @@ public:
         std::string const& topic_name,
         std::string const& contents,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
 
-        auto sp_topic_name = std::make_shared<std::string>(topic_name);
-        auto sp_contents = std::make_shared<std::string>(contents);
+        auto sp = make_publish_buffer(topic_name, contents);
 
         async_send_publish(
-            as::buffer(*sp_topic_name),
+            as::buffer(sp->data(), topic_name.size()),
             qos::exactly_once,
             retain,
             false,
             packet_id,
-            as::buffer(*sp_contents),
-            func,
-            [sp_topic_name, sp_contents] {}
+            as::buffer(sp->data() + topic_name.size(), contents.size()),
+            std::move(func),
+            [sp] {}
         );
     }
 
@@ -3363,28 +4800,270 @@ public:
      *        3.3.1.3 RETAIN
      * @param func A callback function that is called when async operation will finish.
      */
-    void acquired_async_publish_exactly_once(
+    void acquired_async_publish_exactly_once(
+        packet_id_t packet_id,
+        as::const_buffer const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+
+        async_send_publish(
+            topic_name,
+            qos::exactly_once,
+            retain,
+            false,
+            packet_id,
+            contents,
+            std::move(func),
+            life_keeper
+        );
+    }
+
+    /**
+     * @brief Publish QoS2 to the prepared topic with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     */
+    void acquired_async_publish_exactly_once(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        acquired_async_publish(packet_id, topic_name, contents, qos::exactly_once, retain, std::move(func));
+    }
+
+    /**
+     * @brief Publish QoS2 to the prepared topic with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping contents lifetime.
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     */
+    void acquired_async_publish_exactly_once(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        acquired_async_publish(packet_id, topic_name, contents, life_keeper, qos::exactly_once, retain, std::move(func));
+    }
+
+    /**
+     * @brief Publish with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     *        If qos == qos::at_most_once, packet_id must be 0. But not checked in release mode due to performance.
+     * @param topic_name
+     *        A topic name to publish
+     * @param contents
+     *        The contents to publish
+     * @param qos
+     *        mqtt::qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     */
+    void acquired_async_publish(
+        packet_id_t packet_id,
+        std::string const& topic_name,
+        std::string const& contents,
+        std::uint8_t qos = qos::at_most_once,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        BOOST_ASSERT((qos == qos::at_most_once && packet_id == 0) || (qos != qos::at_most_once && packet_id != 0));
+
+        auto sp = make_publish_buffer(topic_name, contents);
+
+        async_send_publish(
+            as::buffer(sp->data(), topic_name.size()),
+            qos,
+            retain,
+            false,
+            packet_id,
+            as::buffer(sp->data() + topic_name.size(), contents.size()),
+            std::move(func),
+            [sp] {}
+        );
+    }
+
+    /**
+     * @brief Publish with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     *        If qos == qos::at_most_once, packet_id must be 0. But not checked in release mode due to performance.
+     * @param topic_name
+     *        A topic name to publish
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping topic_name and contents lifetime.
+     * @param qos
+     *        mqtt::qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     */
+    void acquired_async_publish(
+        packet_id_t packet_id,
+        as::const_buffer const& topic_name,
+        as::const_buffer const& contents,
+        life_keeper_t const& life_keeper,
+        std::uint8_t qos = qos::at_most_once,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        BOOST_ASSERT((qos == qos::at_most_once && packet_id == 0) || (qos != qos::at_most_once && packet_id != 0));
+
+        async_send_publish(
+            topic_name,
+            qos,
+            retain,
+            false,
+            packet_id,
+            contents,
+            std::move(func),
+            life_keeper
+        );
+    }
+
+    /**
+     * @brief Publish the message that is shared with other endpoints with a manual set packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     *        If qos == qos::at_most_once, packet_id must be 0. But not checked in release mode due to performance.
+     * @param fanout
+     *        The shared parts of the message. See basic_publish_fanout.
+     * @param qos
+     *        mqtt::qos
+     * @param func A callback function that is called when async operation will finish.
+     */
+    void acquired_async_publish(
+        packet_id_t packet_id,
+        std::shared_ptr<publish_fanout_t const> const& fanout,
+        std::uint8_t qos = qos::at_most_once,
+        async_handler_t func = async_handler_t()) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        BOOST_ASSERT((qos == qos::at_most_once && packet_id == 0) || (qos != qos::at_most_once && packet_id != 0));
+
+        async_send_publish(fanout, qos, packet_id, std::move(func));
+    }
+
+    /**
+     * @brief Publish to the prepared topic with already acquired packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     *        If qos == qos::at_most_once, packet_id must be 0. But not checked in release mode due to performance.
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param qos
+     *        mqtt::qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     */
+    void acquired_async_publish(
+        packet_id_t packet_id,
+        prepared_topic const& topic_name,
+        std::string const& contents,
+        std::uint8_t qos = qos::at_most_once,
+        bool retain = false,
+        async_handler_t func = async_handler_t()) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        BOOST_ASSERT((qos == qos::at_most_once && packet_id == 0) || (qos != qos::at_most_once && packet_id != 0));
+        auto sp = make_publish_buffer(contents);
+
+        async_send_publish(
+            topic_name,
+            qos,
+            retain,
+            false,
+            packet_id,
+            as::buffer(sp->data(), sp->size()),
+            std::move(func),
+            [sp, topic_name] {}
+        );
+    }
+
+    /**
+     * @brief Publish to the prepared topic with already acquired packet identifier
+     * @param packet_id
+     *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
+     *        The ownership of  the packet_id moves to the library.
+     *        If qos == qos::at_most_once, packet_id must be 0. But not checked in release mode due to performance.
+     * @param topic_name
+     *        A topic name that is prepared by prepare_topic()
+     * @param contents
+     *        The contents to publish
+     * @param life_keeper the function that is keeping contents lifetime.
+     * @param qos
+     *        mqtt::qos
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func A callback function that is called when async operation will finish.
+     */
+    void acquired_async_publish(
         packet_id_t packet_id,
-        as::const_buffer const& topic_name,
+        prepared_topic const& topic_name,
         as::const_buffer const& contents,
         life_keeper_t const& life_keeper,
+        std::uint8_t qos = qos::at_most_once,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
+        BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
+        BOOST_ASSERT((qos == qos::at_most_once && packet_id == 0) || (qos != qos::at_most_once && packet_id != 0));
 
         async_send_publish(
             topic_name,
-            qos::exactly_once,
+            qos,
             retain,
             false,
             packet_id,
             contents,
-            func,
-            life_keeper
+            std::move(func),
+            [topic_name, life_keeper] {
+                if (life_keeper) life_keeper();
+            }
         );
     }
 
     /**
-     * @brief Publish with a manual set packet identifier
+     * @brief Publish as dup with a manual set packet identifier
      * @param packet_id
      *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
      *        The ownership of  the packet_id moves to the library.
@@ -3401,33 +5080,32 @@ public:
      *        3.3.1.3 RETAIN
      * @param func A callback function that is called when async operation will finish.
      */
-    void acquired_async_publish(
+    void acquired_async_publish_dup(
         packet_id_t packet_id,
         std::string const& topic_name,
         std::string const& contents,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         BOOST_ASSERT((qos == qos::at_most_once && packet_id == 0) || (qos != qos::at_most_once && packet_id != 0));
 
-        auto sp_topic_name = std::make_shared<std::string>(topic_name);
-        auto sp_contents = std::make_shared<std::string>(contents);
+        auto sp = make_publish_buffer(topic_name, contents);
 
         async_send_publish(
-            as::buffer(*sp_topic_name),
+            as::buffer(sp->data(), topic_name.size()),
             qos,
             retain,
-            false,
+            true,
             packet_id,
-            as::buffer(*sp_contents),
-            func,
-            [sp_topic_name, sp_contents] {}
+            as::buffer(sp->data() + topic_name.size(), contents.size()),
+            std::move(func),
+            [sp] {}
         );
     }
 
     /**
-     * @brief Publish with a manual set packet identifier
+     * @brief Publish as dup with a manual set packet identifier
      * @param packet_id
      *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
      *        The ownership of  the packet_id moves to the library.
@@ -3445,14 +5123,14 @@ public:
      *        3.3.1.3 RETAIN
      * @param func A callback function that is called when async operation will finish.
      */
-    void acquired_async_publish(
+    void acquired_async_publish_dup(
         packet_id_t packet_id,
         as::const_buffer const& topic_name,
         as::const_buffer const& contents,
         life_keeper_t const& life_keeper,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         BOOST_ASSERT((qos == qos::at_most_once && packet_id == 0) || (qos != qos::at_most_once && packet_id != 0));
 
@@ -3460,22 +5138,22 @@ public:
             topic_name,
             qos,
             retain,
-            false,
+            true,
             packet_id,
             contents,
-            func,
+            std::move(func),
             life_keeper
         );
     }
 
     /**
-     * @brief Publish as dup with a manual set packet identifier
+     * @brief Publish as dup to the prepared topic with a manual set packet identifier
      * @param packet_id
      *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
      *        The ownership of  the packet_id moves to the library.
      *        If qos == qos::at_most_once, packet_id must be 0. But not checked in release mode due to performance.
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name that is prepared by prepare_topic()
      * @param contents
      *        The contents to publish
      * @param qos
@@ -3488,40 +5166,38 @@ public:
      */
     void acquired_async_publish_dup(
         packet_id_t packet_id,
-        std::string const& topic_name,
+        prepared_topic const& topic_name,
         std::string const& contents,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         BOOST_ASSERT((qos == qos::at_most_once && packet_id == 0) || (qos != qos::at_most_once && packet_id != 0));
-
-        auto sp_topic_name = std::make_shared<std::string>(topic_name);
-        auto sp_contents = std::make_shared<std::string>(contents);
+        auto sp = make_publish_buffer(contents);
 
         async_send_publish(
-            as::buffer(*sp_topic_name),
+            topic_name,
             qos,
             retain,
             true,
             packet_id,
-            as::buffer(*sp_contents),
-            func,
-            [sp_topic_name, sp_contents] {}
+            as::buffer(sp->data(), sp->size()),
+            std::move(func),
+            [sp, topic_name] {}
         );
     }
 
     /**
-     * @brief Publish as dup with a manual set packet identifier
+     * @brief Publish as dup to the prepared topic with a manual set packet identifier
      * @param packet_id
      *        packet identifier. It should be acquired by acquire_unique_packet_id, or register_packet_id.
      *        The ownership of  the packet_id moves to the library.
      *        If qos == qos::at_most_once, packet_id must be 0. But not checked in release mode due to performance.
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name that is prepared by prepare_topic()
      * @param contents
      *        The contents to publish
-     * @param life_keeper the function that is keeping topic_name and contents lifetime.
+     * @param life_keeper the function that is keeping contents lifetime.
      * @param qos
      *        mqtt::qos
      * @param retain
@@ -3532,12 +5208,12 @@ public:
      */
     void acquired_async_publish_dup(
         packet_id_t packet_id,
-        as::const_buffer const& topic_name,
+        prepared_topic const& topic_name,
         as::const_buffer const& contents,
         life_keeper_t const& life_keeper,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         BOOST_ASSERT((qos == qos::at_most_once && packet_id == 0) || (qos != qos::at_most_once && packet_id != 0));
 
@@ -3548,8 +5224,10 @@ public:
             true,
             packet_id,
             contents,
-            func,
-            life_keeper
+            std::move(func),
+            [topic_name, life_keeper] {
+                if (life_keeper) life_keeper();
+            }
         );
     }
 
@@ -3622,7 +5300,7 @@ public:
         packet_id_t packet_id,
         std::string const& topic_name,
         std::uint8_t qos,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
 
         std::vector<std::tuple<as::const_buffer, std::uint8_t>> params;
@@ -3635,7 +5313,7 @@ public:
             packet_id,
             topic_name,
             qos,
-            func
+            std::move(func)
         );
     }
 
@@ -3656,7 +5334,7 @@ public:
         packet_id_t packet_id,
         as::const_buffer const& topic_name,
         std::uint8_t qos,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
 
         std::vector<std::tuple<as::const_buffer, std::uint8_t>> params;
@@ -3669,7 +5347,7 @@ public:
             packet_id,
             topic_name,
             qos,
-            func
+            std::move(func)
         );
     }
 
@@ -3686,7 +5364,7 @@ public:
     void acquired_async_subscribe(
         packet_id_t packet_id,
         std::vector<std::tuple<std::string, std::uint8_t>> const& params,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
 
         std::vector<std::tuple<as::const_buffer, std::uint8_t>> cb_params;
         cb_params.reserve(params.size());
@@ -3704,7 +5382,7 @@ public:
             cb_params,
             life_keepers,
             packet_id,
-            func
+            std::move(func)
         );
     }
 
@@ -3721,7 +5399,7 @@ public:
     void acquired_async_subscribe(
         packet_id_t packet_id,
         std::vector<std::tuple<as::const_buffer, std::uint8_t>> const& params,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
 
         std::vector<std::shared_ptr<std::string>> life_keepers;
 
@@ -3729,7 +5407,7 @@ public:
             params,
             life_keepers,
             packet_id,
-            func
+            std::move(func)
         );
     }
 
@@ -3789,7 +5467,7 @@ public:
     void acquired_async_unsubscribe(
         packet_id_t packet_id,
         std::vector<std::string> const& params,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
 
         std::vector<as::const_buffer> cb_params;
         cb_params.reserve(params.size());
@@ -3806,7 +5484,7 @@ public:
             cb_params,
             life_keepers,
             packet_id,
-            func
+            std::move(func)
         );
     }
 
@@ -3824,14 +5502,14 @@ public:
     void acquired_async_unsubscribe(
         packet_id_t packet_id,
         std::vector<as::const_buffer> const& params,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
 
         std::vector<std::shared_ptr<std::string>> life_keepers;
         async_send_unsubscribe(
             params,
             life_keepers,
             packet_id,
-            func
+            std::move(func)
         );
     }
 
@@ -3840,8 +5518,8 @@ public:
      * @param func A callback function that is called when async operation will finish.
      * See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718066
      */
-    void async_pingreq(async_handler_t const& func = async_handler_t()) {
-        if (connected_ && mqtt_connected_) async_send_pingreq(func);
+    void async_pingreq(async_handler_t func = async_handler_t()) {
+        if (connected_ && mqtt_connected_) async_send_pingreq(std::move(func));
     }
 
     /**
@@ -3849,8 +5527,8 @@ public:
      * @param func A callback function that is called when async operation will finish.
      * See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718086
      */
-    void async_pingresp(async_handler_t const& func = async_handler_t()) {
-        async_send_pingresp(func);
+    void async_pingresp(async_handler_t func = async_handler_t()) {
+        async_send_pingresp(std::move(func));
     }
 
 
@@ -3862,9 +5540,9 @@ public:
      */
     void async_connect(
         std::uint16_t keep_alive_sec,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         connect_requested_ = true;
-        async_send_connect(keep_alive_sec, func);
+        async_send_connect(keep_alive_sec, std::move(func));
     }
 
     /**
@@ -3877,8 +5555,8 @@ public:
     void async_connack(
         bool session_present,
         std::uint8_t return_code,
-        async_handler_t const& func = async_handler_t()) {
-        async_send_connack(session_present, return_code, func);
+        async_handler_t func = async_handler_t()) {
+        async_send_connack(session_present, return_code, std::move(func));
     }
 
     /**
@@ -3887,8 +5565,8 @@ public:
      * @param func A callback function that is called when async operation will finish.
      * See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718043
      */
-    void async_puback(packet_id_t packet_id, async_handler_t const& func = async_handler_t()) {
-        async_send_puback(packet_id, func);
+    void async_puback(packet_id_t packet_id, async_handler_t func = async_handler_t()) {
+        async_send_puback(packet_id, std::move(func));
     }
 
     /**
@@ -3897,8 +5575,8 @@ public:
      * @param func A callback function that is called when async operation will finish.
      * See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718048
      */
-    void async_pubrec(packet_id_t packet_id, async_handler_t const& func = async_handler_t()) {
-        async_send_pubrec(packet_id, func);
+    void async_pubrec(packet_id_t packet_id, async_handler_t func = async_handler_t()) {
+        async_send_pubrec(packet_id, std::move(func));
     }
 
     /**
@@ -3907,8 +5585,8 @@ public:
      * @param func A callback function that is called when async operation will finish.
      * See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718053
      */
-    void async_pubrel(packet_id_t packet_id, async_handler_t const& func = async_handler_t()) {
-        async_send_pubrel(packet_id, func);
+    void async_pubrel(packet_id_t packet_id, async_handler_t func = async_handler_t()) {
+        async_send_pubrel(packet_id, std::move(func));
     }
 
     /**
@@ -3917,8 +5595,8 @@ public:
      * @param func A callback function that is called when async operation will finish.
      * See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718058
      */
-    void async_pubcomp(packet_id_t packet_id, async_handler_t const& func = async_handler_t()) {
-        async_send_pubcomp(packet_id, func);
+    void async_pubcomp(packet_id_t packet_id, async_handler_t func = async_handler_t()) {
+        async_send_pubcomp(packet_id, std::move(func));
     }
 
     /**
@@ -3950,10 +5628,10 @@ public:
     void async_suback(
         packet_id_t packet_id,
         std::uint8_t qos,
-        async_handler_t const& func = async_handler_t()) {
+        async_handler_t func = async_handler_t()) {
         BOOST_ASSERT(qos == qos::at_most_once || qos::at_least_once || qos::exactly_once);
         std::vector<std::uint8_t> params;
-        async_send_suback(params, packet_id, qos, func);
+        async_send_suback(params, packet_id, qos, std::move(func));
     }
 
     /**
@@ -3966,8 +5644,8 @@ public:
     void async_suback(
         packet_id_t packet_id,
         std::vector<std::uint8_t> const& qoss,
-        async_handler_t const& func = async_handler_t()) {
-        async_send_suback(qoss, packet_id, func);
+        async_handler_t func = async_handler_t()) {
+        async_send_suback(qoss, packet_id, std::move(func));
     }
 
     /**
@@ -3978,8 +5656,8 @@ public:
      */
     void async_unsuback(
         packet_id_t packet_id,
-        async_handler_t const& func = async_handler_t()) {
-        async_send_unsuback(packet_id, func);
+        async_handler_t func = async_handler_t()) {
+        async_send_unsuback(packet_id, std::move(func));
     }
 
     /**
@@ -3988,9 +5666,7 @@ public:
      */
     void clear_stored_publish(packet_id_t packet_id) {
         LockGuard<Mutex> lck (store_mtx_);
-        auto& idx = store_.template get<tag_packet_id>();
-        auto r = idx.equal_range(packet_id);
-        idx.erase(std::get<0>(r), std::get<1>(r));
+        store_.erase(packet_id);
         packet_id_.erase(packet_id);
     }
 
@@ -4017,12 +5693,13 @@ public:
      */
     void for_each_store(std::function<void(char const*, std::size_t)> const& f) {
         LockGuard<Mutex> lck (store_mtx_);
-        auto& idx = store_.template get<tag_seq>();
-        for (auto const & e : idx) {
-            auto const& m = e.message();
-            auto cb = continuous_buffer(m);
-            f(cb.data(), cb.size());
-        }
+        store_.for_each(
+            [&f](store const& e) {
+                auto const& m = e.message();
+                auto cb = continuous_buffer(m);
+                f(cb.data(), cb.size());
+            }
+        );
     }
 
     /**
@@ -4031,10 +5708,11 @@ public:
      */
     void for_each_store(std::function<void(message_variant const&)> const& f) {
         LockGuard<Mutex> lck (store_mtx_);
-        auto& idx = store_.template get<tag_seq>();
-        for (auto const & e : idx) {
-            f(e.message());
-        }
+        store_.for_each(
+            [&f](store const& e) {
+                f(e.message());
+            }
+        );
     }
 
     // manual packet_id management for advanced users
@@ -4049,41 +5727,9 @@ public:
      */
     packet_id_t acquire_unique_packet_id() {
         LockGuard<Mutex> lck (store_mtx_);
-        if (packet_id_.size() == std::numeric_limits<packet_id_t>::max()) throw packet_id_exhausted_error();
-        if (packet_id_master_ == std::numeric_limits<packet_id_t>::max()) {
-            packet_id_master_ = 1U;
-        }
-        else {
-            ++packet_id_master_;
-        }
-        auto ret = packet_id_.insert(packet_id_master_);
-        if (ret.second) return packet_id_master_;
-
-        auto last = packet_id_.end();
-        auto e = last;
-        --last;
-
-        if (*last != std::numeric_limits<packet_id_t>::max()) {
-            packet_id_master_ = static_cast<packet_id_t>(*last + 1U);
-            packet_id_.insert(e, packet_id_master_);
-            return packet_id_master_;
-        }
-
-        auto b = packet_id_.begin();
-        auto prev = *b;
-        if (prev != 1U) {
-            packet_id_master_ = 1U;
-            packet_id_.insert(b, packet_id_master_);
-            return packet_id_master_;
-        }
-        ++b;
-        while (*b - 1U == prev && b != e) {
-            prev = *b;
-            ++b;
-        }
-        packet_id_master_ = static_cast<packet_id_t>(prev + 1U);
-        packet_id_.insert(b, packet_id_master_);
-        return packet_id_master_;
+        auto packet_id = packet_id_.acquire();
+        if (packet_id == 0) throw packet_id_exhausted_error();
+        return packet_id;
     }
 
     /**
@@ -4096,7 +5742,7 @@ public:
     bool register_packet_id(packet_id_t packet_id) {
         if (packet_id == 0) return false;
         LockGuard<Mutex> lck (store_mtx_);
-        return packet_id_.insert(packet_id).second;
+        return packet_id_.insert(packet_id);
     }
 
     /**
@@ -4148,7 +5794,7 @@ public:
         auto packet_id = msg.packet_id();
         auto qos = msg.qos();
         LockGuard<Mutex> lck (store_mtx_);
-        if (packet_id_.insert(packet_id).second) {
+        if (packet_id_.insert(packet_id)) {
             auto ret = store_.emplace(
                 packet_id,
                 qos == qos::at_least_once ? control_packet_type::puback
@@ -4156,7 +5802,7 @@ public:
                 std::move(msg),
                 std::move(life_keeper)
             );
-            BOOST_ASSERT(ret.second);
+            BOOST_ASSERT(ret);
         }
     }
 
@@ -4168,14 +5814,14 @@ public:
     void restore_serialized_message(basic_pubrel_message<PacketIdBytes> msg) {
         auto packet_id = msg.packet_id();
         LockGuard<Mutex> lck (store_mtx_);
-        if (packet_id_.insert(packet_id).second) {
+        if (packet_id_.insert(packet_id)) {
             auto ret = store_.emplace(
                 packet_id,
                 control_packet_type::pubcomp,
                 std::move(msg),
                 []{}
             );
-            BOOST_ASSERT(ret.second);
+            BOOST_ASSERT(ret);
         }
     }
 
@@ -4207,7 +5853,7 @@ public:
         else {
             h_mqtt_message_processed_ =
                 [this]
-                (async_handler_t const& func) {
+                (session_handler_t const& func) {
                 async_read_control_packet_type(func);
             };
         }
@@ -4218,12 +5864,22 @@ public:
      *        If you call this function, you need to set manual receive mode
      *        using set_auto_next_read(false);
      */
-    void async_read_next_message(async_handler_t const& func) {
+    void async_read_next_message(session_handler_t const& func) {
         async_read_control_packet_type(func);
     }
 
 protected:
-    void async_read_control_packet_type(async_handler_t const& func) {
+    void async_read_control_packet_type(session_handler_t const& func) {
+        if (read_buffer_size_ != 0) {
+            if (read_buf_parsing_) {
+                // Called from handle_payload() in the parse loop.
+                // The loop continues with the next buffered message.
+                read_buf_next_requested_ = true;
+                return;
+            }
+            process_read_buffer(func);
+            return;
+        }
         auto self = this->shared_from_this();
         async_read(
             *socket_,
@@ -4628,15 +6284,31 @@ private:
         async_send_suback(params, packet_id, qos, std::forward<Args>(args)..., async_handler_t());
     }
 
+    // Copy topic_name and contents into one buffer. It is released when the returned pointer is released.
+    std::shared_ptr<buffer_t> make_publish_buffer(std::string const& topic_name, std::string const& contents) {
+        auto sp = std::allocate_shared<buffer_t>(Alloc());
+        sp->reserve(topic_name.size() + contents.size());
+        sp->insert(sp->end(), topic_name.begin(), topic_name.end());
+        sp->insert(sp->end(), contents.begin(), contents.end());
+        return sp;
+    }
+
+    // Copy contents into a buffer. The topic name is kept by prepared_topic.
+    std::shared_ptr<buffer_t> make_publish_buffer(std::string const& contents) {
+        return std::allocate_shared<buffer_t>(Alloc(), contents.begin(), contents.end());
+    }
+
     class send_buffer {
     public:
-        send_buffer():buf_(std::make_shared<std::string>(static_cast<int>(payload_position_), 0)) {}
+        using string_t = std::basic_string<char, std::char_traits<char>, Alloc>;
+
+        send_buffer():buf_(std::allocate_shared<string_t>(Alloc(), payload_position_, '\0')) {}
 
-        std::shared_ptr<std::string> const& buf() const {
+        std::shared_ptr<string_t> const& buf() const {
             return buf_;
         }
 
-        std::shared_ptr<std::string>& buf() {
+        std::shared_ptr<string_t>& buf() {
             return buf_;
         }
 
@@ -4644,14 +6316,14 @@ private:
             auto rb = remaining_bytes(buf_->size() - payload_position_);
             std::size_t start_position = payload_position_ - rb.size() - 1;
             (*buf_)[start_position] = fixed_header;
-            buf_->replace(start_position + 1, rb.size(), rb);
+            buf_->replace(start_position + 1, rb.size(), rb.data(), rb.size());
             return std::make_tuple(
                 &(*buf_)[start_position],
                 buf_->size() - start_position);
         }
     private:
         static constexpr std::size_t const payload_position_ = 5;
-        std::shared_ptr<std::string> buf_;
+        std::shared_ptr<string_t> buf_;
     };
 
     struct store {
@@ -4670,6 +6342,7 @@ private:
         basic_message_variant<PacketIdBytes> message() const {
             return get_basic_message_variant<PacketIdBytes>(smv_);
         }
+        life_keeper_t const& life_keeper() const { return life_keeper_; }
     private:
         packet_id_t packet_id_;
         std::uint8_t expected_control_packet_type_;
@@ -4677,40 +6350,7 @@ private:
         life_keeper_t life_keeper_;
     };
 
-    struct tag_packet_id {};
-    struct tag_packet_id_type {};
-    struct tag_seq {};
-    using mi_store = mi::multi_index_container<
-        store,
-        mi::indexed_by<
-            mi::ordered_unique<
-                mi::tag<tag_packet_id_type>,
-                mi::composite_key<
-                    store,
-                    mi::const_mem_fun<
-                        store, packet_id_t,
-                        &store::packet_id
-                    >,
-                    mi::const_mem_fun<
-                        store, std::uint8_t,
-                        &store::expected_control_packet_type
-                    >
-                >
-            >,
-            mi::ordered_non_unique<
-                mi::tag<tag_packet_id>,
-                mi::const_mem_fun<
-                    store, packet_id_t,
-                    &store::packet_id
-                >
-            >,
-            mi::sequenced<
-                mi::tag<tag_seq>
-            >
-        >
-    >;
-
-    void handle_control_packet_type(async_handler_t const& func) {
+    void handle_control_packet_type(session_handler_t const& func) {
         fixed_header_ = static_cast<std::uint8_t>(buf_);
         remaining_length_ = 0;
         remaining_length_multiplier_ = 1;
@@ -4735,7 +6375,7 @@ private:
         );
     }
 
-    void handle_remaining_length(async_handler_t const& func) {
+    void handle_remaining_length(session_handler_t const& func) {
         remaining_length_ += (buf_ & 0b01111111) * remaining_length_multiplier_;
         remaining_length_multiplier_ *= 128;
         if (remaining_length_multiplier_ > 128 * 128 * 128 * 128) {
@@ -4765,38 +6405,7 @@ private:
             );
         }
         else {
-            auto check =
-                [&]() -> bool {
-                    auto cpt = get_control_packet_type(fixed_header_);
-                    switch (cpt) {
-                    case control_packet_type::connect:
-                    case control_packet_type::publish:
-                    case control_packet_type::subscribe:
-                    case control_packet_type::suback:
-                    case control_packet_type::unsubscribe:
-                        if (h_is_valid_length_) {
-                            return h_is_valid_length_(cpt, remaining_length_);
-                        }
-                        else {
-                            return true;
-                        }
-                    case control_packet_type::connack:
-                        return remaining_length_ == 2;
-                    case control_packet_type::puback:
-                    case control_packet_type::pubrec:
-                    case control_packet_type::pubrel:
-                    case control_packet_type::pubcomp:
-                    case control_packet_type::unsuback:
-                        return remaining_length_ == sizeof(packet_id_t);
-                    case control_packet_type::pingreq:
-                    case control_packet_type::pingresp:
-                    case control_packet_type::disconnect:
-                        return remaining_length_ == 0;
-                    default:
-                        return false;
-                    }
-                };
-            if (!check()) {
+            if (!check_remaining_length()) {
                 handle_error(boost::system::errc::make_error_code(boost::system::errc::message_size));
                 if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
                 return;
@@ -4833,7 +6442,153 @@ private:
         }
     }
 
-    void handle_payload(async_handler_t const& func) {
+    bool check_remaining_length() {
+        auto cpt = get_control_packet_type(fixed_header_);
+        switch (cpt) {
+        case control_packet_type::connect:
+        case control_packet_type::publish:
+        case control_packet_type::subscribe:
+        case control_packet_type::suback:
+        case control_packet_type::unsubscribe:
+            if (h_is_valid_length_) {
+                return h_is_valid_length_(cpt, remaining_length_);
+            }
+            else {
+                return true;
+            }
+        case control_packet_type::connack:
+            return remaining_length_ == 2;
+        case control_packet_type::puback:
+        case control_packet_type::pubrec:
+        case control_packet_type::pubrel:
+        case control_packet_type::pubcomp:
+        case control_packet_type::unsuback:
+            return remaining_length_ == sizeof(packet_id_t);
+        case control_packet_type::pingreq:
+        case control_packet_type::pingresp:
+        case control_packet_type::disconnect:
+            return remaining_length_ == 0;
+        default:
+            return false;
+        }
+    }
+
+    // Buffered read
+
+    void async_read_some_to_buffer(session_handler_t const& func) {
+        if (read_buf_.size() != read_buffer_size_) {
+            read_buf_.resize(read_buffer_size_);
+        }
+        // Only an incomplete fixed header and remaining length can be left in the buffer.
+        // Longer fragments are moved to payload_ by process_read_buffer().
+        if (read_buf_begin_ != 0) {
+            std::copy(
+                read_buf_.begin() + static_cast<std::ptrdiff_t>(read_buf_begin_),
+                read_buf_.begin() + static_cast<std::ptrdiff_t>(read_buf_end_),
+                read_buf_.begin()
+            );
+            read_buf_end_ -= read_buf_begin_;
+            read_buf_begin_ = 0;
+        }
+        auto self = this->shared_from_this();
+        async_read_some(
+            *socket_,
+            as::buffer(read_buf_.data() + read_buf_end_, read_buf_.size() - read_buf_end_),
+            [this, self, func](
+                boost::system::error_code const& ec,
+                std::size_t bytes_transferred){
+                if (handle_close_or_error(ec)) {
+                    read_buf_begin_ = read_buf_end_ = 0;
+                    if (func) func(ec);
+                    return;
+                }
+                read_buf_end_ += bytes_transferred;
+                process_read_buffer(func);
+            }
+        );
+    }
+
+    void process_read_buffer(session_handler_t const& func) {
+        read_buf_parsing_ = true;
+        auto g = unique_scope_guard(
+            [this]
+            {
+                read_buf_parsing_ = false;
+            }
+        );
+        while (connected_) {
+            auto const* p = read_buf_.data();
+            std::size_t i = read_buf_begin_;
+            if (i == read_buf_end_) break;
+            fixed_header_ = static_cast<std::uint8_t>(p[i++]);
+            remaining_length_ = 0;
+            remaining_length_multiplier_ = 1;
+            bool header_completed = false;
+            while (i != read_buf_end_) {
+                auto b = p[i++];
+                remaining_length_ += (b & 0b01111111) * remaining_length_multiplier_;
+                remaining_length_multiplier_ *= 128;
+                if (remaining_length_multiplier_ > 128 * 128 * 128 * 128) {
+                    handle_error(boost::system::errc::make_error_code(boost::system::errc::message_size));
+                    if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
+                    return;
+                }
+                if (!(b & 0b10000000)) {
+                    header_completed = true;
+                    break;
+                }
+            }
+            if (!header_completed) break;
+            if (!check_remaining_length()) {
+                handle_error(boost::system::errc::make_error_code(boost::system::errc::message_size));
+                if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
+                return;
+            }
+            auto buffered = read_buf_end_ - i;
+            if (buffered < remaining_length_) {
+                // The rest of the message is read directly into payload_.
+                payload_.resize(remaining_length_);
+                std::copy(p + i, p + read_buf_end_, payload_.begin());
+                read_buf_begin_ = read_buf_end_ = 0;
+                read_buf_parsing_ = false;
+                auto self = this->shared_from_this();
+                async_read(
+                    *socket_,
+                    as::buffer(payload_.data() + buffered, remaining_length_ - buffered),
+                    [this, self, func, buffered](
+                        boost::system::error_code const& ec,
+                        std::size_t bytes_transferred){
+                        if (handle_close_or_error(ec)) {
+                            payload_.clear();
+                            if (func) func(ec);
+                            return;
+                        }
+                        if (bytes_transferred != remaining_length_ - buffered) {
+                            payload_.clear();
+                            handle_error(boost::system::errc::make_error_code(boost::system::errc::message_size));
+                            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
+                            return;
+                        }
+                        // payload_ is not cleared after handle_payload() because the next message
+                        // could have already started to be read into payload_ synchronously.
+                        handle_payload(func);
+                    }
+                );
+                return;
+            }
+            payload_.assign(p + i, p + i + remaining_length_);
+            read_buf_begin_ = i + remaining_length_;
+            if (read_buf_begin_ == read_buf_end_) read_buf_begin_ = read_buf_end_ = 0;
+            read_buf_next_requested_ = false;
+            handle_payload(func);
+            payload_.clear();
+            if (!read_buf_next_requested_) return;
+        }
+        read_buf_parsing_ = false;
+        async_read_some_to_buffer(func);
+    }
+
+    void handle_payload(session_handler_t const& func) {
         auto control_packet_type = get_control_packet_type(fixed_header_);
         bool ret = false;
         switch (control_packet_type) {
@@ -4921,7 +6676,7 @@ private:
         if (h_error_) h_error_(ec);
     }
 
-    bool handle_connect(async_handler_t const& func) {
+    bool handle_connect(session_handler_t const& func) {
         std::size_t i = 0;
         if (remaining_length_ < 10 || // *1
             payload_[i++] != 0x00 ||
@@ -5062,7 +6817,7 @@ private:
         return true;
     }
 
-    bool handle_connack(async_handler_t const& func) {
+    bool handle_connack(session_handler_t const& func) {
         if (!connect_requested_) {
             if (func) func(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
             return false;
@@ -5074,12 +6829,34 @@ private:
                 store_.clear();
                 packet_id_.clear();
             }
+            else if (async_resend_) {
+                // Don't hold the lock while writing. The life keepers keep the buffers until the writes finish.
+                std::vector<std::pair<basic_message_variant<PacketIdBytes>, life_keeper_t>> msgs;
+                {
+                    LockGuard<Mutex> lck (store_mtx_);
+                    msgs.reserve(store_.size());
+                    store_.for_each(
+                        [&msgs](store const& e) {
+                            msgs.emplace_back(e.message(), e.life_keeper());
+                        }
+                    );
+                }
+                for (auto& m : msgs) {
+                    auto life_keeper = std::move(m.second);
+                    do_async_write(
+                        std::move(m.first),
+                        [MQTT_CAPTURE_MOVE(life_keeper)]
+                        (boost::system::error_code const&) {}
+                    );
+                }
+            }
             else {
                 LockGuard<Mutex> lck (store_mtx_);
-                auto& idx = store_.template get<tag_seq>();
-                for (auto const& e : idx) {
-                    do_sync_write(e.message());
-                }
+                store_.for_each(
+                    [this](store const& e) {
+                        do_sync_write(e.message());
+                    }
+                );
             }
         }
         bool session_present = is_session_present(payload_[0]);
@@ -5096,7 +6873,7 @@ private:
         }
     }
 
-    bool handle_publish(async_handler_t const& func) {
+    bool handle_publish(session_handler_t const& func) {
         if (remaining_length_ < 2) {
             if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
             return false;
@@ -5109,8 +6886,9 @@ private:
             if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
             return false;
         }
-        std::string topic_name(payload_.data() + i, topic_name_length);
-        if (utf8string::validate_contents(topic_name) != utf8string::validation::well_formed) {
+        auto topic_name_pos = i;
+        if (utf8string::validate_contents(string_view(payload_.data() + i, topic_name_length)) !=
+            utf8string::validation::well_formed) {
             if (func) func(boost::system::errc::make_error_code(boost::system::errc::bad_message));
             return false;
         }
@@ -5120,9 +6898,8 @@ private:
         auto qos = publish::get_qos(fixed_header_);
         switch (qos) {
         case qos::at_most_once:
-            if (h_publish_) {
-                std::string contents(payload_.data() + i, payload_.size() - i);
-                return h_publish_(fixed_header_, packet_id, std::move(topic_name), std::move(contents));
+            if (h_publish_ || h_publish_view_) {
+                return call_publish_handler(packet_id, topic_name_pos, topic_name_length, i);
             }
             break;
         case qos::at_least_once: {
@@ -5145,9 +6922,8 @@ private:
                     }
                 );
             };
-            if (h_publish_) {
-                std::string contents(payload_.data() + i, payload_.size() - i);
-                if (h_publish_(fixed_header_, packet_id, std::move(topic_name), std::move(contents))) {
+            if (h_publish_ || h_publish_view_) {
+                if (call_publish_handler(packet_id, topic_name_pos, topic_name_length, i)) {
                     res();
                     return true;
                 }
@@ -5175,12 +6951,10 @@ private:
                     }
                 );
             };
-            if (h_publish_) {
-                auto it = qos2_publish_handled_.find(*packet_id);
-                if (it == qos2_publish_handled_.end()) {
-                    std::string contents(payload_.data() + i, payload_.size() - i);
-                    if (h_publish_(fixed_header_, packet_id, std::move(topic_name), std::move(contents))) {
-                        qos2_publish_handled_.emplace(*packet_id);
+            if (h_publish_ || h_publish_view_) {
+                if (!qos2_publish_handled_.contains(*packet_id)) {
+                    if (call_publish_handler(packet_id, topic_name_pos, topic_name_length, i)) {
+                        qos2_publish_handled_.insert(*packet_id);
                         res();
                         return true;
                     }
@@ -5195,16 +6969,43 @@ private:
         return true;
     }
 
-    bool handle_puback(async_handler_t const& /*func*/) {
+    bool call_publish_handler(
+        mqtt::optional<packet_id_t> const& packet_id,
+        std::size_t topic_name_pos,
+        std::size_t topic_name_length,
+        std::size_t contents_pos) {
+        if (h_publish_view_) {
+            // Move the payload into the shared buffer. The previous buffer is reused
+            // if the user doesn't keep it.
+            if (!publish_buffer_ || publish_buffer_.use_count() != 1) {
+                publish_buffer_ = std::allocate_shared<buffer_t>(Alloc());
+            }
+            publish_buffer_->swap(payload_);
+            auto const& b = *publish_buffer_;
+            return h_publish_view_(
+                fixed_header_,
+                packet_id,
+                string_view(b.data() + topic_name_pos, topic_name_length),
+                string_view(b.data() + contents_pos, b.size() - contents_pos),
+                publish_buffer_
+            );
+        }
+        return h_publish_(
+            fixed_header_,
+            packet_id,
+            std::string(payload_.data() + topic_name_pos, topic_name_length),
+            std::string(payload_.data() + contents_pos, payload_.size() - contents_pos)
+        );
+    }
+
+    bool handle_puback(session_handler_t const& /*func*/) {
         packet_id_t packet_id = make_packet_id<PacketIdBytes>::apply(
             &payload_[0],
             &payload_[0 + sizeof(packet_id_t)]
         );
         {
             LockGuard<Mutex> lck (store_mtx_);
-            auto& idx = store_.template get<tag_packet_id_type>();
-            auto r = idx.equal_range(std::make_tuple(packet_id, control_packet_type::puback));
-            idx.erase(std::get<0>(r), std::get<1>(r));
+            store_.erase(packet_id, control_packet_type::puback);
             packet_id_.erase(packet_id);
         }
         if (h_serialize_remove_) h_serialize_remove_(packet_id);
@@ -5212,16 +7013,14 @@ private:
         return true;
     }
 
-    bool handle_pubrec(async_handler_t const& func) {
+    bool handle_pubrec(session_handler_t const& func) {
         packet_id_t packet_id = make_packet_id<PacketIdBytes>::apply(
             &payload_[0],
             &payload_[0 + sizeof(packet_id_t)]
         );
         {
             LockGuard<Mutex> lck (store_mtx_);
-            auto& idx = store_.template get<tag_packet_id_type>();
-            auto r = idx.equal_range(std::make_tuple(packet_id, control_packet_type::pubrec));
-            idx.erase(std::get<0>(r), std::get<1>(r));
+            store_.erase(packet_id, control_packet_type::pubrec);
             // packet_id shouldn't be erased here.
             // It is reused for pubrel/pubcomp.
         }
@@ -5248,7 +7047,7 @@ private:
         return true;
     }
 
-    bool handle_pubrel(async_handler_t const& func) {
+    bool handle_pubrel(session_handler_t const& func) {
         packet_id_t packet_id = make_packet_id<PacketIdBytes>::apply(
             &payload_[0],
             &payload_[0 + sizeof(packet_id_t)]
@@ -5275,16 +7074,14 @@ private:
         return true;
     }
 
-    bool handle_pubcomp(async_handler_t const& /*func*/) {
+    bool handle_pubcomp(session_handler_t const& /*func*/) {
         packet_id_t packet_id = make_packet_id<PacketIdBytes>::apply(
             &payload_[0],
             &payload_[0 + sizeof(packet_id_t)]
         );
         {
             LockGuard<Mutex> lck (store_mtx_);
-            auto& idx = store_.template get<tag_packet_id_type>();
-            auto r = idx.equal_range(std::make_tuple(packet_id, control_packet_type::pubcomp));
-            idx.erase(std::get<0>(r), std::get<1>(r));
+            store_.erase(packet_id, control_packet_type::pubcomp);
             packet_id_.erase(packet_id);
         }
         if (h_serialize_remove_) h_serialize_remove_(packet_id);
@@ -5292,7 +7089,7 @@ private:
         return true;
     }
 
-    bool handle_subscribe(async_handler_t const& func) {
+    bool handle_subscribe(session_handler_t const& func) {
         std::size_t i = 0;
         if (remaining_length_ < sizeof(packet_id_t)) {
             if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
@@ -5336,7 +7133,7 @@ private:
         return true;
     }
 
-    bool handle_suback(async_handler_t const& func) {
+    bool handle_suback(session_handler_t const& func) {
         if (remaining_length_ < sizeof(packet_id_t)) {
             if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
             return false;
@@ -5365,7 +7162,7 @@ private:
         return true;
     }
 
-    bool handle_unsubscribe(async_handler_t const& func) {
+    bool handle_unsubscribe(session_handler_t const& func) {
         std::size_t i = 0;
         if (remaining_length_ < sizeof(packet_id_t)) {
             if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
@@ -5401,7 +7198,7 @@ private:
         return true;
     }
 
-    bool handle_unsuback(async_handler_t const& /*func*/) {
+    bool handle_unsuback(session_handler_t const& /*func*/) {
         packet_id_t packet_id = make_packet_id<PacketIdBytes>::apply(
             &payload_[0],
             &payload_[0 + sizeof(packet_id_t)]
@@ -5414,17 +7211,17 @@ private:
         return true;
     }
 
-    bool handle_pingreq(async_handler_t const& /*func*/) {
+    bool handle_pingreq(session_handler_t const& /*func*/) {
         if (h_pingreq_) return h_pingreq_();
         return true;
     }
 
-    bool handle_pingresp(async_handler_t const& /*func*/) {
+    bool handle_pingresp(session_handler_t const& /*func*/) {
         if (h_pingresp_) return h_pingresp_();
         return true;
     }
 
-    void handle_disconnect(async_handler_t const& /*func*/) {
+    void handle_disconnect(session_handler_t const& /*func*/) {
         if (h_disconnect_) h_disconnect_();
     }
 
@@ -5443,16 +7240,13 @@ private:
     }
 
     void send_connack(bool session_present, std::uint8_t return_code) {
-        do_sync_write(
-            connack_message(
-                session_present,
-                return_code
-            )
-        );
+        do_sync_write(detail::encode_connack(session_present, return_code));
     }
 
+    // Topic is as::const_buffer or prepared_topic.
+    template <typename Topic>
     void send_publish(
-        as::const_buffer const& topic_name,
+        Topic const& topic_name,
         std::uint8_t qos,
         bool retain,
         bool dup,
@@ -5488,7 +7282,7 @@ private:
                     store_msg,
                     [g] {}
                 );
-                BOOST_ASSERT(ret.second);
+                BOOST_ASSERT(ret);
             }
             if (h_serialize_publish_) {
                 h_serialize_publish_(msg);
@@ -5497,13 +7291,125 @@ private:
         do_sync_write(msg);
     }
 
+    void send_publish(
+        std::shared_ptr<publish_fanout_t const> const& fanout,
+        std::uint8_t qos,
+        packet_id_t packet_id) {
+
+        auto msg = fanout->message(qos, packet_id);
+        if (qos == qos::at_least_once || qos == qos::exactly_once) {
+            store_publish(msg, fanout);
+        }
+        do_sync_write(msg);
+    }
+
+    // The lambda that keeps only fanout fits in the local storage of std::function.
+    void store_publish(
+        basic_publish_message<PacketIdBytes> const& msg,
+        std::shared_ptr<publish_fanout_t const> const& fanout) {
+        auto store_msg = msg;
+        store_msg.set_dup(true);
+        {
+            LockGuard<Mutex> lck (store_mtx_);
+            auto ret = store_.emplace(
+                msg.packet_id(),
+                msg.qos() == qos::at_least_once ? control_packet_type::puback
+                                                : control_packet_type::pubrec,
+                store_msg,
+                [fanout] {}
+            );
+            BOOST_ASSERT(ret);
+        }
+        if (h_serialize_publish_) {
+            h_serialize_publish_(msg);
+        }
+    }
+
+    // Make the messages of publish_batch and async_publish_batch.
+    // All topic names and contents are copied into one buffer that is returned.
+    // The packet ids are acquired and the messages are stored under one lock.
+    template <typename Range>
+    std::shared_ptr<buffer_t> store_publish_batch(
+        Range const& entries,
+        std::vector<basic_publish_message<PacketIdBytes>>& msgs,
+        std::vector<packet_id_t>& packet_ids) {
+        std::size_t count = 0;
+        std::size_t total_size = 0;
+        for (auto const& e : entries) {
+            ++count;
+            total_size += std::get<0>(e).size() + std::get<1>(e).size();
+        }
+        auto sp = std::allocate_shared<buffer_t>(Alloc());
+        sp->reserve(total_size);
+        for (auto const& e : entries) {
+            sp->insert(sp->end(), std::get<0>(e).begin(), std::get<0>(e).end());
+            sp->insert(sp->end(), std::get<1>(e).begin(), std::get<1>(e).end());
+        }
+        msgs.reserve(count);
+        packet_ids.reserve(count);
+
+        {
+            LockGuard<Mutex> lck (store_mtx_);
+            try {
+                auto p = sp->data();
+                for (auto const& e : entries) {
+                    auto const& topic_name = std::get<0>(e);
+                    auto const& contents = std::get<1>(e);
+                    std::uint8_t qos = std::get<2>(e);
+                    BOOST_ASSERT(qos == qos::at_most_once || qos == qos::at_least_once || qos == qos::exactly_once);
+                    packet_id_t packet_id = 0;
+                    if (qos != qos::at_most_once) {
+                        packet_id = packet_id_.acquire();
+                        if (packet_id == 0) throw packet_id_exhausted_error();
+                    }
+                    packet_ids.push_back(packet_id);
+                    msgs.emplace_back(
+                        as::buffer(p, topic_name.size()),
+                        qos,
+                        false,
+                        false,
+                        packet_id,
+                        as::buffer(p + topic_name.size(), contents.size())
+                    );
+                    p += topic_name.size() + contents.size();
+                }
+            }
+            catch (...) {
+                // Nothing is stored yet. Release the acquired packet ids.
+                for (auto packet_id : packet_ids) {
+                    if (packet_id != 0) packet_id_.erase(packet_id);
+                }
+                throw;
+            }
+            for (auto const& msg : msgs) {
+                if (msg.qos() == qos::at_most_once) continue;
+                auto store_msg = msg;
+                store_msg.set_dup(true);
+                auto ret = store_.emplace(
+                    msg.packet_id(),
+                    msg.qos() == qos::at_least_once ? control_packet_type::puback
+                                                    : control_packet_type::pubrec,
+                    store_msg,
+                    [sp] {}
+                );
+                BOOST_ASSERT(ret);
+            }
+        }
+        if (h_serialize_publish_) {
+            for (auto const& msg : msgs) {
+                if (msg.qos() != qos::at_most_once) h_serialize_publish_(msg);
+            }
+        }
+        return sp;
+    }
+
     void send_puback(packet_id_t packet_id) {
-        do_sync_write(basic_puback_message<PacketIdBytes>(packet_id));
+        do_sync_write(detail::encode_header_packet_id<PacketIdBytes>(control_packet_type::puback, 0b0000, packet_id));
         if (h_pub_res_sent_) h_pub_res_sent_(packet_id);
     }
 
     void send_pubrec(packet_id_t packet_id) {
-        do_sync_write(basic_pubrec_message<PacketIdBytes>(packet_id));
+        do_sync_write(detail::encode_header_packet_id<PacketIdBytes>(control_packet_type::pubrec, 0b0000, packet_id));
     }
 
     void send_pubrel(packet_id_t packet_id) {
@@ -5522,7 +7428,7 @@ private:
                 msg,
                 [] {}
             );
-            BOOST_ASSERT(ret.second);
+            BOOST_ASSERT(ret);
         }
 
         if (h_serialize_pubrel_) {
@@ -5545,7 +7451,7 @@ private:
                 msg,
                 [] {}
             );
-            BOOST_ASSERT(ret.second);
+            BOOST_ASSERT(ret);
             if (h_serialize_pubrel_) {
                 h_serialize_pubrel_(msg);
             }
@@ -5553,7 +7459,7 @@ private:
     }
 
     void send_pubcomp(packet_id_t packet_id) {
-        do_sync_write(basic_pubcomp_message<PacketIdBytes>(packet_id));
+        do_sync_write(detail::encode_header_packet_id<PacketIdBytes>(control_packet_type::pubcomp, 0b0000, packet_id));
         if (h_pub_res_sent_) h_pub_res_sent_(packet_id);
     }
 
@@ -5626,33 +7532,49 @@ private:
 
     void send_unsuback(
         packet_id_t packet_id) {
-        do_sync_write(basic_unsuback_message<PacketIdBytes>(packet_id));
+        do_sync_write(detail::encode_header_packet_id<PacketIdBytes>(control_packet_type::unsuback, 0b0000, packet_id));
     }
 
     void send_pingreq() {
-        do_sync_write(pingreq_message());
+        do_sync_write(detail::encode_header_only(control_packet_type::pingreq, 0b0000));
     }
 
     void send_pingresp() {
-        do_sync_write(pingresp_message());
+        do_sync_write(detail::encode_header_only(control_packet_type::pingresp, 0b0000));
     }
 
     void send_disconnect() {
-        do_sync_write(disconnect_message());
+        do_sync_write(detail::encode_header_only(control_packet_type::disconnect, 0b0000));
     }
 
     // Blocking write
-    template <typename MessageVariant>
-    void do_sync_write(MessageVariant&& mv) {
+    // The buffer sequence of the message is written directly, without converting to the variant.
+    template <typename Message>
+    void do_sync_write(Message const& m) {
+        do_sync_write_buffers(m.const_buffer_sequence());
+    }
+
+    // The fixed size control packet is written from the stack array.
+    template <std::size_t N>
+    void do_sync_write(std::array<char, N> const& packet) {
+        do_sync_write_buffers(as::buffer(packet));
+    }
+
+    void do_sync_write(basic_message_variant<PacketIdBytes> const& mv) {
+        do_sync_write_buffers(const_buffer_sequence<PacketIdBytes>(mv));
+    }
+
+    template <typename ConstBufferSequence>
+    void do_sync_write_buffers(ConstBufferSequence const& cbs) {
         boost::system::error_code ec;
         if (!connected_) return;
         if (h_pre_send_) h_pre_send_();
-        write(*socket_, const_buffer_sequence<PacketIdBytes>(std::forward<MessageVariant>(mv)), ec);
+        write(*socket_, cbs, ec);
         if (ec) handle_error(ec);
     }
 
     // Non blocking (async) senders
-    void async_send_connect(std::uint16_t keep_alive_sec, async_handler_t const& func) {
+    void async_send_connect(std::uint16_t keep_alive_sec, async_handler_t func) {
         do_async_write(
             connect_message(
                 keep_alive_sec,
@@ -5662,36 +7584,26 @@ private:
                 user_name_,
                 password_
             ),
-            func
+            std::move(func)
         );
     }
 
-    void async_send_connack(bool session_present, std::uint8_t return_code, async_handler_t const& func) {
-        do_async_write(
-            connack_message(
-                session_present,
-                return_code
-            ),
-            func
-        );
+    void async_send_connack(bool session_present, std::uint8_t return_code, async_handler_t func) {
+        do_async_write(fixed_packet(detail::encode_connack(session_present, return_code)), std::move(func));
     }
 
+    // Topic is as::const_buffer or prepared_topic.
+    template <typename Topic>
     void async_send_publish(
-        as::const_buffer const& topic_name,
+        Topic const& topic_name,
         std::uint8_t qos,
         bool retain,
         bool dup,
         packet_id_t packet_id,
         as::const_buffer const& payload,
-        async_handler_t const& func,
+        async_handler_t func,
         life_keeper_t life_keeper) {
 
-        auto g = shared_scope_guard(
-            [MQTT_CAPTURE_MOVE(life_keeper)] {
-                if (life_keeper) life_keeper();
-            }
-        );
-
         auto msg =
             basic_publish_message<PacketIdBytes>(
                 topic_name,
@@ -5703,6 +7615,13 @@ private:
             );
 
         if (qos == qos::at_least_once || qos == qos::exactly_once) {
+            // The contents are kept until both the store entry and the queued message are released.
+            auto g = shared_scope_guard(
+                [MQTT_CAPTURE_MOVE(life_keeper)] {
+                    if (life_keeper) life_keeper();
+                }
+            );
+            life_keeper = [g] {};
             auto store_msg = msg;
             store_msg.set_dup(true);
             {
@@ -5714,7 +7633,7 @@ private:
                     store_msg,
                     [g] {}
                 );
-                BOOST_ASSERT(ret.second);
+                BOOST_ASSERT(ret);
             }
 
             if (h_serialize_publish_) {
@@ -5722,19 +7641,27 @@ private:
             }
         }
 
-        do_async_write(
-            msg,
-            [g, func](boost::system::error_code const& ec) {
-                if (func) func(ec);
-            }
-        );
+        do_async_write(msg, std::move(func), std::move(life_keeper));
+    }
+
+    void async_send_publish(
+        std::shared_ptr<publish_fanout_t const> const& fanout,
+        std::uint8_t qos,
+        packet_id_t packet_id,
+        async_handler_t func) {
+
+        auto msg = fanout->message(qos, packet_id);
+        if (qos == qos::at_least_once || qos == qos::exactly_once) {
+            store_publish(msg, fanout);
+        }
+        do_async_write(std::move(msg), std::move(func), [fanout] {});
     }
 
-    void async_send_puback(packet_id_t packet_id, async_handler_t const& func) {
+    void async_send_puback(packet_id_t packet_id, async_handler_t func) {
         auto self = this->shared_from_this();
         do_async_write(
-            basic_puback_message<PacketIdBytes>(packet_id),
-            [this, self, packet_id, func]
+            fixed_packet(detail::encode_header_packet_id<PacketIdBytes>(control_packet_type::puback, 0b0000, packet_id)),
+            [this, self, packet_id, MQTT_CAPTURE_MOVE(func)]
             (boost::system::error_code const& ec){
                 if (func) func(ec);
                 if (h_pub_res_sent_) h_pub_res_sent_(packet_id);
@@ -5742,14 +7669,14 @@ private:
         );
     }
 
-    void async_send_pubrec(packet_id_t packet_id, async_handler_t const& func) {
+    void async_send_pubrec(packet_id_t packet_id, async_handler_t func) {
         do_async_write(
-            basic_pubrec_message<PacketIdBytes>(packet_id),
-            func
+            fixed_packet(detail::encode_header_packet_id<PacketIdBytes>(control_packet_type::pubrec, 0b0000, packet_id)),
+            std::move(func)
         );
     }
 
-    void async_send_pubrel(packet_id_t packet_id, async_handler_t const& func) {
+    void async_send_pubrel(packet_id_t packet_id, async_handler_t func) {
 
         auto msg = basic_pubrel_message<PacketIdBytes>(packet_id);
 
@@ -5764,20 +7691,20 @@ private:
                 control_packet_type::pubcomp,
                 msg,
                 [] {});
-            BOOST_ASSERT(ret.second);
+            BOOST_ASSERT(ret);
         }
 
         if (h_serialize_pubrel_) {
             h_serialize_pubrel_(msg);
         }
-        do_async_write(msg, func);
+        do_async_write(msg, std::move(func));
     }
 
-    void async_send_pubcomp(packet_id_t packet_id, async_handler_t const& func) {
+    void async_send_pubcomp(packet_id_t packet_id, async_handler_t func) {
         auto self = this->shared_from_this();
         do_async_write(
-            basic_pubcomp_message<PacketIdBytes>(packet_id),
-            [this, self, packet_id, func]
+            fixed_packet(detail::encode_header_packet_id<PacketIdBytes>(control_packet_type::pubcomp, 0b0000, packet_id)),
+            [this, self, packet_id, MQTT_CAPTURE_MOVE(func)]
             (boost::system::error_code const& ec){
                 if (func) func(ec);
                 if (h_pub_res_sent_) h_pub_res_sent_(packet_id);
@@ -5816,14 +7743,12 @@ private:
         std::vector<std::tuple<as::const_buffer, std::uint8_t>> const& params,
         std::vector<std::shared_ptr<std::string>> const& life_keepers,
         packet_id_t packet_id,
-        async_handler_t const& func) {
+        async_handler_t func) {
 
         do_async_write(
             basic_subscribe_message<PacketIdBytes>(params, packet_id),
-            [life_keepers, func]
-            (boost::system::error_code const& ec) {
-                if (func) func(ec);
-            }
+            std::move(func),
+            [life_keepers] {}
         );
     }
 
@@ -5839,8 +7764,8 @@ private:
     void async_send_suback(
         std::vector<std::uint8_t> const& params,
         packet_id_t packet_id,
-        async_handler_t const& func) {
-        do_async_write(basic_suback_message<PacketIdBytes>(params, packet_id), func);
+        async_handler_t func) {
+        do_async_write(basic_suback_message<PacketIdBytes>(params, packet_id), std::move(func));
     }
 
     template <typename... Args>
@@ -5871,92 +7796,184 @@ private:
         std::vector<as::const_buffer> const& params,
         std::vector<std::shared_ptr<std::string>> const& life_keepers,
         packet_id_t packet_id,
-        async_handler_t const& func) {
+        async_handler_t func) {
         do_async_write(
             basic_unsubscribe_message<PacketIdBytes>(
                 params,
                 packet_id
             ),
-            [life_keepers, func]
-            (boost::system::error_code const& ec) {
-                if (func) func(ec);
-            }
+            std::move(func),
+            [life_keepers] {}
         );
     }
 
     void async_send_unsuback(
-        packet_id_t packet_id, async_handler_t const& func) {
-        do_async_write(basic_unsuback_message<PacketIdBytes>(packet_id), func);
+        packet_id_t packet_id, async_handler_t func) {
+        do_async_write(fixed_packet(detail::encode_header_packet_id<PacketIdBytes>(control_packet_type::unsuback, 0b0000, packet_id)), std::move(func));
     }
 
-    void async_send_pingreq(async_handler_t const& func) {
-        do_async_write(pingreq_message(), func);
+    void async_send_pingreq(async_handler_t func) {
+        do_async_write(fixed_packet(detail::encode_header_only(control_packet_type::pingreq, 0b0000)), std::move(func));
     }
 
-    void async_send_pingresp(async_handler_t const& func) {
-        do_async_write(pingresp_message(), func);
+    void async_send_pingresp(async_handler_t func) {
+        do_async_write(fixed_packet(detail::encode_header_only(control_packet_type::pingresp, 0b0000)), std::move(func));
     }
 
-    void async_send_disconnect(async_handler_t const& func) {
-        do_async_write(disconnect_message(), func);
+    void async_send_disconnect(async_handler_t func) {
+        do_async_write(fixed_packet(detail::encode_header_only(control_packet_type::disconnect, 0b0000)), std::move(func));
     }
 
     // Non blocking (async) write
 
+    // Fixed size control packet that is encoded by the constexpr encoders.
+    // It is stored and written without the message variant.
+    struct fixed_packet {
+        // fixed header, remaining length and 4 bytes packet id
+        static constexpr std::size_t const max_size = 2 + 4;
+        fixed_packet():size(0) {}
+        template <std::size_t N>
+        explicit fixed_packet(std::array<char, N> const& packet)
+            :size(N) {
+            static_assert(N <= max_size, "the packet is too large");
+            std::copy(packet.begin(), packet.end(), bytes.begin());
+        }
+        std::array<char, max_size> bytes;
+        std::size_t size;
+    };
+
+    // The life keeper is called when the packet is destroyed, after the handler is called.
+    // It is kept in move_only_function that is empty after it is moved from,
+    // so it is called only once.
     class async_packet {
     public:
         async_packet(
             basic_message_variant<PacketIdBytes> const& mv,
-            async_handler_t h = async_handler_t())
+            async_handler_t h = async_handler_t(),
+            life_keeper_t life_keeper = life_keeper_t())
             :
-            mv_(mv), handler_(std::move(h)) {}
+            mv_(mv), handler_(std::move(h)), life_keeper_(std::move(life_keeper)) {}
         async_packet(
             basic_message_variant<PacketIdBytes>&& mv,
-            async_handler_t h = async_handler_t())
+            async_handler_t h = async_handler_t(),
+            life_keeper_t life_keeper = life_keeper_t())
             :
-            mv_(std::move(mv)), handler_(std::move(h)) {}
-        basic_message_variant<PacketIdBytes> const& message() const {
-            return mv_;
+            mv_(std::move(mv)), handler_(std::move(h)), life_keeper_(std::move(life_keeper)) {}
+        async_packet(
+            fixed_packet const& p,
+            async_handler_t h = async_handler_t(),
+            life_keeper_t life_keeper = life_keeper_t())
+            :
+            fixed_(p), handler_(std::move(h)), life_keeper_(std::move(life_keeper)) {}
+        async_packet(async_packet&&) = default;
+        ~async_packet() {
+            if (life_keeper_) life_keeper_();
         }
-        basic_message_variant<PacketIdBytes>& message() {
-            return mv_;
+        std::size_t size() const {
+            return mv_ ? mqtt::size<PacketIdBytes>(*mv_) : fixed_.size;
+        }
+        template <typename Container>
+        void add_const_buffer_sequence(Container& buf) const {
+            if (mv_) mqtt::add_const_buffer_sequence(buf, *mv_);
+            else buf.emplace_back(as::buffer(fixed_.bytes.data(), fixed_.size));
         }
         async_handler_t const& handler() const { return handler_; }
         async_handler_t& handler() { return handler_; }
     private:
-        basic_message_variant<PacketIdBytes> mv_;
+        mqtt::optional<basic_message_variant<PacketIdBytes>> mv_;
+        fixed_packet fixed_;
         async_handler_t handler_;
+        move_only_function<void()> life_keeper_;
     };
 
-    void do_async_write(basic_message_variant<PacketIdBytes> mv, async_handler_t const& func) {
+    void do_async_write(
+        basic_message_variant<PacketIdBytes> mv,
+        async_handler_t func,
+        life_keeper_t life_keeper = life_keeper_t()) {
+        do_async_write_packet(std::move(mv), std::move(func), std::move(life_keeper));
+    }
+
+    // The fixed size control packet is captured and queued by value, without the message variant.
+    void do_async_write(fixed_packet const& p, async_handler_t func) {
+        do_async_write_packet(p, std::move(func), life_keeper_t());
+    }
+
+    // The handler and the life keeper are moved into the queue without wrapping.
+    template <typename Packet>
+    void do_async_write_packet(Packet p, async_handler_t func, life_keeper_t life_keeper) {
+        async_packet packet(std::move(p), std::move(func), std::move(life_keeper));
         auto self = this->shared_from_this();
         socket_->post(
-            [this, self, MQTT_CAPTURE_MOVE(mv), func]
-            () {
+            [this, self, MQTT_CAPTURE_MOVE(packet)]
+            () mutable {
                 if (!connected_) {
                     // offline async publish is successfully finished
-                    if (func) func(boost::system::errc::make_error_code(boost::system::errc::success));
+                    if (packet.handler()) packet.handler()(boost::system::errc::make_error_code(boost::system::errc::success));
                     return;
                 }
-                queue_.emplace_back(std::move(mv), func);
+                queue_.emplace_back(std::move(packet));
                 if (queue_.size() > 1) return;
                 do_async_write();
             }
         );
     }
 
+    // All messages are queued by one post, and written together if the queue send limits allow.
+    // func is called when the last message is written.
+    void do_async_write_batch(
+        std::vector<basic_publish_message<PacketIdBytes>> msgs,
+        async_handler_t func,
+        life_keeper_t life_keeper) {
+        if (msgs.empty()) {
+            if (func) func(boost::system::errc::make_error_code(boost::system::errc::success));
+            if (life_keeper) life_keeper();
+            return;
+        }
+        async_packet packet(std::move(msgs.back()), std::move(func), std::move(life_keeper));
+        msgs.pop_back();
+        auto self = this->shared_from_this();
+        socket_->post(
+            [this, self, MQTT_CAPTURE_MOVE(msgs), MQTT_CAPTURE_MOVE(packet)]
+            () mutable {
+                if (!connected_) {
+                    // offline async publish is successfully finished
+                    if (packet.handler()) packet.handler()(boost::system::errc::make_error_code(boost::system::errc::success));
+                    return;
+                }
+                for (auto& msg : msgs) {
+                    queue_.emplace_back(std::move(msg));
+                }
+                queue_.emplace_back(std::move(packet));
+                if (queue_.size() > msgs.size() + 1) return;
+                do_async_write();
+            }
+        );
+    }
+
     void do_async_write() {
-        auto const& elem = queue_.front();
-        auto const& mv = elem.message();
+        auto& buf = send_buffers_;
+        buf.clear();
+        std::size_t total_size = 0;
+        std::size_t count = 0;
+        for (auto const& elem : queue_) {
+            if (max_queue_send_count_ != 0 && count == max_queue_send_count_) break;
+            auto size = elem.size();
+            if (count != 0 &&
+                max_queue_send_size_ != 0 &&
+                total_size + size > max_queue_send_size_) break;
+            elem.add_const_buffer_sequence(buf);
+            total_size += size;
+            ++count;
+        }
         auto self = this->shared_from_this();
         if (h_pre_send_) h_pre_send_();
         async_write(
             *socket_,
-            const_buffer_sequence(mv),
+            buf,
             write_completion_handler(
                 std::move(self),
-                elem.handler(),
-                mqtt::size<PacketIdBytes>(mv)
+                count,
+                total_size
             )
         );
     }
@@ -5972,22 +7989,17 @@ private:
     struct write_completion_handler {
         write_completion_handler(
             std::shared_ptr<this_type> self,
-            async_handler_t func,
+            std::size_t count,
             std::size_t expected)
             :self_(std::move(self)),
-             func_(std::move(func)),
+             count_(count),
              expected_(expected)
         {}
         void operator()(boost::system::error_code const& ec) const {
-            if (func_) func_(ec);
-            self_->queue_.pop_front();
+            complete(ec);
             if (ec || // Error is handled by async_read.
                 !self_->connected_) {
-                self_->connected_ = false;
-                while (!self_->queue_.empty()) {
-                    self_->queue_.front().handler()(ec);
-                    self_->queue_.pop_front();
-                }
+                abort(ec);
                 return;
             }
             if (!self_->queue_.empty()) {
@@ -5997,31 +8009,37 @@ private:
         void operator()(
             boost::system::error_code const& ec,
             std::size_t bytes_transferred) const {
-            if (func_) func_(ec);
-            self_->queue_.pop_front();
+            complete(ec);
             if (ec || // Error is handled by async_read.
                 !self_->connected_) {
-                self_->connected_ = false;
-                while (!self_->queue_.empty()) {
-                    self_->queue_.front().handler()(ec);
-                    self_->queue_.pop_front();
-                }
+                abort(ec);
                 return;
             }
             if (expected_ != bytes_transferred) {
-                self_->connected_ = false;
-                while (!self_->queue_.empty()) {
-                    self_->queue_.front().handler()(ec);
-                    self_->queue_.pop_front();
-                }
+                abort(ec);
                 throw write_bytes_transferred_error(expected_, bytes_transferred);
             }
             if (!self_->queue_.empty()) {
                 self_->do_async_write();
             }
         }
+    private:
+        // Call the handlers of the messages that are written by this write.
+        void complete(boost::system::error_code const& ec) const {
+            for (std::size_t i = 0; i != count_; ++i) {
+                if (self_->queue_.front().handler()) self_->queue_.front().handler()(ec);
+                self_->queue_.pop_front();
+            }
+        }
+        void abort(boost::system::error_code const& ec) const {
+            self_->connected_ = false;
+            while (!self_->queue_.empty()) {
+                if (self_->queue_.front().handler()) self_->queue_.front().handler()(ec);
+                self_->queue_.pop_front();
+            }
+        }
         std::shared_ptr<this_type> self_;
-        async_handler_t func_;
+        std::size_t count_;
         std::size_t expected_;
     };
 
@@ -6038,12 +8056,14 @@ private:
     std::uint8_t fixed_header_;
     std::size_t remaining_length_multiplier_;
     std::size_t remaining_length_;
-    std::vector<char> payload_;
+    buffer_t payload_;
+    std::shared_ptr<buffer_t> publish_buffer_;
     close_handler h_close_;
     error_handler h_error_;
     connect_handler h_connect_;
     connack_handler h_connack_;
     publish_handler h_publish_;
+    publish_view_handler h_publish_view_;
     puback_handler h_puback_;
     pubrec_handler h_pubrec_;
     pubrel_handler h_pubrel_;
@@ -6064,16 +8084,27 @@ private:
     mqtt::optional<std::string> user_name_;
     mqtt::optional<std::string> password_;
     Mutex store_mtx_;
-    mi_store store_;
-    std::set<packet_id_t> qos2_publish_handled_;
-    std::deque<async_packet> queue_;
-    packet_id_t packet_id_master_;
-    std::set<packet_id_t> packet_id_;
+    Store<store, Alloc> store_;
+    packet_id_set<packet_id_t, Alloc> qos2_publish_handled_;
+    std::deque<async_packet, rebind_alloc<async_packet>> queue_;
+    packet_id_pool<packet_id_t, Alloc> packet_id_;
     bool auto_pub_response_;
     bool auto_pub_response_async_;
+    bool async_resend_;
     bool disconnect_requested_;
     bool connect_requested_;
+    std::size_t read_buffer_size_;
+    buffer_t read_buf_;
+    std::size_t read_buf_begin_;
+    std::size_t read_buf_end_;
+    bool read_buf_parsing_;
+    bool read_buf_next_requested_;
+    std::size_t max_queue_send_count_;
+    std::size_t max_queue_send_size_;
+    std::vector<as::const_buffer, rebind_alloc<as::const_buffer>> send_buffers_;
     mqtt_message_processed_handler h_mqtt_message_processed_;
+
+    static constexpr std::size_t const min_read_buffer_size = 5; // fixed header and remaining length
 };
 
 } // namespace mqtt
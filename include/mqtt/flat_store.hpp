@@ -0,0 +1,217 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_FLAT_STORE_HPP)
+#define MQTT_FLAT_STORE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <algorithm>
+
+#include <mqtt/optional.hpp>
+
+namespace mqtt {
+
+/**
+ * @brief Store of in-flight messages that is keyed directly by packet id.
+ *
+ * Elements are kept in a node array with a free list, and linked in insertion order by
+ * indexes. The slot array is indexed by the lower bits of the packet id and points the nodes
+ * that have the packet id. Packet ids are acquired sequentially, so the ids in-flight
+ * don't collide while the number of elements is less than the number of slots.
+ * The slot array is doubled when the number of elements reaches it.<BR>
+ * emplace, erase and lookup are O(1), and no memory is allocated per element once the arrays
+ * have grown. for_each visits the elements in insertion order like multi_index_store.
+ * @tparam Element stored element. It has packet_id() and expected_control_packet_type().
+ * @tparam Alloc   allocator for the arrays.
+ */
+template <typename Element, typename Alloc = std::allocator<char>>
+class flat_store {
+public:
+    using packet_id_t = typename std::decay<decltype(std::declval<Element>().packet_id())>::type;
+
+    /**
+     * @brief Insert the element.
+     * @return If the element that has the same packet_id and type is already stored, return false,
+     *         otherwise return true.
+     */
+    template <typename... Args>
+    bool emplace(Args&&... args) {
+        auto ni = allocate_node();
+        auto& n = nodes_[ni];
+        n.value.emplace(std::forward<Args>(args)...);
+        auto packet_id = n.value->packet_id();
+        if (find(packet_id, n.value->expected_control_packet_type()) != npos) {
+            free_node(ni);
+            return false;
+        }
+        if (size_ == slots_.size()) grow();
+
+        // link to the tail of insertion order
+        n.prev = tail_;
+        n.next = npos;
+        if (tail_ == npos) head_ = ni;
+        else nodes_[tail_].next = ni;
+        tail_ = ni;
+
+        // link to the head of the slot
+        auto& s = slots_[slot(packet_id)];
+        n.next_in_slot = s;
+        s = ni;
+
+        ++size_;
+        return true;
+    }
+
+    /**
+     * @brief Erase the element that has packet_id and expected control packet type.
+     */
+    void erase(packet_id_t packet_id, std::uint8_t type) {
+        if (slots_.empty()) return;
+        auto* link = &slots_[slot(packet_id)];
+        while (*link != npos) {
+            auto ni = *link;
+            auto& v = *nodes_[ni].value;
+            if (v.packet_id() == packet_id && v.expected_control_packet_type() == type) {
+                *link = nodes_[ni].next_in_slot;
+                unlink(ni);
+                return;
+            }
+            link = &nodes_[ni].next_in_slot;
+        }
+    }
+
+    /**
+     * @brief Erase all elements that have packet_id.
+     */
+    void erase(packet_id_t packet_id) {
+        if (slots_.empty()) return;
+        auto* link = &slots_[slot(packet_id)];
+        while (*link != npos) {
+            auto ni = *link;
+            if (nodes_[ni].value->packet_id() == packet_id) {
+                *link = nodes_[ni].next_in_slot;
+                unlink(ni);
+            }
+            else {
+                link = &nodes_[ni].next_in_slot;
+            }
+        }
+    }
+
+    void clear() {
+        nodes_.clear();
+        std::fill(slots_.begin(), slots_.end(), npos);
+        head_ = tail_ = free_ = npos;
+        size_ = 0;
+    }
+
+    /**
+     * @brief Apply f to the elements in insertion order.
+     * @param f applying function. f should be void(Element const&)
+     */
+    template <typename F>
+    void for_each(F&& f) const {
+        for (auto ni = head_; ni != npos; ni = nodes_[ni].next) {
+            f(*nodes_[ni].value);
+        }
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+private:
+    using index_t = std::uint32_t;
+    static constexpr index_t const npos = std::numeric_limits<index_t>::max();
+    static constexpr std::size_t const initial_slots = 16;
+
+    struct node {
+        optional<Element> value;
+        index_t prev = npos;
+        index_t next = npos;
+        index_t next_in_slot = npos;
+    };
+
+    template <typename T>
+    using rebind_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+
+    std::size_t slot(packet_id_t packet_id) const {
+        return std::size_t(packet_id) & (slots_.size() - 1);
+    }
+
+    index_t find(packet_id_t packet_id, std::uint8_t type) const {
+        if (slots_.empty()) return npos;
+        for (auto ni = slots_[slot(packet_id)]; ni != npos; ni = nodes_[ni].next_in_slot) {
+            auto const& v = *nodes_[ni].value;
+            if (v.packet_id() == packet_id && v.expected_control_packet_type() == type) return ni;
+        }
+        return npos;
+    }
+
+    index_t allocate_node() {
+        if (free_ != npos) {
+            auto ni = free_;
+            free_ = nodes_[ni].next;
+            return ni;
+        }
+        nodes_.emplace_back();
+        return static_cast<index_t>(nodes_.size() - 1);
+    }
+
+    void free_node(index_t ni) {
+        auto& n = nodes_[ni];
+        n.value = nullopt;
+        n.next = free_;
+        free_ = ni;
+    }
+
+    // Remove from insertion order and release. The node is already removed from the slot.
+    void unlink(index_t ni) {
+        auto& n = nodes_[ni];
+        if (n.prev == npos) head_ = n.next;
+        else nodes_[n.prev].next = n.next;
+        if (n.next == npos) tail_ = n.prev;
+        else nodes_[n.next].prev = n.prev;
+        free_node(ni);
+        --size_;
+    }
+
+    void grow() {
+        slots_.assign(slots_.empty() ? initial_slots : slots_.size() * 2, npos);
+        for (auto ni = head_; ni != npos; ni = nodes_[ni].next) {
+            auto& s = slots_[slot(nodes_[ni].value->packet_id())];
+            nodes_[ni].next_in_slot = s;
+            s = ni;
+        }
+    }
+
+    std::vector<node, rebind_alloc<node>> nodes_;
+    std::vector<index_t, rebind_alloc<index_t>> slots_;
+    index_t head_ = npos;
+    index_t tail_ = npos;
+    index_t free_ = npos;
+    std::size_t size_ = 0;
+};
+
+template <typename Element, typename Alloc>
+constexpr typename flat_store<Element, Alloc>::index_t const flat_store<Element, Alloc>::npos;
+
+template <typename Element, typename Alloc>
+constexpr std::size_t const flat_store<Element, Alloc>::initial_slots;
+
+} // namespace mqtt
+
+#endif // MQTT_FLAT_STORE_HPP
@@ -9,8 +9,11 @@
 
 #include <string>
 #include <vector>
+#include <array>
+#include <utility>
 #include <memory>
 #include <algorithm>
+#include <functional>
 
 #include <boost/asio/buffer.hpp>
 #include <boost/optional.hpp>
@@ -36,6 +39,13 @@ namespace mqtt {
 
 namespace as = boost::asio;
 
+/**
+ * @brief Buffer sequence of a message that has the known maximum number of buffers.
+ *        The buffers are stored in the object, so it doesn't allocate memory.
+ */
+template <std::size_t N>
+using const_buffer_array = boost::container::static_vector<as::const_buffer, N>;
+
 namespace detail {
 
 inline void utf8string_check(string_view str) {
@@ -46,6 +56,48 @@ inline void utf8string_check(string_view str) {
     }
 }
 
+// Encoders of the fixed size control packets. The sizes are known at compile time.
+
+inline constexpr
+std::array<char, 2> encode_header_only(std::uint8_t type, std::uint8_t flags) {
+    return {{ static_cast<char>(make_fixed_header(type, flags)), 0 }};
+}
+
+template <std::size_t... I>
+inline constexpr
+std::array<char, 2 + sizeof...(I)> encode_header_packet_id_impl(
+    std::uint8_t fixed_header,
+    std::uint32_t packet_id,
+    std::index_sequence<I...>) {
+    return {{
+        static_cast<char>(fixed_header),
+        static_cast<char>(sizeof...(I)),
+        // big endian
+        static_cast<char>((packet_id >> ((sizeof...(I) - 1 - I) * 8)) & 0xff)...
+    }};
+}
+
+template <std::size_t PacketIdBytes>
+inline constexpr
+std::array<char, 2 + PacketIdBytes> encode_header_packet_id(
+    std::uint8_t type,
+    std::uint8_t flags,
+    typename packet_id_type<PacketIdBytes>::type packet_id) {
+    return encode_header_packet_id_impl(
+        make_fixed_header(type, flags),
+        packet_id,
+        std::make_index_sequence<PacketIdBytes>());
+}
+
+inline constexpr
+std::array<char, 4> encode_connack(bool session_present, std::uint8_t return_code) {
+    return {{
+        static_cast<char>(make_fixed_header(control_packet_type::connack, 0b0000)),
+        0b0010,
+        static_cast<char>(session_present ? 1 : 0),
+        static_cast<char>(return_code)
+    }};
+}
 
 class header_only_message {
 public:
@@ -53,7 +105,7 @@ public:
      * @brief Create empty header_packet_id_message.
      */
     header_only_message(std::uint8_t type, std::uint8_t flags)
-        : message_ { static_cast<char>(make_fixed_header(type, flags)), 0 }
+        : message_(encode_header_only(type, flags))
     {}
 
     /**
@@ -61,7 +113,7 @@ public:
      *        it is for boost asio APIs
      * @return const buffer sequence
      */
-    std::vector<as::const_buffer> const_buffer_sequence() const {
+    const_buffer_array<1> const_buffer_sequence() const {
         return { as::buffer(message_.data(), message_.size()) };
     }
 
@@ -83,7 +135,7 @@ public:
         return std::string(message_.data(), message_.size());
     }
 private:
-    boost::container::static_vector<char, 2> message_;
+    std::array<char, 2> message_;
 };
 
 
@@ -99,17 +151,15 @@ public:
      * @brief Create empty header_packet_id_message.
      */
     basic_header_packet_id_message(std::uint8_t type, std::uint8_t flags, typename packet_id_type<PacketIdBytes>::type packet_id)
-        : message_ { static_cast<char>(make_fixed_header(type, flags)), PacketIdBytes }
-    {
-        add_packet_id_to_buf<PacketIdBytes>::apply(message_, packet_id);
-    }
+        : message_(encode_header_packet_id<PacketIdBytes>(type, flags, packet_id))
+    {}
 
     template <typename Iterator>
     basic_header_packet_id_message(Iterator b, Iterator e) {
         if (std::distance(b, e) != 2 + PacketIdBytes) throw remaining_length_error();
         if (b[1] != PacketIdBytes) throw remaining_length_error();
 
-        std::copy(b, e, std::back_inserter(message_));
+        std::copy(b, e, message_.begin());
     }
 
     /**
@@ -117,7 +167,7 @@ public:
      *        it is for boost asio APIs
      * @return const buffer sequence
      */
-    std::vector<as::const_buffer> const_buffer_sequence() const {
+    const_buffer_array<1> const_buffer_sequence() const {
         return { as::buffer(message_.data(), message_.size()) };
     }
 
@@ -139,12 +189,12 @@ public:
         return std::string(message_.data(), message_.size());
     }
 protected:
-    boost::container::static_vector<char, 2 + PacketIdBytes> const& message() const {
+    std::array<char, 2 + PacketIdBytes> const& message() const {
         return message_;
     }
 
 private:
-    boost::container::static_vector<char, 2 + PacketIdBytes> message_;
+    std::array<char, 2 + PacketIdBytes> message_;
 };
 
 } // namespace detail
@@ -234,12 +284,7 @@ struct disconnect_message : detail::header_only_message {
 class connack_message {
 public:
     connack_message(bool session_present, std::uint8_t return_code)
-        : message_ {
-                    static_cast<char>(make_fixed_header(control_packet_type::connack, 0b0000)),
-              0b0010,
-              static_cast<char>(session_present ? 1 : 0),
-              static_cast<char>(return_code)
-          }
+        : message_(detail::encode_connack(session_present, return_code))
     {}
 
     /**
@@ -247,7 +292,7 @@ public:
      *        it is for boost asio APIs
      * @return const buffer sequence
      */
-    std::vector<as::const_buffer> const_buffer_sequence() const {
+    const_buffer_array<1> const_buffer_sequence() const {
         return { as::buffer(message_.data(), message_.size()) };
     }
 
@@ -270,12 +315,27 @@ public:
     }
 
 private:
-    boost::container::static_vector<char, 4> message_;
+    std::array<char, 4> message_;
 };
 
 // variable length messages
 
 class connect_message {
+    using buffers_t = const_buffer_array<
+        1 +                   // fixed header
+        1 +                   // remaining length
+        1 +                   // protocol name and level
+        1 +                   // connect flags
+        1 +                   // keep alive
+
+        2 +                   // client id length, client id
+
+        2 +                   // will topic name length, will topic name
+        2 +                   // will message length, will message
+        2 +                   // user name length, user name
+        2                     // password length, password
+    >;
+
 public:
     connect_message(
         std::uint16_t keep_alive_sec,
@@ -350,22 +410,8 @@ public:
      *        it is for boost asio APIs
      * @return const buffer sequence
      */
-    std::vector<as::const_buffer> const_buffer_sequence() const {
-        std::vector<as::const_buffer> ret;
-        ret.reserve(
-            1 +                   // fixed header
-            1 +                   // remaining length
-            1 +                   // protocol name and level
-            1 +                   // connect flags
-            1 +                   // keep alive
-
-            2 +                   // client id length, client id
-
-            2 +                   // will topic name length, will topic name
-            2 +                   // will message length, will message
-            2 +                   // user name length, user name
-            2                     // password length, password
-        );
+    buffers_t const_buffer_sequence() const {
+        buffers_t ret;
 
         ret.emplace_back(as::buffer(&fixed_header_, 1));
         ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
@@ -468,6 +514,57 @@ private:
     boost::container::static_vector<char, 2> keep_alive_buf_;
 };
 
+/**
+ * @brief Topic name that is checked and whose length is encoded once.
+ *        Pass it to publish() and async_publish() instead of the topic name
+ *        to skip the check and the encoding at each PUBLISH.<BR>
+ *        Copies share the same topic name, so it is cheap to copy.
+ */
+class prepared_topic {
+public:
+    /**
+     * @brief Constructor
+     * @param topic_name topic name. The object keeps the string.
+     */
+    explicit prepared_topic(std::string topic_name)
+        : impl_(std::make_shared<impl>(std::move(topic_name)))
+    {}
+
+    /**
+     * @brief Get topic name
+     * @return topic name
+     */
+    as::const_buffer topic() const {
+        return as::buffer(impl_->topic_name);
+    }
+
+    /**
+     * @brief Get encoded topic name length
+     * @return two bytes topic name length
+     */
+    boost::container::static_vector<char, 2> const& topic_name_length_buf() const {
+        return impl_->topic_name_length_buf;
+    }
+
+private:
+    struct impl {
+        explicit impl(std::string topic_name)
+            : topic_name(std::move(topic_name))
+        {
+            detail::utf8string_check(this->topic_name);
+            add_uint16_t_to_buf(topic_name_length_buf, static_cast<std::uint16_t>(this->topic_name.size()));
+        }
+
+        std::string topic_name;
+        boost::container::static_vector<char, 2> topic_name_length_buf;
+    };
+
+    std::shared_ptr<impl const> impl_;
+};
+
+template <std::size_t PacketIdBytes>
+class basic_publish_fanout;
+
 template <std::size_t PacketIdBytes>
 class basic_publish_message {
 public:
@@ -479,45 +576,54 @@ public:
         typename packet_id_type<PacketIdBytes>::type packet_id,
         as::const_buffer const& payload
     )
-        : fixed_header_(static_cast<char>(make_fixed_header(control_packet_type::publish, 0b0000))),
-          topic_name_(topic_name),
-          topic_name_length_buf_ { MQTT_16BITNUM_TO_BYTE_SEQ(get_size(topic_name)) },
-          payload_(payload),
-          remaining_length_(publish_remaining_length(topic_name, qos, payload))
+        : topic_name_(topic_name),
+          payload_(payload)
     {
         detail::utf8string_check(string_view(get_pointer(topic_name), get_size(topic_name)));
-        publish::set_qos(fixed_header_, qos);
-        publish::set_retain(fixed_header_, retain);
-        publish::set_dup(fixed_header_, dup);
+        init(
+            qos,
+            retain,
+            dup,
+            packet_id,
+            { MQTT_16BITNUM_TO_BYTE_SEQ(get_size(topic_name)) }
+        );
+    }
 
-        auto rb = remaining_bytes(remaining_length_);
-        for (auto e : rb) {
-            remaining_length_buf_.push_back(e);
-        }
-        if (qos == qos::at_least_once ||
-            qos == qos::exactly_once) {
-            packet_id_.reserve(PacketIdBytes);
-            add_packet_id_to_buf<PacketIdBytes>::apply(packet_id_, packet_id);
-        }
+    /**
+     * @brief Constructor
+     *        The topic name is not checked again and its length is not encoded again.
+     *        prepared_topic must be kept until the message is no longer needed.
+     */
+    basic_publish_message(
+        prepared_topic const& topic_name,
+        std::uint8_t qos,
+        bool retain,
+        bool dup,
+        typename packet_id_type<PacketIdBytes>::type packet_id,
+        as::const_buffer const& payload
+    )
+        : topic_name_(topic_name.topic()),
+          payload_(payload)
+    {
+        init(qos, retain, dup, packet_id, topic_name.topic_name_length_buf());
     }
 
     template <typename Iterator>
     basic_publish_message(Iterator b, Iterator e) {
         if (b >= e) throw remaining_length_error();
-        fixed_header_ = static_cast<std::uint8_t>(*b);
-        auto qos = publish::get_qos(fixed_header_);
+        header_.push_back(*b);
+        auto qos = publish::get_qos(fixed_header());
         ++b;
 
         if (b + 4 >= e) throw remaining_length_error();
         auto len_consumed = remaining_length(b, b + 4);
-        remaining_length_ = std::get<0>(len_consumed);
         auto consumed = static_cast<std::string::difference_type>(std::get<1>(len_consumed));
 
-        std::copy(b, b + consumed, std::back_inserter(remaining_length_buf_));
+        std::copy(b, b + consumed, std::back_inserter(header_));
         b += consumed;
 
         if (b + 2 >= e) throw remaining_length_error();
-        std::copy(b, b + 2, std::back_inserter(topic_name_length_buf_));
+        std::copy(b, b + 2, std::back_inserter(header_));
         auto topic_name_length = make_uint16_t(b, b + 2);
         b += 2;
 
@@ -548,28 +654,16 @@ public:
      *        it is for boost asio APIs
      * @return const buffer sequence
      */
-    std::vector<as::const_buffer> const_buffer_sequence() const {
-        if (packet_id_.empty()) {
-            return
-                {
-                    as::buffer(&fixed_header_, 1),
-                    as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()),
-                    as::buffer(topic_name_length_buf_.data(), topic_name_length_buf_.size()),
-                    topic_name_,
-                    payload_
-                };
-        }
-        else {
-            return
-                {
-                    as::buffer(&fixed_header_, 1),
-                    as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()),
-                    as::buffer(topic_name_length_buf_.data(), topic_name_length_buf_.size()),
-                    topic_name_,
-                    as::buffer(packet_id_.data(), packet_id_.size()),
-                    payload_
-                };
+    const_buffer_array<4> const_buffer_sequence() const {
+        const_buffer_array<4> ret {
+            as::buffer(header_.data(), header_.size()),
+            topic_name_
+        };
+        if (!packet_id_.empty()) {
+            ret.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
         }
+        ret.emplace_back(payload_);
+        return ret;
     }
 
     /**
@@ -577,7 +671,7 @@ public:
      * @return whole size
      */
     std::size_t size() const {
-        return 1 + remaining_length_buf_.size() + remaining_length_;
+        return header_.size() + get_size(topic_name_) + packet_id_.size() + get_size(payload_);
     }
 
     /**
@@ -591,10 +685,7 @@ public:
 
         ret.reserve(size());
 
-        ret.push_back(static_cast<char>(fixed_header_));
-        ret.append(remaining_length_buf_.data(), remaining_length_buf_.size());
-
-        ret.append(topic_name_length_buf_.data(), topic_name_length_buf_.size());
+        ret.append(header_.data(), header_.size());
         ret.append(get_pointer(topic_name_), get_size(topic_name_));
 
         ret.append(packet_id_.data(), packet_id_.size());
@@ -616,7 +707,7 @@ public:
      * @return qos
      */
     std::uint8_t qos() const {
-        return publish::get_qos(fixed_header_);
+        return publish::get_qos(fixed_header());
     }
 
     /**
@@ -624,7 +715,7 @@ public:
      * @return true if retain, otherwise return false.
      */
     bool is_retain() const {
-        return publish::is_retain(fixed_header_);
+        return publish::is_retain(fixed_header());
     }
 
     /**
@@ -632,7 +723,7 @@ public:
      * @return true if dup, otherwise return false.
      */
     bool is_dup() const {
-        return publish::is_dup(fixed_header_);
+        return publish::is_dup(fixed_header());
     }
 
     /**
@@ -656,11 +747,56 @@ public:
      * @param dup flag value to set
      */
     void set_dup(bool dup) {
-        publish::set_dup(fixed_header_, dup);
+        auto fixed_header = this->fixed_header();
+        publish::set_dup(fixed_header, dup);
+        header_[0] = static_cast<char>(fixed_header);
     }
 
 
 private:
+    friend class basic_publish_fanout<PacketIdBytes>;
+
+    // fixed header, remaining length, and topic name length. They are contiguous on the wire.
+    using header_t = boost::container::static_vector<char, 1 + 4 + 2>;
+
+    // Build from the parts that are already encoded by basic_publish_fanout.
+    basic_publish_message(
+        header_t const& header,
+        as::const_buffer const& topic_name,
+        boost::container::static_vector<char, PacketIdBytes> const& packet_id,
+        as::const_buffer const& payload
+    )
+        : header_(header),
+          topic_name_(topic_name),
+          packet_id_(packet_id),
+          payload_(payload)
+    {}
+
+    void init(
+        std::uint8_t qos,
+        bool retain,
+        bool dup,
+        typename packet_id_type<PacketIdBytes>::type packet_id,
+        boost::container::static_vector<char, 2> const& topic_name_length_buf) {
+        auto fixed_header = make_fixed_header(control_packet_type::publish, 0b0000);
+        publish::set_qos(fixed_header, qos);
+        publish::set_retain(fixed_header, retain);
+        publish::set_dup(fixed_header, dup);
+        header_.push_back(static_cast<char>(fixed_header));
+
+        auto rb = remaining_bytes(publish_remaining_length(topic_name_, qos, payload_));
+        header_.insert(header_.end(), rb.begin(), rb.end());
+        header_.insert(header_.end(), topic_name_length_buf.begin(), topic_name_length_buf.end());
+        if (qos == qos::at_least_once ||
+            qos == qos::exactly_once) {
+            add_packet_id_to_buf<PacketIdBytes>::apply(packet_id_, packet_id);
+        }
+    }
+
+    std::uint8_t fixed_header() const {
+        return static_cast<std::uint8_t>(header_[0]);
+    }
+
     static std::size_t publish_remaining_length(
         as::const_buffer const& topic_name,
         std::uint8_t qos,
@@ -680,18 +816,146 @@ private:
     }
 
 private:
-    std::uint8_t fixed_header_;
+    header_t header_;
     as::const_buffer topic_name_;
-    boost::container::static_vector<char, 2> topic_name_length_buf_;
     boost::container::static_vector<char, PacketIdBytes> packet_id_;
     as::const_buffer payload_;
-    std::size_t remaining_length_;
-    boost::container::static_vector<char, 4> remaining_length_buf_;
 };
 
 using publish_message = basic_publish_message<2>;
 using publish_32_message = basic_publish_message<4>;
 
+/**
+ * @brief The parts of PUBLISH that are shared by all receivers of the same message.
+ *        The topic name is checked and the fixed header, remaining length, and
+ *        topic name length are encoded once. message() makes the PUBLISH for each receiver
+ *        by setting only the QoS bits and the packet identifier.<BR>
+ *        It is shared by the endpoints with std::shared_ptr, so it is not copyable.
+ */
+template <std::size_t PacketIdBytes>
+class basic_publish_fanout {
+public:
+    /**
+     * @brief Constructor
+     * @param topic_name topic name. The object keeps the string.
+     * @param contents   contents. The object keeps the string.
+     * @param retain     retain flag
+     */
+    basic_publish_fanout(
+        std::string topic_name,
+        std::string contents,
+        bool retain = false
+    )
+        : topic_name_str_(std::move(topic_name)),
+          contents_str_(std::move(contents))
+    {
+        init(as::buffer(topic_name_str_), as::buffer(contents_str_), retain);
+    }
+
+    /**
+     * @brief Constructor
+     * @param topic_name  topic name
+     * @param contents    contents
+     * @param life_keeper the function that is keeping topic_name and contents lifetime.
+     *                    It is destroyed with this object.
+     * @param retain      retain flag
+     */
+    basic_publish_fanout(
+        as::const_buffer const& topic_name,
+        as::const_buffer const& contents,
+        std::function<void()> life_keeper,
+        bool retain = false
+    )
+        : life_keeper_(std::move(life_keeper))
+    {
+        init(topic_name, contents, retain);
+    }
+
+    basic_publish_fanout(basic_publish_fanout const&) = delete;
+    basic_publish_fanout& operator=(basic_publish_fanout const&) = delete;
+
+    /**
+     * @brief Make PUBLISH for a receiver
+     * @param qos       QoS
+     * @param packet_id packet identifier. It is ignored if qos is at_most_once.
+     * @return PUBLISH that refers topic name and contents of this object
+     */
+    basic_publish_message<PacketIdBytes> message(
+        std::uint8_t qos,
+        typename packet_id_type<PacketIdBytes>::type packet_id) const {
+        boost::container::static_vector<char, PacketIdBytes> packet_id_buf;
+        std::size_t with_packet_id = 0;
+        if (qos == qos::at_least_once ||
+            qos == qos::exactly_once) {
+            add_packet_id_to_buf<PacketIdBytes>::apply(packet_id_buf, packet_id);
+            with_packet_id = 1;
+        }
+        auto header = header_[with_packet_id];
+        auto fixed_header = static_cast<std::uint8_t>(header[0]);
+        publish::set_qos(fixed_header, qos);
+        header[0] = static_cast<char>(fixed_header);
+        return basic_publish_message<PacketIdBytes>(
+            header,
+            topic_name_,
+            packet_id_buf,
+            payload_
+        );
+    }
+
+    /**
+     * @brief Get topic name
+     * @return topic name
+     */
+    as::const_buffer topic() const {
+        return topic_name_;
+    }
+
+    /**
+     * @brief Get payload
+     * @return payload
+     */
+    as::const_buffer payload() const {
+        return payload_;
+    }
+
+    /**
+     * @brief Check retain flag
+     * @return true if retain, otherwise return false.
+     */
+    bool is_retain() const {
+        return publish::is_retain(static_cast<std::uint8_t>(header_[0][0]));
+    }
+
+private:
+    void init(as::const_buffer const& topic_name, as::const_buffer const& payload, bool retain) {
+        detail::utf8string_check(string_view(get_pointer(topic_name), get_size(topic_name)));
+        topic_name_ = topic_name;
+        payload_ = payload;
+        auto fixed_header = make_fixed_header(control_packet_type::publish, 0b0000);
+        publish::set_retain(fixed_header, retain);
+
+        // [0] is for QoS0, and [1] is for QoS1 and QoS2 that have packet identifier.
+        for (std::size_t i = 0; i != 2; ++i) {
+            auto& h = header_[i];
+            h.push_back(static_cast<char>(fixed_header));
+            auto rb = remaining_bytes(2 + get_size(topic_name) + get_size(payload) + i * PacketIdBytes);
+            h.insert(h.end(), rb.begin(), rb.end());
+            add_uint16_t_to_buf(h, static_cast<std::uint16_t>(get_size(topic_name)));
+        }
+    }
+
+private:
+    std::string topic_name_str_;
+    std::string contents_str_;
+    std::function<void()> life_keeper_;
+    as::const_buffer topic_name_;
+    as::const_buffer payload_;
+    typename basic_publish_message<PacketIdBytes>::header_t header_[2];
+};
+
+using publish_fanout = basic_publish_fanout<2>;
+using publish_32_fanout = basic_publish_fanout<4>;
+
 template <std::size_t PacketIdBytes>
 class basic_subscribe_message {
 private:
@@ -833,9 +1097,9 @@ public:
      *        it is for boost asio APIs
      * @return const buffer sequence
      */
-    std::vector<as::const_buffer> const_buffer_sequence() const {
-        std::vector<as::const_buffer> ret;
-        ret.reserve(4); // fixed header, remaining length, packet_id, entries
+    const_buffer_array<4> const_buffer_sequence() const {
+        // fixed header, remaining length, packet_id, entries
+        const_buffer_array<4> ret;
 
         ret.emplace_back(as::buffer(&fixed_header_, 1));
         ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
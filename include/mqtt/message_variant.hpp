@@ -46,17 +46,22 @@ struct is_shared_ptr<std::shared_ptr<T>> {
     static constexpr bool value = true;
 };
 
-struct const_buffer_sequence_visitor
+template <typename Container>
+struct add_const_buffer_sequence_visitor
 
 #if !defined(MQTT_STD_VARIANT)
-    : boost::static_visitor<std::vector<as::const_buffer>>
+    : boost::static_visitor<void>
 #endif // !defined(MQTT_STD_VARIANT)
 
 {
+    explicit add_const_buffer_sequence_visitor(Container& buf):buf_(buf) {}
     template <typename T>
-    std::vector<as::const_buffer> operator()(T&& t) const {
-        return t.const_buffer_sequence();
+    void operator()(T&& t) const {
+        auto cbs = t.const_buffer_sequence();
+        buf_.insert(buf_.end(), cbs.begin(), cbs.end());
     }
+private:
+    Container& buf_;
 };
 
 struct size_visitor
@@ -87,10 +92,25 @@ struct continuous_buffer_visitor
 
 } // namespace detail
 
+/**
+ * @brief Append the const buffer sequence of the message to the container.
+ *        If the container has enough capacity, no memory is allocated.
+ * @param buf container of as::const_buffer
+ * @param mv  message
+ */
+template <std::size_t PacketIdBytes, typename Container>
+inline void add_const_buffer_sequence(
+    Container& buf,
+    basic_message_variant<PacketIdBytes> const& mv) {
+    mqtt::visit(detail::add_const_buffer_sequence_visitor<Container>(buf), mv);
+}
+
 template <std::size_t PacketIdBytes>
 inline std::vector<as::const_buffer> const_buffer_sequence(
     basic_message_variant<PacketIdBytes> const& mv) {
-    return mqtt::visit(detail::const_buffer_sequence_visitor(), mv);
+    std::vector<as::const_buffer> ret;
+    add_const_buffer_sequence(ret, mv);
+    return ret;
 }
 
 template <std::size_t PacketIdBytes>
@@ -0,0 +1,201 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_MOVE_ONLY_FUNCTION_HPP)
+#define MQTT_MOVE_ONLY_FUNCTION_HPP
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace mqtt {
+
+template <typename Signature>
+class move_only_function;
+
+namespace detail {
+
+template <typename T>
+struct is_move_only_function : std::false_type {};
+
+template <typename Signature>
+struct is_move_only_function<move_only_function<Signature>> : std::true_type {};
+
+template <typename F>
+inline bool is_null_function(F const&) {
+    return false;
+}
+
+template <typename R, typename... Args>
+inline bool is_null_function(R (*f)(Args...)) {
+    return f == nullptr;
+}
+
+template <typename Signature>
+inline bool is_null_function(std::function<Signature> const& f) {
+    return !f;
+}
+
+} // namespace detail
+
+/**
+ * @brief Function wrapper like std::function that requires only move construction of the function object.
+ *        The function object whose size is not greater than local_storage_size is kept in the wrapper
+ *        without allocating memory. Larger one is allocated by the global operator new.<BR>
+ *        It is not copyable.
+ */
+template <typename R, typename... Args>
+class move_only_function<R(Args...)> {
+public:
+    static constexpr std::size_t const local_storage_size = 4 * sizeof(void*);
+
+    move_only_function() noexcept = default;
+
+    move_only_function(std::nullptr_t) noexcept {}
+
+    /**
+     * @brief Constructor
+     * @param f function object. If it is a null function pointer or an empty std::function,
+     *          the wrapper is empty.
+     */
+    template <
+        typename F,
+        std::enable_if_t<
+            !detail::is_move_only_function<std::decay_t<F>>::value &&
+            (std::is_void<R>::value ||
+             std::is_convertible<decltype(std::declval<std::decay_t<F>&>()(std::declval<Args>()...)), R>::value)
+        >* = nullptr
+    >
+    move_only_function(F&& f) {
+        if (detail::is_null_function(f)) return;
+        emplace<std::decay_t<F>>(std::forward<F>(f));
+    }
+
+    move_only_function(move_only_function&& other) noexcept
+        : ops_(other.ops_) {
+        if (ops_) {
+            ops_->move(&storage_, &other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    move_only_function& operator=(move_only_function&& other) noexcept {
+        if (this != &other) {
+            reset();
+            if (other.ops_) {
+                other.ops_->move(&storage_, &other.storage_);
+                ops_ = other.ops_;
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    move_only_function& operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    move_only_function(move_only_function const&) = delete;
+    move_only_function& operator=(move_only_function const&) = delete;
+
+    ~move_only_function() {
+        reset();
+    }
+
+    explicit operator bool() const noexcept {
+        return ops_ != nullptr;
+    }
+
+    R operator()(Args... args) const {
+        if (!ops_) throw std::bad_function_call();
+        return ops_->invoke(&storage_, std::forward<Args>(args)...);
+    }
+
+private:
+    using storage_t = typename std::aligned_storage<local_storage_size, alignof(std::max_align_t)>::type;
+
+    struct ops {
+        R (*invoke)(void* storage, Args&&... args);
+        void (*move)(void* dst, void* src) noexcept;
+        void (*destroy)(void* storage) noexcept;
+    };
+
+    template <typename F>
+    struct is_local : std::integral_constant<
+        bool,
+        sizeof(F) <= sizeof(storage_t) &&
+        alignof(storage_t) % alignof(F) == 0 &&
+        std::is_nothrow_move_constructible<F>::value
+    > {};
+
+    // The function object is constructed in the storage.
+    template <typename F>
+    struct local_ops {
+        static R invoke(void* storage, Args&&... args) {
+            return static_cast<R>((*static_cast<F*>(storage))(std::forward<Args>(args)...));
+        }
+        static void move(void* dst, void* src) noexcept {
+            ::new (dst) F(std::move(*static_cast<F*>(src)));
+            static_cast<F*>(src)->~F();
+        }
+        static void destroy(void* storage) noexcept {
+            static_cast<F*>(storage)->~F();
+        }
+        static ops const* get() {
+            static constexpr ops const value { &invoke, &move, &destroy };
+            return &value;
+        }
+    };
+
+    // The storage keeps the pointer to the allocated function object.
+    template <typename F>
+    struct remote_ops {
+        static R invoke(void* storage, Args&&... args) {
+            return static_cast<R>((**static_cast<F**>(storage))(std::forward<Args>(args)...));
+        }
+        static void move(void* dst, void* src) noexcept {
+            ::new (dst) F*(*static_cast<F**>(src));
+        }
+        static void destroy(void* storage) noexcept {
+            delete *static_cast<F**>(storage);
+        }
+        static ops const* get() {
+            static constexpr ops const value { &invoke, &move, &destroy };
+            return &value;
+        }
+    };
+
+    template <typename F, typename T>
+    std::enable_if_t<is_local<F>::value> emplace(T&& f) {
+        ::new (&storage_) F(std::forward<T>(f));
+        ops_ = local_ops<F>::get();
+    }
+
+    template <typename F, typename T>
+    std::enable_if_t<!is_local<F>::value> emplace(T&& f) {
+        ::new (&storage_) F*(new F(std::forward<T>(f)));
+        ops_ = remote_ops<F>::get();
+    }
+
+    void reset() noexcept {
+        if (ops_) {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    mutable storage_t storage_;
+    ops const* ops_ = nullptr;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_MOVE_ONLY_FUNCTION_HPP
@@ -0,0 +1,131 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_MULTI_INDEX_STORE_HPP)
+#define MQTT_MULTI_INDEX_STORE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/mem_fun.hpp>
+#include <boost/multi_index/composite_key.hpp>
+
+namespace mqtt {
+
+namespace mi = boost::multi_index;
+
+/**
+ * @brief Store of in-flight messages that uses boost::multi_index_container.
+ *
+ * Messages are indexed by (packet_id, expected control packet type), by packet_id,
+ * and by insertion order.
+ * @tparam Element stored element. It has packet_id() and expected_control_packet_type().
+ * @tparam Alloc   allocator for the elements.
+ */
+template <typename Element, typename Alloc = std::allocator<char>>
+class multi_index_store {
+public:
+    using packet_id_t = typename std::decay<decltype(std::declval<Element>().packet_id())>::type;
+
+    /**
+     * @brief Insert the element.
+     * @return If the element that has the same packet_id and type is already stored, return false,
+     *         otherwise return true.
+     */
+    template <typename... Args>
+    bool emplace(Args&&... args) {
+        return elements_.emplace(std::forward<Args>(args)...).second;
+    }
+
+    /**
+     * @brief Erase the element that has packet_id and expected control packet type.
+     */
+    void erase(packet_id_t packet_id, std::uint8_t type) {
+        auto& idx = elements_.template get<tag_packet_id_type>();
+        auto r = idx.equal_range(std::make_tuple(packet_id, type));
+        idx.erase(std::get<0>(r), std::get<1>(r));
+    }
+
+    /**
+     * @brief Erase all elements that have packet_id.
+     */
+    void erase(packet_id_t packet_id) {
+        auto& idx = elements_.template get<tag_packet_id>();
+        auto r = idx.equal_range(packet_id);
+        idx.erase(std::get<0>(r), std::get<1>(r));
+    }
+
+    void clear() {
+        elements_.clear();
+    }
+
+    /**
+     * @brief Apply f to the elements in insertion order.
+     * @param f applying function. f should be void(Element const&)
+     */
+    template <typename F>
+    void for_each(F&& f) const {
+        auto& idx = elements_.template get<tag_seq>();
+        for (auto const& e : idx) {
+            f(e);
+        }
+    }
+
+    std::size_t size() const {
+        return elements_.size();
+    }
+
+    bool empty() const {
+        return elements_.empty();
+    }
+
+private:
+    struct tag_packet_id {};
+    struct tag_packet_id_type {};
+    struct tag_seq {};
+    using elements_t = mi::multi_index_container<
+        Element,
+        mi::indexed_by<
+            mi::ordered_unique<
+                mi::tag<tag_packet_id_type>,
+                mi::composite_key<
+                    Element,
+                    mi::const_mem_fun<
+                        Element, packet_id_t,
+                        &Element::packet_id
+                    >,
+                    mi::const_mem_fun<
+                        Element, std::uint8_t,
+                        &Element::expected_control_packet_type
+                    >
+                >
+            >,
+            mi::ordered_non_unique<
+                mi::tag<tag_packet_id>,
+                mi::const_mem_fun<
+                    Element, packet_id_t,
+                    &Element::packet_id
+                >
+            >,
+            mi::sequenced<
+                mi::tag<tag_seq>
+            >
+        >,
+        typename std::allocator_traits<Alloc>::template rebind_alloc<Element>
+    >;
+
+    elements_t elements_;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_MULTI_INDEX_STORE_HPP
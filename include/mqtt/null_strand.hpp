@@ -10,6 +10,7 @@
 #include <boost/asio.hpp>
 
 #include <mqtt/utility.hpp>
+#include <mqtt/strand_post.hpp>
 
 namespace mqtt {
 
@@ -19,7 +20,7 @@ struct null_strand {
     null_strand(as::io_service& ios) : ios_(ios) {}
     template <typename Func>
     void post(Func&& f) {
-        ios_.post([MQTT_CAPTURE_FORWARD(Func, f)]{ f(); });
+        strand_post(ios_, [MQTT_CAPTURE_FORWARD(Func, f)]() mutable { f(); });
     }
     template <typename Func>
     void dispatch(Func&& f) {
@@ -33,6 +34,11 @@ private:
     as::io_service& ios_;
 };
 
+template <typename Handler>
+inline void strand_post(null_strand& strand, Handler&& handler) {
+    strand.post(std::forward<Handler>(handler));
+}
+
 } // namespace mqtt
 
 #endif // MQTT_NULL_STRAND_HPP
@@ -0,0 +1,385 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_OFFLINE_QUEUE_HPP)
+#define MQTT_OFFLINE_QUEUE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <deque>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <utility>
+
+#include <boost/assert.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <mqtt/optional.hpp>
+
+namespace mqtt {
+
+/**
+ * @brief Queue of the messages for a disconnected session.
+ *
+ * The queue has the upper limits of the number of the messages and the bytes (the size of the
+ * topic name and the contents). If a new message exceeds the limits, the oldest messages are
+ * dropped, or the new message is dropped, by the overflow_policy.<BR>
+ * If spill file is enabled, the messages are appended to the file through memory mapped segments
+ * instead of the heap. The segments are reused after all messages in them are popped, so the file
+ * doesn't grow while the queued bytes don't grow. The file is truncated when the queue becomes empty.
+ */
+class offline_queue {
+public:
+    enum class overflow_policy {
+        drop_oldest,
+        drop_newest
+    };
+
+    struct message {
+        message(
+            std::shared_ptr<std::string> topic,
+            std::shared_ptr<std::string> contents,
+            std::uint8_t qos)
+            :topic(std::move(topic)), contents(std::move(contents)), qos(qos) {}
+        std::shared_ptr<std::string> topic;
+        std::shared_ptr<std::string> contents;
+        std::uint8_t qos;
+    };
+
+    /**
+     * @brief Constructor
+     * @param max_messages the upper limit of the number of the messages. 0 means no limit.
+     * @param max_bytes    the upper limit of the bytes of the messages. 0 means no limit.
+     * @param policy       the message to drop when the limits are exceeded.
+     */
+    explicit offline_queue(
+        std::size_t max_messages = 0,
+        std::size_t max_bytes = 0,
+        overflow_policy policy = overflow_policy::drop_oldest)
+        :max_messages_(max_messages),
+         max_bytes_(max_bytes),
+         policy_(policy) {}
+
+    offline_queue(offline_queue&&) = default;
+    offline_queue& operator=(offline_queue&&) = default;
+
+    /**
+     * @brief Store the following messages to the spill file instead of the heap.
+     *        The file is created (or truncated), and removed when the queue is destroyed.
+     *        The queue should be empty.
+     * @param path          path of the spill file
+     * @param segment_bytes the size of the memory mapped segment.
+     *                      A message that is larger than it has its own segment.
+     * @return true if the spill file is enabled. false if the file can't be created or mapped,
+     *         and the messages are kept in the heap.
+     */
+    bool enable_spill(std::string path, std::size_t segment_bytes = 1024 * 1024) {
+        BOOST_ASSERT(empty());
+        try {
+            spill_.reset(new spill_file(std::move(path), segment_bytes));
+        }
+        catch (boost::interprocess::interprocess_exception const&) {
+            spill_.reset();
+            return false;
+        }
+        return true;
+    }
+
+    bool is_spilled() const {
+        return static_cast<bool>(spill_);
+    }
+
+    /**
+     * @brief Append the message.
+     * @param topic    topic name
+     * @param contents contents
+     * @param qos      QoS of the delivery
+     * @return true if the message is queued.
+     *         false if it is dropped by the limits, or the spill file can't be extended.
+     */
+    bool push(
+        std::shared_ptr<std::string> const& topic,
+        std::shared_ptr<std::string> const& contents,
+        std::uint8_t qos) {
+        auto bytes = topic->size() + contents->size();
+        if (max_bytes_ != 0 && bytes > max_bytes_) {
+            ++dropped_;
+            return false;
+        }
+        while (exceeds(size_ + 1, bytes_ + bytes)) {
+            if (policy_ == overflow_policy::drop_newest) {
+                ++dropped_;
+                return false;
+            }
+            pop();
+            ++dropped_;
+        }
+        if (spill_) {
+            if (!spill_->push(*topic, *contents, qos)) {
+                ++dropped_;
+                return false;
+            }
+        }
+        else {
+            messages_.emplace_back(topic, contents, qos);
+        }
+        ++size_;
+        bytes_ += bytes;
+        return true;
+    }
+
+    /**
+     * @brief Remove the oldest message.
+     * @return the oldest message. nullopt if the queue is empty.
+     */
+    optional<message> pop() {
+        if (size_ == 0) return nullopt;
+        optional<message> ret;
+        if (spill_) {
+            ret.emplace(spill_->pop());
+        }
+        else {
+            ret.emplace(std::move(messages_.front()));
+            messages_.pop_front();
+        }
+        --size_;
+        bytes_ -= ret->topic->size() + ret->contents->size();
+        if (size_ == 0 && spill_) spill_->reset();
+        return ret;
+    }
+
+    void clear() {
+        messages_.clear();
+        if (spill_) spill_->reset();
+        size_ = 0;
+        bytes_ = 0;
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    /**
+     * @brief Get the bytes of the queued messages. It is the sum of the size of the topic names and the contents.
+     */
+    std::size_t bytes() const {
+        return bytes_;
+    }
+
+    /**
+     * @brief Get the number of the messages that are dropped by the limits.
+     */
+    std::size_t dropped() const {
+        return dropped_;
+    }
+
+private:
+    /**
+     * @brief Append only file that is accessed through memory mapped segments.
+     *
+     * A record is the header (the size of the topic name, the size of the contents, and QoS)
+     * followed by the topic name and the contents. A record doesn't cross the segments.<BR>
+     * The segments that all records are read are kept in free_, and reused for the following records.
+     */
+    class spill_file {
+    public:
+        /**
+         * @brief Constructor
+         *        Throws boost::interprocess::interprocess_exception if the file can't be created.
+         */
+        spill_file(std::string path, std::size_t segment_bytes)
+            :path_(std::move(path)),
+             segment_bytes_(round_up(segment_bytes)) {
+            std::ofstream(path_, std::ios::binary | std::ios::trunc);
+            try {
+                file_ = boost::interprocess::file_mapping(path_.c_str(), boost::interprocess::read_write);
+            }
+            catch (boost::interprocess::interprocess_exception const&) {
+                std::remove(path_.c_str());
+                throw;
+            }
+        }
+
+        ~spill_file() {
+            segments_.clear();
+            free_.clear();
+            file_ = boost::interprocess::file_mapping();
+            std::remove(path_.c_str());
+        }
+
+        spill_file(spill_file const&) = delete;
+        spill_file& operator=(spill_file const&) = delete;
+
+        /**
+         * @brief Append the record.
+         * @return false if the file can't be extended. Nothing is written.
+         */
+        bool push(std::string const& topic, std::string const& contents, std::uint8_t qos) {
+            std::size_t size = header_size + topic.size() + contents.size();
+            if (segments_.empty() || segments_.back().capacity - segments_.back().write_pos < size) {
+                if (!add_segment(size)) return false;
+            }
+            auto& seg = segments_.back();
+            char* p = static_cast<char*>(seg.region.get_address()) + seg.write_pos;
+            write_u32(p, static_cast<std::uint32_t>(topic.size()));
+            write_u32(p + 4, static_cast<std::uint32_t>(contents.size()));
+            p[8] = static_cast<char>(qos);
+            std::memcpy(p + header_size, topic.data(), topic.size());
+            std::memcpy(p + header_size + topic.size(), contents.data(), contents.size());
+            seg.write_pos += size;
+            return true;
+        }
+
+        message pop() {
+            auto& seg = segments_.front();
+            BOOST_ASSERT(seg.read_pos < seg.write_pos);
+            char const* p = static_cast<char const*>(seg.region.get_address()) + seg.read_pos;
+            std::size_t topic_size = read_u32(p);
+            std::size_t contents_size = read_u32(p + 4);
+            auto qos = static_cast<std::uint8_t>(p[8]);
+            p += header_size;
+            message ret(
+                std::make_shared<std::string>(p, topic_size),
+                std::make_shared<std::string>(p + topic_size, contents_size),
+                qos);
+            seg.read_pos += header_size + topic_size + contents_size;
+            if (seg.read_pos == seg.write_pos && segments_.size() > 1) {
+                // All records in the segment are read. The last segment is kept for the following records.
+                seg.read_pos = 0;
+                seg.write_pos = 0;
+                free_.push_back(std::move(seg));
+                segments_.pop_front();
+            }
+            return ret;
+        }
+
+        /**
+         * @brief Unmap all segments and truncate the file.
+         */
+        void reset() {
+            segments_.clear();
+            free_.clear();
+            file_size_ = 0;
+            std::ofstream(path_, std::ios::binary | std::ios::trunc);
+        }
+
+    private:
+        static constexpr std::size_t const header_size = 9;
+
+        struct segment {
+            segment(boost::interprocess::mapped_region region, std::size_t capacity)
+                :region(std::move(region)), capacity(capacity) {}
+            boost::interprocess::mapped_region region;
+            std::size_t capacity;
+            std::size_t write_pos = 0;
+            std::size_t read_pos = 0;
+        };
+
+        static std::size_t round_up(std::size_t size) {
+            std::size_t page = boost::interprocess::mapped_region::get_page_size();
+            return (size + page - 1) / page * page;
+        }
+
+        bool add_segment(std::size_t record_size) {
+            // Reuse the smallest free segment that the record fits in.
+            auto reuse = free_.end();
+            for (auto it = free_.begin(); it != free_.end(); ++it) {
+                if (it->capacity >= record_size && (reuse == free_.end() || it->capacity < reuse->capacity)) {
+                    reuse = it;
+                }
+            }
+            if (reuse != free_.end()) {
+                segments_.push_back(std::move(*reuse));
+                free_.erase(reuse);
+                return true;
+            }
+
+            std::size_t capacity = record_size > segment_bytes_ ? round_up(record_size) : segment_bytes_;
+            if (!extend(capacity)) return false;
+            try {
+                segments_.emplace_back(
+                    boost::interprocess::mapped_region(
+                        file_,
+                        boost::interprocess::read_write,
+                        static_cast<boost::interprocess::offset_t>(file_size_),
+                        capacity),
+                    capacity);
+            }
+            catch (boost::interprocess::interprocess_exception const&) {
+                return false;
+            }
+            file_size_ += capacity;
+            return true;
+        }
+
+        /**
+         * @brief Append the bytes to the file before mapping.
+         *        Zeros are written instead of seeking to the end, so the disk space is allocated here.
+         *        Otherwise writing through the mapping to a sparse file can raise SIGBUS on a full disk.
+         * @return false if the file can't be written.
+         */
+        bool extend(std::size_t bytes) {
+            static char const zeros[4096] = {};
+            std::fstream f(path_, std::ios::in | std::ios::out | std::ios::binary);
+            if (!f.seekp(static_cast<std::streamoff>(file_size_))) return false;
+            while (bytes != 0) {
+                auto n = std::min(bytes, sizeof(zeros));
+                if (!f.write(zeros, static_cast<std::streamsize>(n))) return false;
+                bytes -= n;
+            }
+            return static_cast<bool>(f.flush());
+        }
+
+        static void write_u32(char* p, std::uint32_t v) {
+            std::memcpy(p, &v, sizeof(v));
+        }
+
+        static std::uint32_t read_u32(char const* p) {
+            std::uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+    private:
+        std::string path_;
+        std::size_t segment_bytes_;
+        boost::interprocess::file_mapping file_;
+        std::deque<segment> segments_;
+        std::vector<segment> free_;
+        std::size_t file_size_ = 0;
+    };
+
+    bool exceeds(std::size_t size, std::size_t bytes) const {
+        return
+            (max_messages_ != 0 && size > max_messages_) ||
+            (max_bytes_ != 0 && bytes > max_bytes_);
+    }
+
+private:
+    std::size_t max_messages_;
+    std::size_t max_bytes_;
+    overflow_policy policy_;
+    std::deque<message> messages_;
+    std::unique_ptr<spill_file> spill_;
+    std::size_t size_ = 0;
+    std::size_t bytes_ = 0;
+    std::size_t dropped_ = 0;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_OFFLINE_QUEUE_HPP
@@ -0,0 +1,454 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_PACKET_ID_POOL_HPP)
+#define MQTT_PACKET_ID_POOL_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <array>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <type_traits>
+
+#include <boost/assert.hpp>
+
+namespace mqtt {
+
+namespace detail {
+
+inline std::size_t count_trailing_zeros(std::uint64_t v) {
+    BOOST_ASSERT(v != 0);
+#if defined(__GNUC__)
+    return static_cast<std::size_t>(__builtin_ctzll(v));
+#else  // defined(__GNUC__)
+    std::size_t n = 0;
+    while (!(v & 1)) {
+        v >>= 1;
+        ++n;
+    }
+    return n;
+#endif // defined(__GNUC__)
+}
+
+/**
+ * @brief Bitmap of 65536 ids with a summary of full words.
+ *
+ * find_next_zero() checks at most one bitmap word and the summary words.
+ */
+class packet_id_page {
+public:
+    static constexpr std::size_t const size = 0x10000;
+
+    packet_id_page() {
+        words_.fill(0);
+        full_.fill(0);
+    }
+
+    bool test(std::size_t i) const {
+        return words_[i / 64] & bit(i % 64);
+    }
+
+    bool set(std::size_t i) {
+        auto& w = words_[i / 64];
+        if (w & bit(i % 64)) return false;
+        w |= bit(i % 64);
+        if (w == all) full_[i / 64 / 64] |= bit(i / 64 % 64);
+        ++count_;
+        return true;
+    }
+
+    bool reset(std::size_t i) {
+        auto& w = words_[i / 64];
+        if (!(w & bit(i % 64))) return false;
+        w &= ~bit(i % 64);
+        full_[i / 64 / 64] &= ~bit(i / 64 % 64);
+        --count_;
+        return true;
+    }
+
+    std::size_t count() const {
+        return count_;
+    }
+
+    /**
+     * @brief Find the first unset bit that is greater than or equal to i.
+     * @return index of the bit. If not found, return size.
+     */
+    std::size_t find_next_zero(std::size_t i) const {
+        if (i >= size) return size;
+        auto wi = i / 64;
+        auto free_bits = ~words_[wi] & (all << (i % 64));
+        if (free_bits) return wi * 64 + count_trailing_zeros(free_bits);
+        // Find the next word that is not full.
+        ++wi;
+        if (wi == num_words) return size;
+        auto si = wi / 64;
+        auto not_full = ~full_[si] & (all << (wi % 64));
+        while (!not_full) {
+            if (++si == num_summaries) return size;
+            not_full = ~full_[si];
+        }
+        wi = si * 64 + count_trailing_zeros(not_full);
+        return wi * 64 + count_trailing_zeros(~words_[wi]);
+    }
+
+private:
+    static constexpr std::size_t const num_words = size / 64;
+    static constexpr std::size_t const num_summaries = num_words / 64;
+    static constexpr std::uint64_t const all = ~std::uint64_t(0);
+
+    static std::uint64_t bit(std::size_t i) {
+        return std::uint64_t(1) << i;
+    }
+
+    std::array<std::uint64_t, num_words> words_;
+    std::array<std::uint64_t, num_summaries> full_;
+    std::size_t count_ = 0;
+};
+
+} // namespace detail
+
+/**
+ * @brief Storage policy of packet_id_set that keeps ids in bitmap pages of 65536 ids.
+ *
+ * It fits dense ids. A page costs 8KB even if it has only one id.
+ */
+struct packet_id_bitmap_storage {};
+
+/**
+ * @brief Storage policy of packet_id_set that keeps ids in an open addressing hash table.
+ *
+ * It fits sparse ids. The table has 2 to 8 slots per id.
+ */
+struct packet_id_hash_storage {};
+
+/**
+ * @brief The storage policy of packet_id_set by the packet id type.
+ *
+ * 2 bytes packet ids use the bitmap, because all ids are in one page.
+ * 4 bytes packet ids use the hash table, because the ids that the peer chooses can be sparse.
+ */
+template <typename PacketId>
+using default_packet_id_storage = typename std::conditional<
+    sizeof(PacketId) == 2,
+    packet_id_bitmap_storage,
+    packet_id_hash_storage
+>::type;
+
+/**
+ * @brief Set of packet identifiers.
+ * @tparam PacketId packet id type. std::uint16_t or std::uint32_t.
+ * @tparam Alloc    allocator for the storage.
+ * @tparam Storage  packet_id_bitmap_storage or packet_id_hash_storage.
+ */
+template <
+    typename PacketId,
+    typename Alloc = std::allocator<char>,
+    typename Storage = default_packet_id_storage<PacketId>
+>
+class packet_id_set;
+
+/**
+ * @brief Set of packet identifiers in bitmap pages.
+ *
+ * Ids are kept in bitmap pages of 65536 ids. A page is allocated when an id in the page is used
+ * for the first time. So no memory is allocated per id.<BR>
+ * 2 bytes packet ids use only one page. For 4 bytes packet ids, pages other than the page of
+ * the last inserted id are released when they become empty.
+ */
+template <typename PacketId, typename Alloc>
+class packet_id_set<PacketId, Alloc, packet_id_bitmap_storage> {
+    using page_t = detail::packet_id_page;
+    using page_index_t = std::uint32_t;
+    using pages_t = std::unordered_map<
+        page_index_t,
+        page_t,
+        std::hash<page_index_t>,
+        std::equal_to<page_index_t>,
+        typename std::allocator_traits<Alloc>::template rebind_alloc<std::pair<page_index_t const, page_t>>
+    >;
+
+public:
+    static constexpr PacketId const max_id = std::numeric_limits<PacketId>::max();
+
+    /**
+     * @brief Insert the id.
+     * @return If id is 0 or already in the set, return false, otherwise return true.
+     */
+    bool insert(PacketId id) {
+        if (id == 0) return false;
+        return do_insert(id);
+    }
+
+    /**
+     * @brief Erase the id.
+     * @return If id is in the set, return true, otherwise return false.
+     */
+    bool erase(PacketId id) {
+        auto pi = page_index(id);
+        auto p = find_page(pi);
+        if (!p || !p->reset(page_offset(id))) return false;
+        --size_;
+        if (pi != current_page_index_) release_page_if_empty(pi);
+        return true;
+    }
+
+    bool contains(PacketId id) const {
+        if (cached_page_ && cached_page_index_ == page_index(id)) {
+            return cached_page_->test(page_offset(id));
+        }
+        auto it = pages_.find(page_index(id));
+        return it != pages_.end() && it->second.test(page_offset(id));
+    }
+
+    void clear() {
+        pages_.clear();
+        cached_page_ = nullptr;
+        size_ = 0;
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+protected:
+    static PacketId next(PacketId id) {
+        return id == max_id ? PacketId(1) : static_cast<PacketId>(id + 1);
+    }
+
+    static page_index_t page_index(PacketId id) {
+        return static_cast<page_index_t>(std::size_t(id) >> 16);
+    }
+
+    static std::size_t page_offset(PacketId id) {
+        return std::size_t(id) & 0xffff;
+    }
+
+    /**
+     * @brief Find the first id that is not in the set from id, in the page of id.
+     * @return found id. If the rest of the page is full, return 0.
+     */
+    PacketId find_next_free_in_page(PacketId id) {
+        auto pi = page_index(id);
+        auto p = find_page(pi);
+        if (!p) return id;
+        auto off = p->find_next_zero(page_offset(id));
+        if (off == page_t::size) return 0;
+        return static_cast<PacketId>((std::size_t(pi) << 16) + off);
+    }
+
+    /**
+     * @brief Get the last id of the page of id.
+     */
+    static PacketId page_last(PacketId id) {
+        return static_cast<PacketId>((std::size_t(page_index(id)) << 16) + (page_t::size - 1));
+    }
+
+    bool do_insert(PacketId id) {
+        auto pi = page_index(id);
+        auto p = find_page(pi);
+        if (!p) {
+            p = &pages_[pi];
+            cached_page_ = p;
+            cached_page_index_ = pi;
+        }
+        if (!p->set(page_offset(id))) return false;
+        ++size_;
+        if (pi != current_page_index_) {
+            auto prev = current_page_index_;
+            current_page_index_ = pi;
+            release_page_if_empty(prev);
+        }
+        return true;
+    }
+
+private:
+    page_t* find_page(page_index_t pi) {
+        if (cached_page_ && cached_page_index_ == pi) return cached_page_;
+        auto it = pages_.find(pi);
+        if (it == pages_.end()) return nullptr;
+        cached_page_ = &it->second;
+        cached_page_index_ = pi;
+        return cached_page_;
+    }
+
+    void release_page_if_empty(page_index_t pi) {
+        auto p = find_page(pi);
+        if (!p || p->count() != 0) return;
+        cached_page_ = nullptr;
+        pages_.erase(pi);
+    }
+
+    pages_t pages_;
+    page_t* cached_page_ = nullptr;
+    page_index_t cached_page_index_ = 0;
+    // The page of the last inserted id. It is kept even if it becomes empty.
+    page_index_t current_page_index_ = 0;
+    std::size_t size_ = 0;
+};
+
+/**
+ * @brief Set of packet identifiers in an open addressing hash table.
+ *
+ * The table uses linear probing, and 0 is the empty slot because 0 is not a packet id.
+ * Erasing shifts the following ids back instead of leaving a tombstone, so the probe length
+ * doesn't grow by churn. The table grows at the load factor 1/2 and shrinks at 1/8, so the memory
+ * is proportional to the number of the ids, not to the range of them.
+ */
+template <typename PacketId, typename Alloc>
+class packet_id_set<PacketId, Alloc, packet_id_hash_storage> {
+    using slots_t = std::vector<PacketId, typename std::allocator_traits<Alloc>::template rebind_alloc<PacketId>>;
+
+public:
+    static constexpr PacketId const max_id = std::numeric_limits<PacketId>::max();
+
+    /**
+     * @brief Insert the id.
+     * @return If id is 0 or already in the set, return false, otherwise return true.
+     */
+    bool insert(PacketId id) {
+        if (id == 0) return false;
+        if ((size_ + 1) * 2 > slots_.size()) {
+            rehash(slots_.empty() ? min_slots : slots_.size() * 2);
+        }
+        auto i = find_slot(id);
+        if (slots_[i] == id) return false;
+        slots_[i] = id;
+        ++size_;
+        return true;
+    }
+
+    /**
+     * @brief Erase the id.
+     * @return If id is in the set, return true, otherwise return false.
+     */
+    bool erase(PacketId id) {
+        if (id == 0 || size_ == 0) return false;
+        auto i = find_slot(id);
+        if (slots_[i] != id) return false;
+        auto mask = slots_.size() - 1;
+        for (auto j = (i + 1) & mask; slots_[j] != 0; j = (j + 1) & mask) {
+            // The id at j can fill the hole at i if its home slot is not in (i, j].
+            if (((j - home(slots_[j])) & mask) >= ((j - i) & mask)) {
+                slots_[i] = slots_[j];
+                i = j;
+            }
+        }
+        slots_[i] = 0;
+        --size_;
+        if (slots_.size() > min_slots && size_ * 8 < slots_.size()) {
+            rehash(slots_.size() / 2);
+        }
+        return true;
+    }
+
+    bool contains(PacketId id) const {
+        if (id == 0 || size_ == 0) return false;
+        return slots_[find_slot(id)] == id;
+    }
+
+    void clear() {
+        slots_t().swap(slots_);
+        size_ = 0;
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+private:
+    static constexpr std::size_t const min_slots = 16;
+
+    std::size_t home(PacketId id) const {
+        // Fibonacci hashing spreads the ids that are the multiples of the table size.
+        return static_cast<std::size_t>((std::uint64_t(id) * 0x9e3779b97f4a7c15ULL) >> shift_);
+    }
+
+    /**
+     * @brief Find the slot of id, or the empty slot that id is inserted to.
+     */
+    std::size_t find_slot(PacketId id) const {
+        auto mask = slots_.size() - 1;
+        auto i = home(id);
+        while (slots_[i] != 0 && slots_[i] != id) i = (i + 1) & mask;
+        return i;
+    }
+
+    void rehash(std::size_t num_slots) {
+        BOOST_ASSERT((num_slots & (num_slots - 1)) == 0);
+        slots_t old(num_slots, 0, slots_.get_allocator());
+        old.swap(slots_);
+        shift_ = 64;
+        for (auto n = num_slots; n != 1; n >>= 1) --shift_;
+        for (auto id : old) {
+            if (id != 0) slots_[find_slot(id)] = id;
+        }
+    }
+
+    slots_t slots_;
+    unsigned shift_ = 64;
+    std::size_t size_ = 0;
+};
+
+/**
+ * @brief Pool of in-flight packet identifiers.
+ *
+ * It is a packet_id_set in bitmap pages that can acquire the unused id.
+ * The acquired ids are sequential, so the pages are dense.
+ * @tparam PacketId packet id type. std::uint16_t or std::uint32_t.
+ * @tparam Alloc    allocator for the pages.
+ */
+template <typename PacketId, typename Alloc = std::allocator<char>>
+class packet_id_pool : public packet_id_set<PacketId, Alloc, packet_id_bitmap_storage> {
+    using base = packet_id_set<PacketId, Alloc, packet_id_bitmap_storage>;
+
+public:
+    using base::max_id;
+
+    /**
+     * @brief Acquire the unused id that is next to the previously acquired id.
+     *        0 is skipped. After the max id, it restarts from 1.
+     * @return acquired id. If all ids are in use, return 0.
+     */
+    PacketId acquire() {
+        if (this->size() == max_id) return 0;
+        auto id = base::next(last_acquired_);
+        while (true) {
+            // next() never returns 0, so the found id is not 0 on the first page.
+            auto found = this->find_next_free_in_page(id);
+            if (found != 0) {
+                id = found;
+                break;
+            }
+            // The rest of the page is in use. Go to the next page.
+            id = base::next(base::page_last(id));
+        }
+        auto ret = this->do_insert(id);
+        BOOST_ASSERT(ret);
+        static_cast<void>(ret);
+        last_acquired_ = id;
+        return id;
+    }
+
+private:
+    PacketId last_acquired_ = 0;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_PACKET_ID_POOL_HPP
@@ -0,0 +1,180 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_POOL_ALLOCATOR_HPP)
+#define MQTT_POOL_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <new>
+#include <array>
+
+namespace mqtt {
+
+namespace detail {
+
+/**
+ * @brief Thread local memory pool that caches freed blocks per size class.
+ *
+ * Size classes are powers of two from min_block_size to max_block_size.
+ * Larger requests are passed to the global operator new directly.<BR>
+ * Each block is allocated individually, so a block can be freed on another thread.
+ * It is cached by the pool of the thread that frees it.
+ */
+class size_class_pool {
+public:
+    static constexpr std::size_t const min_block_size = 16;
+    static constexpr std::size_t const max_block_size = 64 * 1024;
+    static constexpr std::size_t const max_cached_bytes_per_class = 1024 * 1024;
+
+    size_class_pool() {
+        free_.fill(nullptr);
+        cached_.fill(0);
+        state() = state_t::alive;
+    }
+
+    ~size_class_pool() {
+        state() = state_t::destroyed;
+        for (auto& f : free_) {
+            while (f) {
+                auto n = f;
+                f = f->next;
+                ::operator delete(n);
+            }
+        }
+    }
+
+    size_class_pool(size_class_pool const&) = delete;
+    size_class_pool& operator=(size_class_pool const&) = delete;
+
+    static size_class_pool& instance() {
+        static thread_local size_class_pool pool;
+        return pool;
+    }
+
+    static void* allocate(std::size_t size) {
+        if (size > max_block_size) return ::operator new(size);
+        auto index = class_index(size);
+        // The block could be cached by another thread's pool. So the size of the block is always block_size(index).
+        if (state() == state_t::destroyed) return ::operator new(block_size(index));
+        return instance().do_allocate(index);
+    }
+
+    static void deallocate(void* p, std::size_t size) {
+        if (size > max_block_size || state() == state_t::destroyed) {
+            ::operator delete(p);
+            return;
+        }
+        instance().do_deallocate(p, class_index(size));
+    }
+
+private:
+    struct node {
+        node* next;
+    };
+
+    static constexpr std::size_t const num_classes = 13; // 16 to 64K
+
+    static std::size_t class_index(std::size_t size) {
+        std::size_t index = 0;
+        std::size_t block = min_block_size;
+        while (block < size) {
+            block <<= 1;
+            ++index;
+        }
+        return index;
+    }
+
+    static std::size_t block_size(std::size_t index) {
+        return min_block_size << index;
+    }
+
+    enum class state_t {
+        not_constructed,
+        alive,
+        destroyed
+    };
+
+    // It is trivially destructible. So it can be checked after the pool is destroyed on thread exit.
+    static state_t& state() {
+        static thread_local state_t s = state_t::not_constructed;
+        return s;
+    }
+
+    void* do_allocate(std::size_t index) {
+        if (auto n = free_[index]) {
+            free_[index] = n->next;
+            --cached_[index];
+            return n;
+        }
+        return ::operator new(block_size(index));
+    }
+
+    void do_deallocate(void* p, std::size_t index) {
+        if ((cached_[index] + 1) * block_size(index) > max_cached_bytes_per_class) {
+            ::operator delete(p);
+            return;
+        }
+        auto n = static_cast<node*>(p);
+        n->next = free_[index];
+        free_[index] = n;
+        ++cached_[index];
+    }
+
+    std::array<node*, num_classes> free_;
+    std::array<std::size_t, num_classes> cached_;
+};
+
+} // namespace detail
+
+/**
+ * @brief Allocator that uses the thread local size class pool.
+ *
+ * It can be used as the Alloc template parameter of mqtt::endpoint.
+ * The endpoint uses Alloc for the receive payload buffer, the send buffers of the string publish
+ * APIs, the write gather vector and the send queue. When an io_service is run on one thread,
+ * these are allocated from the pool of the thread. So no lock is required.<BR>
+ * Freed memory is kept in the pool and reused by the next allocation of the same size class.<BR>
+ * The other memory, e.g. the store entries of QoS1 and QoS2 messages, the subscribe and connect
+ * messages, and the asio operations, is still allocated from the global heap.<BR>
+ * The endpoint default constructs Alloc where it is used, so the allocator must be stateless.
+ */
+template <typename T>
+class pool_allocator {
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = pool_allocator<U>;
+    };
+
+    pool_allocator() noexcept = default;
+
+    template <typename U>
+    pool_allocator(pool_allocator<U> const&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(detail::size_class_pool::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        detail::size_class_pool::deallocate(p, n * sizeof(T));
+    }
+};
+
+template <typename T, typename U>
+inline bool operator==(pool_allocator<T> const&, pool_allocator<U> const&) noexcept {
+    return true;
+}
+
+template <typename T, typename U>
+inline bool operator!=(pool_allocator<T> const&, pool_allocator<U> const&) noexcept {
+    return false;
+}
+
+} // namespace mqtt
+
+#endif // MQTT_POOL_ALLOCATOR_HPP
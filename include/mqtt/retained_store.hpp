@@ -0,0 +1,322 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_RETAINED_STORE_HPP)
+#define MQTT_RETAINED_STORE_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <utility>
+
+#include <boost/container/small_vector.hpp>
+
+#include <mqtt/string_view.hpp>
+#include <mqtt/topic_util.hpp>
+
+namespace mqtt {
+
+/**
+ * @brief Store of the retained messages that is indexed by the topic tree.
+ *
+ * Each level of the topic names is a node of the tree, and a node has at most one message.
+ * find() walks only the nodes that match the topic filter, so the cost of a wildcard
+ * subscription grows with the number of the matched messages, not with the number of
+ * the stored messages.<BR>
+ * The store accounts the bytes of the messages (topic name and the bytes that are given
+ * with the value). If max_bytes is set, the least recently stored messages are evicted to
+ * keep the total bytes within it.
+ * @tparam Value stored value. e.g. the topic name, contents, and QoS.
+ */
+template <typename Value>
+class retained_store {
+public:
+    /**
+     * @brief Memory usage of the store
+     */
+    struct usage {
+        /// the number of the messages
+        std::size_t messages;
+        /// the accounted bytes of the messages. It is limited by max_bytes.
+        std::size_t bytes;
+        /// the number of the nodes of the topic tree
+        std::size_t nodes;
+        /// the estimated bytes of the topic tree and the message entries
+        std::size_t index_bytes;
+        /// the number of the messages that are evicted to keep max_bytes
+        std::size_t evicted;
+    };
+
+    /**
+     * @brief Constructor
+     * @param max_bytes the upper limit of the accounted bytes. 0 means no limit.
+     */
+    explicit retained_store(std::size_t max_bytes = 0)
+        :max_bytes_(max_bytes) {}
+
+    retained_store(retained_store const&) = delete;
+    retained_store& operator=(retained_store const&) = delete;
+
+    /**
+     * @brief Check the topic name. The topic names should not be empty, and should not
+     *        contain wildcard characters.
+     * @param topic topic name
+     * @return true if the topic name is valid, otherwise false.
+     */
+    static bool is_valid_topic(string_view topic) {
+        return !topic.empty() && topic.find_first_of("+#") == string_view::npos;
+    }
+
+    /**
+     * @brief Store the message. The stored message of the same topic is replaced.
+     *        If the total bytes exceed max_bytes, the least recently stored messages are evicted.
+     * @param topic topic name
+     * @param value value to store
+     * @param bytes the bytes of the value to account. e.g. the size of the contents.
+     *              The size of the topic name is added by the store.
+     * @return true if stored. false if the topic name is invalid or the message is larger than max_bytes.
+     *         In this case, the message that has the same topic name is erased.
+     */
+    bool insert_or_assign(string_view topic, Value value, std::size_t bytes) {
+        if (!is_valid_topic(topic)) return false;
+        bytes += topic.size();
+        if (max_bytes_ != 0 && bytes > max_bytes_) {
+            erase(topic);
+            return false;
+        }
+
+        node* n = &root_;
+        detail::for_each_topic_level(
+            topic,
+            [&](string_view level) {
+                auto it = n->children.find(level);
+                if (it == n->children.end()) {
+                    std::unique_ptr<node> c(new node(n, level));
+                    string_view key(c->level);
+                    it = n->children.emplace(key, std::move(c)).first;
+                    ++nodes_;
+                    level_bytes_ += level.size();
+                }
+                n = it->second.get();
+            }
+        );
+        if (n->has_entry) {
+            bytes_ -= n->entry->bytes;
+            entries_.erase(n->entry);
+        }
+        n->entry = entries_.emplace(entries_.end(), n, std::move(value), bytes);
+        n->has_entry = true;
+        bytes_ += bytes;
+        shrink();
+        return true;
+    }
+
+    /**
+     * @brief Erase the message of the topic name.
+     * @param topic topic name
+     * @return the number of erased messages
+     */
+    std::size_t erase(string_view topic) {
+        node* n = &root_;
+        detail::for_each_topic_level(
+            topic,
+            [&](string_view level) {
+                if (!n) return;
+                auto it = n->children.find(level);
+                n = it == n->children.end() ? nullptr : it->second.get();
+            }
+        );
+        if (!n || !n->has_entry) return 0;
+        erase_entry(n->entry);
+        return 1;
+    }
+
+    /**
+     * @brief Apply f to the messages that match the topic filter.
+     *        Wildcards on the first level don't match the topic names that start with '$'.
+     * @param filter topic filter
+     * @param f      applying function. f should be void(Value const&)
+     */
+    template <typename F>
+    void find(string_view filter, F&& f) const {
+        boost::container::small_vector<string_view, 16> levels;
+        detail::for_each_topic_level(
+            filter,
+            [&](string_view level) {
+                levels.push_back(level);
+            }
+        );
+        match_level(root_, levels.data(), levels.data() + levels.size(), f);
+    }
+
+    /**
+     * @brief Set the upper limit of the accounted bytes. The messages are evicted if needed.
+     * @param max_bytes the upper limit. 0 means no limit.
+     */
+    void set_max_bytes(std::size_t max_bytes) {
+        max_bytes_ = max_bytes;
+        shrink();
+    }
+
+    std::size_t max_bytes() const {
+        return max_bytes_;
+    }
+
+    /**
+     * @brief Get the accounted bytes of the stored messages.
+     */
+    std::size_t bytes() const {
+        return bytes_;
+    }
+
+    /**
+     * @brief Get the number of the stored messages.
+     */
+    std::size_t size() const {
+        return entries_.size();
+    }
+
+    bool empty() const {
+        return entries_.empty();
+    }
+
+    /**
+     * @brief Get the number of the nodes. The root node is not counted.
+     */
+    std::size_t node_count() const {
+        return nodes_;
+    }
+
+    /**
+     * @brief Get the memory usage of the store.
+     */
+    usage memory_usage() const {
+        // A node of std::list and std::unordered_map has two pointers.
+        return usage {
+            entries_.size(),
+            bytes_,
+            nodes_,
+            nodes_ * (sizeof(node) + sizeof(std::pair<string_view const, std::unique_ptr<node>>) + sizeof(void*) * 2)
+            + level_bytes_
+            + entries_.size() * (sizeof(entry) + sizeof(void*) * 2),
+            evicted_
+        };
+    }
+
+    void clear() {
+        entries_.clear();
+        root_.children.clear();
+        nodes_ = 0;
+        level_bytes_ = 0;
+        bytes_ = 0;
+    }
+
+private:
+    struct node;
+
+    struct entry {
+        entry(node* n, Value value, std::size_t bytes)
+            :n(n), value(std::move(value)), bytes(bytes) {}
+        node* n;
+        Value value;
+        std::size_t bytes;
+    };
+
+    // The front is the least recently stored one.
+    using entries_t = std::list<entry>;
+
+    struct node {
+        node() = default;
+        node(node* parent, string_view level)
+            :parent(parent), level(level.data(), level.size()) {}
+        node* parent = nullptr;
+        std::string level;
+        // The keys point to the level of the children.
+        std::unordered_map<string_view, std::unique_ptr<node>, detail::string_view_hash> children;
+        typename entries_t::iterator entry;
+        bool has_entry = false;
+    };
+
+    static bool is_dollar(node const& n) {
+        return !n.level.empty() && n.level[0] == '$';
+    }
+
+    // [it, end) is the rest of the levels of the filter.
+    template <typename F>
+    void match_level(node const& n, string_view const* it, string_view const* end, F& f) const {
+        if (it == end) {
+            if (n.has_entry) f(n.entry->value);
+            return;
+        }
+        bool first = &n == &root_;
+        if (*it == "#") {
+            // "a/#" matches "a"
+            if (n.has_entry) f(n.entry->value);
+            for (auto const& c : n.children) {
+                if (first && is_dollar(*c.second)) continue;
+                apply_all(*c.second, f);
+            }
+            return;
+        }
+        if (*it == "+") {
+            for (auto const& c : n.children) {
+                if (first && is_dollar(*c.second)) continue;
+                match_level(*c.second, it + 1, end, f);
+            }
+            return;
+        }
+        auto c = n.children.find(*it);
+        if (c != n.children.end()) match_level(*c->second, it + 1, end, f);
+    }
+
+    template <typename F>
+    static void apply_all(node const& n, F& f) {
+        if (n.has_entry) f(n.entry->value);
+        for (auto const& c : n.children) {
+            apply_all(*c.second, f);
+        }
+    }
+
+    void erase_entry(typename entries_t::iterator it) {
+        node* n = it->n;
+        bytes_ -= it->bytes;
+        entries_.erase(it);
+        n->has_entry = false;
+        // Release the empty nodes from the leaf.
+        while (n != &root_ && !n->has_entry && n->children.empty()) {
+            node* p = n->parent;
+            level_bytes_ -= n->level.size();
+            --nodes_;
+            // The key points to n->level, so erase by the iterator.
+            p->children.erase(p->children.find(string_view(n->level)));
+            n = p;
+        }
+    }
+
+    void shrink() {
+        if (max_bytes_ == 0) return;
+        while (bytes_ > max_bytes_) {
+            erase_entry(entries_.begin());
+            ++evicted_;
+        }
+    }
+
+private:
+    node root_;
+    entries_t entries_;
+    std::size_t max_bytes_;
+    std::size_t bytes_ = 0;
+    std::size_t nodes_ = 0;
+    std::size_t level_bytes_ = 0;
+    std::size_t evicted_ = 0;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_RETAINED_STORE_HPP
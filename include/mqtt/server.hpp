@@ -31,12 +31,14 @@ template <
     typename Strand = as::io_service::strand,
     typename Mutex = std::mutex,
     template<typename...> class LockGuard = std::lock_guard,
-    std::size_t PacketIdBytes = 2
+    std::size_t PacketIdBytes = 2,
+    typename Alloc = std::allocator<char>,
+    template<typename...> class Store = multi_index_store
 >
 class server {
 public:
     using socket_t = tcp_endpoint<as::ip::tcp::socket, Strand>;
-    using endpoint_t = endpoint<socket_t, Mutex, LockGuard, PacketIdBytes>;
+    using endpoint_t = endpoint<socket_t, Mutex, LockGuard, PacketIdBytes, Alloc, Store>;
     using accept_handler = std::function<void(endpoint_t& ep)>;
 
     /**
@@ -144,12 +146,14 @@ template <
     typename Strand = as::io_service::strand,
     typename Mutex = std::mutex,
     template<typename...> class LockGuard = std::lock_guard,
-    std::size_t PacketIdBytes = 2
+    std::size_t PacketIdBytes = 2,
+    typename Alloc = std::allocator<char>,
+    template<typename...> class Store = multi_index_store
 >
 class server_tls {
 public:
     using socket_t = tcp_endpoint<as::ssl::stream<as::ip::tcp::socket>, Strand>;
-    using endpoint_t = endpoint<socket_t, Mutex, LockGuard, PacketIdBytes>;
+    using endpoint_t = endpoint<socket_t, Mutex, LockGuard, PacketIdBytes, Alloc, Store>;
     using accept_handler = std::function<void(endpoint_t& ep)>;
 
     /**
@@ -290,12 +294,14 @@ template <
     typename Strand = as::io_service::strand,
     typename Mutex = std::mutex,
     template<typename...> class LockGuard = std::lock_guard,
-    std::size_t PacketIdBytes = 2
+    std::size_t PacketIdBytes = 2,
+    typename Alloc = std::allocator<char>,
+    template<typename...> class Store = multi_index_store
 >
 class server_ws {
 public:
     using socket_t = ws_endpoint<as::ip::tcp::socket, Strand>;
-    using endpoint_t = endpoint<socket_t, Mutex, LockGuard, PacketIdBytes>;
+    using endpoint_t = endpoint<socket_t, Mutex, LockGuard, PacketIdBytes, Alloc, Store>;
     using accept_handler = std::function<void(endpoint_t& ep)>;
 
     /**
@@ -445,12 +451,14 @@ template <
     typename Strand = as::io_service::strand,
     typename Mutex = std::mutex,
     template<typename...> class LockGuard = std::lock_guard,
-    std::size_t PacketIdBytes = 2
+    std::size_t PacketIdBytes = 2,
+    typename Alloc = std::allocator<char>,
+    template<typename...> class Store = multi_index_store
 >
 class server_tls_ws {
 public:
     using socket_t = mqtt::ws_endpoint<as::ssl::stream<as::ip::tcp::socket>, Strand>;
-    using endpoint_t = endpoint<socket_t, Mutex, LockGuard, PacketIdBytes>;
+    using endpoint_t = endpoint<socket_t, Mutex, LockGuard, PacketIdBytes, Alloc, Store>;
 
     using accept_handler = std::function<void(endpoint_t& ep)>;
 
@@ -0,0 +1,38 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_STRAND_POST_HPP)
+#define MQTT_STRAND_POST_HPP
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include <boost/asio.hpp>
+
+namespace mqtt {
+
+namespace as = boost::asio;
+
+/**
+ * @brief Post the handler that could be move only.
+ * @param strand strand or io_service that the handler is posted to
+ * @param handler handler to post
+ */
+template <typename Strand, typename Handler>
+inline void strand_post(Strand& strand, Handler&& handler) {
+#if BOOST_VERSION >= 106600
+    as::post(strand, std::forward<Handler>(handler));
+#else  // BOOST_VERSION >= 106600
+    // Older Boost.Asio requires the handler to be copy constructible.
+    auto sp = std::make_shared<typename std::decay<Handler>::type>(std::forward<Handler>(handler));
+    strand.post([sp] { (*sp)(); });
+#endif // BOOST_VERSION >= 106600
+}
+
+} // namespace mqtt
+
+#endif // MQTT_STRAND_POST_HPP
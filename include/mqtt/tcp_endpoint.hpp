@@ -14,6 +14,7 @@
 #endif // !defined(MQTT_NO_TLS)
 
 #include <mqtt/utility.hpp>
+#include <mqtt/strand_post.hpp>
 
 namespace mqtt {
 
@@ -71,6 +72,13 @@ public:
         as::async_read(tcp_, buffers, strand_.wrap(std::forward<ReadHandler>(handler)));
     }
 
+    template <typename MutableBufferSequence, typename ReadHandler>
+    void async_read_some(
+        MutableBufferSequence const& buffers,
+        ReadHandler&& handler) {
+        tcp_.async_read_some(buffers, strand_.wrap(std::forward<ReadHandler>(handler)));
+    }
+
     template <typename ConstBufferSequence>
     std::size_t write(
         ConstBufferSequence const& buffers) {
@@ -97,7 +105,7 @@ public:
 
     template <typename PostHandler>
     void post(PostHandler&& handler) {
-        strand_.post(std::forward<PostHandler>(handler));
+        strand_post(strand_, std::forward<PostHandler>(handler));
     }
 
 private:
@@ -113,6 +121,14 @@ inline void async_read(
     ep.async_read(buffers, std::forward<ReadHandler>(handler));
 }
 
+template <typename Socket, typename Strand, typename MutableBufferSequence, typename ReadHandler>
+inline void async_read_some(
+    tcp_endpoint<Socket, Strand>& ep,
+    MutableBufferSequence const& buffers,
+    ReadHandler&& handler) {
+    ep.async_read_some(buffers, std::forward<ReadHandler>(handler));
+}
+
 template <typename Socket, typename Strand, typename ConstBufferSequence>
 inline std::size_t write(
     tcp_endpoint<Socket, Strand>& ep,
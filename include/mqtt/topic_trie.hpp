@@ -0,0 +1,366 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TOPIC_TRIE_HPP)
+#define MQTT_TOPIC_TRIE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <utility>
+#include <algorithm>
+
+#include <boost/functional/hash.hpp>
+#include <boost/container/small_vector.hpp>
+
+#include <mqtt/string_view.hpp>
+#include <mqtt/topic_util.hpp>
+
+namespace mqtt {
+
+/**
+ * @brief Subscription index that matches topic names against topic filters.
+ *
+ * Topic filters are split into levels and stored as a trie. Each level string is interned,
+ * so the nodes are keyed by (parent node id, segment id) in one hash table and the same level
+ * string is stored only once.<BR>
+ * Each node has the vector of the values that are subscribed with the filter of the node.
+ * match() visits only the nodes on the path of the topic name and the wildcard nodes, so the cost
+ * grows with the depth of the topic, not with the number of subscriptions.<BR>
+ * The trie is copyable. The copy shares the interned level strings with the source.
+ * See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718106
+ * @tparam Value stored value. e.g. the pair of the connection and QoS.
+ * @tparam Alloc allocator for the nodes and values.
+ */
+template <typename Value, typename Alloc = std::allocator<char>>
+class topic_trie {
+public:
+    /**
+     * @brief Check the topic filter.
+     *        '+' should occupy the entire level, and '#' should be the last level.
+     * @param filter topic filter
+     * @return true if the filter is valid, otherwise false.
+     */
+    static bool is_valid_filter(string_view filter) {
+        if (filter.empty()) return false;
+        for (std::size_t i = 0; i != filter.size(); ++i) {
+            auto c = filter[i];
+            if (c != '+' && c != '#') continue;
+            if (i != 0 && filter[i - 1] != '/') return false;
+            if (c == '#') return i + 1 == filter.size();
+            if (i + 1 != filter.size() && filter[i + 1] != '/') return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Add the value to the filter.
+     *        The same value can be added to the same filter more than once.
+     * @param filter topic filter
+     * @param value  value to add
+     * @return If the filter is invalid, return false, otherwise return true.
+     */
+    bool insert(string_view filter, Value value) {
+        if (!is_valid_filter(filter)) return false;
+        node* n = &root_;
+        node_id_t parent = root_id;
+        detail::for_each_topic_level(
+            filter,
+            [&](string_view level) {
+                auto sid = intern(level);
+                auto it = nodes_.find(key { parent, sid });
+                if (it == nodes_.end()) {
+                    it = nodes_.emplace(key { parent, sid }, node(next_node_id_++)).first;
+                    ++n->children;
+                    n->wildcards |= wildcard_flag(sid);
+                }
+                else {
+                    release(level);
+                }
+                n = &it->second;
+                parent = n->id;
+            }
+        );
+        n->values.push_back(std::move(value));
+        ++size_;
+        return true;
+    }
+
+    /**
+     * @brief Erase the values of the filter that satisfy the predicate.
+     *        The nodes that become empty are released.
+     * @param filter topic filter
+     * @param pred   predicate. pred should be bool(Value const&)
+     * @return the number of erased values
+     */
+    template <typename Pred>
+    std::size_t erase_if(string_view filter, Pred pred) {
+        // The path from the root to the node of the filter.
+        boost::container::small_vector<std::pair<key, string_view>, 16> path;
+        node_id_t parent = root_id;
+        bool found = true;
+        detail::for_each_topic_level(
+            filter,
+            [&](string_view level) {
+                if (!found) return;
+                auto sid = find_segment(level);
+                if (sid == npos) {
+                    found = false;
+                    return;
+                }
+                auto it = nodes_.find(key { parent, sid });
+                if (it == nodes_.end()) {
+                    found = false;
+                    return;
+                }
+                path.emplace_back(key { parent, sid }, level);
+                parent = it->second.id;
+            }
+        );
+        if (!found || path.empty()) return 0;
+
+        auto& values = nodes_.find(path.back().first)->second.values;
+        auto size = values.size();
+        values.erase(std::remove_if(values.begin(), values.end(), pred), values.end());
+        auto erased = size - values.size();
+        size_ -= erased;
+
+        // Release the empty nodes from the leaf.
+        while (!path.empty()) {
+            auto it = nodes_.find(path.back().first);
+            if (!it->second.values.empty() || it->second.children != 0) break;
+            auto sid = path.back().first.segment;
+            auto level = path.back().second;
+            nodes_.erase(it);
+            path.pop_back();
+            auto& p = path.empty() ? root_ : nodes_.find(path.back().first)->second;
+            --p.children;
+            p.wildcards &= static_cast<std::uint8_t>(~wildcard_flag(sid));
+            release(level);
+        }
+        return erased;
+    }
+
+    /**
+     * @brief Apply f to the values of the filters that match the topic name.
+     *        If the same value is added to the overlapping filters, f is called for each filter.<BR>
+     *        Wildcards on the first level don't match the topic names that start with '$'.
+     * @param topic topic name
+     * @param f     applying function. f should be void(Value const&)
+     */
+    template <typename F>
+    void match(string_view topic, F&& f) const {
+        // Resolve the segment ids of the levels once. Unknown levels match only wildcards.
+        // Topic names don't contain wildcard characters.
+        boost::container::small_vector<segment_id_t, 16> levels;
+        detail::for_each_topic_level(
+            topic,
+            [&](string_view level) {
+                levels.push_back(find_segment(level));
+            }
+        );
+        bool dollar = !topic.empty() && topic[0] == '$';
+        match_level(root_, levels.data(), levels.data() + levels.size(), dollar, f);
+    }
+
+    /**
+     * @brief Apply f to the values of the filter. Wildcards in the filter are not expanded.
+     * @param filter topic filter
+     * @param f      applying function. f should be void(Value const&)
+     */
+    template <typename F>
+    void find(string_view filter, F&& f) const {
+        node const* n = &root_;
+        detail::for_each_topic_level(
+            filter,
+            [&](string_view level) {
+                if (n) n = child(*n, find_segment(level));
+            }
+        );
+        apply(n, f);
+    }
+
+    /**
+     * @brief Get the number of the values.
+     */
+    std::size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    /**
+     * @brief Get the number of the nodes. The root node is not counted.
+     */
+    std::size_t node_count() const {
+        return nodes_.size();
+    }
+
+    void clear() {
+        nodes_.clear();
+        segments_.clear();
+        root_ = node(root_id);
+        size_ = 0;
+    }
+
+private:
+    using node_id_t = std::size_t;
+    using segment_id_t = std::size_t;
+
+    static constexpr node_id_t const root_id = 0;
+    static constexpr segment_id_t const npos = static_cast<segment_id_t>(-1);
+    static constexpr segment_id_t const plus_id = 0;
+    static constexpr segment_id_t const hash_id = 1;
+    static constexpr std::uint8_t const plus_flag = 0b01;
+    static constexpr std::uint8_t const hash_flag = 0b10;
+
+    template <typename T>
+    using rebind_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+
+    struct key {
+        node_id_t parent;
+        segment_id_t segment;
+        friend bool operator==(key const& lhs, key const& rhs) {
+            return lhs.parent == rhs.parent && lhs.segment == rhs.segment;
+        }
+    };
+
+    struct key_hash {
+        std::size_t operator()(key const& k) const {
+            std::size_t seed = 0;
+            boost::hash_combine(seed, k.parent);
+            boost::hash_combine(seed, k.segment);
+            return seed;
+        }
+    };
+
+    struct node {
+        explicit node(node_id_t id):id(id) {}
+        node_id_t id;
+        std::size_t children = 0;
+        std::uint8_t wildcards = 0;
+        std::vector<Value, rebind_alloc<Value>> values;
+    };
+
+    struct segment {
+        std::shared_ptr<std::string const> str;
+        segment_id_t id;
+        std::size_t refs;
+    };
+
+    using nodes_t = std::unordered_map<
+        key,
+        node,
+        key_hash,
+        std::equal_to<key>,
+        rebind_alloc<std::pair<key const, node>>
+    >;
+
+    // The keys point to the strings in the values.
+    using segments_t = std::unordered_map<
+        string_view,
+        segment,
+        detail::string_view_hash,
+        std::equal_to<string_view>,
+        rebind_alloc<std::pair<string_view const, segment>>
+    >;
+
+    static std::uint8_t wildcard_flag(segment_id_t sid) {
+        switch (sid) {
+        case plus_id:
+            return plus_flag;
+        case hash_id:
+            return hash_flag;
+        default:
+            return 0;
+        }
+    }
+
+    segment_id_t find_segment(string_view level) const {
+        if (level.size() == 1) {
+            if (level[0] == '+') return plus_id;
+            if (level[0] == '#') return hash_id;
+        }
+        auto it = segments_.find(level);
+        if (it == segments_.end()) return npos;
+        return it->second.id;
+    }
+
+    // Get the segment id of the level and increment the reference count.
+    segment_id_t intern(string_view level) {
+        auto sid = find_segment(level);
+        if (sid == plus_id || sid == hash_id) return sid;
+        if (sid != npos) {
+            ++segments_.find(level)->second.refs;
+            return sid;
+        }
+        auto str = std::make_shared<std::string const>(level.data(), level.size());
+        sid = next_segment_id_++;
+        segments_.emplace(string_view(*str), segment { str, sid, 1 });
+        return sid;
+    }
+
+    // Decrement the reference count of the level that is interned.
+    void release(string_view level) {
+        if (level.size() == 1 && (level[0] == '+' || level[0] == '#')) return;
+        auto it = segments_.find(level);
+        if (--it->second.refs == 0) segments_.erase(it);
+    }
+
+    node const* child(node const& n, segment_id_t sid) const {
+        if (sid == npos || n.children == 0) return nullptr;
+        auto it = nodes_.find(key { n.id, sid });
+        if (it == nodes_.end()) return nullptr;
+        return &it->second;
+    }
+
+    template <typename F>
+    static void apply(node const* n, F& f) {
+        if (!n) return;
+        for (auto const& v : n->values) f(v);
+    }
+
+    // [it, end) is the segment ids of the rest of the levels.
+    template <typename F>
+    void match_level(
+        node const& n,
+        segment_id_t const* it,
+        segment_id_t const* end,
+        bool dollar,
+        F& f) const {
+        if (it == end) {
+            apply(&n, f);
+            // "a/#" matches "a"
+            if (n.wildcards & hash_flag) apply(child(n, hash_id), f);
+            return;
+        }
+        // Wildcards on the first level don't match the topic names that start with '$'.
+        if (!dollar) {
+            if (n.wildcards & hash_flag) apply(child(n, hash_id), f);
+            if (n.wildcards & plus_flag) {
+                if (auto c = child(n, plus_id)) match_level(*c, it + 1, end, false, f);
+            }
+        }
+        if (auto c = child(n, *it)) match_level(*c, it + 1, end, false, f);
+    }
+
+    nodes_t nodes_;
+    segments_t segments_;
+    node root_ { root_id };
+    node_id_t next_node_id_ = root_id + 1;
+    segment_id_t next_segment_id_ = hash_id + 1;
+    std::size_t size_ = 0;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_TOPIC_TRIE_HPP
@@ -0,0 +1,46 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TOPIC_UTIL_HPP)
+#define MQTT_TOPIC_UTIL_HPP
+
+#include <cstddef>
+
+#include <boost/functional/hash.hpp>
+
+#include <mqtt/string_view.hpp>
+
+namespace mqtt {
+
+namespace detail {
+
+struct string_view_hash {
+    std::size_t operator()(string_view s) const {
+        return boost::hash_range(s.begin(), s.end());
+    }
+};
+
+/**
+ * @brief Call f for each level of the topic. "a//b" has 3 levels and "" has 1 level.
+ */
+template <typename F>
+inline void for_each_topic_level(string_view topic, F&& f) {
+    while (true) {
+        auto pos = topic.find('/');
+        if (pos == string_view::npos) {
+            f(topic);
+            return;
+        }
+        f(topic.substr(0, pos));
+        topic = topic.substr(pos + 1);
+    }
+}
+
+} // namespace detail
+
+} // namespace mqtt
+
+#endif // MQTT_TOPIC_UTIL_HPP
@@ -7,9 +7,17 @@
 #if !defined(MQTT_UTF8ENCODED_STRINGS_HPP)
 #define MQTT_UTF8ENCODED_STRINGS_HPP
 
+#include <cstdint>
+
 #include <mqtt/utility.hpp>
 #include <mqtt/string_view.hpp>
 
+// SSE2 is always available on x86-64. AVX2 is selected at runtime.
+#if defined(MQTT_USE_STR_CHECK) && defined(__SSE2__) && defined(__GNUC__)
+#define MQTT_UTF8_SIMD
+#include <immintrin.h>
+#endif // defined(MQTT_USE_STR_CHECK) && defined(__SSE2__) && defined(__GNUC__)
+
 namespace mqtt {
 
 namespace utf8string {
@@ -43,103 +51,215 @@ is_valid_length(string_view str) {
     return str.size() <= 0xffff;
 }
 
-inline validation
-validate_contents(string_view str) {
-    // This code is based on https://www.cl.cam.ac.uk/~mgk25/ucs/utf8_check.c
-    auto result = validation::well_formed;
 #if defined(MQTT_USE_STR_CHECK)
-    auto it = str.begin();
-    auto end = str.end();
 
-    while (it != end) {
-        if (static_cast<unsigned char>(*(it + 0)) < 0b1000'0000) {
-            // 0xxxxxxxxx
-            if (static_cast<unsigned char>(*(it + 0)) == 0x00) {
-                result = validation::ill_formed;
-                break;
-            }
-            if ((static_cast<unsigned char>(*(it + 0)) >= 0x01 &&
-                 static_cast<unsigned char>(*(it + 0)) <= 0x1f) ||
-                static_cast<unsigned char>(*(it + 0)) == 0x7f) {
-                result = validation::well_formed_with_non_charactor;
-            }
-            ++it;
+namespace detail {
+
+/**
+ * @brief Validate one character at it and advance it.
+ * @return If the character is ill_formed, return false, otherwise return true.
+ */
+inline bool
+validate_char(char const*& it, char const* end, validation& result) {
+    // This code is based on https://www.cl.cam.ac.uk/~mgk25/ucs/utf8_check.c
+    if (static_cast<unsigned char>(*(it + 0)) < 0b1000'0000) {
+        // 0xxxxxxxxx
+        if (static_cast<unsigned char>(*(it + 0)) == 0x00) {
+            result = validation::ill_formed;
+            return false;
+        }
+        if ((static_cast<unsigned char>(*(it + 0)) >= 0x01 &&
+             static_cast<unsigned char>(*(it + 0)) <= 0x1f) ||
+            static_cast<unsigned char>(*(it + 0)) == 0x7f) {
+            result = validation::well_formed_with_non_charactor;
         }
-        else if ((static_cast<unsigned char>(*(it + 0)) & 0b1110'0000) == 0b1100'0000) {
-            // 110XXXXx 10xxxxxx
-            if (it + 1 >= end) {
-                result = validation::ill_formed;
-                break;
-            }
-            if ((static_cast<unsigned char>(*(it + 1)) & 0b1100'0000) != 0b1000'0000 ||
-                (static_cast<unsigned char>(*(it + 0)) & 0b1111'1110) == 0b1100'0000) { // overlong
-                result = validation::ill_formed;
-                break;
-            }
-            if (static_cast<unsigned char>(*(it + 0)) == 0b1100'0010 &&
-                static_cast<unsigned char>(*(it + 1)) >= 0b1000'0000 &&
-                static_cast<unsigned char>(*(it + 1)) <= 0b1001'1111) {
-                result = validation::well_formed_with_non_charactor;
-            }
-            it += 2;
+        ++it;
+    }
+    else if ((static_cast<unsigned char>(*(it + 0)) & 0b1110'0000) == 0b1100'0000) {
+        // 110XXXXx 10xxxxxx
+        if (it + 1 >= end) {
+            result = validation::ill_formed;
+            return false;
         }
-        else if ((static_cast<unsigned char>(*(it + 0)) & 0b1111'0000) == 0b1110'0000) {
-            // 1110XXXX 10Xxxxxx 10xxxxxx
-            if (it + 2 >= end) {
-                result = validation::ill_formed;
-                break;
-            }
-            if ((static_cast<unsigned char>(*(it + 1)) & 0b1100'0000) != 0b1000'0000 ||
-                (static_cast<unsigned char>(*(it + 2)) & 0b1100'0000) != 0b1000'0000 ||
-                (static_cast<unsigned char>(*(it + 0)) == 0b1110'0000 &&
-                 (static_cast<unsigned char>(*(it + 1)) & 0b1110'0000) == 0b1000'0000) || // overlong?
-                (static_cast<unsigned char>(*(it + 0)) == 0b1110'1101 &&
-                 (static_cast<unsigned char>(*(it + 1)) & 0b1110'0000) == 0b1010'0000)) { // surrogate?
-                result = validation::ill_formed;
-                break;
-            }
-            if (static_cast<unsigned char>(*(it + 0)) == 0b1110'1111 &&
-                static_cast<unsigned char>(*(it + 1)) == 0b1011'1111 &&
-                (static_cast<unsigned char>(*(it + 2)) & 0b1111'1110) == 0b1011'1110) {
-                // U+FFFE or U+FFFF?
-                result = validation::well_formed_with_non_charactor;
-            }
-            it += 3;
+        if ((static_cast<unsigned char>(*(it + 1)) & 0b1100'0000) != 0b1000'0000 ||
+            (static_cast<unsigned char>(*(it + 0)) & 0b1111'1110) == 0b1100'0000) { // overlong
+            result = validation::ill_formed;
+            return false;
         }
-        else if ((static_cast<unsigned char>(*(it + 0)) & 0b1111'1000) == 0b1111'0000) {
-            // 11110XXX 10XXxxxx 10xxxxxx 10xxxxxx
-            if (it + 3 >= end) {
-                result = validation::ill_formed;
-                break;
-            }
-            if ((static_cast<unsigned char>(*(it + 1)) & 0b1100'0000) != 0b1000'0000 ||
-                (static_cast<unsigned char>(*(it + 2)) & 0b1100'0000) != 0b1000'0000 ||
-                (static_cast<unsigned char>(*(it + 3)) & 0b1100'0000) != 0b1000'0000 ||
-                (static_cast<unsigned char>(*(it + 0)) == 0b1111'0000 &&
-                 (static_cast<unsigned char>(*(it + 1)) & 0b1111'0000) == 0b1000'0000) ||    // overlong?
-                (static_cast<unsigned char>(*(it + 0)) == 0b1111'0100 &&
-                 static_cast<unsigned char>(*(it + 1)) > 0b1000'1111) ||
-                static_cast<unsigned char>(*(it + 0)) > 0b1111'0100) { // > U+10FFFF?
-                result = validation::ill_formed;
-                break;
-            }
-            if ((static_cast<unsigned char>(*(it + 1)) & 0b1100'1111) == 0b1000'1111 &&
-                static_cast<unsigned char>(*(it + 2)) == 0b1011'1111 &&
-                (static_cast<unsigned char>(*(it + 3)) & 0b1111'1110) == 0b1011'1110) {
-                // U+nFFFE or U+nFFFF?
-                result = validation::well_formed_with_non_charactor;
-            }
-            it += 4;
+        if (static_cast<unsigned char>(*(it + 0)) == 0b1100'0010 &&
+            static_cast<unsigned char>(*(it + 1)) >= 0b1000'0000 &&
+            static_cast<unsigned char>(*(it + 1)) <= 0b1001'1111) {
+            result = validation::well_formed_with_non_charactor;
         }
-        else {
+        it += 2;
+    }
+    else if ((static_cast<unsigned char>(*(it + 0)) & 0b1111'0000) == 0b1110'0000) {
+        // 1110XXXX 10Xxxxxx 10xxxxxx
+        if (it + 2 >= end) {
             result = validation::ill_formed;
-            break;
+            return false;
         }
+        if ((static_cast<unsigned char>(*(it + 1)) & 0b1100'0000) != 0b1000'0000 ||
+            (static_cast<unsigned char>(*(it + 2)) & 0b1100'0000) != 0b1000'0000 ||
+            (static_cast<unsigned char>(*(it + 0)) == 0b1110'0000 &&
+             (static_cast<unsigned char>(*(it + 1)) & 0b1110'0000) == 0b1000'0000) || // overlong?
+            (static_cast<unsigned char>(*(it + 0)) == 0b1110'1101 &&
+             (static_cast<unsigned char>(*(it + 1)) & 0b1110'0000) == 0b1010'0000)) { // surrogate?
+            result = validation::ill_formed;
+            return false;
+        }
+        if (static_cast<unsigned char>(*(it + 0)) == 0b1110'1111 &&
+            static_cast<unsigned char>(*(it + 1)) == 0b1011'1111 &&
+            (static_cast<unsigned char>(*(it + 2)) & 0b1111'1110) == 0b1011'1110) {
+            // U+FFFE or U+FFFF?
+            result = validation::well_formed_with_non_charactor;
+        }
+        it += 3;
+    }
+    else if ((static_cast<unsigned char>(*(it + 0)) & 0b1111'1000) == 0b1111'0000) {
+        // 11110XXX 10XXxxxx 10xxxxxx 10xxxxxx
+        if (it + 3 >= end) {
+            result = validation::ill_formed;
+            return false;
+        }
+        if ((static_cast<unsigned char>(*(it + 1)) & 0b1100'0000) != 0b1000'0000 ||
+            (static_cast<unsigned char>(*(it + 2)) & 0b1100'0000) != 0b1000'0000 ||
+            (static_cast<unsigned char>(*(it + 3)) & 0b1100'0000) != 0b1000'0000 ||
+            (static_cast<unsigned char>(*(it + 0)) == 0b1111'0000 &&
+             (static_cast<unsigned char>(*(it + 1)) & 0b1111'0000) == 0b1000'0000) ||    // overlong?
+            (static_cast<unsigned char>(*(it + 0)) == 0b1111'0100 &&
+             static_cast<unsigned char>(*(it + 1)) > 0b1000'1111) ||
+            static_cast<unsigned char>(*(it + 0)) > 0b1111'0100) { // > U+10FFFF?
+            result = validation::ill_formed;
+            return false;
+        }
+        if ((static_cast<unsigned char>(*(it + 1)) & 0b1100'1111) == 0b1000'1111 &&
+            static_cast<unsigned char>(*(it + 2)) == 0b1011'1111 &&
+            (static_cast<unsigned char>(*(it + 3)) & 0b1111'1110) == 0b1011'1110) {
+            // U+nFFFE or U+nFFFF?
+            result = validation::well_formed_with_non_charactor;
+        }
+        it += 4;
+    }
+    else {
+        result = validation::ill_formed;
+        return false;
+    }
+    return true;
+}
+
+inline validation
+validate_contents_scalar(string_view str) {
+    auto result = validation::well_formed;
+    auto it = str.data();
+    auto end = str.data() + str.size();
+    while (it != end) {
+        if (!validate_char(it, end, result)) break;
+    }
+    return result;
+}
+
+#if defined(MQTT_UTF8_SIMD)
+
+/**
+ * @brief Validate str using SSE2.
+ * 16 bytes blocks that contain only ASCII characters are checked at once,
+ * including nul and control characters.
+ * When a block contains a multi bytes character, the ASCII prefix is checked in the same way
+ * and the character is validated by validate_char.
+ */
+inline validation
+validate_contents_sse2(string_view str) {
+    auto result = validation::well_formed;
+    auto it = str.data();
+    auto end = str.data() + str.size();
+    auto const zero = _mm_setzero_si128();
+    auto const space = _mm_set1_epi8(0x20);
+    auto const del = _mm_set1_epi8(0x7f);
+    while (end - it >= 16) {
+        auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(it));
+        auto non_ascii = static_cast<std::uint32_t>(_mm_movemask_epi8(v));
+        auto nul = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)));
+        // Non ASCII bytes are negative as signed char, so they are masked out.
+        auto ctrl = static_cast<std::uint32_t>(
+            _mm_movemask_epi8(_mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del)))
+        ) & ~non_ascii;
+        std::size_t ascii_len = non_ascii == 0 ? 16 : static_cast<std::size_t>(__builtin_ctz(non_ascii));
+        auto ascii_mask = (std::uint32_t(1) << ascii_len) - 1;
+        if (nul & ascii_mask) return validation::ill_formed;
+        if (ctrl & ascii_mask) result = validation::well_formed_with_non_charactor;
+        it += ascii_len;
+        if (non_ascii != 0 && !validate_char(it, end, result)) return result;
+    }
+    while (it != end) {
+        if (!validate_char(it, end, result)) break;
+    }
+    return result;
+}
+
+/**
+ * @brief Validate str using AVX2.
+ * It is the same as validate_contents_sse2 except that the block size is 32 bytes.
+ */
+__attribute__((target("avx2")))
+inline validation
+validate_contents_avx2(string_view str) {
+    auto result = validation::well_formed;
+    auto it = str.data();
+    auto end = str.data() + str.size();
+    auto const zero = _mm256_setzero_si256();
+    auto const space = _mm256_set1_epi8(0x20);
+    auto const del = _mm256_set1_epi8(0x7f);
+    while (end - it >= 32) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(it));
+        auto non_ascii = static_cast<std::uint32_t>(_mm256_movemask_epi8(v));
+        auto nul = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)));
+        // Non ASCII bytes are negative as signed char, so they are masked out.
+        auto ctrl = static_cast<std::uint32_t>(
+            _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpgt_epi8(space, v), _mm256_cmpeq_epi8(v, del)))
+        ) & ~non_ascii;
+        std::size_t ascii_len = non_ascii == 0 ? 32 : static_cast<std::size_t>(__builtin_ctz(non_ascii));
+        auto ascii_mask = static_cast<std::uint32_t>((std::uint64_t(1) << ascii_len) - 1);
+        if (nul & ascii_mask) return validation::ill_formed;
+        if (ctrl & ascii_mask) result = validation::well_formed_with_non_charactor;
+        it += ascii_len;
+        if (non_ascii != 0 && !validate_char(it, end, result)) return result;
     }
+    while (it != end) {
+        if (!validate_char(it, end, result)) break;
+    }
+    return result;
+}
+
+inline bool
+has_avx2() {
+#if defined(__AVX2__)
+    return true;
+#else  // defined(__AVX2__)
+    static bool const b = __builtin_cpu_supports("avx2");
+    return b;
+#endif // defined(__AVX2__)
+}
+
+#endif // defined(MQTT_UTF8_SIMD)
+
+} // namespace detail
+
+#endif // defined(MQTT_USE_STR_CHECK)
+
+inline validation
+validate_contents(string_view str) {
+#if defined(MQTT_USE_STR_CHECK)
+#if defined(MQTT_UTF8_SIMD)
+    if (detail::has_avx2()) return detail::validate_contents_avx2(str);
+    return detail::validate_contents_sse2(str);
+#else  // defined(MQTT_UTF8_SIMD)
+    return detail::validate_contents_scalar(str);
+#endif // defined(MQTT_UTF8_SIMD)
 #else // MQTT_USE_STR_CHECK
     static_cast<void>(str);
+    return validation::well_formed;
 #endif // MQTT_USE_STR_CHECK
-    return result;
 }
 
 } // namespace utf8string
@@ -14,6 +14,7 @@
 #include <boost/beast/websocket.hpp>
 
 #include <mqtt/utility.hpp>
+#include <mqtt/strand_post.hpp>
 #include <mqtt/string_view.hpp>
 
 namespace mqtt {
@@ -142,6 +143,39 @@ public:
         );
     }
 
+    template <typename MutableBufferSequence, typename ReadHandler>
+    void async_read_some(
+        MutableBufferSequence const& buffers,
+        ReadHandler&& handler) {
+        if (buffer_.size() > 0) {
+            auto size = as::buffer_copy(buffers, buffer_.data());
+            buffer_.consume(size);
+            handler(boost::system::errc::make_error_code(boost::system::errc::success), size);
+            return;
+        }
+        ws_.async_read(
+            buffer_,
+            strand_.wrap(
+                [this, buffers, MQTT_CAPTURE_FORWARD(ReadHandler, handler)]
+                (boost::system::error_code const& ec, std::size_t) mutable {
+                    if (ec) {
+                        handler(ec, 0);
+                        return;
+                    }
+                    if (!ws_.got_binary()) {
+                        buffer_.consume(buffer_.size());
+                        std::forward<ReadHandler>(handler)
+                            (boost::system::errc::make_error_code(boost::system::errc::bad_message), 0);
+                        return;
+                    }
+                    auto size = as::buffer_copy(buffers, buffer_.data());
+                    buffer_.consume(size);
+                    handler(boost::system::errc::make_error_code(boost::system::errc::success), size);
+                }
+            )
+        );
+    }
+
     template <typename ConstBufferSequence>
     std::size_t write(
         ConstBufferSequence const& buffers) {
@@ -169,7 +203,7 @@ public:
 
     template <typename PostHandler>
     void post(PostHandler&& handler) {
-        strand_.post(std::forward<PostHandler>(handler));
+        strand_post(strand_, std::forward<PostHandler>(handler));
     }
 
 private:
@@ -186,6 +220,14 @@ inline void async_read(
     ep.async_read(buffers, std::forward<ReadHandler>(handler));
 }
 
+template <typename Socket, typename Strand, typename MutableBufferSequence, typename ReadHandler>
+inline void async_read_some(
+    ws_endpoint<Socket, Strand>& ep,
+    MutableBufferSequence const& buffers,
+    ReadHandler&& handler) {
+    ep.async_read_some(buffers, std::forward<ReadHandler>(handler));
+}
+
 template <typename Socket, typename Strand, typename ConstBufferSequence>
 inline std::size_t write(
     ws_endpoint<Socket, Strand>& ep,
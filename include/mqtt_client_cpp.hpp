@@ -13,6 +13,10 @@
 #include <mqtt/exception.hpp>
 #include <mqtt/fixed_header.hpp>
 #include <mqtt/hexdump.hpp>
+#include <mqtt/pool_allocator.hpp>
+#include <mqtt/packet_id_pool.hpp>
+#include <mqtt/multi_index_store.hpp>
+#include <mqtt/flat_store.hpp>
 #include <mqtt/publish.hpp>
 #include <mqtt/qos.hpp>
 #include <mqtt/remaining_length.hpp>
@@ -13,11 +13,18 @@
 #include <mqtt/exception.hpp>
 #include <mqtt/fixed_header.hpp>
 #include <mqtt/hexdump.hpp>
+#include <mqtt/pool_allocator.hpp>
+#include <mqtt/packet_id_pool.hpp>
+#include <mqtt/multi_index_store.hpp>
+#include <mqtt/flat_store.hpp>
 #include <mqtt/publish.hpp>
 #include <mqtt/qos.hpp>
 #include <mqtt/remaining_length.hpp>
 #include <mqtt/session_present.hpp>
 #include <mqtt/str_connect_return_code.hpp>
 #include <mqtt/str_qos.hpp>
+#include <mqtt/topic_trie.hpp>
+#include <mqtt/retained_store.hpp>
+#include <mqtt/offline_queue.hpp>
 #include <mqtt/utf8encoded_strings.hpp>
 #include <mqtt/will.hpp>
@@ -0,0 +1,61 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TEST_ALLOCATION_COUNT_HPP)
+#define MQTT_TEST_ALLOCATION_COUNT_HPP
+
+// Replaces the global operator new to count the heap allocations.
+// Include it from only one translation unit of the test program.
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+
+namespace {
+
+std::atomic<std::size_t> allocation_count(0);
+
+// Counts the allocations in the scope.
+struct allocation_counter {
+    allocation_counter():start_(allocation_count.load()) {}
+    std::size_t count() const {
+        return allocation_count.load() - start_;
+    }
+private:
+    std::size_t start_;
+};
+
+} // anonymous namespace
+
+void* operator new(std::size_t size) {
+    ++allocation_count;
+    if (size == 0) size = 1;
+    if (void* p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+#endif // MQTT_TEST_ALLOCATION_COUNT_HPP
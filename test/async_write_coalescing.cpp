@@ -0,0 +1,159 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "combi_test.hpp"
+
+#include <mqtt/optional.hpp>
+
+#include <vector>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(test_async_write_coalescing)
+
+template <typename Test>
+void coalescing_test(std::size_t max_count, std::size_t max_size, Test const& test) {
+    do_combi_test(
+        [&](boost::asio::io_service& ios, auto& c, auto& s) {
+            c->set_max_queue_send_count(max_count);
+            c->set_max_queue_send_size(max_size);
+            test(ios, c, s);
+        }
+    );
+}
+
+// The number of the publish messages
+std::size_t const count = 300;
+
+// The publish messages are written by the writes in [min_writes, max_writes].
+auto make_publish_test(std::size_t contents_size, std::size_t min_writes, std::size_t max_writes) {
+    return [contents_size, min_writes, max_writes](boost::asio::io_service& ios, auto& c, auto& s) {
+        using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+        c->set_clean_session(true);
+        // A synchronous response could be written in the middle of a batch.
+        c->set_auto_pub_response(true, true);
+
+        std::string const padding(contents_size, 'x');
+        std::size_t sent = 0;
+        std::size_t received = 0;
+        std::size_t acked = 0;
+        std::size_t writes = 0;
+        std::size_t publish_writes = 0;
+        bool closed = false;
+
+        auto check_finish =
+            [&] {
+                if (received == count && acked == count / 3 * 2) {
+                    c->async_disconnect();
+                }
+            };
+
+        c->set_connack_handler(
+            [&]
+            (bool, std::uint8_t connack_return_code) {
+                BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+                // Counts the writes of the client. The client sets its own handler on connect,
+                // so it is replaced here.
+                c->set_pre_send_handler(
+                    [&]
+                    () {
+                        ++writes;
+                    });
+                c->async_subscribe("topic1", mqtt::qos::exactly_once);
+                return true;
+            });
+        c->set_close_handler(
+            [&]
+            () {
+                closed = true;
+                s.close();
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->set_puback_handler(
+            [&]
+            (packet_id_t) {
+                ++acked;
+                check_finish();
+                return true;
+            });
+        c->set_pubcomp_handler(
+            [&]
+            (packet_id_t) {
+                ++acked;
+                check_finish();
+                return true;
+            });
+        c->set_suback_handler(
+            [&]
+            (packet_id_t, std::vector<mqtt::optional<std::uint8_t>>) {
+                writes = 0;
+                for (std::size_t i = 0; i != count; ++i) {
+                    c->async_publish(
+                        "topic1",
+                        "topic1_contents_" + std::to_string(i) + padding,
+                        static_cast<std::uint8_t>(i % 3),
+                        false,
+                        [&, i]
+                        (boost::system::error_code const& ec) {
+                            BOOST_TEST(!ec);
+                            // Handlers are called in the order of the messages.
+                            BOOST_TEST(sent == i);
+                            ++sent;
+                            // The acknowledgements that are written meanwhile are counted too.
+                            if (sent == count) publish_writes = writes;
+                        });
+                }
+                return true;
+            });
+        c->set_publish_handler(
+            [&]
+            (std::uint8_t,
+             mqtt::optional<packet_id_t>,
+             std::string topic,
+             std::string contents) {
+                BOOST_TEST(topic == "topic1");
+                BOOST_TEST(contents == "topic1_contents_" + std::to_string(received) + padding);
+                ++received;
+                check_finish();
+                return true;
+            });
+        c->connect();
+        ios.run();
+        BOOST_TEST(sent == count);
+        BOOST_TEST(received == count);
+        BOOST_TEST(acked == count / 3 * 2);
+        BOOST_TEST(closed);
+        BOOST_TEST(publish_writes >= min_writes);
+        BOOST_TEST(publish_writes <= max_writes);
+    };
+}
+
+BOOST_AUTO_TEST_CASE( no_limit ) {
+    // The first message is written alone, and the others are gathered while it is written.
+    coalescing_test(0, 0, make_publish_test(0, 1, count / 10));
+}
+
+BOOST_AUTO_TEST_CASE( count_limit ) {
+    coalescing_test(7, 0, make_publish_test(0, (count + 6) / 7, count / 2));
+}
+
+BOOST_AUTO_TEST_CASE( size_limit ) {
+    // Smaller than one message. Each message is sent one by one.
+    coalescing_test(0, 1, make_publish_test(0, count, count * 2));
+    // A message is about 30 bytes.
+    coalescing_test(0, 256, make_publish_test(0, count / 10, count / 2));
+}
+
+BOOST_AUTO_TEST_CASE( large_contents ) {
+    // The batch is written by several system calls, but it is one async write.
+    coalescing_test(0, 0, make_publish_test(10000, 1, count / 10));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
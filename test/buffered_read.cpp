@@ -0,0 +1,172 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "combi_test.hpp"
+
+#include <mqtt/optional.hpp>
+
+#include <vector>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(test_buffered_read)
+
+BOOST_AUTO_TEST_CASE( pipelined_publish ) {
+    auto test = [](boost::asio::io_service& ios, auto& c, auto& s) {
+        using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+        c->set_clean_session(true);
+        c->set_read_buffer_size(4096);
+
+        std::size_t const count = 300;
+        std::size_t received = 0;
+        std::size_t acked = 0;
+        bool closed = false;
+
+        auto check_finish =
+            [&] {
+                if (received == count && acked == count / 3 * 2) {
+                    c->async_disconnect();
+                }
+            };
+
+        c->set_connack_handler(
+            [&]
+            (bool sp, std::uint8_t connack_return_code) {
+                BOOST_TEST(sp == false);
+                BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+                c->async_subscribe("topic1", mqtt::qos::exactly_once);
+                return true;
+            });
+        c->set_close_handler(
+            [&]
+            () {
+                closed = true;
+                s.close();
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->set_puback_handler(
+            [&]
+            (packet_id_t) {
+                ++acked;
+                check_finish();
+                return true;
+            });
+        c->set_pubcomp_handler(
+            [&]
+            (packet_id_t) {
+                ++acked;
+                check_finish();
+                return true;
+            });
+        c->set_suback_handler(
+            [&]
+            (packet_id_t, std::vector<mqtt::optional<std::uint8_t>> results) {
+                BOOST_TEST(results.size() == 1U);
+                BOOST_TEST(*results[0] == mqtt::qos::exactly_once);
+                // All messages are queued at once, so the broker's responses
+                // and the delivered publishes arrive back to back.
+                for (std::size_t i = 0; i != count; ++i) {
+                    c->async_publish(
+                        "topic1",
+                        "topic1_contents_" + std::to_string(i),
+                        static_cast<std::uint8_t>(i % 3));
+                }
+                return true;
+            });
+        c->set_publish_handler(
+            [&]
+            (std::uint8_t header,
+             mqtt::optional<packet_id_t>,
+             std::string topic,
+             std::string contents) {
+                BOOST_TEST(mqtt::publish::get_qos(header) == received % 3);
+                BOOST_TEST(topic == "topic1");
+                BOOST_TEST(contents == "topic1_contents_" + std::to_string(received));
+                ++received;
+                check_finish();
+                return true;
+            });
+        c->connect();
+        ios.run();
+        BOOST_TEST(received == count);
+        BOOST_TEST(acked == count / 3 * 2);
+        BOOST_TEST(closed);
+    };
+    do_combi_test(test);
+}
+
+BOOST_AUTO_TEST_CASE( payload_larger_than_buffer ) {
+    auto test = [](boost::asio::io_service& ios, auto& c, auto& s) {
+        using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+        c->set_clean_session(true);
+        // Smaller than the fixed header and remaining length. It is adjusted to the minimum size.
+        c->set_read_buffer_size(1);
+
+        std::string const payload(100000, 'a');
+        std::size_t received = 0;
+        bool closed = false;
+
+        c->set_connack_handler(
+            [&]
+            (bool, std::uint8_t connack_return_code) {
+                BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+                c->async_subscribe("topic1", mqtt::qos::at_least_once);
+                return true;
+            });
+        c->set_close_handler(
+            [&]
+            () {
+                closed = true;
+                s.close();
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->set_suback_handler(
+            [&]
+            (packet_id_t, std::vector<mqtt::optional<std::uint8_t>>) {
+                c->async_publish("topic1", payload, mqtt::qos::at_least_once);
+                c->async_publish("topic1", "", mqtt::qos::at_most_once);
+                c->async_publish("topic1", payload, mqtt::qos::at_most_once);
+                return true;
+            });
+        c->set_publish_handler(
+            [&]
+            (std::uint8_t,
+             mqtt::optional<packet_id_t>,
+             std::string topic,
+             std::string contents) {
+                BOOST_TEST(topic == "topic1");
+                switch (received++) {
+                case 0:
+                case 2:
+                    BOOST_TEST(contents == payload);
+                    break;
+                case 1:
+                    BOOST_TEST(contents.empty());
+                    break;
+                default:
+                    BOOST_CHECK(false);
+                    break;
+                }
+                if (received == 3) c->async_disconnect();
+                return true;
+            });
+        c->connect();
+        ios.run();
+        BOOST_TEST(received == 3U);
+        BOOST_TEST(closed);
+    };
+    do_combi_test(test);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -775,4 +775,249 @@ BOOST_AUTO_TEST_CASE( async_disconnect_not_timeout ) {
     do_combi_test(test);
 }
 
+BOOST_AUTO_TEST_CASE( resolved_endpoints ) {
+    boost::asio::io_service ios;
+    test_broker b(ios);
+    test_server_no_tls s(ios, b);
+
+    boost::asio::ip::tcp::resolver r(ios);
+    auto eps = std::make_shared<std::vector<boost::asio::ip::tcp::endpoint>>();
+    for (auto const& e : r.resolve(broker_url, std::to_string(broker_notls_port))) {
+        eps->push_back(e.endpoint());
+    }
+
+    // Both clients use the same endpoints. The host is not resolved.
+    auto c1 = mqtt::make_client(ios, "host.invalid", broker_notls_port);
+    auto c2 = mqtt::make_client(ios, "host.invalid", broker_notls_port);
+    std::size_t closed = 0;
+    for (auto c : { c1, c2 }) {
+        c->set_clean_session(true);
+        c->set_resolved_endpoints(eps);
+        c->set_connect_timeout(boost::posix_time::seconds(10));
+        c->set_connack_handler(
+            [c]
+            (bool, std::uint8_t connack_return_code) {
+                BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+                c->disconnect();
+                return true;
+            });
+        c->set_close_handler(
+            [&closed, &s]
+            () {
+                if (++closed == 2) s.close();
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->connect();
+    }
+    ios.run();
+    BOOST_TEST(closed == 2U);
+}
+
+BOOST_AUTO_TEST_CASE( connect_timeout ) {
+    boost::asio::io_service ios;
+
+    // The accept queue is filled and never accepted, so the next connection is not established.
+    boost::asio::ip::tcp::acceptor a(ios);
+    boost::asio::ip::tcp::endpoint listen_ep(boost::asio::ip::address_v4::loopback(), 0);
+    a.open(listen_ep.protocol());
+    a.bind(listen_ep);
+    a.listen(0);
+    auto ep = a.local_endpoint();
+    std::vector<std::unique_ptr<boost::asio::ip::tcp::socket>> fillers;
+    for (std::size_t i = 0; i != 3; ++i) {
+        fillers.emplace_back(new boost::asio::ip::tcp::socket(ios));
+        fillers.back()->async_connect(ep, [](boost::system::error_code const&) {});
+    }
+
+    auto c = mqtt::make_client(ios, "host.invalid", ep.port());
+    c->set_resolved_endpoints(
+        std::make_shared<std::vector<boost::asio::ip::tcp::endpoint>>(1, ep));
+    c->set_connect_timeout(boost::posix_time::milliseconds(500));
+    bool timed_out = false;
+    c->set_connack_handler(
+        []
+        (bool, std::uint8_t) {
+            BOOST_CHECK(false);
+            return true;
+        });
+    c->set_close_handler(
+        []
+        () {
+            BOOST_CHECK(false);
+        });
+    c->set_error_handler(
+        [&]
+        (boost::system::error_code const& ec) {
+            BOOST_TEST(ec == boost::asio::error::timed_out);
+            timed_out = true;
+            for (auto& f : fillers) f->close();
+            a.close();
+        });
+    c->connect();
+    ios.run();
+    BOOST_TEST(timed_out);
+}
+
+BOOST_AUTO_TEST_CASE( resolve_error ) {
+    boost::asio::io_service ios;
+    auto c = mqtt::make_client(ios, "host.invalid", broker_notls_port);
+    bool error = false;
+    c->set_close_handler(
+        []
+        () {
+            BOOST_CHECK(false);
+        });
+    c->set_error_handler(
+        [&]
+        (boost::system::error_code const& ec) {
+            BOOST_TEST(ec);
+            error = true;
+        });
+    // Resolving error is reported to the error handler instead of throwing an exception.
+    c->connect();
+    ios.run();
+    BOOST_TEST(error);
+}
+
+BOOST_AUTO_TEST_CASE( takeover_waiter_closed ) {
+    // c2 waits for c1 that has the same client id, and is closed before the takeover.
+    // c1 can connect again after c1 is disconnected.
+    boost::asio::io_service ios;
+    test_broker b(ios);
+    test_server_no_tls s(ios, b);
+    boost::asio::deadline_timer tim(ios);
+
+    auto c1 = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c1->set_client_id("cid1");
+    c1->set_clean_session(true);
+    auto c2 = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c2->set_client_id("cid1");
+    c2->set_clean_session(true);
+
+    std::size_t connack = 0;
+    c1->set_connack_handler(
+        [&]
+        (bool, std::uint8_t connack_return_code) {
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            if (++connack == 2) {
+                c1->disconnect();
+                return true;
+            }
+            c2->connect();
+            tim.expires_from_now(boost::posix_time::milliseconds(100));
+            tim.async_wait(
+                [&](boost::system::error_code const&) {
+                    c2->force_disconnect();
+                    tim.expires_from_now(boost::posix_time::milliseconds(100));
+                    tim.async_wait(
+                        [&](boost::system::error_code const&) {
+                            c1->disconnect();
+                        }
+                    );
+                }
+            );
+            return true;
+        });
+    c1->set_close_handler(
+        [&]
+        () {
+            if (connack == 1) {
+                c1->connect();
+            }
+            else {
+                s.close();
+            }
+        });
+    c1->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+    c2->set_connack_handler(
+        []
+        (bool, std::uint8_t) {
+            BOOST_CHECK(false);
+            return true;
+        });
+    c2->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+        });
+
+    c1->connect();
+    ios.run();
+    BOOST_TEST(connack == 2U);
+}
+
+BOOST_AUTO_TEST_CASE( connect_twice ) {
+    // c1 sends the second CONNECT with another client id, and is closed by the broker.
+    // The client id of the first CONNECT is released, so c2 can connect with it.
+    using endpoint_t = mqtt::endpoint<
+        mqtt::tcp_endpoint<boost::asio::ip::tcp::socket, boost::asio::io_service::strand>,
+        std::mutex,
+        std::lock_guard,
+        2
+    >;
+    boost::asio::io_service ios;
+    test_broker b(ios);
+    test_server_no_tls s(ios, b);
+
+    auto c1 = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c1->set_client_id("cid1");
+    c1->set_clean_session(true);
+    auto c2 = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c2->set_client_id("cid1");
+    c2->set_clean_session(true);
+
+    bool c1_closed = false;
+    bool c2_connected = false;
+    c1->set_connack_handler(
+        [&]
+        (bool, std::uint8_t connack_return_code) {
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            c1->set_client_id("cid2");
+            static_cast<endpoint_t&>(*c1).connect(0);
+            return true;
+        });
+    c1->set_close_handler(
+        [&]
+        () {
+            c1_closed = true;
+            c2->connect();
+        });
+    c1->set_error_handler(
+        [&]
+        (boost::system::error_code const&) {
+            c1_closed = true;
+            c2->connect();
+        });
+    c2->set_connack_handler(
+        [&]
+        (bool, std::uint8_t connack_return_code) {
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            c2_connected = true;
+            c2->disconnect();
+            return true;
+        });
+    c2->set_close_handler(
+        [&]
+        () {
+            s.close();
+        });
+    c2->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    c1->connect();
+    ios.run();
+    BOOST_TEST(c1_closed);
+    BOOST_TEST(c2_connected);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,238 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+
+#include <mqtt/client.hpp>
+#include <mqtt/server.hpp>
+#include <mqtt/flat_store.hpp>
+#include <mqtt/multi_index_store.hpp>
+
+#include <vector>
+#include <string>
+#include <random>
+
+BOOST_AUTO_TEST_SUITE(test_flat_store)
+
+namespace {
+
+template <typename PacketId>
+struct element {
+    element(PacketId id, std::uint8_t type, std::string body)
+        :packet_id_(id), type_(type), body_(std::move(body)) {}
+    PacketId packet_id() const { return packet_id_; }
+    std::uint8_t expected_control_packet_type() const { return type_; }
+    std::string const& body() const { return body_; }
+private:
+    PacketId packet_id_;
+    std::uint8_t type_;
+    std::string body_;
+};
+
+template <typename Store>
+std::vector<std::string> bodies(Store const& s) {
+    std::vector<std::string> ret;
+    s.for_each(
+        [&](auto const& e) {
+            ret.push_back(e.body());
+        }
+    );
+    return ret;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( insertion_order ) {
+    mqtt::flat_store<element<std::uint16_t>> s;
+    BOOST_TEST(s.emplace(3, mqtt::control_packet_type::puback, "a"));
+    BOOST_TEST(s.emplace(1, mqtt::control_packet_type::pubrec, "b"));
+    BOOST_TEST(s.emplace(2, mqtt::control_packet_type::pubcomp, "c"));
+    BOOST_TEST(!s.emplace(1, mqtt::control_packet_type::pubrec, "d"));
+    BOOST_TEST(s.emplace(1, mqtt::control_packet_type::pubcomp, "e"));
+    BOOST_TEST(s.size() == 4U);
+    BOOST_TEST((bodies(s) == std::vector<std::string>{ "a", "b", "c", "e" }));
+
+    s.erase(1, mqtt::control_packet_type::pubrec);
+    BOOST_TEST((bodies(s) == std::vector<std::string>{ "a", "c", "e" }));
+    // Not matched type
+    s.erase(3, mqtt::control_packet_type::pubcomp);
+    BOOST_TEST(s.size() == 3U);
+    // Reuse the released node. The order is still the insertion order.
+    BOOST_TEST(s.emplace(4, mqtt::control_packet_type::puback, "f"));
+    BOOST_TEST((bodies(s) == std::vector<std::string>{ "a", "c", "e", "f" }));
+
+    s.erase(1);
+    s.erase(3);
+    BOOST_TEST((bodies(s) == std::vector<std::string>{ "c", "f" }));
+    s.clear();
+    BOOST_TEST(s.empty());
+    BOOST_TEST(bodies(s).empty());
+    BOOST_TEST(s.emplace(3, mqtt::control_packet_type::puback, "g"));
+    BOOST_TEST((bodies(s) == std::vector<std::string>{ "g" }));
+}
+
+BOOST_AUTO_TEST_CASE( same_slot ) {
+    // Only the lower bits of the packet id are used for the slot.
+    mqtt::flat_store<element<std::uint32_t>> s;
+    for (std::uint32_t i = 0; i != 8; ++i) {
+        BOOST_TEST(s.emplace(i * 0x10000 + 1, mqtt::control_packet_type::puback, std::to_string(i)));
+    }
+    s.erase(0x30001);
+    s.erase(0x10001, mqtt::control_packet_type::puback);
+    s.erase(0x50001, mqtt::control_packet_type::pubrec);
+    BOOST_TEST((bodies(s) == std::vector<std::string>{ "0", "2", "4", "5", "6", "7" }));
+}
+
+BOOST_AUTO_TEST_CASE( same_as_multi_index_store ) {
+    mqtt::flat_store<element<std::uint16_t>> fs;
+    mqtt::multi_index_store<element<std::uint16_t>> ms;
+
+    std::mt19937 gen(1);
+    // A small id range causes many collisions and duplicates.
+    std::uniform_int_distribution<std::uint16_t> id_dist(1, 300);
+    std::uniform_int_distribution<int> op_dist(0, 9);
+    std::uint8_t const types[] = {
+        mqtt::control_packet_type::puback,
+        mqtt::control_packet_type::pubrec,
+        mqtt::control_packet_type::pubcomp
+    };
+    for (std::size_t i = 0; i != 20000; ++i) {
+        auto id = id_dist(gen);
+        auto type = types[id % 3];
+        auto op = op_dist(gen);
+        if (op < 6) {
+            auto body = std::to_string(i);
+            BOOST_TEST(fs.emplace(id, type, body) == ms.emplace(id, type, body));
+        }
+        else if (op < 9) {
+            fs.erase(id, type);
+            ms.erase(id, type);
+        }
+        else {
+            fs.erase(id);
+            ms.erase(id);
+        }
+        BOOST_TEST(fs.size() == ms.size());
+    }
+    BOOST_TEST(bodies(fs) == bodies(ms));
+}
+
+BOOST_AUTO_TEST_CASE( flat_store_endpoint ) {
+    boost::asio::io_service ios;
+
+    using server_t = mqtt::server<
+        boost::asio::io_service::strand,
+        std::mutex,
+        std::lock_guard,
+        2,
+        std::allocator<char>,
+        mqtt::flat_store
+    >;
+    using endpoint_t = server_t::endpoint_t;
+    server_t server(
+        boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), broker_notls_port),
+        ios);
+
+    // Echo server
+    std::shared_ptr<endpoint_t> sp;
+    server.set_accept_handler(
+        [&](endpoint_t& ep) {
+            sp = ep.shared_from_this();
+            ep.start_session(
+                [&](boost::system::error_code const&) {
+                    sp.reset();
+                    server.close();
+                }
+            );
+            ep.set_connect_handler(
+                [&]
+                (std::string const&,
+                 mqtt::optional<std::string> const&,
+                 mqtt::optional<std::string> const&,
+                 mqtt::optional<mqtt::will>,
+                 bool,
+                 std::uint16_t) {
+                    sp->connack(false, mqtt::connect_return_code::accepted);
+                    return true;
+                });
+            ep.set_publish_handler(
+                [&]
+                (std::uint8_t header,
+                 mqtt::optional<std::uint16_t>,
+                 std::string topic,
+                 std::string contents) {
+                    sp->async_publish(topic, contents, mqtt::publish::get_qos(header));
+                    return true;
+                });
+            ep.set_disconnect_handler(
+                [&] {
+                    sp->force_disconnect();
+                });
+        }
+    );
+    server.listen();
+
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+
+    std::size_t const count = 100;
+    std::size_t received = 0;
+    std::size_t acked = 0;
+
+    auto check_finish =
+        [&] {
+            if (received == count && acked == count / 3 * 2) {
+                c->disconnect();
+            }
+        };
+
+    c->set_connack_handler(
+        [&]
+        (bool, std::uint8_t connack_return_code) {
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            for (std::size_t i = 0; i != count; ++i) {
+                c->async_publish(
+                    "topic1",
+                    "topic1_contents_" + std::to_string(i),
+                    static_cast<std::uint8_t>(i % 3));
+            }
+            return true;
+        });
+    c->set_puback_handler(
+        [&]
+        (std::uint16_t) {
+            ++acked;
+            check_finish();
+            return true;
+        });
+    c->set_pubcomp_handler(
+        [&]
+        (std::uint16_t) {
+            ++acked;
+            check_finish();
+            return true;
+        });
+    c->set_publish_handler(
+        [&]
+        (std::uint8_t header,
+         mqtt::optional<std::uint16_t>,
+         std::string topic,
+         std::string contents) {
+            BOOST_TEST(mqtt::publish::get_qos(header) == received % 3);
+            BOOST_TEST(topic == "topic1");
+            BOOST_TEST(contents == "topic1_contents_" + std::to_string(received));
+            ++received;
+            check_finish();
+            return true;
+        });
+    c->connect();
+    ios.run();
+    BOOST_TEST(received == count);
+    BOOST_TEST(acked == count / 3 * 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,155 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "allocation_count.hpp"
+
+#include <mqtt/endpoint.hpp>
+#include <mqtt/move_only_function.hpp>
+#include <mqtt/pool_allocator.hpp>
+
+#include <boost/asio.hpp>
+
+#include <memory>
+#include <string>
+#include <array>
+#include <algorithm>
+
+BOOST_AUTO_TEST_SUITE(test_handler_allocation)
+
+BOOST_AUTO_TEST_CASE( move_only_function_local ) {
+    int called = 0;
+    auto p = std::make_unique<int>(1);
+    allocation_counter ac;
+    // The move only function object is kept in the local storage.
+    mqtt::move_only_function<void(int)> f(
+        [&called, MQTT_CAPTURE_MOVE(p)](int i) {
+            called += *p + i;
+        }
+    );
+    auto moved = std::move(f);
+    BOOST_TEST(!f);
+    BOOST_TEST(static_cast<bool>(moved));
+    moved(2);
+    BOOST_TEST(called == 3);
+    BOOST_TEST(ac.count() == 0U);
+}
+
+BOOST_AUTO_TEST_CASE( move_only_function_remote ) {
+    std::array<char, mqtt::move_only_function<int()>::local_storage_size + 1> large {{ 'a' }};
+    allocation_counter ac;
+    mqtt::move_only_function<int()> f(
+        [large] {
+            return large[0];
+        }
+    );
+    auto moved = std::move(f);
+    BOOST_TEST(moved() == 'a');
+    // The larger function object is allocated once, and the pointer is moved.
+    BOOST_TEST(ac.count() == 1U);
+}
+
+BOOST_AUTO_TEST_CASE( move_only_function_empty ) {
+    mqtt::move_only_function<void()> f1;
+    BOOST_TEST(!f1);
+    mqtt::move_only_function<void()> f2 = std::function<void()>();
+    BOOST_TEST(!f2);
+    void (*fp)() = nullptr;
+    mqtt::move_only_function<void()> f3 = fp;
+    BOOST_TEST(!f3);
+    BOOST_CHECK_THROW(f3(), std::bad_function_call);
+}
+
+BOOST_AUTO_TEST_CASE( move_only_function_discard_result ) {
+    int called = 0;
+    // The result is discarded like std::function<void()>.
+    mqtt::move_only_function<void()> f(
+        [&called] {
+            return ++called;
+        }
+    );
+    f();
+    BOOST_TEST(called == 1);
+}
+
+// Returns the largest number of the allocations of one async_publish from the call to the completion
+// in a steady state. The peer doesn't acknowledge, so the QoS1 and QoS2 messages stay in the store.
+template <typename Alloc>
+std::size_t async_publish_allocations(std::uint8_t qos) {
+    using socket_t = mqtt::tcp_endpoint<boost::asio::ip::tcp::socket, boost::asio::io_service::strand>;
+    using endpoint_t = mqtt::endpoint<socket_t, std::mutex, std::lock_guard, 2, Alloc>;
+
+    boost::asio::io_service ios;
+    boost::asio::ip::tcp::acceptor acceptor(
+        ios,
+        boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+    boost::asio::ip::tcp::socket peer(ios);
+    peer.connect(acceptor.local_endpoint());
+    auto s = std::make_unique<socket_t>(ios);
+    acceptor.accept(s->socket());
+    auto ep = std::make_shared<endpoint_t>(std::move(s));
+
+    std::string topic("topic1");
+    std::string payload(100, 'x');
+    std::size_t const count = 10;
+    std::size_t const warm_up = 2;
+    std::size_t written = 0;
+    std::size_t kept = 0;
+    std::size_t max_allocations = 0;
+    mqtt::optional<allocation_counter> ac;
+
+    // Each async_publish is called in the completion handler of the previous one,
+    // so the memory of the asio handlers is reused.
+    std::function<void()> publish =
+        [&] {
+            if (written > warm_up) max_allocations = std::max(max_allocations, ac->count());
+            if (written == count) return;
+            ac.emplace();
+            ep->async_publish(
+                boost::asio::buffer(topic),
+                boost::asio::buffer(payload),
+                [&kept] { ++kept; },
+                qos,
+                false,
+                [&](boost::system::error_code const& ec) {
+                    BOOST_TEST(!ec);
+                    ++written;
+                    publish();
+                }
+            );
+        };
+    ios.post(publish);
+    ios.run();
+
+    BOOST_TEST(written == count);
+    // The life keeper of a QoS0 message is called when it is written. The others are kept in the store.
+    BOOST_TEST(kept == (qos == mqtt::qos::at_most_once ? count : 0U));
+
+    std::size_t packet_id_size = qos == mqtt::qos::at_most_once ? 0 : 2;
+    std::string received(count * (2 + 2 + topic.size() + packet_id_size + payload.size()), '\0');
+    boost::asio::read(peer, boost::asio::buffer(&received[0], received.size()));
+    BOOST_TEST(received.substr(4, topic.size()) == topic);
+    return max_allocations;
+}
+
+// The bounds are the numbers that are measured in a steady state. They are checked to find regressions.
+// QoS0 allocates only the send buffers that don't use the pool.
+// QoS1 and QoS2 also allocate the shared scope guard of the contents, the std::function life keepers
+// that hold it, the copy of the message for the store, and the store entry. They are not allocator aware.
+BOOST_AUTO_TEST_CASE( async_publish_default_allocator ) {
+    BOOST_TEST(async_publish_allocations<std::allocator<char>>(mqtt::qos::at_most_once) <= 2U);
+    BOOST_TEST(async_publish_allocations<std::allocator<char>>(mqtt::qos::at_least_once) <= 7U);
+    BOOST_TEST(async_publish_allocations<std::allocator<char>>(mqtt::qos::exactly_once) <= 7U);
+}
+
+BOOST_AUTO_TEST_CASE( async_publish_pool_allocator ) {
+    // One async publish allocates at most once from the call to the completion.
+    BOOST_TEST(async_publish_allocations<mqtt::pool_allocator<char>>(mqtt::qos::at_most_once) <= 1U);
+    BOOST_TEST(async_publish_allocations<mqtt::pool_allocator<char>>(mqtt::qos::at_least_once) <= 5U);
+    BOOST_TEST(async_publish_allocations<mqtt::pool_allocator<char>>(mqtt::qos::exactly_once) <= 5U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
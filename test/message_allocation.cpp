@@ -0,0 +1,103 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "allocation_count.hpp"
+
+#include <mqtt/message.hpp>
+#include <mqtt/message_variant.hpp>
+#include <mqtt/connect_return_code.hpp>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/local/connect_pair.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/asio/read.hpp>
+
+#include <vector>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(test_message_allocation)
+
+BOOST_AUTO_TEST_CASE( puback ) {
+    boost::asio::io_service ios;
+    boost::asio::local::stream_protocol::socket s1(ios);
+    boost::asio::local::stream_protocol::socket s2(ios);
+    boost::asio::local::connect_pair(s1, s2);
+
+    std::size_t allocations;
+    {
+        allocation_counter ac;
+        mqtt::puback_message m(0x1234);
+        boost::asio::write(s1, m.const_buffer_sequence());
+        allocations = ac.count();
+    }
+    BOOST_TEST(allocations == 0U);
+
+    char buf[4];
+    boost::asio::read(s2, boost::asio::buffer(buf));
+    BOOST_TEST((std::string(buf, sizeof(buf)) == std::string{ 0x40, 0x02, 0x12, 0x34 }));
+}
+
+BOOST_AUTO_TEST_CASE( header_only ) {
+    allocation_counter ac;
+    mqtt::pingreq_message m;
+    auto cbs = m.const_buffer_sequence();
+    BOOST_TEST(cbs.size() == 1U);
+    BOOST_TEST(boost::asio::buffer_size(cbs) == 2U);
+    BOOST_TEST(ac.count() == 0U);
+}
+
+BOOST_AUTO_TEST_CASE( publish ) {
+    std::string topic("topic1");
+    std::string payload(200, 'x');
+    for (std::uint8_t qos = 0; qos != 3; ++qos) {
+        allocation_counter ac;
+        mqtt::publish_message m(
+            boost::asio::buffer(topic), qos, false, false, 1, boost::asio::buffer(payload));
+        auto cbs = m.const_buffer_sequence();
+        BOOST_TEST(ac.count() == 0U);
+        // The fixed header, remaining length and topic name length are one buffer.
+        BOOST_TEST(cbs.size() == (qos == 0 ? 3U : 4U));
+        BOOST_TEST(boost::asio::buffer_size(cbs) == m.size());
+        BOOST_TEST(boost::asio::buffer_size(cbs[0]) == 1U + 2U + 2U);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( variant ) {
+    std::vector<boost::asio::const_buffer> buf;
+    buf.reserve(16);
+    mqtt::message_variant mv = mqtt::pubrec_message(1);
+    allocation_counter ac;
+    mqtt::add_const_buffer_sequence(buf, mv);
+    BOOST_TEST(ac.count() == 0U);
+    BOOST_TEST(buf.size() == 1U);
+    BOOST_TEST(boost::asio::buffer_size(buf) == mqtt::size(mv));
+}
+
+BOOST_AUTO_TEST_CASE( constexpr_encode ) {
+    // The fixed size control packets are encoded at compile time.
+    constexpr auto puback = mqtt::detail::encode_header_packet_id<2>(mqtt::control_packet_type::puback, 0b0000, 0x1234);
+    static_assert(puback.size() == 4, "");
+    static_assert(puback[0] == 0x40 && puback[1] == 0x02 && puback[2] == 0x12 && puback[3] == 0x34, "");
+    constexpr auto pubrel = mqtt::detail::encode_header_packet_id<4>(mqtt::control_packet_type::pubrel, 0b0010, 0x12345678);
+    static_assert(pubrel.size() == 6, "");
+    static_assert(pubrel[0] == 0x62 && pubrel[1] == 0x04 && pubrel[2] == 0x12 && pubrel[5] == 0x78, "");
+    constexpr auto pingreq = mqtt::detail::encode_header_only(mqtt::control_packet_type::pingreq, 0b0000);
+    static_assert(pingreq[0] == static_cast<char>(0xc0) && pingreq[1] == 0, "");
+    constexpr auto connack = mqtt::detail::encode_connack(true, mqtt::connect_return_code::accepted);
+    static_assert(connack[0] == 0x20 && connack[1] == 0x02 && connack[2] == 1 && connack[3] == 0, "");
+
+    // Same as the messages
+    BOOST_TEST(std::string(puback.data(), puback.size()) == mqtt::puback_message(0x1234).continuous_buffer());
+    BOOST_TEST(std::string(pubrel.data(), pubrel.size()) == mqtt::pubrel_32_message(0x12345678).continuous_buffer());
+    BOOST_TEST(std::string(pingreq.data(), pingreq.size()) == mqtt::pingreq_message().continuous_buffer());
+    BOOST_TEST(
+        std::string(connack.data(), connack.size()) ==
+        mqtt::connack_message(true, mqtt::connect_return_code::accepted).continuous_buffer());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
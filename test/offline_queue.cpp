@@ -0,0 +1,331 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_broker.hpp"
+#include "test_server_no_tls.hpp"
+#include "test_sharded_broker.hpp"
+
+#include <mqtt/client.hpp>
+#include <mqtt/offline_queue.hpp>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdio>
+
+BOOST_AUTO_TEST_SUITE(test_offline_queue)
+
+namespace {
+
+using policy = mqtt::offline_queue::overflow_policy;
+
+void push(mqtt::offline_queue& q, std::string const& contents, std::uint8_t qos = mqtt::qos::at_least_once) {
+    q.push(std::make_shared<std::string>("t"), std::make_shared<std::string>(contents), qos);
+}
+
+std::vector<std::string> pop_all(mqtt::offline_queue& q) {
+    std::vector<std::string> ret;
+    while (auto m = q.pop()) {
+        BOOST_TEST(*m->topic == "t");
+        ret.push_back(*m->contents);
+    }
+    return ret;
+}
+
+bool file_exists(std::string const& path) {
+    return std::ifstream(path).good();
+}
+
+// cid1 subscribes topic1 and disconnects. cid2 publishes 1 to 5 to topic1 while cid1 is offline.
+// cid1 reconnects, and publishes "end" to topic1 after the queued messages.
+// Returns the messages that cid1 received.
+template <typename Close>
+std::vector<std::string> receive_queued(boost::asio::io_service& ios, Close const& close) {
+    auto c1 = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c1->set_client_id("cid1");
+    c1->set_clean_session(false);
+    auto c2 = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c2->set_client_id("cid2");
+    c2->set_clean_session(true);
+
+    bool reconnected = false;
+    std::size_t acked = 0;
+    std::vector<std::string> received;
+
+    c1->set_connack_handler(
+        [&]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            BOOST_TEST(sp == reconnected);
+            if (reconnected) {
+                c1->publish("topic1", "end", mqtt::qos::at_least_once);
+            }
+            else {
+                c1->subscribe("topic1", mqtt::qos::at_least_once);
+            }
+            return true;
+        });
+    c1->set_suback_handler(
+        [&]
+        (std::uint16_t, std::vector<mqtt::optional<std::uint8_t>>) {
+            c1->disconnect();
+            return true;
+        });
+    c1->set_publish_handler(
+        [&]
+        (std::uint8_t,
+         mqtt::optional<std::uint16_t>,
+         std::string,
+         std::string contents) {
+            if (contents == "end") {
+                c1->disconnect();
+            }
+            else {
+                received.push_back(contents);
+            }
+            return true;
+        });
+    c1->set_close_handler(
+        [&]
+        () {
+            if (reconnected) {
+                close();
+            }
+            else {
+                reconnected = true;
+                c2->connect();
+            }
+        });
+    c1->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    c2->set_connack_handler(
+        [&]
+        (bool, std::uint8_t) {
+            for (auto contents : { "1", "2", "3", "4", "5" }) {
+                c2->publish("topic1", contents, mqtt::qos::at_least_once);
+            }
+            return true;
+        });
+    c2->set_puback_handler(
+        [&]
+        (std::uint16_t) {
+            if (++acked == 5) c2->disconnect();
+            return true;
+        });
+    c2->set_close_handler(
+        [&]
+        () {
+            c1->connect();
+        });
+    c2->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    c1->connect();
+    ios.run();
+    return received;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( unlimited ) {
+    mqtt::offline_queue q;
+    for (int i = 0; i != 100; ++i) push(q, std::to_string(i));
+    BOOST_TEST(q.size() == 100U);
+    BOOST_TEST(q.dropped() == 0U);
+    auto m = q.pop();
+    BOOST_TEST(*m->contents == "0");
+    BOOST_TEST(m->qos == mqtt::qos::at_least_once);
+    BOOST_TEST(pop_all(q).size() == 99U);
+    BOOST_TEST(q.empty());
+    BOOST_TEST(q.bytes() == 0U);
+    BOOST_TEST(!q.pop());
+}
+
+BOOST_AUTO_TEST_CASE( max_messages ) {
+    mqtt::offline_queue oldest(2, 0, policy::drop_oldest);
+    mqtt::offline_queue newest(2, 0, policy::drop_newest);
+    for (auto c : { "1", "2", "3" }) {
+        push(oldest, c);
+        push(newest, c);
+    }
+    BOOST_TEST(oldest.dropped() == 1U);
+    BOOST_TEST(newest.dropped() == 1U);
+    BOOST_TEST((pop_all(oldest) == std::vector<std::string>{ "2", "3" }));
+    BOOST_TEST((pop_all(newest) == std::vector<std::string>{ "1", "2" }));
+}
+
+BOOST_AUTO_TEST_CASE( max_bytes ) {
+    // The bytes are the size of the topic name and the contents.
+    mqtt::offline_queue q(0, 10, policy::drop_oldest);
+    push(q, "111");
+    push(q, "222");
+    BOOST_TEST(q.bytes() == 8U);
+    push(q, "3333");
+    BOOST_TEST(q.bytes() == 9U);
+    BOOST_TEST(q.dropped() == 1U);
+    // Larger than max_bytes. The queued messages are kept.
+    push(q, "4444444444");
+    BOOST_TEST(q.dropped() == 2U);
+    BOOST_TEST((pop_all(q) == std::vector<std::string>{ "222", "3333" }));
+}
+
+BOOST_AUTO_TEST_CASE( spill ) {
+    std::string path = "offline_queue_spill.tmp";
+    {
+        mqtt::offline_queue q(0, 0, policy::drop_oldest);
+        q.enable_spill(path, 1);
+        BOOST_TEST(q.is_spilled());
+        BOOST_TEST(file_exists(path));
+        // The messages cross the segments, and a message is larger than the segment.
+        std::vector<std::string> expected;
+        for (std::size_t i = 0; i != 1000; ++i) {
+            expected.push_back(std::string(i * 13 % 200, static_cast<char>('a' + i % 26)));
+        }
+        expected.push_back(std::string(100000, 'x'));
+        for (std::size_t i = 0; i != 500; ++i) {
+            expected.push_back(std::to_string(i));
+        }
+        for (std::size_t i = 0; i != expected.size(); ++i) {
+            push(q, expected[i], static_cast<std::uint8_t>(i % 3));
+        }
+        BOOST_TEST(q.size() == expected.size());
+
+        std::size_t i = 0;
+        while (auto m = q.pop()) {
+            BOOST_TEST(*m->topic == "t");
+            BOOST_TEST(*m->contents == expected[i]);
+            BOOST_TEST(m->qos == i % 3);
+            ++i;
+        }
+        BOOST_TEST(i == expected.size());
+        BOOST_TEST(q.bytes() == 0U);
+
+        // The file is truncated and reused.
+        push(q, "again");
+        BOOST_TEST((pop_all(q) == std::vector<std::string>{ "again" }));
+    }
+    BOOST_TEST(!file_exists(path));
+}
+
+BOOST_AUTO_TEST_CASE( spill_limits ) {
+    std::string path = "offline_queue_spill_limits.tmp";
+    mqtt::offline_queue q(3, 0, policy::drop_oldest);
+    q.enable_spill(path, 1);
+    for (int i = 0; i != 10; ++i) push(q, std::to_string(i));
+    BOOST_TEST(q.dropped() == 7U);
+    BOOST_TEST((pop_all(q) == std::vector<std::string>{ "7", "8", "9" }));
+}
+
+BOOST_AUTO_TEST_CASE( spill_reuse ) {
+    std::string path = "offline_queue_spill_reuse.tmp";
+    mqtt::offline_queue q(10, 0, policy::drop_oldest);
+    q.enable_spill(path, 1);
+    std::size_t page = boost::interprocess::mapped_region::get_page_size();
+    std::string contents(page / 4, 'x');
+    for (int i = 0; i != 1000; ++i) push(q, contents);
+    BOOST_TEST(q.dropped() == 990U);
+    // The segments of the dropped messages are reused, so the file has only the last messages.
+    auto file_size = static_cast<std::size_t>(std::ifstream(path, std::ios::binary | std::ios::ate).tellg());
+    BOOST_TEST(file_size <= page * 8);
+    BOOST_TEST(pop_all(q).size() == 10U);
+}
+
+BOOST_AUTO_TEST_CASE( spill_unwritable ) {
+    mqtt::offline_queue q;
+    // The directory doesn't exist. The messages are kept in the heap.
+    BOOST_TEST(!q.enable_spill("no_such_directory/offline_queue_spill.tmp"));
+    BOOST_TEST(!q.is_spilled());
+    push(q, "1");
+    BOOST_TEST((pop_all(q) == std::vector<std::string>{ "1" }));
+
+    std::string path = "offline_queue_spill_unwritable.tmp";
+    BOOST_TEST(q.enable_spill(path, 1));
+    // The file can't be removed while it is mapped on some platforms.
+    if (std::remove(path.c_str()) == 0) {
+        // The file can't be extended, so the message is dropped.
+        BOOST_TEST(!q.push(std::make_shared<std::string>("t"), std::make_shared<std::string>("2"), mqtt::qos::at_least_once));
+        BOOST_TEST(q.dropped() == 1U);
+        BOOST_TEST(q.empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( broker_limits ) {
+    boost::asio::io_service ios;
+    test_broker b(ios);
+    test_server_no_tls s(ios, b);
+    b.set_offline_queue_limits(3, 0, policy::drop_oldest);
+    auto received = receive_queued(ios, [&] { s.close(); });
+    BOOST_TEST((received == std::vector<std::string>{ "3", "4", "5" }));
+}
+
+BOOST_AUTO_TEST_CASE( broker_spill ) {
+    boost::asio::io_service ios;
+    test_broker b(ios);
+    test_server_no_tls s(ios, b);
+    b.set_offline_queue_limits(0, 8, policy::drop_newest);
+    b.set_offline_spill_directory(".");
+    // The bytes of a message are 7. "topic1" and the contents.
+    auto received = receive_queued(ios, [&] { s.close(); });
+    BOOST_TEST((received == std::vector<std::string>{ "1" }));
+}
+
+BOOST_AUTO_TEST_CASE( broker_replay_window ) {
+    boost::asio::io_service ios;
+    test_broker b(ios);
+    test_server_no_tls s(ios, b);
+    // One message in flight, and "topic1" and one message that is not written yet.
+    b.set_replay_window(1, 7);
+    // "end" is published while the queued messages are replayed. It is delivered after them.
+    auto received = receive_queued(ios, [&] { s.close(); });
+    BOOST_TEST((received == std::vector<std::string>{ "1", "2", "3", "4", "5" }));
+    BOOST_TEST(b.replay_max_inflight_seen() == 1U);
+    // A tick for each message
+    BOOST_TEST(b.replay_ticks() >= 5U);
+}
+
+BOOST_AUTO_TEST_CASE( broker_replay_bytes_in_flight ) {
+    boost::asio::io_service ios;
+    test_broker b(ios);
+    test_server_no_tls s(ios, b);
+    b.set_replay_window(0, 14);
+    auto received = receive_queued(ios, [&] { s.close(); });
+    BOOST_TEST((received == std::vector<std::string>{ "1", "2", "3", "4", "5" }));
+    // At most two messages are not written yet
+    BOOST_TEST(b.replay_max_bytes_in_flight_seen() <= 14U);
+    BOOST_TEST(b.replay_ticks() >= 3U);
+}
+
+BOOST_AUTO_TEST_CASE( broker_replay_unlimited ) {
+    boost::asio::io_service ios;
+    test_broker b(ios);
+    test_server_no_tls s(ios, b);
+    auto received = receive_queued(ios, [&] { s.close(); });
+    BOOST_TEST((received == std::vector<std::string>{ "1", "2", "3", "4", "5" }));
+    BOOST_TEST(b.replay_max_inflight_seen() == 5U);
+    BOOST_TEST(b.replay_ticks() == 1U);
+}
+
+BOOST_AUTO_TEST_CASE( sharded_broker_limits ) {
+    boost::asio::io_service ios;
+    test_sharded_broker b(broker_notls_port, 2);
+    b.set_offline_queue_limits(2, 0, policy::drop_newest);
+    b.set_offline_spill_directory(".");
+    b.run();
+    auto received = receive_queued(ios, [&] { b.close(); });
+    b.join();
+    BOOST_TEST((received == std::vector<std::string>{ "1", "2" }));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
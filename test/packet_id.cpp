@@ -8,6 +8,11 @@
 #include "test_settings.hpp"
 
 #include <mqtt/client.hpp>
+#include <mqtt/packet_id_pool.hpp>
+
+#include <set>
+#include <string>
+#include <chrono>
 
 BOOST_AUTO_TEST_SUITE(test_packet_id)
 
@@ -87,4 +92,246 @@ BOOST_AUTO_TEST_CASE( exhausted ) {
     }
 }
 
+BOOST_AUTO_TEST_CASE( pool_skip_in_use ) {
+    mqtt::packet_id_pool<std::uint16_t> pool;
+    for (std::uint16_t i = 2; i != 200; ++i) {
+        BOOST_TEST(pool.insert(i));
+    }
+    BOOST_TEST(pool.acquire() == 1);
+    BOOST_TEST(pool.acquire() == 200);
+    BOOST_TEST(pool.erase(100));
+    BOOST_TEST(!pool.erase(100));
+    BOOST_TEST(!pool.contains(100));
+    BOOST_TEST(pool.contains(101));
+    BOOST_TEST(pool.acquire() == 201);
+    BOOST_TEST(pool.size() == 200U);
+}
+
+BOOST_AUTO_TEST_CASE( pool_exhausted ) {
+    mqtt::packet_id_pool<std::uint16_t> pool;
+    for (std::uint32_t i = 1; i != 0x10000; ++i) {
+        BOOST_TEST(pool.acquire() == i);
+    }
+    BOOST_TEST(pool.acquire() == 0);
+    BOOST_TEST(pool.erase(0x8000));
+    BOOST_TEST(pool.acquire() == 0x8000);
+    BOOST_TEST(pool.acquire() == 0);
+    pool.clear();
+    BOOST_TEST(pool.empty());
+    BOOST_TEST(pool.acquire() == 0x8001);
+}
+
+BOOST_AUTO_TEST_CASE( pool_four_bytes ) {
+    mqtt::packet_id_pool<std::uint32_t> pool;
+    BOOST_TEST(pool.insert(0xffffffff));
+    BOOST_TEST(pool.insert(0x10000));
+    // Crosses the boundary of the first page.
+    for (std::uint32_t i = 1; i != 0x10000; ++i) {
+        BOOST_TEST(pool.acquire() == i);
+    }
+    BOOST_TEST(pool.acquire() == 0x10001);
+    BOOST_TEST(pool.erase(0xffff));
+    BOOST_TEST(pool.contains(0x10000));
+    BOOST_TEST(!pool.contains(0xffff));
+    BOOST_TEST(!pool.contains(0x20000));
+    BOOST_TEST(pool.erase(0x10000));
+    BOOST_TEST(pool.erase(0xffffffff));
+    BOOST_TEST(pool.size() == 0xfffeU + 1U);
+    BOOST_TEST(pool.acquire() == 0x10002);
+    BOOST_TEST(pool.insert(0x12345678));
+    BOOST_TEST(pool.contains(0x12345678));
+    BOOST_TEST(pool.size() == 0xfffeU + 3U);
+}
+
+BOOST_AUTO_TEST_CASE( rotate_four_bytes ) {
+    boost::asio::io_service ios;
+    auto c = mqtt::make_client_32(ios, broker_url, broker_notls_port);
+    BOOST_TEST(c->register_packet_id(0xffffffff));
+    BOOST_TEST(c->register_packet_id(1));
+    for (std::uint32_t i = 0; i != 100; ++i) {
+        BOOST_TEST(c->acquire_unique_packet_id() == i + 2);
+    }
+    for (std::uint32_t i = 0; i != 100; ++i) {
+        BOOST_TEST(c->release_packet_id(i + 2));
+    }
+    BOOST_TEST(c->acquire_unique_packet_id() == 102);
+}
+
+BOOST_AUTO_TEST_CASE( set_two_bytes ) {
+    mqtt::packet_id_set<std::uint16_t> s;
+    BOOST_TEST(!s.insert(0));
+    BOOST_TEST(s.insert(1));
+    BOOST_TEST(s.insert(0xffff));
+    BOOST_TEST(!s.insert(1));
+    BOOST_TEST(s.contains(1));
+    BOOST_TEST(s.contains(0xffff));
+    BOOST_TEST(!s.contains(2));
+    BOOST_TEST(s.size() == 2U);
+    BOOST_TEST(s.erase(1));
+    BOOST_TEST(!s.erase(1));
+    BOOST_TEST(!s.contains(1));
+    BOOST_TEST(s.erase(0xffff));
+    BOOST_TEST(s.empty());
+}
+
+BOOST_AUTO_TEST_CASE( set_four_bytes ) {
+    mqtt::packet_id_set<std::uint32_t, std::allocator<char>, mqtt::packet_id_bitmap_storage> s;
+    for (std::uint32_t i = 0xfff0; i != 0x10010; ++i) {
+        BOOST_TEST(s.insert(i));
+    }
+    BOOST_TEST(s.insert(0xffffffff));
+    BOOST_TEST(s.contains(0xffff));
+    BOOST_TEST(s.contains(0x10000));
+    BOOST_TEST(!s.contains(0x10010));
+    // Erasing all ids of a page that is not the current page releases the page.
+    for (std::uint32_t i = 0x10000; i != 0x10010; ++i) {
+        BOOST_TEST(s.erase(i));
+    }
+    BOOST_TEST(!s.contains(0x10000));
+    BOOST_TEST(s.insert(0x10000));
+    BOOST_TEST(s.erase(0xffffffff));
+    BOOST_TEST(s.size() == 0x11U);
+}
+
+BOOST_AUTO_TEST_CASE( set_hash ) {
+    mqtt::packet_id_set<std::uint32_t, std::allocator<char>, mqtt::packet_id_hash_storage> s;
+    std::set<std::uint32_t> expected;
+    BOOST_TEST(!s.insert(0));
+    BOOST_TEST(!s.contains(1));
+    BOOST_TEST(!s.erase(1));
+    // Sparse ids that are the multiples of the table size, and the churn that grows and shrinks the table.
+    std::uint32_t id = 0;
+    for (std::size_t i = 0; i != 100000; ++i) {
+        id = id * 1103515245U + 12345U;
+        auto v = (id >> 8) << 16;
+        if (v == 0) continue;
+        if (i % 1000 < 600) {
+            BOOST_TEST(s.insert(v) == expected.insert(v).second);
+        }
+        else if (!expected.empty()) {
+            auto it = expected.begin();
+            BOOST_TEST(s.erase(*it));
+            BOOST_TEST(!s.contains(*it));
+            expected.erase(it);
+        }
+    }
+    BOOST_TEST(s.size() == expected.size());
+    for (auto v : expected) BOOST_TEST(s.contains(v));
+    for (auto v : expected) BOOST_TEST(s.erase(v));
+    BOOST_TEST(s.empty());
+    BOOST_TEST(s.insert(0xffffffff));
+    BOOST_TEST(s.contains(0xffffffff));
+}
+
+BOOST_AUTO_TEST_CASE( inbound_qos2_sparse_ids ) {
+    // The peer chooses sparse 4 bytes packet ids for the QoS2 publishes. Each id is in its own
+    // 65536 ids range, and is kept in the handled set of the endpoint until the pubrel arrives.
+    using socket_t = mqtt::tcp_endpoint<boost::asio::ip::tcp::socket, boost::asio::io_service::strand>;
+    using endpoint_t = mqtt::endpoint<socket_t, std::mutex, std::lock_guard, 4>;
+    std::uint32_t const count = 20000;
+
+    boost::asio::io_service ios;
+    boost::asio::ip::tcp::acceptor acceptor(
+        ios,
+        boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+    boost::asio::ip::tcp::socket peer(ios);
+    peer.connect(acceptor.local_endpoint());
+    auto sock = std::make_unique<socket_t>(ios);
+    acceptor.accept(sock->socket());
+    auto ep = std::make_shared<endpoint_t>(std::move(sock));
+
+    std::size_t received = 0;
+    ep->set_connect_handler(
+        [&]
+        (std::string const&,
+         mqtt::optional<std::string> const&,
+         mqtt::optional<std::string> const&,
+         mqtt::optional<mqtt::will>,
+         bool,
+         std::uint16_t) {
+            ep->connack(false, mqtt::connect_return_code::accepted);
+            return true;
+        });
+    ep->set_publish_handler(
+        [&]
+        (std::uint8_t, mqtt::optional<std::uint32_t>, std::string, std::string) {
+            ++received;
+            return true;
+        });
+    ep->start_session();
+
+    auto id = [](std::uint32_t i) { return (i << 16) | 1; };
+    auto append_id = [](std::string& b, std::uint32_t v) {
+        for (int shift = 24; shift >= 0; shift -= 8) b += static_cast<char>((v >> shift) & 0xff);
+    };
+    auto append_publish = [&](std::string& b, std::uint32_t v, bool dup) {
+        // topic name "t" and empty contents
+        b += static_cast<char>(dup ? 0x3c : 0x34);
+        b += std::string("\x07\x00\x01t", 4);
+        append_id(b, v);
+    };
+
+    // connect, and each publish is sent twice. The second one is a duplicate.
+    std::string publishes("\x10\x0d\x00\x04MQTT\x04\x02\x00\x00\x00\x01" "c", 15);
+    std::string pubrels;
+    for (std::uint32_t i = 0; i != count; ++i) {
+        append_publish(publishes, id(i), false);
+        append_publish(publishes, id(i), true);
+        pubrels += std::string("\x62\x04", 2);
+        append_id(pubrels, id(i));
+    }
+    // The id can be used again after the pubrel.
+    std::string again;
+    append_publish(again, id(0), false);
+
+    // connack and pubrecs
+    std::string pubrecs(4 + count * 2 * 6, '\0');
+    std::string pubcomps(count * 6, '\0');
+    std::string again_pubrec(6, '\0');
+    std::size_t received_before_pubrel = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start;
+
+    boost::asio::async_write(
+        peer,
+        boost::asio::buffer(publishes),
+        [](boost::system::error_code const& ec, std::size_t) { BOOST_TEST(!ec); });
+    boost::asio::async_read(
+        peer,
+        boost::asio::buffer(&pubrecs[0], pubrecs.size()),
+        [&](boost::system::error_code const& ec, std::size_t) {
+            BOOST_TEST(!ec);
+            received_before_pubrel = received;
+            boost::asio::async_write(
+                peer,
+                boost::asio::buffer(pubrels),
+                [](boost::system::error_code const& ec, std::size_t) { BOOST_TEST(!ec); });
+            boost::asio::async_read(
+                peer,
+                boost::asio::buffer(&pubcomps[0], pubcomps.size()),
+                [&](boost::system::error_code const& ec, std::size_t) {
+                    BOOST_TEST(!ec);
+                    end = std::chrono::steady_clock::now();
+                    boost::asio::write(peer, boost::asio::buffer(again));
+                    boost::asio::async_read(
+                        peer,
+                        boost::asio::buffer(&again_pubrec[0], again_pubrec.size()),
+                        [&](boost::system::error_code const& ec, std::size_t) {
+                            BOOST_TEST(!ec);
+                            peer.close();
+                        });
+                });
+        });
+    ios.run();
+
+    BOOST_TEST(received_before_pubrel == count);
+    BOOST_TEST(received == count + 1);
+    BOOST_TEST(pubrecs[4] == '\x50');
+    BOOST_TEST(pubcomps[0] == '\x70');
+    BOOST_TEST(again_pubrec[0] == '\x50');
+    // The limit is loose for slow test environments.
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    BOOST_TEST(ms < 10000);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
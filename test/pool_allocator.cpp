@@ -0,0 +1,176 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+
+#include <mqtt/client.hpp>
+#include <mqtt/server.hpp>
+#include <mqtt/pool_allocator.hpp>
+
+#include <vector>
+#include <string>
+#include <thread>
+
+BOOST_AUTO_TEST_SUITE(test_pool_allocator)
+
+BOOST_AUTO_TEST_CASE( reuse ) {
+    mqtt::pool_allocator<char> a;
+    auto p1 = a.allocate(100);
+    a.deallocate(p1, 100);
+    // Same size class
+    auto p2 = a.allocate(128);
+    BOOST_TEST(p1 == p2);
+    auto p3 = a.allocate(128);
+    BOOST_TEST(p2 != p3);
+    a.deallocate(p2, 128);
+    a.deallocate(p3, 128);
+
+    // Larger than the largest size class
+    auto p4 = a.allocate(1024 * 1024);
+    a.deallocate(p4, 1024 * 1024);
+}
+
+BOOST_AUTO_TEST_CASE( container ) {
+    std::vector<int, mqtt::pool_allocator<int>> v;
+    for (int i = 0; i != 10000; ++i) v.push_back(i);
+    for (int i = 0; i != 10000; ++i) BOOST_TEST(v[static_cast<std::size_t>(i)] == i);
+
+    std::basic_string<char, std::char_traits<char>, mqtt::pool_allocator<char>> s(1000, 'a');
+    BOOST_TEST(s.size() == 1000U);
+}
+
+BOOST_AUTO_TEST_CASE( free_on_other_thread ) {
+    mqtt::pool_allocator<char> a;
+    std::vector<char*> blocks;
+    for (std::size_t i = 0; i != 100; ++i) blocks.push_back(a.allocate(i * 10 + 1));
+    std::thread th(
+        [&] {
+            // Cached by the pool of this thread, and released on the thread exit.
+            for (std::size_t i = 0; i != blocks.size(); ++i) a.deallocate(blocks[i], i * 10 + 1);
+        }
+    );
+    th.join();
+}
+
+BOOST_AUTO_TEST_CASE( pooled_endpoint ) {
+    boost::asio::io_service ios;
+
+    using server_t = mqtt::server<
+        boost::asio::io_service::strand,
+        std::mutex,
+        std::lock_guard,
+        2,
+        mqtt::pool_allocator<char>
+    >;
+    using endpoint_t = server_t::endpoint_t;
+    server_t server(
+        boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), broker_notls_port),
+        ios);
+
+    // Echo server
+    std::shared_ptr<endpoint_t> sp;
+    server.set_accept_handler(
+        [&](endpoint_t& ep) {
+            sp = ep.shared_from_this();
+            ep.start_session(
+                [&](boost::system::error_code const&) {
+                    sp.reset();
+                    server.close();
+                }
+            );
+            ep.set_connect_handler(
+                [&]
+                (std::string const&,
+                 mqtt::optional<std::string> const&,
+                 mqtt::optional<std::string> const&,
+                 mqtt::optional<mqtt::will>,
+                 bool,
+                 std::uint16_t) {
+                    sp->connack(false, mqtt::connect_return_code::accepted);
+                    return true;
+                });
+            ep.set_publish_view_handler(
+                [&]
+                (std::uint8_t header,
+                 mqtt::optional<std::uint16_t>,
+                 mqtt::string_view topic,
+                 mqtt::string_view contents,
+                 endpoint_t::shared_buffer) {
+                    sp->async_publish(
+                        std::string(topic.data(), topic.size()),
+                        std::string(contents.data(), contents.size()),
+                        mqtt::publish::get_qos(header));
+                    return true;
+                });
+            ep.set_disconnect_handler(
+                [&] {
+                    sp->force_disconnect();
+                });
+        }
+    );
+    server.listen();
+
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+
+    std::size_t const count = 100;
+    std::size_t received = 0;
+    std::size_t acked = 0;
+
+    auto check_finish =
+        [&] {
+            if (received == count && acked == count / 3 * 2) {
+                c->disconnect();
+            }
+        };
+
+    c->set_connack_handler(
+        [&]
+        (bool, std::uint8_t connack_return_code) {
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            for (std::size_t i = 0; i != count; ++i) {
+                c->async_publish(
+                    "topic1",
+                    "topic1_contents_" + std::to_string(i),
+                    static_cast<std::uint8_t>(i % 3));
+            }
+            return true;
+        });
+    c->set_puback_handler(
+        [&]
+        (std::uint16_t) {
+            ++acked;
+            check_finish();
+            return true;
+        });
+    c->set_pubcomp_handler(
+        [&]
+        (std::uint16_t) {
+            ++acked;
+            check_finish();
+            return true;
+        });
+    c->set_publish_handler(
+        [&]
+        (std::uint8_t header,
+         mqtt::optional<std::uint16_t>,
+         std::string topic,
+         std::string contents) {
+            BOOST_TEST(mqtt::publish::get_qos(header) == received % 3);
+            BOOST_TEST(topic == "topic1");
+            BOOST_TEST(contents == "topic1_contents_" + std::to_string(received));
+            ++received;
+            check_finish();
+            return true;
+        });
+    c->connect();
+    ios.run();
+    BOOST_TEST(received == count);
+    BOOST_TEST(acked == count / 3 * 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
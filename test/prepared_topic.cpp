@@ -0,0 +1,254 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "combi_test.hpp"
+
+#include <mqtt/message.hpp>
+
+#include <vector>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(test_prepared_topic)
+
+BOOST_AUTO_TEST_CASE( same_as_publish_message ) {
+    std::string topic("topic1/a");
+    std::string payload(200, 'x');
+    mqtt::prepared_topic prepared(topic);
+    for (std::uint8_t qos = 0; qos != 3; ++qos) {
+        std::uint16_t packet_id = qos == 0 ? 0 : 0x1234;
+        auto expected = mqtt::publish_message(
+            as::buffer(topic), qos, true, false, packet_id, as::buffer(payload));
+        auto msg = mqtt::publish_message(
+            prepared, qos, true, false, packet_id, as::buffer(payload));
+        BOOST_TEST(msg.size() == expected.size());
+        BOOST_TEST(msg.continuous_buffer() == expected.continuous_buffer());
+        // The topic name is not copied.
+        BOOST_TEST(mqtt::get_pointer(msg.topic()) == mqtt::get_pointer(prepared.topic()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( copy_shares_topic ) {
+    mqtt::prepared_topic prepared("topic1");
+    auto copied = prepared;
+    BOOST_TEST(mqtt::get_pointer(copied.topic()) == mqtt::get_pointer(prepared.topic()));
+    BOOST_TEST(mqtt::get_size(copied.topic()) == 6U);
+    BOOST_TEST((std::string(copied.topic_name_length_buf().begin(), copied.topic_name_length_buf().end()) == std::string{ 0, 6 }));
+}
+
+BOOST_AUTO_TEST_CASE( invalid_topic ) {
+    BOOST_CHECK_THROW(mqtt::prepared_topic(std::string("\xff")), mqtt::utf8string_contents_error);
+}
+
+BOOST_AUTO_TEST_CASE( pub_qos0_1_2 ) {
+    auto test = [](boost::asio::io_service& ios, auto& c, auto& s) {
+        using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+        c->set_clean_session(true);
+
+        auto topic = c->prepare_topic("topic1");
+        auto contents = std::make_shared<std::string>("topic1_contents");
+        std::size_t const count = 12;
+        std::size_t received = 0;
+        std::size_t acked = 0;
+        std::size_t written = 0;
+
+        auto check_finish =
+            [&] {
+                if (received == count && acked == count / 3 * 2 && written == count / 2) {
+                    c->disconnect();
+                }
+            };
+
+        c->set_connack_handler(
+            [&]
+            (bool, std::uint8_t connack_return_code) {
+                BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+                c->subscribe("topic1", mqtt::qos::exactly_once);
+                return true;
+            });
+        c->set_close_handler(
+            [&]
+            () {
+                s.close();
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->set_puback_handler(
+            [&]
+            (packet_id_t) {
+                ++acked;
+                check_finish();
+                return true;
+            });
+        c->set_pubcomp_handler(
+            [&]
+            (packet_id_t) {
+                ++acked;
+                check_finish();
+                return true;
+            });
+        c->set_suback_handler(
+            [&]
+            (packet_id_t, std::vector<mqtt::optional<std::uint8_t>>) {
+                // The same prepared topic is published with all overloads.
+                for (std::size_t i = 0; i != count / 4; ++i) {
+                    c->publish(topic, *contents, static_cast<std::uint8_t>(i % 3));
+                }
+                for (std::size_t i = count / 4; i != count / 2; ++i) {
+                    c->publish(topic, as::buffer(*contents), [contents] {}, static_cast<std::uint8_t>(i % 3));
+                }
+                auto written_handler =
+                    [&](boost::system::error_code const& ec) {
+                        BOOST_TEST(!ec);
+                        ++written;
+                        check_finish();
+                    };
+                for (std::size_t i = count / 2; i != count / 4 * 3; ++i) {
+                    c->async_publish(topic, *contents, static_cast<std::uint8_t>(i % 3), false, written_handler);
+                }
+                for (std::size_t i = count / 4 * 3; i != count; ++i) {
+                    c->async_publish(
+                        topic, as::buffer(*contents), [contents] {},
+                        static_cast<std::uint8_t>(i % 3), false, written_handler);
+                }
+                return true;
+            });
+        c->set_publish_handler(
+            [&]
+            (std::uint8_t header,
+             mqtt::optional<packet_id_t> packet_id,
+             std::string topic_name,
+             std::string contents) {
+                BOOST_TEST(mqtt::publish::get_qos(header) == received % 3);
+                BOOST_TEST(static_cast<bool>(packet_id) == (received % 3 != 0));
+                BOOST_TEST(topic_name == "topic1");
+                BOOST_TEST(contents == "topic1_contents");
+                ++received;
+                check_finish();
+                return true;
+            });
+        c->connect();
+        ios.run();
+        BOOST_TEST(received == count);
+        // The endpoint doesn't keep the contents after all messages are acknowledged.
+        BOOST_TEST(contents.use_count() == 1);
+    };
+    do_combi_test(test);
+}
+
+BOOST_AUTO_TEST_CASE( pub_qos_specific ) {
+    auto test = [](boost::asio::io_service& ios, auto& c, auto& s) {
+        using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+        c->set_clean_session(true);
+
+        auto topic = c->prepare_topic("topic1");
+        auto contents = std::make_shared<std::string>("topic1_contents");
+        // The QoS of the messages in the publishing order.
+        std::vector<std::uint8_t> const expected {
+            mqtt::qos::at_most_once,
+            mqtt::qos::at_least_once,
+            mqtt::qos::exactly_once,
+            mqtt::qos::at_least_once,
+            mqtt::qos::at_least_once,
+            mqtt::qos::exactly_once,
+            mqtt::qos::at_most_once,
+            mqtt::qos::at_least_once,
+            mqtt::qos::exactly_once,
+            mqtt::qos::exactly_once,
+        };
+        std::size_t const num_acks = 8;
+        std::size_t const num_async = 4;
+        std::size_t received = 0;
+        std::size_t acked = 0;
+        std::size_t written = 0;
+
+        auto check_finish =
+            [&] {
+                if (received == expected.size() && acked == num_acks && written == num_async) {
+                    c->disconnect();
+                }
+            };
+
+        c->set_connack_handler(
+            [&]
+            (bool, std::uint8_t connack_return_code) {
+                BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+                c->subscribe("topic1", mqtt::qos::exactly_once);
+                return true;
+            });
+        c->set_close_handler(
+            [&]
+            () {
+                s.close();
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->set_puback_handler(
+            [&]
+            (packet_id_t) {
+                ++acked;
+                check_finish();
+                return true;
+            });
+        c->set_pubcomp_handler(
+            [&]
+            (packet_id_t) {
+                ++acked;
+                check_finish();
+                return true;
+            });
+        c->set_suback_handler(
+            [&]
+            (packet_id_t, std::vector<mqtt::optional<std::uint8_t>>) {
+                c->publish_at_most_once(topic, *contents);
+                c->publish_at_least_once(topic, as::buffer(*contents), [contents] {});
+                c->publish_exactly_once(topic, *contents);
+                BOOST_TEST(c->publish_at_least_once(0x100, topic, *contents));
+                BOOST_TEST(c->publish_dup(0x101, topic, as::buffer(*contents), [contents] {}, mqtt::qos::at_least_once));
+                c->acquired_publish_exactly_once(c->acquire_unique_packet_id(), topic, *contents);
+
+                auto written_handler =
+                    [&](boost::system::error_code const& ec) {
+                        BOOST_TEST(!ec);
+                        ++written;
+                        check_finish();
+                    };
+                c->async_publish_at_most_once(topic, as::buffer(*contents), false, written_handler);
+                c->async_publish_at_least_once(topic, *contents, false, written_handler);
+                c->async_publish_exactly_once(topic, as::buffer(*contents), [contents] {}, false, written_handler);
+                BOOST_TEST(c->async_publish_dup(0x102, topic, *contents, mqtt::qos::exactly_once, false, written_handler));
+                return true;
+            });
+        c->set_publish_handler(
+            [&]
+            (std::uint8_t header,
+             mqtt::optional<packet_id_t>,
+             std::string topic_name,
+             std::string contents) {
+                BOOST_TEST(received < expected.size());
+                if (received >= expected.size()) return true;
+                BOOST_TEST(mqtt::publish::get_qos(header) == expected[received]);
+                BOOST_TEST(topic_name == "topic1");
+                BOOST_TEST(contents == "topic1_contents");
+                ++received;
+                check_finish();
+                return true;
+            });
+        c->connect();
+        ios.run();
+        BOOST_TEST(received == expected.size());
+        BOOST_TEST(contents.use_count() == 1);
+    };
+    do_combi_test(test);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,171 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "combi_test.hpp"
+
+#include <mqtt/optional.hpp>
+
+#include <vector>
+#include <string>
+#include <tuple>
+
+BOOST_AUTO_TEST_SUITE(test_publish_batch)
+
+namespace {
+
+std::size_t const count = 9;
+
+std::vector<std::tuple<std::string, std::string, std::uint8_t>> make_entries() {
+    std::vector<std::tuple<std::string, std::string, std::uint8_t>> entries;
+    for (std::size_t i = 0; i != count; ++i) {
+        entries.emplace_back("topic1", "contents" + std::to_string(i), static_cast<std::uint8_t>(i % 3));
+    }
+    return entries;
+}
+
+template <typename Publish>
+void batch_test(Publish const& publish) {
+    auto test = [&](boost::asio::io_service& ios, auto& c, auto& s) {
+        using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+        c->set_clean_session(true);
+
+        std::size_t received = 0;
+        std::size_t acked = 0;
+        bool written = false;
+
+        auto check_finish =
+            [&] {
+                if (received == count && acked == count / 3 * 2 && written) {
+                    c->disconnect();
+                }
+            };
+
+        c->set_connack_handler(
+            [&]
+            (bool, std::uint8_t connack_return_code) {
+                BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+                c->subscribe("topic1", mqtt::qos::exactly_once);
+                return true;
+            });
+        c->set_close_handler(
+            [&]
+            () {
+                s.close();
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->set_puback_handler(
+            [&]
+            (packet_id_t) {
+                ++acked;
+                check_finish();
+                return true;
+            });
+        c->set_pubcomp_handler(
+            [&]
+            (packet_id_t) {
+                ++acked;
+                check_finish();
+                return true;
+            });
+        c->set_suback_handler(
+            [&]
+            (packet_id_t, std::vector<mqtt::optional<std::uint8_t>>) {
+                auto packet_ids = publish(
+                    *c,
+                    make_entries(),
+                    [&] {
+                        written = true;
+                        check_finish();
+                    });
+                BOOST_TEST(packet_ids.size() == count);
+                for (std::size_t i = 0; i != count; ++i) {
+                    BOOST_TEST((packet_ids[i] == 0) == (i % 3 == 0));
+                }
+                return true;
+            });
+        c->set_publish_handler(
+            [&]
+            (std::uint8_t header,
+             mqtt::optional<packet_id_t> packet_id,
+             std::string topic,
+             std::string contents) {
+                BOOST_TEST(mqtt::publish::get_qos(header) == received % 3);
+                BOOST_TEST(static_cast<bool>(packet_id) == (received % 3 != 0));
+                BOOST_TEST(topic == "topic1");
+                BOOST_TEST(contents == "contents" + std::to_string(received));
+                ++received;
+                check_finish();
+                return true;
+            });
+        c->connect();
+        ios.run();
+        BOOST_TEST(received == count);
+    };
+    do_combi_test(test);
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( sync ) {
+    batch_test(
+        [](auto& c, auto const& entries, auto const& written) {
+            std::size_t sent = 0;
+            c.set_pre_send_handler([&] { ++sent; });
+            auto packet_ids = c.publish_batch(entries);
+            c.set_pre_send_handler();
+            // All messages are written at once.
+            BOOST_TEST(sent == 1U);
+            written();
+            return packet_ids;
+        });
+}
+
+BOOST_AUTO_TEST_CASE( async ) {
+    batch_test(
+        [](auto& c, auto const& entries, auto const& written) {
+            return c.async_publish_batch(
+                entries,
+                [written](boost::system::error_code const& ec) {
+                    BOOST_TEST(!ec);
+                    written();
+                });
+        });
+}
+
+BOOST_AUTO_TEST_CASE( invalid_topic ) {
+    auto test = [](boost::asio::io_service& ios, auto& c, auto& s) {
+        c->set_clean_session(true);
+        c->set_connack_handler(
+            [&]
+            (bool, std::uint8_t) {
+                std::vector<std::tuple<std::string, std::string, std::uint8_t>> entries {
+                    std::make_tuple("topic1", "contents", mqtt::qos::at_least_once),
+                    std::make_tuple("\xff", "contents", mqtt::qos::at_least_once)
+                };
+                BOOST_CHECK_THROW(c->publish_batch(entries), mqtt::utf8string_contents_error);
+                // The packet id that is acquired for the first entry is released.
+                BOOST_TEST(c->register_packet_id(1));
+                BOOST_TEST(c->release_packet_id(1));
+                c->disconnect();
+                return true;
+            });
+        c->set_close_handler(
+            [&]
+            () {
+                s.close();
+            });
+        c->connect();
+        ios.run();
+    };
+    do_combi_test(test);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
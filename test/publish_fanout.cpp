@@ -0,0 +1,170 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "combi_test.hpp"
+
+#include <mqtt/message.hpp>
+
+#include <vector>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(test_publish_fanout)
+
+namespace {
+
+template <std::size_t PacketIdBytes>
+void check_same_as_publish_message(std::size_t payload_size, bool retain) {
+    std::string topic("topic1/a");
+    std::string payload(payload_size, 'x');
+    auto fanout = std::make_shared<mqtt::basic_publish_fanout<PacketIdBytes> const>(topic, payload, retain);
+    for (std::uint8_t qos = 0; qos != 3; ++qos) {
+        typename mqtt::packet_id_type<PacketIdBytes>::type packet_id = qos == 0 ? 0 : 0x1234;
+        auto expected = mqtt::basic_publish_message<PacketIdBytes>(
+            as::buffer(topic), qos, retain, false, packet_id, as::buffer(payload));
+        auto msg = fanout->message(qos, packet_id);
+        BOOST_TEST(msg.size() == expected.size());
+        BOOST_TEST(msg.continuous_buffer() == expected.continuous_buffer());
+        BOOST_TEST(msg.const_buffer_sequence().size() == expected.const_buffer_sequence().size());
+        BOOST_TEST(msg.qos() == qos);
+        BOOST_TEST(msg.is_retain() == retain);
+        BOOST_TEST(!msg.is_dup());
+        if (qos != 0) BOOST_TEST(msg.packet_id() == packet_id);
+        // The topic name and payload are not copied.
+        BOOST_TEST(mqtt::get_pointer(msg.topic()) == mqtt::get_pointer(fanout->topic()));
+        BOOST_TEST(mqtt::get_pointer(msg.payload()) == mqtt::get_pointer(fanout->payload()));
+    }
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( same_as_publish_message ) {
+    // The remaining length is encoded in 1, 2, 3, and 4 bytes.
+    for (auto payload_size : { 0, 100, 20000, 3000000 }) {
+        check_same_as_publish_message<2>(static_cast<std::size_t>(payload_size), false);
+        check_same_as_publish_message<2>(static_cast<std::size_t>(payload_size), true);
+        check_same_as_publish_message<4>(static_cast<std::size_t>(payload_size), false);
+    }
+    // 127 + 2 + 8 is the boundary between 1 byte and 2 bytes with the packet identifier.
+    check_same_as_publish_message<2>(127 - 2 - 8, false);
+    check_same_as_publish_message<2>(127 - 2 - 8 - 1, false);
+}
+
+BOOST_AUTO_TEST_CASE( life_keeper ) {
+    auto topic = std::make_shared<std::string>("topic1");
+    auto contents = std::make_shared<std::string>("contents");
+    {
+        mqtt::publish_fanout fanout(
+            as::buffer(*topic),
+            as::buffer(*contents),
+            [topic, contents] {});
+        BOOST_TEST(topic.use_count() == 2);
+        BOOST_TEST(mqtt::get_pointer(fanout.topic()) == topic->data());
+        BOOST_TEST(mqtt::get_pointer(fanout.payload()) == contents->data());
+        BOOST_TEST(!fanout.is_retain());
+    }
+    BOOST_TEST(topic.use_count() == 1);
+}
+
+BOOST_AUTO_TEST_CASE( invalid_topic ) {
+    BOOST_CHECK_THROW(mqtt::publish_fanout(std::string("\xff"), "contents"), mqtt::utf8string_contents_error);
+}
+
+BOOST_AUTO_TEST_CASE( pub_qos0_1_2 ) {
+    auto test = [](boost::asio::io_service& ios, auto& c, auto& s) {
+        using endpoint_t = std::remove_reference_t<decltype(*c)>;
+        using packet_id_t = typename endpoint_t::packet_id_t;
+        c->set_clean_session(true);
+        // The responses are written asynchronously with the async_publish.
+        c->set_auto_pub_response(true, true);
+
+        auto fanout = std::make_shared<typename endpoint_t::publish_fanout_t const>("topic1", "topic1_contents");
+        std::size_t const count = 6;
+        std::size_t received = 0;
+        std::size_t acked = 0;
+        std::size_t written = 0;
+
+        auto check_finish =
+            [&] {
+                if (received == count && acked == count / 3 * 2 && written == count / 2) {
+                    c->disconnect();
+                }
+            };
+
+        c->set_connack_handler(
+            [&]
+            (bool, std::uint8_t connack_return_code) {
+                BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+                c->subscribe("topic1", mqtt::qos::exactly_once);
+                return true;
+            });
+        c->set_close_handler(
+            [&]
+            () {
+                s.close();
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->set_puback_handler(
+            [&]
+            (packet_id_t) {
+                ++acked;
+                check_finish();
+                return true;
+            });
+        c->set_pubcomp_handler(
+            [&]
+            (packet_id_t) {
+                ++acked;
+                check_finish();
+                return true;
+            });
+        c->set_suback_handler(
+            [&]
+            (packet_id_t, std::vector<mqtt::optional<std::uint8_t>>) {
+                // The same fanout is published with the different QoS, synchronously and asynchronously.
+                for (std::size_t i = 0; i != count / 2; ++i) {
+                    c->publish(fanout, static_cast<std::uint8_t>(i % 3));
+                }
+                for (std::size_t i = count / 2; i != count; ++i) {
+                    c->async_publish(
+                        fanout,
+                        static_cast<std::uint8_t>(i % 3),
+                        [&](boost::system::error_code const& ec) {
+                            BOOST_TEST(!ec);
+                            ++written;
+                            check_finish();
+                        });
+                }
+                return true;
+            });
+        c->set_publish_handler(
+            [&]
+            (std::uint8_t header,
+             mqtt::optional<packet_id_t> packet_id,
+             std::string topic,
+             std::string contents) {
+                BOOST_TEST(mqtt::publish::get_qos(header) == received % 3);
+                BOOST_TEST(static_cast<bool>(packet_id) == (received % 3 != 0));
+                BOOST_TEST(topic == "topic1");
+                BOOST_TEST(contents == "topic1_contents");
+                ++received;
+                check_finish();
+                return true;
+            });
+        c->connect();
+        ios.run();
+        BOOST_TEST(received == count);
+        // The endpoint doesn't keep the fanout after all messages are acknowledged.
+        BOOST_TEST(fanout.use_count() == 1);
+    };
+    do_combi_test(test);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
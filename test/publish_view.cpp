@@ -0,0 +1,193 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "combi_test.hpp"
+
+#include <mqtt/optional.hpp>
+#include <mqtt/string_view.hpp>
+
+#include <vector>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(test_publish_view)
+
+BOOST_AUTO_TEST_CASE( pub_qos0_1_2 ) {
+    auto test = [](boost::asio::io_service& ios, auto& c, auto& s) {
+        using endpoint_t = std::remove_reference_t<decltype(*c)>;
+        using packet_id_t = typename endpoint_t::packet_id_t;
+        c->set_clean_session(true);
+
+        std::size_t const count = 9;
+        std::size_t received = 0;
+        std::size_t acked = 0;
+        bool closed = false;
+
+        auto check_finish =
+            [&] {
+                if (received == count && acked == count / 3 * 2) {
+                    c->disconnect();
+                }
+            };
+
+        struct kept {
+            mqtt::string_view topic;
+            mqtt::string_view contents;
+            typename endpoint_t::shared_buffer buffer;
+        };
+        std::vector<kept> kept_messages;
+
+        c->set_connack_handler(
+            [&]
+            (bool sp, std::uint8_t connack_return_code) {
+                BOOST_TEST(sp == false);
+                BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+                c->subscribe("topic1", mqtt::qos::exactly_once);
+                return true;
+            });
+        c->set_close_handler(
+            [&]
+            () {
+                closed = true;
+                s.close();
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->set_puback_handler(
+            [&]
+            (packet_id_t) {
+                ++acked;
+                check_finish();
+                return true;
+            });
+        c->set_pubcomp_handler(
+            [&]
+            (packet_id_t) {
+                ++acked;
+                check_finish();
+                return true;
+            });
+        c->set_suback_handler(
+            [&]
+            (packet_id_t, std::vector<mqtt::optional<std::uint8_t>> results) {
+                BOOST_TEST(results.size() == 1U);
+                for (std::size_t i = 0; i != count; ++i) {
+                    c->publish("topic1", "topic1_contents_" + std::to_string(i), static_cast<std::uint8_t>(i % 3));
+                }
+                return true;
+            });
+        c->set_publish_view_handler(
+            [&]
+            (std::uint8_t header,
+             mqtt::optional<packet_id_t> packet_id,
+             mqtt::string_view topic,
+             mqtt::string_view contents,
+             typename endpoint_t::shared_buffer buffer) {
+                BOOST_TEST(mqtt::publish::get_qos(header) == received % 3);
+                BOOST_TEST(static_cast<bool>(packet_id) == (received % 3 != 0));
+                BOOST_TEST(topic == "topic1");
+                BOOST_TEST(contents == "topic1_contents_" + std::to_string(received));
+                BOOST_TEST(buffer->data() <= topic.data());
+                BOOST_TEST(contents.data() + contents.size() == buffer->data() + buffer->size());
+                // Keep every other message. The views must stay valid while the buffer is kept.
+                if (received % 2 == 0) kept_messages.push_back(kept{ topic, contents, std::move(buffer) });
+                ++received;
+                check_finish();
+                return true;
+            });
+        c->connect();
+        ios.run();
+        BOOST_TEST(received == count);
+        BOOST_TEST(closed);
+        BOOST_TEST(kept_messages.size() == (count + 1) / 2);
+        for (std::size_t i = 0; i != kept_messages.size(); ++i) {
+            BOOST_TEST(kept_messages[i].topic == "topic1");
+            BOOST_TEST(kept_messages[i].contents == "topic1_contents_" + std::to_string(i * 2));
+        }
+    };
+    do_combi_test(test);
+}
+
+BOOST_AUTO_TEST_CASE( replace_handler ) {
+    auto test = [](boost::asio::io_service& ios, auto& c, auto& s) {
+        using endpoint_t = std::remove_reference_t<decltype(*c)>;
+        using packet_id_t = typename endpoint_t::packet_id_t;
+        c->set_clean_session(true);
+
+        std::size_t view_called = 0;
+        std::size_t string_called = 0;
+
+        c->set_connack_handler(
+            [&]
+            (bool, std::uint8_t) {
+                c->subscribe("topic1", mqtt::qos::at_most_once);
+                return true;
+            });
+        c->set_close_handler(
+            [&]
+            () {
+                s.close();
+            });
+        c->set_suback_handler(
+            [&]
+            (packet_id_t, std::vector<mqtt::optional<std::uint8_t>>) {
+                c->publish_at_most_once("topic1", "topic1_contents");
+                return true;
+            });
+        c->set_publish_view_handler(
+            [&]
+            (std::uint8_t,
+             mqtt::optional<packet_id_t>,
+             mqtt::string_view,
+             mqtt::string_view,
+             typename endpoint_t::shared_buffer) {
+                ++view_called;
+                return true;
+            });
+        // Setting the std::string version replaces the view version.
+        c->set_publish_handler(
+            [&]
+            (std::uint8_t,
+             mqtt::optional<packet_id_t>,
+             std::string topic,
+             std::string contents) {
+                ++string_called;
+                BOOST_TEST(topic == "topic1");
+                BOOST_TEST(contents == "topic1_contents");
+                c->disconnect();
+                return true;
+            });
+        c->connect();
+        ios.run();
+        BOOST_TEST(view_called == 0U);
+        BOOST_TEST(string_called == 1U);
+    };
+    do_combi_test(test);
+}
+
+BOOST_AUTO_TEST_CASE( clear_handler ) {
+    boost::asio::io_service ios;
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_publish_view_handler(
+        []
+        (std::uint8_t,
+         mqtt::optional<std::uint16_t>,
+         mqtt::string_view,
+         mqtt::string_view,
+         decltype(c)::element_type::shared_buffer) {
+            return true;
+        });
+    BOOST_TEST(static_cast<bool>(c->get_publish_view_handler()));
+    // Clearing the std::string version clears the view version too.
+    c->set_publish_handler(nullptr);
+    BOOST_TEST(!c->get_publish_handler());
+    BOOST_TEST(!c->get_publish_view_handler());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1424,4 +1424,101 @@ BOOST_AUTO_TEST_CASE( publish_dup_function ) {
 }
 
 
+BOOST_AUTO_TEST_CASE( pub_qos0_sub_wildcard ) {
+    auto test = [](boost::asio::io_service& ios, auto& c, auto& s) {
+        using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+        c->set_clean_session(true);
+
+        std::size_t order = 0;
+
+        std::vector<std::string> const expected = {
+            // connect
+            "h_connack",
+            // subscribe topic1/+ and invalid filter
+            "h_suback",
+            // publish topic1/sub QoS0
+            "h_publish",
+            "h_unsuback",
+            // disconnect
+            "h_close",
+            "finish",
+        };
+
+        auto current =
+            [&order, &expected]() -> std::string {
+                try {
+                    return expected.at(order);
+                }
+                catch (std::out_of_range const& e) {
+                    return e.what();
+                }
+            };
+
+        c->set_connack_handler(
+            [&order, &current, &c]
+            (bool sp, std::uint8_t connack_return_code) {
+                BOOST_TEST(current() == "h_connack");
+                ++order;
+                BOOST_TEST(sp == false);
+                BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+                c->subscribe("topic1/+", mqtt::qos::at_most_once, "topic1/#/a", mqtt::qos::at_most_once);
+                return true;
+            });
+        c->set_close_handler(
+            [&order, &current, &s]
+            () {
+                BOOST_TEST(current() == "h_close");
+                ++order;
+                s.close();
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->set_suback_handler(
+            [&order, &current, &c]
+            (packet_id_t /*packet_id*/, std::vector<mqtt::optional<std::uint8_t>> results) {
+                BOOST_TEST(current() == "h_suback");
+                ++order;
+                BOOST_TEST(results.size() == 2U);
+                BOOST_TEST(*results[0] == mqtt::qos::at_most_once);
+                BOOST_CHECK(!results[1]);
+                // not matched
+                c->publish_at_most_once("topic1", "topic1_contents");
+                c->publish_at_most_once("topic1/sub/sub", "topic1_contents");
+                // matched
+                c->publish_at_most_once("topic1/sub", "topic1_sub_contents");
+                return true;
+            });
+        c->set_unsuback_handler(
+            [&order, &current, &c]
+            (packet_id_t /*packet_id*/) {
+                BOOST_TEST(current() == "h_unsuback");
+                ++order;
+                c->disconnect();
+                return true;
+            });
+        c->set_publish_handler(
+            [&order, &current, &c]
+            (std::uint8_t header,
+             mqtt::optional<packet_id_t> packet_id,
+             std::string topic,
+             std::string contents) {
+                BOOST_TEST(current() == "h_publish");
+                ++order;
+                BOOST_TEST(mqtt::publish::get_qos(header) == mqtt::qos::at_most_once);
+                BOOST_CHECK(!packet_id);
+                BOOST_TEST(topic == "topic1/sub");
+                BOOST_TEST(contents == "topic1_sub_contents");
+                c->unsubscribe("topic1/+");
+                return true;
+            });
+        c->connect();
+        ios.run();
+        BOOST_TEST(current() == "finish");
+    };
+    do_combi_test(test);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -412,4 +412,64 @@ BOOST_AUTO_TEST_CASE( retain_and_publish ) {
 }
 
 
+BOOST_AUTO_TEST_CASE( wildcard_and_budget ) {
+    auto test = [](boost::asio::io_service& ios, auto& c, auto& s) {
+        using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+        c->set_clean_session(true);
+        // "topic1/a" (8 bytes) and the contents (10 bytes) are accounted.
+        // The first message is evicted by the third one.
+        s.broker().set_retained_max_bytes(40);
+
+        std::vector<std::string> received;
+
+        c->set_connack_handler(
+            [&]
+            (bool, std::uint8_t connack_return_code) {
+                BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+                c->publish_at_most_once("topic1/a", "contents_a", true);
+                c->publish_at_most_once("topic2/b", "contents_b", true);
+                c->publish_at_most_once("topic1/c", "contents_c", true);
+                c->subscribe("topic1/+", mqtt::qos::at_most_once);
+                return true;
+            });
+        c->set_close_handler(
+            [&]
+            () {
+                s.close();
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->set_suback_handler(
+            [&]
+            (packet_id_t, std::vector<mqtt::optional<std::uint8_t>> results) {
+                BOOST_TEST(results.size() == 1U);
+                BOOST_TEST(*results[0] == mqtt::qos::at_most_once);
+                auto u = s.broker().retained_memory_usage();
+                BOOST_TEST(u.messages == 2U);
+                BOOST_TEST(u.bytes == 36U);
+                BOOST_TEST(u.evicted == 1U);
+                return true;
+            });
+        c->set_publish_handler(
+            [&]
+            (std::uint8_t header,
+             mqtt::optional<packet_id_t>,
+             std::string topic,
+             std::string contents) {
+                BOOST_TEST(mqtt::publish::is_retain(header) == true);
+                received.push_back(topic + ":" + contents);
+                // Only topic1/c is left. topic1/a is evicted.
+                c->disconnect();
+                return true;
+            });
+        c->connect();
+        ios.run();
+        BOOST_TEST((received == std::vector<std::string>{ "topic1/c:contents_c" }));
+    };
+    do_combi_test(test);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,222 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+
+#include <mqtt/retained_store.hpp>
+#include <mqtt/topic_trie.hpp>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <random>
+
+BOOST_AUTO_TEST_SUITE(test_retained_store)
+
+namespace {
+
+using store_t = mqtt::retained_store<std::string>;
+
+std::vector<std::string> find(store_t const& s, mqtt::string_view filter) {
+    std::vector<std::string> ret;
+    s.find(
+        filter,
+        [&](std::string const& v) {
+            ret.push_back(v);
+        }
+    );
+    std::sort(ret.begin(), ret.end());
+    return ret;
+}
+
+void insert(store_t& s, std::string const& topic) {
+    s.insert_or_assign(topic, topic, 0);
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( valid_topic ) {
+    store_t s;
+    BOOST_TEST(!s.insert_or_assign("", "x", 0));
+    BOOST_TEST(!s.insert_or_assign("a/+", "x", 0));
+    BOOST_TEST(!s.insert_or_assign("a/#", "x", 0));
+    BOOST_TEST(s.empty());
+    BOOST_TEST(s.insert_or_assign("/", "x", 0));
+    BOOST_TEST(s.size() == 1U);
+}
+
+BOOST_AUTO_TEST_CASE( exact ) {
+    store_t s;
+    insert(s, "a");
+    insert(s, "a/b");
+    insert(s, "a/b/c");
+    insert(s, "/a/b");
+    BOOST_TEST(s.size() == 4U);
+    BOOST_TEST((find(s, "a/b") == std::vector<std::string>{ "a/b" }));
+    BOOST_TEST((find(s, "/a/b") == std::vector<std::string>{ "/a/b" }));
+    BOOST_TEST(find(s, "a/b/").empty());
+    BOOST_TEST(find(s, "b").empty());
+
+    // Replace
+    BOOST_TEST(s.insert_or_assign("a/b", "new", 3));
+    BOOST_TEST(s.size() == 4U);
+    BOOST_TEST((find(s, "a/b") == std::vector<std::string>{ "new" }));
+}
+
+BOOST_AUTO_TEST_CASE( wildcard ) {
+    store_t s;
+    insert(s, "a");
+    insert(s, "a/b");
+    insert(s, "a/c");
+    insert(s, "a/b/c");
+    insert(s, "a//c");
+    insert(s, "x/b");
+    BOOST_TEST((find(s, "a/+") == std::vector<std::string>{ "a/b", "a/c" }));
+    BOOST_TEST((find(s, "+/b") == std::vector<std::string>{ "a/b", "x/b" }));
+    BOOST_TEST((find(s, "a/+/c") == std::vector<std::string>{ "a//c", "a/b/c" }));
+    BOOST_TEST((find(s, "a/#") == std::vector<std::string>{ "a", "a//c", "a/b", "a/b/c", "a/c" }));
+    BOOST_TEST((find(s, "a/b/#") == std::vector<std::string>{ "a/b", "a/b/c" }));
+    BOOST_TEST((find(s, "+/+/#") == std::vector<std::string>{ "a//c", "a/b", "a/b/c", "a/c", "x/b" }));
+    BOOST_TEST(find(s, "#").size() == 6U);
+    BOOST_TEST((find(s, "+") == std::vector<std::string>{ "a" }));
+}
+
+BOOST_AUTO_TEST_CASE( dollar_topic ) {
+    store_t s;
+    insert(s, "$SYS/monitor/clients");
+    insert(s, "SYS/monitor/clients");
+    BOOST_TEST((find(s, "#") == std::vector<std::string>{ "SYS/monitor/clients" }));
+    BOOST_TEST((find(s, "+/monitor/clients") == std::vector<std::string>{ "SYS/monitor/clients" }));
+    BOOST_TEST((find(s, "$SYS/#") == std::vector<std::string>{ "$SYS/monitor/clients" }));
+    BOOST_TEST((find(s, "$SYS/monitor/+") == std::vector<std::string>{ "$SYS/monitor/clients" }));
+}
+
+BOOST_AUTO_TEST_CASE( erase ) {
+    store_t s;
+    insert(s, "a/b/c");
+    insert(s, "a/b");
+    insert(s, "x");
+    BOOST_TEST(s.node_count() == 4U);
+    BOOST_TEST(s.erase("a/b/c/d") == 0U);
+    BOOST_TEST(s.erase("a") == 0U);
+    BOOST_TEST(s.erase("a/b") == 1U);
+    // a/b is kept for a/b/c
+    BOOST_TEST(s.node_count() == 4U);
+    BOOST_TEST(s.erase("a/b/c") == 1U);
+    BOOST_TEST(s.node_count() == 1U);
+    BOOST_TEST((find(s, "#") == std::vector<std::string>{ "x" }));
+    s.clear();
+    BOOST_TEST(s.empty());
+    BOOST_TEST(s.node_count() == 0U);
+    BOOST_TEST(s.bytes() == 0U);
+}
+
+BOOST_AUTO_TEST_CASE( memory_budget ) {
+    // The bytes are the size of the topic name and the given bytes.
+    store_t s(30);
+    BOOST_TEST(s.insert_or_assign("t1", "1", 8));
+    BOOST_TEST(s.insert_or_assign("t2", "2", 8));
+    BOOST_TEST(s.insert_or_assign("t3", "3", 8));
+    BOOST_TEST(s.bytes() == 30U);
+    BOOST_TEST(s.memory_usage().evicted == 0U);
+
+    // The least recently stored one is evicted.
+    BOOST_TEST(s.insert_or_assign("t4", "4", 8));
+    BOOST_TEST(s.bytes() == 30U);
+    BOOST_TEST((find(s, "#") == std::vector<std::string>{ "2", "3", "4" }));
+    BOOST_TEST(s.memory_usage().evicted == 1U);
+
+    // Updated one becomes the most recent.
+    BOOST_TEST(s.insert_or_assign("t2", "2'", 8));
+    BOOST_TEST(s.insert_or_assign("t5", "5", 18));
+    BOOST_TEST((find(s, "#") == std::vector<std::string>{ "2'", "5" }));
+    BOOST_TEST(s.bytes() == 30U);
+    BOOST_TEST(s.memory_usage().evicted == 3U);
+
+    // Larger than the budget. The old message of the topic is erased.
+    BOOST_TEST(!s.insert_or_assign("t2", "big", 29));
+    BOOST_TEST((find(s, "#") == std::vector<std::string>{ "5" }));
+    BOOST_TEST(s.bytes() == 20U);
+
+    s.set_max_bytes(10);
+    BOOST_TEST(s.empty());
+    BOOST_TEST(s.node_count() == 0U);
+    s.set_max_bytes(0);
+    BOOST_TEST(s.insert_or_assign("t6", "6", 1000));
+    BOOST_TEST(s.bytes() == 1002U);
+}
+
+BOOST_AUTO_TEST_CASE( memory_usage ) {
+    store_t s;
+    insert(s, "a/b");
+    insert(s, "a/c");
+    auto u = s.memory_usage();
+    BOOST_TEST(u.messages == 2U);
+    BOOST_TEST(u.bytes == 6U);
+    BOOST_TEST(u.nodes == 3U);
+    BOOST_TEST(u.index_bytes > 0U);
+    s.erase("a/b");
+    s.erase("a/c");
+    BOOST_TEST(s.memory_usage().index_bytes == 0U);
+}
+
+BOOST_AUTO_TEST_CASE( same_as_topic_trie ) {
+    // A topic name matches a filter in the store if and only if the filter matches the topic name in topic_trie.
+    std::mt19937 gen(1);
+    std::vector<std::string> const levels { "a", "b", "", "$c" };
+    std::uniform_int_distribution<std::size_t> level_dist(0, levels.size() - 1);
+    std::uniform_int_distribution<std::size_t> depth_dist(1, 4);
+    std::uniform_int_distribution<int> wildcard_dist(0, 9);
+
+    auto make_level_path =
+        [&](bool wildcard) {
+            std::string ret;
+            auto depth = depth_dist(gen);
+            for (std::size_t i = 0; i != depth; ++i) {
+                if (i != 0) ret += '/';
+                auto w = wildcard ? wildcard_dist(gen) : 9;
+                if (w < 2) {
+                    ret += '+';
+                }
+                else if (w < 3) {
+                    ret += '#';
+                    break;
+                }
+                else {
+                    ret += levels[level_dist(gen)];
+                }
+            }
+            return ret;
+        };
+
+    store_t s;
+    std::vector<std::string> topics;
+    for (std::size_t i = 0; i != 200; ++i) {
+        auto topic = make_level_path(false);
+        if (topic.empty()) continue;
+        insert(s, topic);
+        topics.push_back(topic);
+    }
+    std::sort(topics.begin(), topics.end());
+    topics.erase(std::unique(topics.begin(), topics.end()), topics.end());
+    BOOST_TEST(s.size() == topics.size());
+
+    for (std::size_t i = 0; i != 500; ++i) {
+        auto filter = make_level_path(true);
+        if (filter.empty()) continue;
+        mqtt::topic_trie<int> t;
+        t.insert(filter, 0);
+        std::vector<std::string> expected;
+        for (auto const& topic : topics) {
+            bool matched = false;
+            t.match(topic, [&](int) { matched = true; });
+            if (matched) expected.push_back(topic);
+        }
+        BOOST_TEST(find(s, filter) == expected);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,539 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_sharded_broker.hpp"
+
+#include <mqtt/client.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_sharded_broker_suite)
+
+BOOST_AUTO_TEST_CASE( fan_out ) {
+    boost::asio::io_service ios;
+    test_sharded_broker b(broker_notls_port, 4);
+    b.run();
+
+    using client_t = decltype(mqtt::make_client(ios, broker_url, broker_notls_port));
+
+    // The subscribers are placed on all shards.
+    std::size_t const num_subs = 8;
+    std::vector<std::uint8_t> const pub_qos {
+        mqtt::qos::at_most_once,
+        mqtt::qos::at_least_once,
+        mqtt::qos::exactly_once
+    };
+    std::vector<client_t> subs;
+    std::vector<std::size_t> received(num_subs);
+    std::size_t subscribed = 0;
+    std::size_t delivered = 0;
+    std::size_t closed = 0;
+
+    auto pub = mqtt::make_client(ios, broker_url, broker_notls_port);
+    pub->set_client_id("pub");
+    pub->set_clean_session(true);
+
+    auto close_all =
+        [&] {
+            for (auto& c : subs) c->disconnect();
+            pub->disconnect();
+        };
+    auto on_close =
+        [&] {
+            if (++closed == num_subs + 1) b.close();
+        };
+
+    for (std::size_t i = 0; i != num_subs; ++i) {
+        auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+        c->set_client_id("sub" + std::to_string(i));
+        c->set_clean_session(true);
+        // Each subscriber has a different QoS.
+        std::uint8_t sub_qos = static_cast<std::uint8_t>(i % 3);
+        auto cp = c.get();
+        c->set_connack_handler(
+            [cp, sub_qos]
+            (bool sp, std::uint8_t connack_return_code) {
+                BOOST_TEST(sp == false);
+                BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+                cp->subscribe("topic1/+", sub_qos);
+                return true;
+            });
+        c->set_suback_handler(
+            [&, sub_qos]
+            (std::uint16_t, std::vector<mqtt::optional<std::uint8_t>> results) {
+                BOOST_TEST(results.size() == 1U);
+                BOOST_TEST(*results[0] == sub_qos);
+                if (++subscribed == num_subs) pub->connect();
+                return true;
+            });
+        c->set_publish_handler(
+            [&, i, sub_qos]
+            (std::uint8_t header,
+             mqtt::optional<std::uint16_t>,
+             std::string topic,
+             std::string contents) {
+                auto n = received[i]++;
+                BOOST_TEST(n < pub_qos.size());
+                if (n >= pub_qos.size()) return true;
+                BOOST_TEST(mqtt::publish::get_qos(header) == std::min(sub_qos, pub_qos[n]));
+                BOOST_TEST(mqtt::publish::is_retain(header) == false);
+                BOOST_TEST(topic == "topic1/a");
+                BOOST_TEST(contents == "contents" + std::to_string(n));
+                if (++delivered == num_subs * pub_qos.size()) close_all();
+                return true;
+            });
+        c->set_close_handler(on_close);
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        subs.push_back(c);
+    }
+
+    pub->set_connack_handler(
+        [&]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            for (std::size_t n = 0; n != pub_qos.size(); ++n) {
+                pub->publish("topic1/a", "contents" + std::to_string(n), pub_qos[n]);
+            }
+            return true;
+        });
+    pub->set_close_handler(on_close);
+    pub->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    for (auto& c : subs) c->connect();
+    ios.run();
+    b.join();
+    BOOST_TEST(delivered == num_subs * pub_qos.size());
+    BOOST_TEST(closed == num_subs + 1);
+}
+
+BOOST_AUTO_TEST_CASE( offline_session ) {
+    boost::asio::io_service ios;
+    test_sharded_broker b(broker_notls_port, 2);
+    b.run();
+
+    auto c1 = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c1->set_client_id("cid1");
+    c1->set_clean_session(false);
+
+    auto c2 = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c2->set_client_id("cid2");
+    c2->set_clean_session(true);
+
+    std::size_t order = 0;
+    std::vector<std::string> const expected = {
+        // c1 connect, subscribe and disconnect
+        "c1_h_connack1",
+        "c1_h_suback",
+        "c1_h_close1",
+        // c2 publish QoS1 to the offline session
+        "c2_h_connack",
+        "c2_h_puback",
+        "c2_h_close",
+        // c1 reconnect and receive the queued message
+        "c1_h_connack2",
+        "c1_h_publish",
+        "c1_h_close2",
+        "finish",
+    };
+    auto current =
+        [&order, &expected]() -> std::string {
+            try {
+                return expected.at(order);
+            }
+            catch (std::out_of_range const& e) {
+                return e.what();
+            }
+        };
+
+    c1->set_connack_handler(
+        [&]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            if (current() == "c1_h_connack1") {
+                ++order;
+                BOOST_TEST(sp == false);
+                c1->subscribe("topic1", mqtt::qos::at_least_once);
+            }
+            else {
+                BOOST_TEST(current() == "c1_h_connack2");
+                ++order;
+                BOOST_TEST(sp == true);
+            }
+            return true;
+        });
+    c1->set_suback_handler(
+        [&]
+        (std::uint16_t, std::vector<mqtt::optional<std::uint8_t>> results) {
+            BOOST_TEST(current() == "c1_h_suback");
+            ++order;
+            BOOST_TEST(results.size() == 1U);
+            BOOST_TEST(*results[0] == mqtt::qos::at_least_once);
+            c1->disconnect();
+            return true;
+        });
+    c1->set_publish_handler(
+        [&]
+        (std::uint8_t header,
+         mqtt::optional<std::uint16_t> packet_id,
+         std::string topic,
+         std::string contents) {
+            BOOST_TEST(current() == "c1_h_publish");
+            ++order;
+            BOOST_TEST(mqtt::publish::get_qos(header) == mqtt::qos::at_least_once);
+            BOOST_TEST(packet_id.has_value());
+            BOOST_TEST(topic == "topic1");
+            BOOST_TEST(contents == "topic1_contents");
+            c1->disconnect();
+            return true;
+        });
+    c1->set_close_handler(
+        [&]
+        () {
+            if (current() == "c1_h_close1") {
+                ++order;
+                c2->connect();
+            }
+            else {
+                BOOST_TEST(current() == "c1_h_close2");
+                ++order;
+                b.close();
+            }
+        });
+    c1->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    c2->set_connack_handler(
+        [&]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(current() == "c2_h_connack");
+            ++order;
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            c2->publish("topic1", "topic1_contents", mqtt::qos::at_least_once);
+            return true;
+        });
+    c2->set_puback_handler(
+        [&]
+        (std::uint16_t) {
+            BOOST_TEST(current() == "c2_h_puback");
+            ++order;
+            c2->disconnect();
+            return true;
+        });
+    c2->set_close_handler(
+        [&]
+        () {
+            BOOST_TEST(current() == "c2_h_close");
+            ++order;
+            c1->connect();
+        });
+    c2->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    c1->connect();
+    ios.run();
+    b.join();
+    BOOST_TEST(current() == "finish");
+}
+
+BOOST_AUTO_TEST_CASE( will_to_other_shard ) {
+    boost::asio::io_service ios;
+    test_sharded_broker b(broker_notls_port, 2);
+    b.run();
+
+    // c1 and c2 are accepted by the different shards.
+    auto c1 = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c1->set_client_id("cid1");
+    c1->set_clean_session(true);
+    c1->set_will(mqtt::will("topic1", "will_contents", mqtt::qos::at_least_once));
+
+    auto c2 = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c2->set_client_id("cid2");
+    c2->set_clean_session(true);
+
+    std::size_t order = 0;
+    std::vector<std::string> const expected = {
+        "c1_h_connack",
+        "c2_h_connack",
+        "c2_h_suback",
+        // c1 force_disconnect
+        "c1_h_error",
+        "c2_h_publish",
+        "c2_h_close",
+        "finish",
+    };
+    auto current =
+        [&order, &expected]() -> std::string {
+            try {
+                return expected.at(order);
+            }
+            catch (std::out_of_range const& e) {
+                return e.what();
+            }
+        };
+
+    c1->set_connack_handler(
+        [&]
+        (bool, std::uint8_t connack_return_code) {
+            BOOST_TEST(current() == "c1_h_connack");
+            ++order;
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            c2->connect();
+            return true;
+        });
+    c1->set_close_handler(
+        []
+        () {
+            BOOST_CHECK(false);
+        });
+    c1->set_error_handler(
+        [&]
+        (boost::system::error_code const&) {
+            BOOST_TEST(current() == "c1_h_error");
+            ++order;
+        });
+
+    c2->set_connack_handler(
+        [&]
+        (bool, std::uint8_t connack_return_code) {
+            BOOST_TEST(current() == "c2_h_connack");
+            ++order;
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            c2->subscribe("topic1", mqtt::qos::at_least_once);
+            return true;
+        });
+    c2->set_suback_handler(
+        [&]
+        (std::uint16_t, std::vector<mqtt::optional<std::uint8_t>>) {
+            BOOST_TEST(current() == "c2_h_suback");
+            ++order;
+            c1->force_disconnect();
+            return true;
+        });
+    c2->set_publish_handler(
+        [&]
+        (std::uint8_t header,
+         mqtt::optional<std::uint16_t>,
+         std::string topic,
+         std::string contents) {
+            BOOST_TEST(current() == "c2_h_publish");
+            ++order;
+            BOOST_TEST(mqtt::publish::get_qos(header) == mqtt::qos::at_least_once);
+            BOOST_TEST(topic == "topic1");
+            BOOST_TEST(contents == "will_contents");
+            c2->disconnect();
+            return true;
+        });
+    c2->set_close_handler(
+        [&]
+        () {
+            BOOST_TEST(current() == "c2_h_close");
+            ++order;
+            b.close();
+        });
+    c2->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    c1->connect();
+    ios.run();
+    b.join();
+    BOOST_TEST(current() == "finish");
+}
+
+BOOST_AUTO_TEST_CASE( reconnect_during_publish ) {
+    boost::asio::io_service ios;
+    // The publisher and the subscriber are on the same shard.
+    test_sharded_broker b(broker_notls_port, 1);
+    b.run();
+
+    auto sub = mqtt::make_client(ios, broker_url, broker_notls_port);
+    sub->set_client_id("sub");
+    sub->set_clean_session(false);
+
+    auto pub = mqtt::make_client(ios, broker_url, broker_notls_port);
+    pub->set_client_id("pub");
+    pub->set_clean_session(true);
+
+    // The subscriber reconnects while the publisher keeps publishing.
+    // It subscribes with QoS0, so it doesn't send PUBACK after DISCONNECT.
+    std::size_t const num_reconnects = 50;
+    std::size_t const num_publishing = 4;
+    std::size_t num_publishing_left = num_publishing;
+    std::size_t connacked = 0;
+    std::size_t received = 0;
+    bool finished = false;
+    std::size_t closed = 0;
+
+    auto on_close =
+        [&] {
+            if (++closed == 2) b.close();
+        };
+
+    sub->set_connack_handler(
+        [&]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            BOOST_TEST(sp == (connacked != 0));
+            if (connacked++ == 0) {
+                sub->subscribe("topic1", mqtt::qos::at_most_once);
+            }
+            else {
+                sub->disconnect();
+            }
+            return true;
+        });
+    sub->set_suback_handler(
+        [&]
+        (std::uint16_t, std::vector<mqtt::optional<std::uint8_t>>) {
+            pub->connect();
+            return true;
+        });
+    sub->set_publish_handler(
+        [&]
+        (std::uint8_t,
+         mqtt::optional<std::uint16_t>,
+         std::string topic,
+         std::string) {
+            BOOST_TEST(topic == "topic1");
+            ++received;
+            return true;
+        });
+    sub->set_close_handler(
+        [&]
+        () {
+            if (connacked == num_reconnects) {
+                finished = true;
+                on_close();
+                return;
+            }
+            sub->connect();
+        });
+    sub->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    pub->set_connack_handler(
+        [&]
+        (bool, std::uint8_t connack_return_code) {
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            for (std::size_t i = 0; i != num_publishing; ++i) {
+                pub->publish("topic1", "topic1_contents", mqtt::qos::at_least_once);
+            }
+            sub->disconnect();
+            return true;
+        });
+    pub->set_puback_handler(
+        [&]
+        (std::uint16_t) {
+            if (finished) {
+                if (--num_publishing_left == 0) pub->disconnect();
+            }
+            else {
+                pub->publish("topic1", "topic1_contents", mqtt::qos::at_least_once);
+            }
+            return true;
+        });
+    pub->set_close_handler(on_close);
+    pub->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    sub->connect();
+    ios.run();
+    b.join();
+    BOOST_TEST(connacked == num_reconnects);
+    BOOST_TEST(received > 0U);
+    BOOST_TEST(closed == 2U);
+}
+
+BOOST_AUTO_TEST_CASE( subscribe_before_connack ) {
+    boost::asio::io_service ios;
+    test_sharded_broker b(broker_notls_port, 2);
+    b.run();
+
+    boost::asio::deadline_timer tim(ios);
+    boost::asio::ip::tcp::socket peer(ios);
+
+    auto c1 = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c1->set_client_id("cid1");
+    c1->set_clean_session(true);
+
+    // CONNECT with the client id of c1, and SUBSCRIBE "topic1" QoS0 without waiting for CONNACK.
+    std::string const packets(
+        "\x10\x10\x00\x04MQTT\x04\x02\x00\x00\x00\x04" "cid1"
+        "\x82\x0b\x00\x01\x00\x06" "topic1" "\x00",
+        31);
+    // CONNACK and SUBACK
+    std::string responses(9, '\0');
+    std::size_t closed = 0;
+    auto on_close =
+        [&] {
+            if (++closed == 2) b.close();
+        };
+
+    c1->set_connack_handler(
+        [&]
+        (bool, std::uint8_t connack_return_code) {
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            peer.connect(
+                boost::asio::ip::tcp::endpoint(
+                    boost::asio::ip::address::from_string("127.0.0.1"),
+                    broker_notls_port));
+            boost::asio::write(peer, boost::asio::buffer(packets));
+            // The peer waits for c1, so CONNACK and SUBACK are sent after c1 is closed.
+            tim.expires_from_now(boost::posix_time::milliseconds(200));
+            tim.async_wait(
+                [&](boost::system::error_code const& ec) {
+                    BOOST_TEST(!ec);
+                    c1->disconnect();
+                });
+            boost::asio::async_read(
+                peer,
+                boost::asio::buffer(&responses[0], responses.size()),
+                [&](boost::system::error_code const& ec, std::size_t) {
+                    BOOST_TEST(!ec);
+                    peer.close();
+                    on_close();
+                });
+            return true;
+        });
+    c1->set_close_handler(on_close);
+    c1->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    c1->connect();
+    ios.run();
+    b.join();
+    BOOST_TEST(responses == std::string("\x20\x02\x00\x00\x90\x03\x00\x01\x00", 9));
+    BOOST_TEST(closed == 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,273 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_broker.hpp"
+#include "test_server_no_tls.hpp"
+
+#include <mqtt/client.hpp>
+
+#include <vector>
+#include <string>
+#include <set>
+
+BOOST_AUTO_TEST_SUITE(test_shared_sub)
+
+namespace {
+
+using share_policy = test_broker::share_policy;
+
+struct subscriber_setting {
+    std::string filter;
+    std::uint8_t qos;
+    // If false, the subscriber doesn't send puback, so the messages stay in flight.
+    bool ack;
+};
+
+struct publication {
+    std::string topic;
+    std::string contents;
+};
+
+// The subscribers subscribe the filters in order, and then the publisher publishes the messages.
+// Returns "topic:contents" that each subscriber received. All clients disconnect after
+// the subscribers received `deliveries` messages in total.
+std::vector<std::vector<std::string>> deliver(
+    share_policy policy,
+    std::vector<subscriber_setting> const& settings,
+    std::vector<publication> const& pubs,
+    std::uint8_t pub_qos,
+    std::size_t deliveries) {
+    boost::asio::io_service ios;
+    test_broker b(ios);
+    test_server_no_tls s(ios, b);
+    b.set_shared_subscription_policy(policy);
+
+    using client_t = decltype(mqtt::make_client(ios, broker_url, broker_notls_port));
+    std::vector<client_t> subs;
+    std::vector<std::vector<std::string>> received(settings.size());
+    std::size_t total = 0;
+    std::size_t closed = 0;
+
+    auto pub = mqtt::make_client(ios, broker_url, broker_notls_port);
+    pub->set_client_id("pub");
+    pub->set_clean_session(true);
+
+    auto finish =
+        [&] {
+            for (auto& c : subs) c->disconnect();
+            pub->disconnect();
+        };
+    auto on_close =
+        [&] {
+            if (++closed == settings.size() + 1) s.close();
+        };
+
+    // Subscribe one by one to fix the order of the members.
+    auto subscribe =
+        [&](std::size_t i) {
+            if (i == subs.size()) {
+                pub->connect();
+            }
+            else {
+                subs[i]->connect();
+            }
+        };
+
+    for (std::size_t i = 0; i != settings.size(); ++i) {
+        auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+        c->set_client_id("sub" + std::to_string(i));
+        c->set_clean_session(true);
+        if (!settings[i].ack) c->set_auto_pub_response(false);
+        auto cp = c.get();
+        c->set_connack_handler(
+            [&, cp, i]
+            (bool, std::uint8_t connack_return_code) {
+                BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+                cp->subscribe(settings[i].filter, settings[i].qos);
+                return true;
+            });
+        c->set_suback_handler(
+            [&, i]
+            (std::uint16_t, std::vector<mqtt::optional<std::uint8_t>> results) {
+                BOOST_TEST(results.size() == 1U);
+                BOOST_TEST(*results[0] == settings[i].qos);
+                subscribe(i + 1);
+                return true;
+            });
+        c->set_publish_handler(
+            [&, i]
+            (std::uint8_t,
+             mqtt::optional<std::uint16_t>,
+             std::string topic,
+             std::string contents) {
+                received[i].push_back(topic + ":" + contents);
+                if (++total == deliveries) finish();
+                return true;
+            });
+        c->set_close_handler(on_close);
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        subs.push_back(std::move(c));
+    }
+
+    pub->set_connack_handler(
+        [&]
+        (bool, std::uint8_t) {
+            for (auto const& p : pubs) {
+                pub->publish(p.topic, p.contents, pub_qos);
+            }
+            return true;
+        });
+    pub->set_close_handler(on_close);
+    pub->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+
+    subscribe(0);
+    ios.run();
+    BOOST_TEST(total == deliveries);
+    return received;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( round_robin ) {
+    auto received = deliver(
+        share_policy::round_robin,
+        {
+            { "$share/g1/topic1", mqtt::qos::at_most_once, true },
+            { "$share/g1/topic1", mqtt::qos::at_most_once, true },
+            { "$share/g1/topic1", mqtt::qos::at_most_once, true },
+            // Not shared. Receives all messages.
+            { "topic1", mqtt::qos::at_most_once, true },
+        },
+        {
+            { "topic1", "1" }, { "topic1", "2" }, { "topic1", "3" },
+            { "topic1", "4" }, { "topic1", "5" }, { "topic1", "6" },
+            { "topic1", "7" }, { "topic1", "8" }, { "topic1", "9" },
+            { "topic1", "10" }, { "topic1", "11" }, { "topic1", "12" },
+        },
+        mqtt::qos::at_most_once,
+        24);
+    BOOST_TEST((received[0] == std::vector<std::string>{ "topic1:1", "topic1:4", "topic1:7", "topic1:10" }));
+    BOOST_TEST((received[1] == std::vector<std::string>{ "topic1:2", "topic1:5", "topic1:8", "topic1:11" }));
+    BOOST_TEST((received[2] == std::vector<std::string>{ "topic1:3", "topic1:6", "topic1:9", "topic1:12" }));
+    BOOST_TEST(received[3].size() == 12U);
+}
+
+BOOST_AUTO_TEST_CASE( groups ) {
+    // Each group receives all messages.
+    auto received = deliver(
+        share_policy::round_robin,
+        {
+            { "$share/g1/topic1/+", mqtt::qos::at_most_once, true },
+            { "$share/g2/topic1/#", mqtt::qos::at_most_once, true },
+            { "$share/g2/topic1/#", mqtt::qos::at_most_once, true },
+        },
+        {
+            { "topic1/a", "1" }, { "topic1/a", "2" },
+        },
+        mqtt::qos::at_most_once,
+        4);
+    BOOST_TEST((received[0] == std::vector<std::string>{ "topic1/a:1", "topic1/a:2" }));
+    BOOST_TEST((received[1] == std::vector<std::string>{ "topic1/a:1" }));
+    BOOST_TEST((received[2] == std::vector<std::string>{ "topic1/a:2" }));
+}
+
+BOOST_AUTO_TEST_CASE( least_inflight ) {
+    // sub0 doesn't acknowledge, and sub1 receives QoS0 that is never in flight.
+    auto received = deliver(
+        share_policy::least_inflight,
+        {
+            { "$share/g1/topic1", mqtt::qos::at_least_once, false },
+            { "$share/g1/topic1", mqtt::qos::at_most_once, true },
+        },
+        {
+            { "topic1", "1" }, { "topic1", "2" }, { "topic1", "3" }, { "topic1", "4" },
+        },
+        mqtt::qos::at_least_once,
+        4);
+    BOOST_TEST((received[0] == std::vector<std::string>{ "topic1:1" }));
+    BOOST_TEST((received[1] == std::vector<std::string>{ "topic1:2", "topic1:3", "topic1:4" }));
+}
+
+BOOST_AUTO_TEST_CASE( sticky_hash ) {
+    auto received = deliver(
+        share_policy::sticky_hash,
+        {
+            { "$share/g1/topic1/+", mqtt::qos::at_most_once, true },
+            { "$share/g1/topic1/+", mqtt::qos::at_most_once, true },
+            { "$share/g1/topic1/+", mqtt::qos::at_most_once, true },
+        },
+        {
+            { "topic1/a", "1" }, { "topic1/b", "2" }, { "topic1/c", "3" },
+            { "topic1/a", "4" }, { "topic1/b", "5" }, { "topic1/c", "6" },
+            { "topic1/a", "7" }, { "topic1/b", "8" }, { "topic1/c", "9" },
+        },
+        mqtt::qos::at_most_once,
+        9);
+    // All messages of a topic are delivered to the same member.
+    std::set<std::string> topics;
+    for (auto const& r : received) {
+        std::set<std::string> mine;
+        for (auto const& m : r) mine.insert(m.substr(0, m.find(':')));
+        for (auto const& t : mine) BOOST_TEST(topics.insert(t).second);
+        BOOST_TEST(r.size() == mine.size() * 3);
+    }
+    BOOST_TEST(topics.size() == 3U);
+}
+
+BOOST_AUTO_TEST_CASE( invalid_share_name ) {
+    boost::asio::io_service ios;
+    test_broker b(ios);
+    test_server_no_tls s(ios, b);
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+    c->set_connack_handler(
+        [&]
+        (bool, std::uint8_t) {
+            c->subscribe(
+                std::vector<std::tuple<std::string, std::uint8_t>> {
+                    std::make_tuple("$share//topic1", mqtt::qos::at_most_once),
+                    std::make_tuple("$share/g1", mqtt::qos::at_most_once),
+                    std::make_tuple("$share/g+/topic1", mqtt::qos::at_most_once),
+                    std::make_tuple("$share/g1/", mqtt::qos::at_most_once),
+                    std::make_tuple("$share/g1/topic1", mqtt::qos::at_most_once),
+                }
+            );
+            return true;
+        });
+    c->set_suback_handler(
+        [&]
+        (std::uint16_t, std::vector<mqtt::optional<std::uint8_t>> results) {
+            BOOST_TEST(results.size() == 5U);
+            for (std::size_t i = 0; i != 4; ++i) BOOST_TEST(!results[i]);
+            BOOST_TEST(*results[4] == mqtt::qos::at_most_once);
+            c->unsubscribe("$share/g1/topic1");
+            return true;
+        });
+    c->set_unsuback_handler(
+        [&]
+        (std::uint16_t) {
+            c->disconnect();
+            return true;
+        });
+    c->set_close_handler(
+        [&] {
+            s.close();
+        });
+    c->connect();
+    ios.run();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -8,14 +8,21 @@
 #define MQTT_TEST_BROKER_HPP
 
 #include <iostream>
+#include <algorithm>
 #include <set>
+#include <map>
+#include <list>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <boost/lexical_cast.hpp>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/identity.hpp>
+#include <boost/functional/hash.hpp>
 
 #include <mqtt_server_cpp.hpp>
 #include <mqtt/optional.hpp>
@@ -45,6 +52,15 @@ using con_sp_t = mqtt::variant<
 
 class test_broker {
 public:
+    // Selection of the member of a shared subscription ($share/<group>/<filter>)
+    enum class share_policy {
+        round_robin,
+        // the member that has the least QoS1/2 messages that are not acknowledged
+        least_inflight,
+        // the member that is selected by the hash of the topic name
+        sticky_hash
+    };
+
     test_broker(as::io_service& ios)
         :ios_(ios),
          tim_disconnect_(ios_)
@@ -54,8 +70,69 @@ public:
     void set_disconnect_delay(boost::posix_time::time_duration const& delay) {
         delay_disconnect_ = delay;
     }
+
+    // The retained messages are evicted from the least recently stored one. 0 means no limit.
+    void set_retained_max_bytes(std::size_t max_bytes) {
+        retains_.set_max_bytes(max_bytes);
+    }
+
+    // Limits of the queued messages for each disconnected session. 0 means no limit.
+    void set_offline_queue_limits(
+        std::size_t max_messages,
+        std::size_t max_bytes,
+        mqtt::offline_queue::overflow_policy policy) {
+        offline_max_messages_ = max_messages;
+        offline_max_bytes_ = max_bytes;
+        offline_policy_ = policy;
+    }
+
+    // The queued messages are stored to the files in the directory. Empty means the heap.
+    void set_offline_spill_directory(std::string dir) {
+        offline_spill_dir_ = std::move(dir);
+    }
+
+    // The queued messages are replayed on reconnect in ticks that are posted to the io_service.
+    // A tick stops when max_inflight QoS1/2 messages are unacknowledged or max_bytes_in_flight
+    // are queued to the endpoint and not written yet. 0 means no limit. If both are 0, all
+    // messages are replayed at once.
+    void set_replay_window(std::size_t max_inflight, std::size_t max_bytes_in_flight) {
+        replay_max_inflight_ = max_inflight;
+        replay_max_bytes_in_flight_ = max_bytes_in_flight;
+    }
+
+    void set_shared_subscription_policy(share_policy policy) {
+        share_policy_ = policy;
+    }
     // [end] for test setting
 
+    /**
+     * Get the memory usage of the retained messages.
+     */
+    auto retained_memory_usage() const {
+        return retains_.memory_usage();
+    }
+
+    /**
+     * Get the number of the replay ticks that have run.
+     */
+    std::size_t replay_ticks() const {
+        return replay_ticks_;
+    }
+
+    /**
+     * Get the largest number of the replayed QoS1/2 messages that were in flight at once.
+     */
+    std::size_t replay_max_inflight_seen() const {
+        return replay_max_inflight_seen_;
+    }
+
+    /**
+     * Get the largest number of the replayed bytes that were queued and not written at once.
+     */
+    std::size_t replay_max_bytes_in_flight_seen() const {
+        return replay_max_bytes_in_flight_seen_;
+    }
+
     template <typename Endpoint>
     void handle_accept(Endpoint& ep) {
         auto sp = ep.shared_from_this();
@@ -117,7 +194,11 @@ public:
             });
         ep.set_puback_handler(
             [&]
-            (typename Endpoint::packet_id_t /*packet_id*/){
+            (typename Endpoint::packet_id_t packet_id){
+                if (auto c = find_connection(&ep)) {
+                    replay_acked(*c, packet_id);
+                    share_acked(*c, packet_id);
+                }
                 return true;
             });
         ep.set_pubrec_handler(
@@ -132,7 +213,11 @@ public:
             });
         ep.set_pubcomp_handler(
             [&]
-            (typename Endpoint::packet_id_t /*packet_id*/){
+            (typename Endpoint::packet_id_t packet_id){
+                if (auto c = find_connection(&ep)) {
+                    replay_acked(*c, packet_id);
+                    share_acked(*c, packet_id);
+                }
                 return true;
             });
         ep.set_publish_handler(
@@ -154,27 +239,47 @@ public:
             [&]
             (typename Endpoint::packet_id_t packet_id,
              std::vector<std::tuple<std::string, std::uint8_t>> entries) {
+                auto c = find_connection(&ep);
                 std::vector<std::uint8_t> res;
                 res.reserve(entries.size());
                 for (auto const& e : entries) {
                     std::string const& topic = std::get<0>(e);
                     std::uint8_t qos = std::get<1>(e);
-                    res.emplace_back(qos);
-                    subs_.emplace(std::make_shared<std::string>(topic), ep.shared_from_this(), qos);
+                    if (!c) {
+                        // Not connected
+                        res.emplace_back(0x80);
+                    }
+                    else if (is_shared(topic)) {
+                        res.emplace_back(share_subscribe(*c, topic, qos) ? qos : 0x80);
+                    }
+                    else if (sub_trie_.insert(topic, con_qos(c, qos))) {
+                        res.emplace_back(qos);
+                        c->subs.emplace_back(std::make_shared<std::string>(topic), qos);
+                    }
+                    else {
+                        // Failure
+                        res.emplace_back(0x80);
+                    }
                 }
                 ep.suback(packet_id, res);
-                for (auto const& e : entries) {
-                    std::string const& topic = std::get<0>(e);
-                    std::uint8_t qos = std::get<1>(e);
-                    auto it = retains_.find(topic);
-                    if (it != retains_.end()) {
-                        ep.publish(
-                            as::buffer(*it->topic),
-                            as::buffer(*it->contents),
-                            [t = it->topic, c = it->contents] {},
-                            std::min(it->qos, qos),
-                            true);
-                    }
+                for (std::size_t i = 0; i != entries.size(); ++i) {
+                    if (res[i] == 0x80) continue;
+                    std::string const& topic = std::get<0>(entries[i]);
+                    // Retained messages are not sent for the shared subscriptions.
+                    if (is_shared(topic)) continue;
+                    std::uint8_t qos = std::get<1>(entries[i]);
+                    // The filter can contain wildcards.
+                    retains_.find(
+                        topic,
+                        [&](retain const& r) {
+                            ep.publish(
+                                as::buffer(*r.topic),
+                                as::buffer(*r.contents),
+                                [t = r.topic, c = r.contents] {},
+                                std::min(r.qos, qos),
+                                true);
+                        }
+                    );
                 }
                 return true;
             }
@@ -183,8 +288,29 @@ public:
             [&]
             (typename Endpoint::packet_id_t packet_id,
              std::vector<std::string> topics) {
-                for (auto const& topic : topics) {
-                    subs_.erase(topic);
+                if (auto c = find_connection(&ep)) {
+                    for (auto const& topic : topics) {
+                        if (is_shared(topic)) {
+                            share_unsubscribe(*c, topic);
+                            continue;
+                        }
+                        c->subs.erase(
+                            std::remove_if(
+                                c->subs.begin(),
+                                c->subs.end(),
+                                [&](subscription const& e) {
+                                    return *e.topic == topic;
+                                }
+                            ),
+                            c->subs.end()
+                        );
+                        sub_trie_.erase_if(
+                            topic,
+                            [&](con_qos const& e) {
+                                return e.c == c;
+                            }
+                        );
+                    }
                 }
                 ep.unsuback(packet_id);
                 return true;
@@ -199,33 +325,45 @@ public:
     }
 
 private:
+    struct connection;
+
     bool try_connect(
         bool clean_session,
         con_sp_t const& spep,
         std::string const& client_id,
         mqtt::optional<mqtt::will> will) {
-        auto it_ret = cons_.emplace(client_id, spep);
+        if (find_connection(handle(spep))) {
+            // The second CONNECT is a protocol violation.
+            // The connection is released before the endpoint is closed.
+            mqtt::visit(
+                make_lambda_visitor<void>(
+                    [&](auto const& con) {
+                        close_proc(*con, true);
+                        con->force_disconnect();
+                    }
+                ),
+                spep
+            );
+            return false;
+        }
+        auto it_ret = cid_cons_.emplace(client_id, nullptr);
         if (!std::get<1>(it_ret)) {
-            pending_.emplace_back(clean_session, spep, client_id, std::move(will));
+            pending_[client_id].emplace_back(clean_session, spep, std::move(will));
             return false;
         }
-        auto cid = mqtt::visit(
-            make_lambda_visitor<std::string>(
-                [&](auto const& con) {
-                    return con->client_id();
-                }
-            ),
-            spep
-        );
-        connect_proc(clean_session, spep, client_id, std::move(will));
+        auto& c = connections_[handle(spep)];
+        c.reset(new connection(spep, client_id, clean_session));
+        it_ret.first->second = c.get();
+        connect_proc(clean_session, *c, std::move(will));
         return true;
     }
 
     void connect_proc(
         bool clean_session,
-        con_sp_t const& spep,
-        std::string const& client_id,
+        connection& c,
         mqtt::optional<mqtt::will> will) {
+        auto const& spep = c.con;
+        auto const& client_id = c.client_id;
         if (clean_session) {
             mqtt::visit(
                 make_lambda_visitor<void>(
@@ -236,6 +374,10 @@ private:
                 spep
             );
             sessions_.erase(client_id);
+            auto r = subsessions_.equal_range(client_id);
+            for (; r.first != r.second; ++r.first) {
+                erase_subsession(*r.first);
+            }
             subsessions_.erase(client_id);
         }
         else {
@@ -264,34 +406,22 @@ private:
                 }
             }
             auto r = subsessions_.equal_range(client_id);
-            std::vector<session_data> data;
+            std::shared_ptr<session> s;
             if (r.first != r.second) {
-                data = std::move(r.first->s->data);
+                s = r.first->s;
             }
             while (r.first != r.second) {
-                subs_.emplace(r.first->topic, spep, r.first->qos);
+                erase_subsession(*r.first);
+                c.subs.emplace_back(r.first->topic, r.first->qos);
+                sub_trie_.insert(*r.first->topic, con_qos(&c, r.first->qos));
                 r.first = subsessions_.erase(r.first);
             }
-            for (auto const& d : data) {
-                mqtt::visit(
-                    make_lambda_visitor<void>(
-                        [&](auto& con) {
-                            con->publish(
-                                as::buffer(*d.topic),
-                                as::buffer(*d.contents),
-                                [t = d.topic, c = d.contents] {},
-                                d.qos,
-                                true
-                            );
-                        }
-                    ),
-                    spep
-                );
+            if (s && !s->data.empty()) {
+                c.replaying.emplace(s);
+                replay_tick(c);
             }
         }
-        if (will) {
-            will_.emplace(spep, std::move(will.value()));
-        }
+        c.will = std::move(will);
     }
 
     void do_publish(
@@ -299,189 +429,311 @@ private:
         std::shared_ptr<std::string> const& contents,
         std::uint8_t qos,
         bool is_retain) {
-        {
-            auto const& idx = subs_.get<tag_topic>();
-            auto r = idx.equal_range(*topic);
-            for (; r.first != r.second; ++r.first) {
-                mqtt::visit(
-                    make_lambda_visitor<void>(
-                        [&](auto& con) {
-                            con->publish(
-                                as::buffer(*topic),
-                                as::buffer(*contents),
-                                [topic, contents] {},
-                                std::min(r.first->qos, qos),
-                                false
-                            );
+        // The shared parts of PUBLISH are encoded once for all subscribers.
+        std::shared_ptr<mqtt::publish_fanout const> fanout;
+        // Returns the packet identifier. 0 if QoS0 or the message is queued.
+        auto deliver =
+            [&](connection& c, std::uint8_t q) -> std::uint32_t {
+                if (c.replaying) {
+                    // Keep the order after the messages that are being replayed.
+                    c.replaying->s->data.push(topic, contents, q);
+                    return 0;
+                }
+                if (!fanout) {
+                    fanout = std::make_shared<mqtt::publish_fanout const>(
+                        as::buffer(*topic),
+                        as::buffer(*contents),
+                        [topic, contents] {}
+                    );
+                }
+                return mqtt::visit(
+                    make_lambda_visitor<std::uint32_t>(
+                        [&](auto& con) -> std::uint32_t {
+                            return con->publish(fanout, q);
                         }
                     ),
-                    r.first->con
+                    c.con
                 );
+            };
+        sub_trie_.match(
+            *topic,
+            [&](con_qos const& e) {
+                deliver(*e.c, std::min(e.qos, qos));
             }
-        }
-        {
-            auto const& idx = subsessions_.get<tag_topic>();
-            auto r = idx.equal_range(*topic);
-            for (; r.first != r.second; ++r.first) {
-                r.first->s->data.emplace_back(
+        );
+        // One member of each shared subscription group
+        share_trie_.match(
+            *topic,
+            [&](std::shared_ptr<share_group> const& g) {
+                auto const& m = g->select(share_policy_, *topic);
+                auto q = std::min(m->qos, qos);
+                auto packet_id = deliver(*m->c, q);
+                if (q != mqtt::qos::at_most_once && packet_id != 0) {
+                    g->sent(*m);
+                    m->c->share_inflight.emplace(packet_id, m);
+                }
+            }
+        );
+        subsession_trie_.match(
+            *topic,
+            [&](session_qos const& e) {
+                e.s->data.push(
                     topic,
                     contents,
-                    std::min(r.first->qos, qos)
+                    std::min(e.qos, qos)
                 );
             }
-        }
+        );
         if (is_retain) {
             if (contents->empty()) {
                 retains_.erase(*topic);
             }
             else {
-                retains_.erase(*topic);
-                retains_.emplace(topic, qos, contents);
+                retains_.insert_or_assign(*topic, retain(topic, qos, contents), contents->size());
             }
         }
     }
 
     template <typename Endpoint>
     void close_proc(Endpoint& con, bool send_will) {
-        auto cs = con.clean_session();
-        auto client_id = con.client_id();
-
-        {   // will processing
-            auto it = will_.find(con.shared_from_this());
-            if (it != will_.end()) {
-                if (send_will) {
-                    do_publish(
-                        std::make_shared<std::string>(std::move(it->will.topic())),
-                        std::make_shared<std::string>(std::move(it->will.message())),
-                        it->will.qos(),
-                        it->will.retain());
-                }
-                will_.erase(it);
+        // Only the connected endpoints are registered.
+        std::unique_ptr<connection> c;
+        {
+            auto it = connections_.find(&con);
+            if (it != connections_.end()) {
+                c = std::move(it->second);
+                connections_.erase(it);
+                cid_cons_.erase(c->client_id);
             }
         }
+        // A second CONNECT overwrites the client id and the clean session flag of the endpoint,
+        // so the registered ones are used.
+        auto cs = c ? c->clean_session : con.clean_session();
+        auto client_id = c ? c->client_id : con.client_id();
 
-        auto& idx = cons_.get<tag_con>();
-        idx.erase(con.shared_from_this());
-        {
-            auto& idx = subs_.get<tag_con>();
-            auto r = idx.equal_range(con.shared_from_this());
-            if (cs) {
-                idx.erase(r.first, r.second);
+        if (c) {
+            // will processing
+            if (c->will && send_will) {
+                do_publish(
+                    std::make_shared<std::string>(std::move(c->will->topic())),
+                    std::make_shared<std::string>(std::move(c->will->message())),
+                    c->will->qos(),
+                    c->will->retain());
             }
-            else {
+
+            // The shared subscriptions are not kept in the session.
+            share_close(*c);
+            for (auto const& sub : c->subs) {
+                sub_trie_.erase_if(
+                    *sub.topic,
+                    [&](con_qos const& e) {
+                        return e.c == c.get();
+                    }
+                );
+            }
+            if (!cs) {
                 sessions_.emplace(client_id);
-                auto s = std::make_shared<session>(client_id);
-                while (r.first != r.second) {
-                    subsessions_.emplace(r.first->topic, s, r.first->qos);
-                    r.first = idx.erase(r.first);
+                std::shared_ptr<session> s;
+                if (!c->subs.empty()) {
+                    // The messages that are not replayed yet are kept in the new session.
+                    s = c->replaying
+                        ? std::make_shared<session>(client_id, std::move(c->replaying->s->data))
+                        : make_session(client_id);
+                }
+                for (auto const& sub : c->subs) {
+                    subsessions_.emplace(sub.topic, s, sub.qos);
+                    subsession_trie_.insert(*sub.topic, session_qos(s, sub.qos));
                 }
             }
         }
 
-        auto it = pending_.begin();
-        auto end = pending_.end();
-        while (it != end) {
-            if (try_connect(it->clean_session, it->spep, it->client_id, it->will)) {
-                it = pending_.erase(it);
-            }
-            else {
-                ++it;
-            }
+        // Only the takeovers of the same client id are woken.
+        auto it = pending_.find(client_id);
+        if (it == pending_.end()) return;
+        auto& waiters = it->second;
+        if (!c) {
+            // The waiter is closed before the takeover.
+            waiters.erase(
+                std::remove_if(
+                    waiters.begin(),
+                    waiters.end(),
+                    [&](pending const& p) {
+                        return handle(p.spep) == &con;
+                    }
+                ),
+                waiters.end()
+            );
+            if (waiters.empty()) pending_.erase(it);
+            return;
         }
+        if (waiters.empty()) return;
+        auto p = std::move(waiters.front());
+        waiters.pop_front();
+        if (waiters.empty()) pending_.erase(it);
+        try_connect(p.clean_session, p.spep, client_id, std::move(p.will));
+    }
+
+    template <typename SubSession>
+    void erase_subsession(SubSession const& ss) {
+        subsession_trie_.erase_if(
+            *ss.topic,
+            [&](session_qos const& e) {
+                return e.s == ss.s;
+            }
+        );
     }
 
 private:
 
-    struct tag_topic {};
-    struct tag_con {};
     struct tag_client_id {};
 
-    struct cid_con {
-        cid_con(std::string const& cid, con_sp_t const& con)
-            :cid(cid), con(con) {}
-        std::string cid;
-        con_sp_t con;
-    };
-    using mi_cid_con = mi::multi_index_container<
-        cid_con,
-        mi::indexed_by<
-            mi::ordered_unique<
-                mi::tag<tag_client_id>,
-                BOOST_MULTI_INDEX_MEMBER(cid_con, std::string, cid)
-            >,
-            mi::ordered_unique<
-                mi::tag<tag_con>,
-                BOOST_MULTI_INDEX_MEMBER(cid_con, con_sp_t, con)
-            >
-        >
-    >;
-
-    struct sub_con {
-        sub_con(
-            std::shared_ptr<std::string> const& topic,
-            con_sp_t const& con,
-            std::uint8_t qos)
-            :topic(topic), con(con), qos(qos) {}
-        std::string const& get_topic() const {
-            return *topic;
-        }
-        std::shared_ptr<std::string> topic;
-        con_sp_t con;
-        std::uint8_t qos;
-    };
-    using mi_sub_con = mi::multi_index_container<
-        sub_con,
-        mi::indexed_by<
-            mi::ordered_non_unique<
-                mi::tag<tag_topic>,
-                BOOST_MULTI_INDEX_CONST_MEM_FUN(sub_con, std::string const&, sub_con::get_topic)
-            >,
-            mi::ordered_non_unique<
-                mi::tag<tag_con>,
-                BOOST_MULTI_INDEX_MEMBER(sub_con, con_sp_t, con)
-            >
-        >
-    >;
-
     struct retain {
         retain(
             std::shared_ptr<std::string> const& topic,
             std::uint8_t qos,
             std::shared_ptr<std::string> const& contents)
             :topic(topic), qos(qos), contents(contents) {}
-        std::string const& get_topic() const {
-            return *topic;
-        }
         std::shared_ptr<std::string> topic;
         std::uint8_t qos;
         std::shared_ptr<std::string> contents;
     };
-    using mi_retain = mi::multi_index_container<
-        retain,
-        mi::indexed_by<
-            mi::ordered_unique<
-                mi::tag<tag_topic>,
-                BOOST_MULTI_INDEX_CONST_MEM_FUN(retain, std::string const&, retain::get_topic)
-            >
-        >
-    >;
 
-    struct session_data {
-        session_data(
-            std::shared_ptr<std::string> const& topic,
-            std::shared_ptr<std::string> const& contents,
-            std::uint8_t qos)
-            : topic(std::move(topic)), contents(contents), qos(qos) {}
+    struct session {
+        session(std::string const& client_id, mqtt::offline_queue data)
+            :client_id(client_id), data(std::move(data)) {}
+        std::string client_id;
+        mqtt::offline_queue data;
+    };
+    // Replay of the queued messages to a reconnected session.
+    struct replay {
+        explicit replay(std::shared_ptr<session> const& s)
+            :s(s) {}
+        std::shared_ptr<session> s;
+        // packet identifiers of the replayed QoS1/2 messages that are not acknowledged yet
+        std::unordered_set<std::uint32_t> inflight;
+        // bytes of the replayed messages that are not written yet
+        std::size_t bytes_in_flight = 0;
+        bool tick_posted = false;
+    };
+    struct share_group;
+    struct share_member {
+        share_member(connection* c, std::uint8_t qos, share_group* group)
+            :c(c), qos(qos), group(group) {}
+        connection* c;
+        std::uint8_t qos;
+        share_group* group;
+        // position in share_group::members
+        std::size_t index = 0;
+        // the number of QoS1/2 messages that are not acknowledged
+        std::size_t inflight = 0;
+        std::list<share_member*>::iterator bucket_pos;
+    };
+
+    // Members of $share/<group>/<filter>. A member is selected in O(1).
+    struct share_group {
+        share_group(std::string const& name, std::size_t filter_pos)
+            :name(name), filter_pos(filter_pos) {}
+
+        mqtt::string_view filter() const {
+            return mqtt::string_view(name).substr(filter_pos);
+        }
+
+        bool empty() const {
+            return members.empty();
+        }
+
+        void add(std::shared_ptr<share_member> const& m) {
+            m->index = members.size();
+            members.push_back(m);
+            if (buckets.empty()) buckets.emplace_back();
+            m->bucket_pos = buckets[0].insert(buckets[0].end(), m.get());
+            min_bucket = 0;
+        }
+
+        void remove(share_member& m) {
+            buckets[m.inflight].erase(m.bucket_pos);
+            while (min_bucket + 1 < buckets.size() && buckets[min_bucket].empty()) ++min_bucket;
+            auto i = m.index;
+            if (i + 1 != members.size()) {
+                members[i] = std::move(members.back());
+                members[i]->index = i;
+            }
+            members.pop_back();
+            if (next >= members.size()) next = 0;
+        }
+
+        std::shared_ptr<share_member> const& select(share_policy policy, mqtt::string_view topic) {
+            switch (policy) {
+            case share_policy::least_inflight: {
+                // Rotate the members that have the same number of messages in flight.
+                auto& b = buckets[min_bucket];
+                b.splice(b.end(), b, b.begin());
+                return members[b.back()->index];
+            }
+            case share_policy::sticky_hash:
+                return members[boost::hash_range(topic.begin(), topic.end()) % members.size()];
+            default: {
+                auto i = next;
+                next = (next + 1) % members.size();
+                return members[i];
+            }
+            }
+        }
+
+        void sent(share_member& m) {
+            auto from = m.inflight;
+            move_bucket(m, from + 1);
+            if (min_bucket == from && buckets[from].empty()) min_bucket = from + 1;
+        }
+
+        void acked(share_member& m) {
+            if (m.inflight == 0) return;
+            move_bucket(m, m.inflight - 1);
+            min_bucket = std::min(min_bucket, m.inflight);
+        }
+
+        std::string const name;
+        std::size_t const filter_pos;
+        std::vector<std::shared_ptr<share_member>> members;
+        // for round_robin
+        std::size_t next = 0;
+        // for least_inflight. buckets[n] has the members that have n messages in flight.
+        // std::deque doesn't move the lists when it grows, so the iterators in the members are kept.
+        std::deque<std::list<share_member*>> buckets;
+        std::size_t min_bucket = 0;
+
+    private:
+        void move_bucket(share_member& m, std::size_t to) {
+            if (buckets.size() <= to) buckets.resize(to + 1);
+            buckets[to].splice(buckets[to].end(), buckets[m.inflight], m.bucket_pos);
+            m.inflight = to;
+        }
+    };
+
+    struct subscription {
+        subscription(std::shared_ptr<std::string> const& topic, std::uint8_t qos)
+            :topic(topic), qos(qos) {}
         std::shared_ptr<std::string> topic;
-        std::shared_ptr<std::string> contents;
         std::uint8_t qos;
     };
-    struct session {
-        explicit session(std::string const& client_id)
-            :client_id(client_id) {}
+
+    // State of a connected endpoint. Everything that is released on close is here.
+    struct connection {
+        connection(con_sp_t const& con, std::string const& client_id, bool clean_session)
+            :con(con), client_id(client_id), clean_session(clean_session) {}
+        con_sp_t con;
         std::string client_id;
-        std::vector<session_data> data;
+        bool clean_session;
+        // non shared subscriptions
+        std::vector<subscription> subs;
+        mqtt::optional<mqtt::will> will;
+        // the queued messages are being replayed
+        mqtt::optional<replay> replaying;
+        std::vector<std::shared_ptr<share_member>> shares;
+        // packet identifiers of the messages in flight to the shared subscriptions
+        std::unordered_map<std::uint32_t, std::weak_ptr<share_member>> share_inflight;
     };
+
     struct sub_session {
         sub_session(
             std::shared_ptr<std::string> const& topic,
@@ -491,9 +743,6 @@ private:
         std::string const& get_client_id() const {
             return s->client_id;
         }
-        std::string const& get_topic() const {
-            return *topic;
-        }
         std::shared_ptr<std::string> topic;
         std::shared_ptr<session> s;
         std::uint8_t qos;
@@ -504,58 +753,241 @@ private:
             mi::ordered_non_unique<
                 mi::tag<tag_client_id>,
                 BOOST_MULTI_INDEX_CONST_MEM_FUN(sub_session, std::string const&, sub_session::get_client_id)
-            >,
-            mi::ordered_non_unique<
-                mi::tag<tag_topic>,
-                BOOST_MULTI_INDEX_CONST_MEM_FUN(sub_session, std::string const&, sub_session::get_topic)
             >
         >
     >;
 
-    struct con_will {
-        con_will(con_sp_t const& con, mqtt::will&& will):con(con), will(will) {}
-        con_sp_t con;
-        mqtt::will will;
+    // Values of the subscription indexes that are matched with the topic name of publish.
+    struct con_qos {
+        con_qos(connection* c, std::uint8_t qos)
+            :c(c), qos(qos) {}
+        connection* c;
+        std::uint8_t qos;
+    };
+    struct session_qos {
+        session_qos(std::shared_ptr<session> const& s, std::uint8_t qos)
+            :s(s), qos(qos) {}
+        std::shared_ptr<session> s;
+        std::uint8_t qos;
     };
-    using mi_con_will = mi::multi_index_container<
-        con_will,
-        mi::indexed_by<
-            mi::ordered_non_unique<
-                mi::tag<tag_con>,
-                BOOST_MULTI_INDEX_MEMBER(con_will, con_sp_t, con)
-            >
-        >
-    >;
 
+    // CONNECT that waits for the connection of the same client id to be closed
     struct pending {
         pending(
             bool clean_session,
             con_sp_t const& spep,
-            std::string const& client_id,
             mqtt::optional<mqtt::will> will)
-            : clean_session(clean_session), spep(spep), client_id(client_id), will(std::move(will)) {}
+            : clean_session(clean_session), spep(spep), will(std::move(will)) {}
         bool clean_session;
         con_sp_t spep;
-        std::string const& client_id;
         mqtt::optional<mqtt::will> will;
     };
-    using mi_pending = mi::multi_index_container<
-        pending,
-        mi::indexed_by<
-            mi::sequenced<>
-        >
-    >;
+
+    static void const* handle(con_sp_t const& spep) {
+        return mqtt::visit(
+            make_lambda_visitor<void const*>(
+                [](auto const& con) -> void const* {
+                    return con.get();
+                }
+            ),
+            spep
+        );
+    }
+
+    connection* find_connection(void const* h) const {
+        auto it = connections_.find(h);
+        if (it == connections_.end()) return nullptr;
+        return it->second.get();
+    }
+
+    void replay_tick(connection& c) {
+        if (!c.replaying) return;
+        auto& r = c.replaying.value();
+        r.tick_posted = false;
+        ++replay_ticks_;
+        while (replay_max_inflight_ == 0 || r.inflight.size() < replay_max_inflight_) {
+            // Resumed by replay_written().
+            if (replay_max_bytes_in_flight_ != 0 && r.bytes_in_flight >= replay_max_bytes_in_flight_) return;
+            auto d = r.s->data.pop();
+            if (!d) {
+                // The messages that are published after the replay are sent synchronously.
+                // They must not overtake the replayed messages that are not written yet.
+                if (r.bytes_in_flight == 0) c.replaying = mqtt::nullopt;
+                // Otherwise resumed by replay_written().
+                return;
+            }
+            auto bytes = d->topic->size() + d->contents->size();
+            r.bytes_in_flight += bytes;
+            replay_max_bytes_in_flight_seen_ = std::max(replay_max_bytes_in_flight_seen_, r.bytes_in_flight);
+            auto packet_id = mqtt::visit(
+                make_lambda_visitor<std::uint32_t>(
+                    [&](auto& con) -> std::uint32_t {
+                        return con->async_publish(
+                            as::buffer(*d->topic),
+                            as::buffer(*d->contents),
+                            [t = d->topic, c = d->contents] {},
+                            d->qos,
+                            true,
+                            [this, spep = c.con, bytes]
+                            (boost::system::error_code const& ec) {
+                                if (ec) return; // The connection is closed.
+                                if (auto p = find_connection(handle(spep))) replay_written(*p, bytes);
+                            }
+                        );
+                    }
+                ),
+                c.con
+            );
+            if (d->qos != mqtt::qos::at_most_once) {
+                r.inflight.insert(packet_id);
+                replay_max_inflight_seen_ = std::max(replay_max_inflight_seen_, r.inflight.size());
+            }
+        }
+        // Resumed by replay_acked().
+    }
+
+    void replay_written(connection& c, std::size_t bytes) {
+        if (!c.replaying) return;
+        auto& r = c.replaying.value();
+        r.bytes_in_flight -= bytes;
+        if (r.s->data.empty()) {
+            if (r.bytes_in_flight == 0) c.replaying = mqtt::nullopt;
+            return;
+        }
+        post_replay_tick(c);
+    }
+
+    // The acknowledgements of the other messages, e.g. retained messages, don't open the window.
+    void replay_acked(connection& c, std::uint32_t packet_id) {
+        if (!c.replaying) return;
+        if (c.replaying->inflight.erase(packet_id) == 0) return;
+        post_replay_tick(c);
+    }
+
+    void post_replay_tick(connection& c) {
+        if (c.replaying->tick_posted) return;
+        c.replaying->tick_posted = true;
+        // The endpoint is kept alive, so the handle is not reused by another connection.
+        ios_.post(
+            [this, spep = c.con] {
+                if (auto p = find_connection(handle(spep))) replay_tick(*p);
+            }
+        );
+    }
+
+    static bool is_shared(mqtt::string_view filter) {
+        return filter.substr(0, 7) == "$share/";
+    }
+
+    // Subscribe $share/<group>/<filter>. Returns false if the format is invalid.
+    bool share_subscribe(connection& c, std::string const& name, std::uint8_t qos) {
+        for (auto const& m : c.shares) {
+            if (m->group->name == name) {
+                m->qos = qos;
+                return true;
+            }
+        }
+        auto it = share_groups_.find(name);
+        if (it == share_groups_.end()) {
+            mqtt::string_view rest(name);
+            rest.remove_prefix(7);
+            auto pos = rest.find('/');
+            if (pos == 0 || pos == mqtt::string_view::npos) return false;
+            auto group = rest.substr(0, pos);
+            if (group.find_first_of("+#") != mqtt::string_view::npos) return false;
+            auto g = std::make_shared<share_group>(name, pos + 8);
+            if (!share_trie_.insert(g->filter(), g)) return false;
+            it = share_groups_.emplace(name, g).first;
+        }
+        auto m = std::make_shared<share_member>(&c, qos, it->second.get());
+        it->second->add(m);
+        c.shares.push_back(std::move(m));
+        return true;
+    }
+
+    void share_unsubscribe(connection& c, std::string const& name) {
+        for (auto it = c.shares.begin(); it != c.shares.end(); ++it) {
+            if ((*it)->group->name == name) {
+                share_leave(**it);
+                c.shares.erase(it);
+                return;
+            }
+        }
+    }
+
+    void share_close(connection& c) {
+        for (auto const& m : c.shares) {
+            share_leave(*m);
+        }
+        c.shares.clear();
+        c.share_inflight.clear();
+    }
+
+    void share_leave(share_member& m) {
+        auto g = m.group;
+        g->remove(m);
+        if (g->empty()) {
+            share_trie_.erase_if(
+                g->filter(),
+                [&](std::shared_ptr<share_group> const& e) {
+                    return e.get() == g;
+                }
+            );
+            // g is released.
+            share_groups_.erase(share_groups_.find(g->name));
+        }
+    }
+
+    void share_acked(connection& c, std::uint32_t packet_id) {
+        if (c.share_inflight.empty()) return;
+        auto it = c.share_inflight.find(packet_id);
+        if (it == c.share_inflight.end()) return;
+        if (auto m = it->second.lock()) m->group->acked(*m);
+        c.share_inflight.erase(it);
+    }
+
+    std::shared_ptr<session> make_session(std::string const& client_id) {
+        auto s = std::make_shared<session>(
+            client_id,
+            mqtt::offline_queue(offline_max_messages_, offline_max_bytes_, offline_policy_)
+        );
+        if (!offline_spill_dir_.empty()) {
+            // The client id is hex encoded because it can contain any characters.
+            std::string name = offline_spill_dir_ + "/mqtt_offline_";
+            for (unsigned char c : client_id) {
+                name += "0123456789abcdef"[c >> 4];
+                name += "0123456789abcdef"[c & 0xf];
+            }
+            s->data.enable_spill(name + ".spill");
+        }
+        return s;
+    }
 
     as::io_service& ios_;
     as::deadline_timer tim_disconnect_;
     mqtt::optional<boost::posix_time::time_duration> delay_disconnect_;
-    mi_cid_con cons_;
-    mi_sub_con subs_;
+    // connected endpoints by the address of the endpoint
+    std::unordered_map<void const*, std::unique_ptr<connection>> connections_;
+    std::unordered_map<std::string, connection*> cid_cons_;
+    mqtt::topic_trie<con_qos> sub_trie_;
     std::set<std::string> sessions_;
     mi_sub_session subsessions_;
-    mi_retain retains_;
-    mi_con_will will_;
-    mi_pending pending_;
+    mqtt::topic_trie<session_qos> subsession_trie_;
+    mqtt::retained_store<retain> retains_;
+    // waiting CONNECTs by the client id
+    std::unordered_map<std::string, std::deque<pending>> pending_;
+    std::size_t offline_max_messages_ = 0;
+    std::size_t offline_max_bytes_ = 0;
+    mqtt::offline_queue::overflow_policy offline_policy_ = mqtt::offline_queue::overflow_policy::drop_oldest;
+    std::string offline_spill_dir_;
+    std::size_t replay_max_inflight_ = 0;
+    std::size_t replay_max_bytes_in_flight_ = 0;
+    std::size_t replay_ticks_ = 0;
+    std::size_t replay_max_inflight_seen_ = 0;
+    std::size_t replay_max_bytes_in_flight_seen_ = 0;
+    share_policy share_policy_ = share_policy::round_robin;
+    std::map<std::string, std::shared_ptr<share_group>> share_groups_;
+    mqtt::topic_trie<std::shared_ptr<share_group>> share_trie_;
 };
 
 #endif // MQTT_TEST_BROKER_HPP
@@ -0,0 +1,780 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TEST_SHARDED_BROKER_HPP)
+#define MQTT_TEST_SHARDED_BROKER_HPP
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <map>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+
+#include <mqtt_server_cpp.hpp>
+#include <mqtt/optional.hpp>
+
+#include "test_settings.hpp"
+
+namespace as = boost::asio;
+
+/**
+ * Multi-threaded broker for the basic behavior of test_broker: subscriptions with wildcards,
+ * retained messages, wills, and persistent sessions with bounded offline queues.
+ * Shared subscriptions ($share/...) and the replay window (set_replay_window()) of test_broker
+ * are not supported. The queued messages are replayed at once on reconnect, and a $share filter
+ * is handled as a normal filter.
+ *
+ * The broker runs one io_service per thread (shard). Accepted connections are assigned to
+ * the shards by round robin, and all operations of a connection run on the thread of its shard.
+ *
+ * The subscriptions are published to the shards as immutable snapshots of topic_trie. When a shard
+ * handles a publish, it compares the version of the snapshot with its cached one, and loads the
+ * snapshot only when it is changed. So publishes read the subscription index without locks.<BR>
+ * Subscription changes are logged under the mutex, and applied to the snapshot in batches outside
+ * the mutex. The previous snapshot is updated in place and reused after all shards have moved to
+ * the new one, so a batch costs the number of the changes instead of a copy of the whole index.
+ * SUBACK and UNSUBACK are sent after the snapshot that contains the change is published.
+ *
+ * Deliveries to the connections on other shards are posted to the shards by one handler per
+ * shard and publish.
+ */
+class test_sharded_broker {
+public:
+    using server_t = mqtt::server<>;
+    using endpoint_t = server_t::endpoint_t;
+    using socket_t = server_t::socket_t;
+
+    test_sharded_broker(std::uint16_t port, std::size_t num_shards)
+        :shards_(make_shards(num_shards)),
+         acceptor_(shards_.front()->ios, as::ip::tcp::endpoint(as::ip::tcp::v4(), port)),
+         current_(std::make_shared<subscription_index_t>()),
+         snapshot_(current_)
+    {
+        do_accept();
+    }
+
+    ~test_sharded_broker() {
+        close();
+        join();
+    }
+
+    /**
+     * Start the threads of the shards.
+     */
+    void run() {
+        for (auto& sh : shards_) {
+            auto p = sh.get();
+            sh->thread = std::thread([p] { p->ios.run(); });
+        }
+    }
+
+    /**
+     * Stop accepting. The threads finish after all connections are closed.
+     */
+    void close() {
+        shards_.front()->ios.post(
+            [this] {
+                boost::system::error_code ec;
+                acceptor_.close(ec);
+            }
+        );
+        for (auto& sh : shards_) sh->work.reset();
+    }
+
+    void join() {
+        for (auto& sh : shards_) {
+            if (sh->thread.joinable()) sh->thread.join();
+        }
+    }
+
+    std::size_t num_shards() const {
+        return shards_.size();
+    }
+
+    /**
+     * Set the limits of the queued messages for each disconnected session. 0 means no limit.
+     * Call it before run().
+     */
+    void set_offline_queue_limits(
+        std::size_t max_messages,
+        std::size_t max_bytes,
+        mqtt::offline_queue::overflow_policy policy) {
+        offline_max_messages_ = max_messages;
+        offline_max_bytes_ = max_bytes;
+        offline_policy_ = policy;
+    }
+
+    /**
+     * Store the queued messages to the files in the directory. Call it before run().
+     */
+    void set_offline_spill_directory(std::string dir) {
+        offline_spill_dir_ = std::move(dir);
+    }
+
+private:
+    // State of a client id. It is kept while the client is disconnected if clean_session is false.
+    struct session {
+        session(std::string const& client_id, mqtt::offline_queue data)
+            :client_id(client_id), data(std::move(data)) {}
+        std::string const client_id;
+
+        // guarded by mtx
+        std::mutex mtx;
+        std::shared_ptr<endpoint_t> con;
+        std::size_t shard = 0;
+        // true after CONNACK is sent to con. Until then, the publishes are queued to data.
+        bool connacked = false;
+        mqtt::offline_queue data;
+
+        // guarded by the broker mutex
+        bool clean_session = true;
+        std::vector<std::string> filters;
+    };
+
+    struct subscriber {
+        subscriber(std::shared_ptr<session> const& s, std::uint8_t qos)
+            :s(s), qos(qos) {}
+        std::shared_ptr<session> s;
+        std::uint8_t qos;
+    };
+    using subscription_index_t = mqtt::topic_trie<subscriber>;
+
+    // A subscription change that is applied to the snapshots.
+    struct subscription_change {
+        subscription_change(std::string filter, std::shared_ptr<session> const& s, bool insert, std::uint8_t qos)
+            :filter(std::move(filter)), s(s), insert(insert), qos(qos) {}
+        std::string filter;
+        std::shared_ptr<session> s;
+        // insert the subscription of s if true, otherwise erase it
+        bool insert;
+        std::uint8_t qos;
+    };
+
+    // State of a connection. It is accessed only on the thread of the shard.
+    struct connection {
+        std::string client_id;
+        std::shared_ptr<session> s;
+        mqtt::optional<mqtt::will> will;
+        bool closed = false;
+        // SUBSCRIBE and UNSUBSCRIBE that are received before s is set
+        std::vector<std::function<void()>> deferred;
+    };
+
+    struct delivery {
+        delivery(std::shared_ptr<endpoint_t> const& con, std::uint8_t qos)
+            :con(con), qos(qos) {}
+        std::shared_ptr<endpoint_t> con;
+        std::uint8_t qos;
+    };
+
+    struct shard {
+        explicit shard(std::size_t index)
+            :index(index), work(new as::io_service::work(ios)) {}
+        std::size_t const index;
+        as::io_service ios;
+        std::unique_ptr<as::io_service::work> work;
+        std::thread thread;
+
+        // accessed only on the thread
+        std::shared_ptr<subscription_index_t const> snapshot;
+        std::uint64_t version = 0;
+        std::vector<std::vector<delivery>> outbox;
+    };
+
+    struct retain {
+        std::shared_ptr<std::string> topic;
+        std::shared_ptr<std::string> contents;
+        std::uint8_t qos;
+    };
+
+    struct pending {
+        pending(
+            std::shared_ptr<endpoint_t> const& ep,
+            std::shared_ptr<connection> const& con,
+            std::size_t shard,
+            bool clean_session)
+            :ep(ep), con(con), shard(shard), clean_session(clean_session) {}
+        std::shared_ptr<endpoint_t> ep;
+        std::shared_ptr<connection> con;
+        std::size_t shard;
+        bool clean_session;
+    };
+
+    static std::vector<std::unique_ptr<shard>> make_shards(std::size_t num_shards) {
+        std::vector<std::unique_ptr<shard>> ret;
+        for (std::size_t i = 0; i != std::max<std::size_t>(num_shards, 1); ++i) {
+            ret.emplace_back(new shard(i));
+            ret.back()->outbox.resize(std::max<std::size_t>(num_shards, 1));
+        }
+        return ret;
+    }
+
+    void do_accept() {
+        auto& sh = *shards_[next_shard_];
+        next_shard_ = (next_shard_ + 1) % shards_.size();
+        auto socket = std::make_shared<std::unique_ptr<socket_t>>(new socket_t(sh.ios));
+        acceptor_.async_accept(
+            (*socket)->lowest_layer(),
+            [this, socket, &sh]
+            (boost::system::error_code const& ec) {
+                if (ec) return;
+                auto ep = std::make_shared<endpoint_t>(std::move(*socket));
+                sh.ios.post(
+                    [this, ep, &sh] {
+                        handle_accept(sh, ep);
+                    }
+                );
+                do_accept();
+            }
+        );
+    }
+
+    // Called on the thread of sh.
+    void handle_accept(shard& sh, std::shared_ptr<endpoint_t> const& sp) {
+        auto& ep = *sp;
+        auto con = std::make_shared<connection>();
+        ep.socket()->lowest_layer().set_option(as::ip::tcp::no_delay(true));
+        // Publishes to other connections are sent asynchronously, so the responses are too.
+        ep.set_auto_pub_response(true, true);
+        ep.start_session(
+            [sp] // keeping ep's lifetime as sp until session finished
+            (boost::system::error_code const& /*ec*/) {
+            }
+        );
+
+        std::weak_ptr<endpoint_t> wp(sp);
+        ep.set_close_handler(
+            [this, &sh, con, wp]
+            (){
+                if (auto sp = wp.lock()) close_proc(sh, sp, con, true);
+            });
+        ep.set_error_handler(
+            [this, &sh, con, wp]
+            (boost::system::error_code const& /*ec*/){
+                if (auto sp = wp.lock()) close_proc(sh, sp, con, true);
+            });
+        ep.set_connect_handler(
+            [this, &sh, con, wp]
+            (std::string const& client_id,
+             mqtt::optional<std::string> const& /*username*/,
+             mqtt::optional<std::string> const& /*password*/,
+             mqtt::optional<mqtt::will> will,
+             bool clean_session,
+             std::uint16_t /*keep_alive*/) {
+                auto sp = wp.lock();
+                if (!sp) return false;
+                if (client_id.empty() && !clean_session) {
+                    sp->async_connack(false, mqtt::connect_return_code::identifier_rejected);
+                    return false;
+                }
+                con->client_id = client_id;
+                con->will = std::move(will);
+                std::lock_guard<std::mutex> lck(mtx_);
+                auto it = sessions_.find(client_id);
+                if (it != sessions_.end() && is_online(*it->second)) {
+                    // Wait until the previous connection is closed.
+                    pending_.emplace(client_id, pending(sp, con, sh.index, clean_session));
+                    return true;
+                }
+                connect_proc(client_id, pending(sp, con, sh.index, clean_session));
+                return true;
+            }
+        );
+        ep.set_disconnect_handler(
+            [this, &sh, con, wp]
+            (){
+                if (auto sp = wp.lock()) close_proc(sh, sp, con, false);
+            });
+        ep.set_publish_handler(
+            [this, &sh]
+            (std::uint8_t header,
+             mqtt::optional<endpoint_t::packet_id_t> /*packet_id*/,
+             std::string topic_name,
+             std::string contents){
+                do_publish(
+                    sh,
+                    std::make_shared<std::string>(std::move(topic_name)),
+                    std::make_shared<std::string>(std::move(contents)),
+                    mqtt::publish::get_qos(header),
+                    mqtt::publish::is_retain(header));
+                return true;
+            });
+        ep.set_subscribe_handler(
+            [this, &sh, con, wp]
+            (endpoint_t::packet_id_t packet_id,
+             std::vector<std::tuple<std::string, std::uint8_t>> entries) {
+                auto sp = wp.lock();
+                if (!sp) return false;
+                if (!con->s) {
+                    // CONNACK is not sent yet. It is handled after the session is assigned.
+                    con->deferred.emplace_back(
+                        [this, &sh, wp, con, packet_id, entries = std::move(entries)] {
+                            if (auto sp = wp.lock()) subscribe_proc(sh, sp, con, packet_id, entries);
+                        }
+                    );
+                    return true;
+                }
+                subscribe_proc(sh, sp, con, packet_id, entries);
+                return true;
+            }
+        );
+        ep.set_unsubscribe_handler(
+            [this, &sh, con, wp]
+            (endpoint_t::packet_id_t packet_id,
+             std::vector<std::string> topics) {
+                auto sp = wp.lock();
+                if (!sp) return false;
+                if (!con->s) {
+                    con->deferred.emplace_back(
+                        [this, &sh, wp, con, packet_id, topics = std::move(topics)] {
+                            if (auto sp = wp.lock()) unsubscribe_proc(sh, sp, con, packet_id, topics);
+                        }
+                    );
+                    return true;
+                }
+                unsubscribe_proc(sh, sp, con, packet_id, topics);
+                return true;
+            }
+        );
+        ep.set_pingreq_handler(
+            [wp] {
+                if (auto sp = wp.lock()) sp->async_pingresp();
+                return true;
+            }
+        );
+    }
+
+    // Called on the thread of sh after con->s is set.
+    void subscribe_proc(
+        shard& sh,
+        std::shared_ptr<endpoint_t> const& sp,
+        std::shared_ptr<connection> const& con,
+        endpoint_t::packet_id_t packet_id,
+        std::vector<std::tuple<std::string, std::uint8_t>> const& entries) {
+        std::vector<std::uint8_t> res;
+        std::vector<retain> retains;
+        res.reserve(entries.size());
+        std::lock_guard<std::mutex> lck(mtx_);
+        for (auto const& e : entries) {
+            std::string const& topic = std::get<0>(e);
+            std::uint8_t qos = std::get<1>(e);
+            if (subscription_index_t::is_valid_filter(topic)) {
+                changes_.emplace_back(topic, con->s, true, qos);
+                res.emplace_back(qos);
+                con->s->filters.push_back(topic);
+                // The filter can contain wildcards.
+                retains_.find(
+                    topic,
+                    [&](retain const& r) {
+                        retains.push_back(r);
+                        retains.back().qos = std::min(r.qos, qos);
+                    }
+                );
+            }
+            else {
+                // Failure
+                res.emplace_back(0x80);
+            }
+        }
+        update_snapshot(
+            sh.index,
+            [sp, packet_id, res, retains] {
+                sp->async_suback(packet_id, res);
+                for (auto const& r : retains) {
+                    sp->async_publish(
+                        as::buffer(*r.topic),
+                        as::buffer(*r.contents),
+                        [t = r.topic, c = r.contents] {},
+                        r.qos,
+                        true);
+                }
+            }
+        );
+    }
+
+    // Called on the thread of sh after con->s is set.
+    void unsubscribe_proc(
+        shard& sh,
+        std::shared_ptr<endpoint_t> const& sp,
+        std::shared_ptr<connection> const& con,
+        endpoint_t::packet_id_t packet_id,
+        std::vector<std::string> const& topics) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        for (auto const& topic : topics) {
+            erase_subscription(con->s, topic);
+            auto& filters = con->s->filters;
+            filters.erase(std::remove(filters.begin(), filters.end(), topic), filters.end());
+        }
+        update_snapshot(
+            sh.index,
+            [sp, packet_id] {
+                sp->async_unsuback(packet_id);
+            }
+        );
+    }
+
+    static bool is_online(session& s) {
+        std::lock_guard<std::mutex> lck(s.mtx);
+        return static_cast<bool>(s.con);
+    }
+
+    // Called with mtx_ locked.
+    void connect_proc(std::string const& client_id, pending const& p) {
+        bool session_present = false;
+        std::shared_ptr<session> s;
+        auto it = sessions_.find(client_id);
+        if (it != sessions_.end()) {
+            if (p.clean_session || it->second->clean_session) {
+                erase_session(it->second);
+                sessions_.erase(it);
+                update_snapshot(p.shard, [] {});
+            }
+            else {
+                s = it->second;
+                session_present = true;
+            }
+        }
+        if (!s) {
+            s = std::make_shared<session>(
+                client_id,
+                mqtt::offline_queue(offline_max_messages_, offline_max_bytes_, offline_policy_)
+            );
+            sessions_.emplace(client_id, s);
+        }
+        s->clean_session = p.clean_session;
+
+        auto ep = p.ep;
+        auto con = p.con;
+        {
+            std::lock_guard<std::mutex> lck(s->mtx);
+            s->con = p.ep;
+            s->shard = p.shard;
+            s->connacked = false;
+        }
+        // Until the posted handler sends CONNACK, do_publish() queues the messages to s->data.
+        // The handler replays them and sets s->connacked with s->mtx locked, so the deliveries
+        // to the new connection come after CONNACK and the queued messages.
+        post(
+            p.shard,
+            [ep, con, s, session_present] {
+                // If the connection is already closed, the messages are kept for the next connection.
+                if (con->closed) return;
+                con->s = s;
+                ep->async_connack(session_present, mqtt::connect_return_code::accepted);
+                {
+                    std::lock_guard<std::mutex> lck(s->mtx);
+                    while (auto d = s->data.pop()) {
+                        ep->async_publish(
+                            as::buffer(*d->topic),
+                            as::buffer(*d->contents),
+                            [t = d->topic, c = d->contents] {},
+                            d->qos,
+                            true
+                        );
+                    }
+                    if (s->con == ep) s->connacked = true;
+                }
+                auto deferred = std::move(con->deferred);
+                for (auto& f : deferred) f();
+            }
+        );
+    }
+
+    // Called on the thread of sh.
+    void close_proc(
+        shard& sh,
+        std::shared_ptr<endpoint_t> const& sp,
+        std::shared_ptr<connection> const& con,
+        bool send_will) {
+        if (con->closed) return;
+        con->closed = true;
+        con->deferred.clear();
+
+        // con->s is set after connack is posted, so find the session by client id.
+        std::shared_ptr<session> s;
+        {
+            std::lock_guard<std::mutex> lck(mtx_);
+            auto it = sessions_.find(con->client_id);
+            if (it != sessions_.end()) {
+                std::lock_guard<std::mutex> lck(it->second->mtx);
+                if (it->second->con == sp) s = it->second;
+            }
+            if (!s) {
+                // Not connected, or waiting for the previous connection.
+                auto r = pending_.equal_range(con->client_id);
+                for (; r.first != r.second; ++r.first) {
+                    if (r.first->second.ep == sp) {
+                        pending_.erase(r.first);
+                        break;
+                    }
+                }
+                return;
+            }
+        }
+
+        if (send_will && con->will) {
+            auto& w = con->will.value();
+            do_publish(
+                sh,
+                std::make_shared<std::string>(std::move(w.topic())),
+                std::make_shared<std::string>(std::move(w.message())),
+                w.qos(),
+                w.retain());
+        }
+        con->will = mqtt::nullopt;
+
+        std::lock_guard<std::mutex> lck(mtx_);
+        {
+            std::lock_guard<std::mutex> lck(s->mtx);
+            if (s->con == sp) {
+                s->con.reset();
+                s->connacked = false;
+            }
+            if (!s->clean_session && !offline_spill_dir_.empty() && !s->data.is_spilled() && s->data.empty()) {
+                // The client id is hex encoded because it can contain any characters.
+                std::string name = offline_spill_dir_ + "/mqtt_offline_";
+                for (unsigned char c : s->client_id) {
+                    name += "0123456789abcdef"[c >> 4];
+                    name += "0123456789abcdef"[c & 0xf];
+                }
+                s->data.enable_spill(name + ".spill");
+            }
+        }
+        if (s->clean_session) {
+            erase_session(s);
+            auto it = sessions_.find(s->client_id);
+            if (it != sessions_.end() && it->second == s) sessions_.erase(it);
+            update_snapshot(sh.index, [] {});
+        }
+
+        // Wake the connection that waits for the client id.
+        auto it = pending_.find(s->client_id);
+        if (it != pending_.end()) {
+            auto p = it->second;
+            pending_.erase(it);
+            connect_proc(s->client_id, p);
+        }
+    }
+
+    // Called with mtx_ locked.
+    void erase_session(std::shared_ptr<session> const& s) {
+        for (auto const& f : s->filters) {
+            erase_subscription(s, f);
+        }
+        s->filters.clear();
+    }
+
+    // Called with mtx_ locked.
+    void erase_subscription(std::shared_ptr<session> const& s, std::string const& filter) {
+        changes_.emplace_back(filter, s, false, 0);
+    }
+
+    static void apply(subscription_index_t& index, std::vector<subscription_change> const& changes) {
+        for (auto const& c : changes) {
+            if (c.insert) {
+                index.insert(c.filter, subscriber(c.s, c.qos));
+            }
+            else {
+                index.erase_if(
+                    c.filter,
+                    [&](subscriber const& e) {
+                        return e.s == c.s;
+                    }
+                );
+            }
+        }
+    }
+
+    /**
+     * Publish the snapshot that contains the logged changes and then call f on the thread of the shard.
+     * Called with mtx_ locked. The changes requested while the snapshot is being made
+     * are applied together by the next build.
+     */
+    template <typename F>
+    void update_snapshot(std::size_t shard_index, F&& f) {
+        pending_updates_.emplace_back(shard_index, std::forward<F>(f));
+        if (update_posted_) return;
+        update_posted_ = true;
+        post(
+            shard_index,
+            [this, shard_index] {
+                build_snapshot(shard_index);
+            }
+        );
+    }
+
+    /**
+     * Apply the logged changes to the next snapshot and publish it. Only one build runs at a time.
+     */
+    void build_snapshot(std::size_t shard_index) {
+        std::vector<subscription_change> changes;
+        std::vector<std::pair<std::size_t, std::function<void()>>> updates;
+        {
+            std::lock_guard<std::mutex> lck(mtx_);
+            changes.swap(changes_);
+            updates.swap(pending_updates_);
+        }
+
+        std::shared_ptr<subscription_index_t> next;
+        if (spare_ && spare_.use_count() == 1) {
+            // No shard refers to the previous snapshot. It catches up with the current one in place.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            next = std::move(spare_);
+            apply(*next, spare_lag_);
+        }
+        else {
+            next = std::make_shared<subscription_index_t>(*current_);
+        }
+        apply(*next, changes);
+        std::atomic_store(&snapshot_, std::shared_ptr<subscription_index_t const>(next));
+        version_.fetch_add(1, std::memory_order_release);
+        spare_ = std::move(current_);
+        current_ = std::move(next);
+        spare_lag_ = std::move(changes);
+
+        for (auto& u : updates) {
+            post(u.first, std::move(u.second));
+        }
+        // The shards that don't handle publishes also move to the new snapshot,
+        // so the previous one can be reused by the next build.
+        for (std::size_t i = 0; i != shards_.size(); ++i) {
+            post(
+                i,
+                [this, i] {
+                    subscription_index(*shards_[i]);
+                }
+            );
+        }
+
+        {
+            std::lock_guard<std::mutex> lck(mtx_);
+            if (pending_updates_.empty()) {
+                update_posted_ = false;
+                return;
+            }
+        }
+        post(
+            shard_index,
+            [this, shard_index] {
+                build_snapshot(shard_index);
+            }
+        );
+    }
+
+    subscription_index_t const& subscription_index(shard& sh) {
+        auto version = version_.load(std::memory_order_acquire);
+        if (!sh.snapshot || sh.version != version) {
+            sh.snapshot = std::atomic_load(&snapshot_);
+            sh.version = version;
+        }
+        return *sh.snapshot;
+    }
+
+    template <typename F>
+    void post(std::size_t shard_index, F&& f) {
+        shards_[shard_index]->ios.post(std::forward<F>(f));
+    }
+
+    static void deliver(
+        std::vector<delivery> const& ds,
+        std::shared_ptr<mqtt::publish_fanout const> const& fanout) {
+        for (auto const& d : ds) {
+            d.con->async_publish(fanout, d.qos);
+        }
+    }
+
+    // Called on the thread of sh.
+    void do_publish(
+        shard& sh,
+        std::shared_ptr<std::string> const& topic,
+        std::shared_ptr<std::string> const& contents,
+        std::uint8_t qos,
+        bool is_retain) {
+        subscription_index(sh).match(
+            *topic,
+            [&](subscriber const& e) {
+                auto q = std::min(e.qos, qos);
+                std::lock_guard<std::mutex> lck(e.s->mtx);
+                if (e.s->connacked) {
+                    sh.outbox[e.s->shard].emplace_back(e.s->con, q);
+                }
+                else {
+                    e.s->data.push(topic, contents, q);
+                }
+            }
+        );
+        // The shared parts of PUBLISH are encoded once, and shared by all shards.
+        std::shared_ptr<mqtt::publish_fanout const> fanout;
+        for (std::size_t i = 0; i != sh.outbox.size(); ++i) {
+            auto& ds = sh.outbox[i];
+            if (ds.empty()) continue;
+            if (!fanout) {
+                fanout = std::make_shared<mqtt::publish_fanout const>(
+                    as::buffer(*topic),
+                    as::buffer(*contents),
+                    [topic, contents] {}
+                );
+            }
+            if (i == sh.index) {
+                deliver(ds, fanout);
+                ds.clear();
+            }
+            else {
+                post(
+                    i,
+                    [ds = std::move(ds), fanout] {
+                        deliver(ds, fanout);
+                    }
+                );
+                ds.clear();
+            }
+        }
+        if (is_retain) {
+            std::lock_guard<std::mutex> lck(mtx_);
+            if (contents->empty()) {
+                retains_.erase(*topic);
+            }
+            else {
+                retains_.insert_or_assign(*topic, retain { topic, contents, qos }, contents->size());
+            }
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<shard>> shards_;
+    as::ip::tcp::acceptor acceptor_;
+    std::size_t next_shard_ = 0;
+
+    // accessed only by the running build_snapshot()
+    std::shared_ptr<subscription_index_t> current_;
+    // the previous snapshot, and the changes that are in current_ but not in it
+    std::shared_ptr<subscription_index_t> spare_;
+    std::vector<subscription_change> spare_lag_;
+
+    // Published subscription index
+    std::shared_ptr<subscription_index_t const> snapshot_;
+    std::atomic<std::uint64_t> version_ { 0 };
+
+    // guarded by mtx_
+    std::mutex mtx_;
+    std::vector<subscription_change> changes_;
+    std::map<std::string, std::shared_ptr<session>> sessions_;
+    std::multimap<std::string, pending> pending_;
+    mqtt::retained_store<retain> retains_;
+    std::vector<std::pair<std::size_t, std::function<void()>>> pending_updates_;
+    bool update_posted_ = false;
+
+    // settings that are not changed after run()
+    std::size_t offline_max_messages_ = 0;
+    std::size_t offline_max_bytes_ = 0;
+    mqtt::offline_queue::overflow_policy offline_policy_ = mqtt::offline_queue::overflow_policy::drop_oldest;
+    std::string offline_spill_dir_;
+};
+
+#endif // MQTT_TEST_SHARDED_BROKER_HPP
@@ -0,0 +1,276 @@
+// Copyright Takatoshi Kondo 2019
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+
+#include <mqtt/topic_trie.hpp>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <random>
+
+BOOST_AUTO_TEST_SUITE(test_topic_trie)
+
+namespace {
+
+using trie_t = mqtt::topic_trie<std::string>;
+
+std::vector<std::string> match(trie_t const& t, mqtt::string_view topic) {
+    std::vector<std::string> ret;
+    t.match(
+        topic,
+        [&](std::string const& v) {
+            ret.push_back(v);
+        }
+    );
+    std::sort(ret.begin(), ret.end());
+    return ret;
+}
+
+std::vector<std::string> split(std::string const& s) {
+    std::vector<std::string> ret;
+    std::string::size_type b = 0;
+    while (true) {
+        auto e = s.find('/', b);
+        ret.push_back(s.substr(b, e == std::string::npos ? e : e - b));
+        if (e == std::string::npos) return ret;
+        b = e + 1;
+    }
+}
+
+// Straightforward implementation of the matching rule.
+bool matches(std::string const& filter, std::string const& topic) {
+    auto f = split(filter);
+    auto t = split(topic);
+    if (!topic.empty() && topic[0] == '$' && (f[0] == "+" || f[0] == "#")) return false;
+    for (std::size_t i = 0; i != f.size(); ++i) {
+        if (f[i] == "#") return true;
+        if (i == t.size()) return false;
+        if (f[i] != "+" && f[i] != t[i]) return false;
+    }
+    return f.size() == t.size();
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( valid_filter ) {
+    BOOST_TEST(trie_t::is_valid_filter("a"));
+    BOOST_TEST(trie_t::is_valid_filter("a/b/c"));
+    BOOST_TEST(trie_t::is_valid_filter("/"));
+    BOOST_TEST(trie_t::is_valid_filter("a//b"));
+    BOOST_TEST(trie_t::is_valid_filter("+"));
+    BOOST_TEST(trie_t::is_valid_filter("#"));
+    BOOST_TEST(trie_t::is_valid_filter("+/+"));
+    BOOST_TEST(trie_t::is_valid_filter("a/+/b"));
+    BOOST_TEST(trie_t::is_valid_filter("a/#"));
+    BOOST_TEST(trie_t::is_valid_filter("/#"));
+    BOOST_TEST(trie_t::is_valid_filter("+/#"));
+
+    BOOST_TEST(!trie_t::is_valid_filter(""));
+    BOOST_TEST(!trie_t::is_valid_filter("a+"));
+    BOOST_TEST(!trie_t::is_valid_filter("+a"));
+    BOOST_TEST(!trie_t::is_valid_filter("a/b+/c"));
+    BOOST_TEST(!trie_t::is_valid_filter("a#"));
+    BOOST_TEST(!trie_t::is_valid_filter("#/a"));
+    BOOST_TEST(!trie_t::is_valid_filter("a/#/"));
+    BOOST_TEST(!trie_t::is_valid_filter("a/##"));
+
+    trie_t t;
+    BOOST_TEST(!t.insert("a/#/b", "x"));
+    BOOST_TEST(t.empty());
+}
+
+BOOST_AUTO_TEST_CASE( exact ) {
+    trie_t t;
+    BOOST_TEST(t.insert("a/b", "1"));
+    BOOST_TEST(t.insert("a/b", "2"));
+    BOOST_TEST(t.insert("a", "3"));
+    BOOST_TEST(t.insert("a/b/c", "4"));
+    BOOST_TEST(t.insert("/a/b", "5"));
+    BOOST_TEST(t.size() == 5U);
+    BOOST_TEST((match(t, "a/b") == std::vector<std::string>{ "1", "2" }));
+    BOOST_TEST((match(t, "a") == std::vector<std::string>{ "3" }));
+    BOOST_TEST((match(t, "a/b/c") == std::vector<std::string>{ "4" }));
+    BOOST_TEST((match(t, "/a/b") == std::vector<std::string>{ "5" }));
+    BOOST_TEST(match(t, "a/b/").empty());
+    BOOST_TEST(match(t, "b").empty());
+    BOOST_TEST(match(t, "").empty());
+}
+
+BOOST_AUTO_TEST_CASE( single_level_wildcard ) {
+    trie_t t;
+    t.insert("a/+", "1");
+    t.insert("+/b", "2");
+    t.insert("+/+", "3");
+    t.insert("+", "4");
+    t.insert("a/+/c", "5");
+    BOOST_TEST((match(t, "a/b") == std::vector<std::string>{ "1", "2", "3" }));
+    BOOST_TEST((match(t, "a/x") == std::vector<std::string>{ "1", "3" }));
+    BOOST_TEST((match(t, "a/") == std::vector<std::string>{ "1", "3" }));
+    BOOST_TEST((match(t, "/b") == std::vector<std::string>{ "2", "3" }));
+    BOOST_TEST((match(t, "a") == std::vector<std::string>{ "4" }));
+    BOOST_TEST((match(t, "") == std::vector<std::string>{ "4" }));
+    BOOST_TEST((match(t, "a/b/c") == std::vector<std::string>{ "5" }));
+    BOOST_TEST(match(t, "a/b/c/d").empty());
+}
+
+BOOST_AUTO_TEST_CASE( multi_level_wildcard ) {
+    trie_t t;
+    t.insert("#", "1");
+    t.insert("a/#", "2");
+    t.insert("a/b/#", "3");
+    t.insert("a/+/#", "4");
+    BOOST_TEST((match(t, "a") == std::vector<std::string>{ "1", "2" }));
+    BOOST_TEST((match(t, "a/b") == std::vector<std::string>{ "1", "2", "3", "4" }));
+    BOOST_TEST((match(t, "a/b/c/d") == std::vector<std::string>{ "1", "2", "3", "4" }));
+    BOOST_TEST((match(t, "b") == std::vector<std::string>{ "1" }));
+    BOOST_TEST((match(t, "/") == std::vector<std::string>{ "1" }));
+}
+
+BOOST_AUTO_TEST_CASE( dollar_topic ) {
+    trie_t t;
+    t.insert("#", "1");
+    t.insert("+/monitor/clients", "2");
+    t.insert("$SYS/#", "3");
+    t.insert("$SYS/monitor/+", "4");
+    BOOST_TEST((match(t, "$SYS/monitor/clients") == std::vector<std::string>{ "3", "4" }));
+    BOOST_TEST((match(t, "SYS/monitor/clients") == std::vector<std::string>{ "1", "2" }));
+    BOOST_TEST((match(t, "a/$SYS") == std::vector<std::string>{ "1" }));
+}
+
+BOOST_AUTO_TEST_CASE( erase ) {
+    trie_t t;
+    t.insert("a/b/c", "1");
+    t.insert("a/b/c", "2");
+    t.insert("a/+/c", "3");
+    t.insert("a/#", "4");
+    t.insert("x/b", "5");
+    auto nodes = t.node_count();
+
+    BOOST_TEST(t.erase_if("a/b/c", [](std::string const& v) { return v == "2"; }) == 1U);
+    BOOST_TEST((match(t, "a/b/c") == std::vector<std::string>{ "1", "3", "4" }));
+    BOOST_TEST(t.node_count() == nodes);
+    // Not exist
+    BOOST_TEST(t.erase_if("a/b", [](std::string const&) { return true; }) == 0U);
+    BOOST_TEST(t.erase_if("a/b/c/d", [](std::string const&) { return true; }) == 0U);
+    BOOST_TEST(t.erase_if("z", [](std::string const&) { return true; }) == 0U);
+    // Wildcards are not expanded
+    BOOST_TEST(t.erase_if("a/+/c", [](std::string const&) { return true; }) == 1U);
+    BOOST_TEST((match(t, "a/b/c") == std::vector<std::string>{ "1", "4" }));
+    BOOST_TEST((match(t, "a/x/c") == std::vector<std::string>{ "4" }));
+
+    BOOST_TEST(t.erase_if("a/b/c", [](std::string const&) { return true; }) == 1U);
+    BOOST_TEST(t.erase_if("a/#", [](std::string const&) { return true; }) == 1U);
+    BOOST_TEST(match(t, "a/b/c").empty());
+    BOOST_TEST(match(t, "a").empty());
+    BOOST_TEST(t.size() == 1U);
+    // Only the nodes of "x/b" are left.
+    BOOST_TEST(t.node_count() == 2U);
+
+    t.insert("a/b/c", "6");
+    BOOST_TEST((match(t, "a/b/c") == std::vector<std::string>{ "6" }));
+    BOOST_TEST((match(t, "x/b") == std::vector<std::string>{ "5" }));
+
+    t.clear();
+    BOOST_TEST(t.empty());
+    BOOST_TEST(t.node_count() == 0U);
+    BOOST_TEST(match(t, "x/b").empty());
+}
+
+BOOST_AUTO_TEST_CASE( find ) {
+    trie_t t;
+    t.insert("a/+", "1");
+    t.insert("a/b", "2");
+    std::vector<std::string> ret;
+    auto f = [&](std::string const& v) { ret.push_back(v); };
+    t.find("a/+", f);
+    BOOST_TEST((ret == std::vector<std::string>{ "1" }));
+    ret.clear();
+    t.find("a/b", f);
+    BOOST_TEST((ret == std::vector<std::string>{ "2" }));
+    ret.clear();
+    t.find("a", f);
+    t.find("a/c", f);
+    t.find("b", f);
+    BOOST_TEST(ret.empty());
+}
+
+BOOST_AUTO_TEST_CASE( copy ) {
+    trie_t t1;
+    t1.insert("a/+", "1");
+    auto t2 = t1;
+    t1.erase_if("a/+", [](std::string const&) { return true; });
+    t1.insert("a/b", "2");
+    BOOST_TEST((match(t1, "a/b") == std::vector<std::string>{ "2" }));
+    BOOST_TEST((match(t2, "a/b") == std::vector<std::string>{ "1" }));
+}
+
+BOOST_AUTO_TEST_CASE( same_as_straightforward ) {
+    std::mt19937 gen(1);
+    std::vector<std::string> const levels { "a", "b", "", "$c" };
+    std::uniform_int_distribution<std::size_t> level_dist(0, levels.size() - 1);
+    std::uniform_int_distribution<std::size_t> depth_dist(1, 4);
+    std::uniform_int_distribution<int> wildcard_dist(0, 9);
+
+    auto make_topic =
+        [&] {
+            std::string ret;
+            auto depth = depth_dist(gen);
+            for (std::size_t i = 0; i != depth; ++i) {
+                if (i != 0) ret += '/';
+                ret += levels[level_dist(gen)];
+            }
+            return ret;
+        };
+    auto make_filter =
+        [&] {
+            std::string ret;
+            auto depth = depth_dist(gen);
+            for (std::size_t i = 0; i != depth; ++i) {
+                if (i != 0) ret += '/';
+                auto w = wildcard_dist(gen);
+                if (w < 2) {
+                    ret += '+';
+                }
+                else if (w < 3) {
+                    ret += '#';
+                    break;
+                }
+                else {
+                    ret += levels[level_dist(gen)];
+                }
+            }
+            return ret;
+        };
+
+    trie_t t;
+    std::vector<std::pair<std::string, std::string>> subs;
+    for (std::size_t i = 0; i != 300; ++i) {
+        auto filter = make_filter();
+        // Empty filter is invalid.
+        if (filter.empty()) continue;
+        BOOST_TEST(t.insert(filter, std::to_string(i)));
+        subs.emplace_back(filter, std::to_string(i));
+    }
+    // Erase some of them.
+    for (std::size_t i = 0; i != subs.size(); i += 3) {
+        auto v = subs[i].second;
+        BOOST_TEST(t.erase_if(subs[i].first, [&](std::string const& e) { return e == v; }) == 1U);
+        subs[i].second.clear();
+    }
+    for (std::size_t i = 0; i != 1000; ++i) {
+        auto topic = make_topic();
+        std::vector<std::string> expected;
+        for (auto const& s : subs) {
+            if (!s.second.empty() && matches(s.first, topic)) expected.push_back(s.second);
+        }
+        std::sort(expected.begin(), expected.end());
+        BOOST_TEST(match(t, topic) == expected);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,8 @@
 #include "test_main.hpp"
 #include "combi_test.hpp"
 
+#include <random>
+
 namespace mqtt {
 namespace utf8string {
 std::ostream& operator<<(std::ostream& o, validation e) {
@@ -698,4 +700,110 @@ BOOST_AUTO_TEST_CASE( unsubscribe_invalid_topic ) {
 #endif // MQTT_USE_STR_CHECK
 }
 
+#if defined(MQTT_USE_STR_CHECK)
+
+namespace {
+
+// Generate a string that mixes ASCII runs, control characters, nul and
+// well formed / ill formed multi bytes characters, so that the SIMD blocks are
+// split at various positions.
+std::string random_string(std::mt19937& gen, std::size_t size, bool ill_formed) {
+    static char const* const pieces[] = {
+        "\xc2\x80",             // U+0080 (C1 control character)
+        "\xc2\xa0",             // U+00A0
+        "\xdf\xbf",             // U+07FF
+        "\xe0\xa0\x80",         // U+0800
+        "\xef\xbf\xbe",         // U+FFFE (non character)
+        "\xe3\x81\x82",         // U+3042
+        "\xf0\x90\x80\x80",     // U+10000
+        "\xf4\x8f\xbf\xbf",     // U+10FFFF (non character)
+    };
+    static char const* const bad_pieces[] = {
+        "\x80",                 // unexpected continuation
+        "\xc0\xaf",             // overlong
+        "\xed\xa0\x80",         // surrogate
+        "\xf4\x90\x80\x80",     // > U+10FFFF
+        "\xe3\x81",             // truncated
+        "\xff",
+    };
+    std::uniform_int_distribution<int> kind(0, 99);
+    std::uniform_int_distribution<int> printable(0x20, 0x7e);
+    std::uniform_int_distribution<int> control(0x01, 0x1f);
+    std::uniform_int_distribution<std::size_t> piece(0, sizeof(pieces) / sizeof(pieces[0]) - 1);
+    std::uniform_int_distribution<std::size_t> bad_piece(0, sizeof(bad_pieces) / sizeof(bad_pieces[0]) - 1);
+    std::string s;
+    while (s.size() < size) {
+        auto k = kind(gen);
+        if (k < 80) {
+            s.push_back(static_cast<char>(printable(gen)));
+        }
+        else if (k < 82) {
+            s.push_back(static_cast<char>(control(gen)));
+        }
+        else if (k < 83) {
+            s.push_back(static_cast<char>(0x7f));
+        }
+        else if (k < 98) {
+            s += pieces[piece(gen)];
+        }
+        else if (ill_formed) {
+            if (k == 98) s.push_back('\0');
+            else s += bad_pieces[bad_piece(gen)];
+        }
+    }
+    return s;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( simd_same_as_scalar ) {
+    using namespace mqtt::utf8string;
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<std::size_t> size(0, 200);
+    std::size_t count[3] = { 0, 0, 0 };
+    for (std::size_t i = 0; i != 20000; ++i) {
+        auto s = random_string(gen, size(gen), i % 2 == 0);
+        auto expected = detail::validate_contents_scalar(s);
+        ++count[static_cast<int>(expected)];
+        BOOST_TEST(validate_contents(s) == expected);
+#if defined(MQTT_UTF8_SIMD)
+        BOOST_TEST(detail::validate_contents_sse2(s) == expected);
+        if (detail::has_avx2()) {
+            BOOST_TEST(detail::validate_contents_avx2(s) == expected);
+        }
+#endif // defined(MQTT_UTF8_SIMD)
+    }
+    // All results are covered.
+    BOOST_TEST(count[0] != 0U);
+    BOOST_TEST(count[1] != 0U);
+    BOOST_TEST(count[2] != 0U);
+}
+
+BOOST_AUTO_TEST_CASE( simd_block_boundary ) {
+    using namespace mqtt::utf8string;
+    // Put a character at every position around the 16 and 32 bytes blocks.
+    char const* const chars[] = { "\x00", "\x01", "\x7f", "\xc2\x80", "\xe3\x81\x82", "\xe3\x81", "\x80" };
+    std::size_t const lengths[] = { 1, 1, 1, 2, 3, 2, 1 };
+    for (std::size_t c = 0; c != sizeof(chars) / sizeof(chars[0]); ++c) {
+        for (std::size_t pos = 0; pos != 70; ++pos) {
+            std::string s(pos, 'a');
+            s.append(chars[c], lengths[c]);
+            auto tail = s;
+            s.append(70, 'b');
+            for (auto const& str : { s, tail }) {
+                auto expected = detail::validate_contents_scalar(str);
+                BOOST_TEST(validate_contents(str) == expected);
+#if defined(MQTT_UTF8_SIMD)
+                BOOST_TEST(detail::validate_contents_sse2(str) == expected);
+                if (detail::has_avx2()) {
+                    BOOST_TEST(detail::validate_contents_avx2(str) == expected);
+                }
+#endif // defined(MQTT_UTF8_SIMD)
+            }
+        }
+    }
+}
+
+#endif // defined(MQTT_USE_STR_CHECK)
+
 BOOST_AUTO_TEST_SUITE_END()